@@ -5,1235 +5,10058 @@
 // ----------------------------------------------------------------
 namespace ConsoleUtils {
 	// ----------------------------------------------------------------
-	// SmartConsole
+	// Console API
 	// ----------------------------------------------------------------
 
-	SmartConsole::SmartConsole(bool bAutoClose) {
-		m_bAutoClose = bAutoClose;
-		m_hWindow = GetConsoleWindow();
-		m_pIn = nullptr;
-		m_pOut = nullptr;
-		m_hIn = GetStdHandle(STD_INPUT_HANDLE);
-		m_hOut = GetStdHandle(STD_OUTPUT_HANDLE);
-		m_unOriginalMode = 0;
-		m_nOriginalStyle = 0;
-		m_nOriginalStyleEx = 0;
-		if (m_hWindow) {
-			setlocale(LC_ALL, "");
+	static const CONSOLE_API g_Win32ConsoleApi = {
+		::GetConsoleWindow,
+		::AllocConsole,
+		::FreeConsole,
+		::GetStdHandle,
+		::GetConsoleMode,
+		::SetConsoleMode,
+		::GetConsoleOutputCP,
+		::GetConsoleScreenBufferInfoEx,
+		::SetConsoleScreenBufferInfoEx,
+		::SetConsoleTextAttribute,
+		::GetConsoleCursorInfo,
+		::SetConsoleCursorInfo,
+		::SetConsoleCursorPosition,
+		::FillConsoleOutputAttribute,
+		::FillConsoleOutputCharacterW,
+		::WriteConsoleA,
+		::WriteConsoleW,
+		::WriteConsoleOutputW,
+		::WriteConsoleOutputAttribute,
+		::ReadConsoleOutputW,
+		::ScrollConsoleScreenBufferW,
+		::ReadConsoleA,
+		::ReadConsoleW,
+		::ReadConsoleInputW,
+		::WaitForSingleObject,
+		::GetWindowLongW,
+		::SetWindowLongW,
+		::SetWindowPos,
+		::ShowWindow,
+		::DestroyWindow,
+		false
+	};
+
+	static std::atomic<const CONSOLE_API*> g_pConsoleApi = &g_Win32ConsoleApi;
+
+	const CONSOLE_API* GetConsoleApi() {
+		return g_pConsoleApi.load(std::memory_order_acquire);
+	}
 
-			if (m_hIn && (m_hIn != INVALID_HANDLE_VALUE)) {
-				if (GetConsoleMode(m_hIn, &m_unOriginalMode)) {
-					SetConsoleMode(m_hIn, m_unOriginalMode | ENABLE_INSERT_MODE);
-				}
-			}
+	void SetConsoleApi(const CONSOLE_API* pApi) {
+		g_pConsoleApi.store(pApi ? pApi : &g_Win32ConsoleApi, std::memory_order_release);
+	}
 
-			LONG nStyle = GetWindowLong(m_hWindow, GWL_STYLE);
-			if (nStyle != 0) {
-				m_nOriginalStyle = nStyle;
-				SetWindowLong(m_hWindow, GWL_STYLE, nStyle & ~(WS_MAXIMIZEBOX | WS_MINIMIZEBOX));
-			}
+	// ----------------------------------------------------------------
+	// UTF-8
+	// ----------------------------------------------------------------
 
-			LONG nStyleEx = GetWindowLong(m_hWindow, GWL_EXSTYLE);
-			if (nStyleEx != 0) {
-				m_nOriginalStyleEx = nStyleEx;
-				SetWindowLong(m_hWindow, GWL_EXSTYLE, nStyleEx | WS_EX_LAYERED);
-			}
+#if defined(CONSOLEUTILS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define CONSOLEUTILS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CONSOLEUTILS_TARGET_AVX2
+#endif
 
-			SetWindowPos(m_hWindow, nullptr, 0, 0, 0, 0, SWP_NOSIZE | SWP_NOMOVE | SWP_NOZORDER | SWP_FRAMECHANGED | SWP_NOOWNERZORDER);
-		}
-	}
+	typedef std::make_unsigned_t<wchar_t> WIDE_UNIT;
 
-	SmartConsole::~SmartConsole() {
-		if (m_bAutoClose) {
-			Close();
-		} else {
-			if (m_nOriginalStyle != 0) {
-				SetWindowLong(m_hWindow, GWL_STYLE, m_nOriginalStyle);
-			}
+	static SIMD_LEVEL DetectSimdLevel() {
+#ifdef CONSOLEUTILS_X86
+#ifdef _MSC_VER
+		int Info[4] = {};
 
-			if (m_nOriginalStyleEx != 0) {
-				SetWindowLong(m_hWindow, GWL_EXSTYLE, m_nOriginalStyleEx);
-			}
+		__cpuid(Info, 0);
+		if (Info[0] < 7) {
+			return SIMD_LEVEL::SIMD_LEVEL_SSE2;
+		}
 
-			if (m_hIn && (m_hIn != INVALID_HANDLE_VALUE) && m_unOriginalMode) {
-				SetConsoleMode(m_hIn, m_unOriginalMode);
-			}
+		// AVX2 also needs the OS to save the YMM registers.
+		__cpuid(Info, 1);
+		if (!(Info[2] & (1 << 27)) || !(Info[2] & (1 << 28)) || ((_xgetbv(0) & 6) != 6)) {
+			return SIMD_LEVEL::SIMD_LEVEL_SSE2;
 		}
+
+		__cpuidex(Info, 7, 0);
+
+		return (Info[1] & (1 << 5)) ? SIMD_LEVEL::SIMD_LEVEL_AVX2 : SIMD_LEVEL::SIMD_LEVEL_SSE2;
+#else
+		__builtin_cpu_init();
+
+		return __builtin_cpu_supports("avx2") ? SIMD_LEVEL::SIMD_LEVEL_AVX2 : SIMD_LEVEL::SIMD_LEVEL_SSE2;
+#endif
+#else
+		return SIMD_LEVEL::SIMD_LEVEL_SCALAR;
+#endif
 	}
 
-	bool SmartConsole::Open(bool bUpdateIO) {
-		if (m_hWindow) {
-			return true;
+	static std::atomic<SIMD_LEVEL> g_SimdLevel(DetectSimdLevel());
+
+	SIMD_LEVEL GetSimdLevel() {
+		return g_SimdLevel.load(std::memory_order_relaxed);
+	}
+
+	bool SetSimdLevel(SIMD_LEVEL Level) {
+		if (Level > DetectSimdLevel()) {
+			return false;
 		}
 
-		if (m_pIn) {
-			if (_tfreopen_s(&m_pIn, _T("nul"), _T("r"), stdin)) {
-				return false;
+		g_SimdLevel.store(Level, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	// Decodes the sequence at a non-ASCII byte. Invalid input decodes to U+FFFD and consumes the longest prefix that could have
+	// started a valid sequence, at least one byte.
+	static inline size_t DecodeUTF8(const unsigned char* pSource, size_t unLength, char32_t* pCodePoint) {
+		const unsigned char unLead = pSource[0];
+
+		size_t unSize = 0;
+		char32_t unCodePoint = 0;
+		unsigned char unLower = 0x80;
+		unsigned char unUpper = 0xBF;
+
+		if ((unLead >= 0xC2) && (unLead <= 0xDF)) {
+			unSize = 2;
+			unCodePoint = unLead & 0x1F;
+		} else if ((unLead >= 0xE0) && (unLead <= 0xEF)) {
+			unSize = 3;
+			unCodePoint = unLead & 0x0F;
+
+			// Overlongs and surrogates.
+			if (unLead == 0xE0) {
+				unLower = 0xA0;
+			} else if (unLead == 0xED) {
+				unUpper = 0x9F;
 			}
-			if (m_pIn) {
-				fclose(m_pIn);
+		} else if ((unLead >= 0xF0) && (unLead <= 0xF4)) {
+			unSize = 4;
+			unCodePoint = unLead & 0x07;
+
+			// Overlongs and code points above U+10FFFF.
+			if (unLead == 0xF0) {
+				unLower = 0x90;
+			} else if (unLead == 0xF4) {
+				unUpper = 0x8F;
 			}
-			m_pIn = nullptr;
+		} else {
+			*pCodePoint = 0xFFFD;
+			return 1;
 		}
 
-		if (m_pOut) {
-			if (_tfreopen_s(&m_pOut, _T("nul"), _T("w"), stdout)) {
-				return false;
+		for (size_t i = 1; i < unSize; ++i) {
+			if ((i >= unLength) || (pSource[i] < unLower) || (pSource[i] > unUpper)) {
+				*pCodePoint = 0xFFFD;
+				return i;
 			}
-			if (m_pOut) {
-				fclose(m_pOut);
-			}
-			m_pOut = nullptr;
-		}
 
-		if (!AllocConsole()) {
-			return false;
+			unCodePoint = (unCodePoint << 6) | (pSource[i] & 0x3F);
+			unLower = 0x80;
+			unUpper = 0xBF;
 		}
 
-		m_hWindow = GetConsoleWindow();
-		if (!m_hWindow) {
-			return false;
-		}
+		*pCodePoint = unCodePoint;
 
-		if (bUpdateIO) {
-			if (_tfreopen_s(&m_pIn, _T("nul"), _T("r"), stdin)) {
-				return false;
-			}
+		return unSize;
+	}
 
-			if (_tfreopen_s(&m_pOut, _T("nul"), _T("w"), stdout)) {
-				return false;
+	// Decodes from a non-ASCII byte up to the next ASCII one. Never writes more units than it reads bytes.
+	static inline void ConvertUTF8Run(const unsigned char*& pSource, const unsigned char* pEnd, wchar_t*& pDestination) {
+		while ((pSource < pEnd) && (*pSource >= 0x80)) {
+			char32_t unCodePoint = 0;
+			pSource += DecodeUTF8(pSource, static_cast<size_t>(pEnd - pSource), &unCodePoint);
+
+			if (unCodePoint < 0x10000) {
+				*pDestination++ = static_cast<wchar_t>(unCodePoint);
+			} else {
+				unCodePoint -= 0x10000;
+				*pDestination++ = static_cast<wchar_t>(0xD800 + (unCodePoint >> 10));
+				*pDestination++ = static_cast<wchar_t>(0xDC00 + (unCodePoint & 0x3FF));
 			}
 		}
+	}
 
-		HANDLE hIn = GetStdHandle(STD_INPUT_HANDLE);
-		if (!hIn || (hIn == INVALID_HANDLE_VALUE)) {
-			return false;
-		}
-
-		m_hIn = hIn;
+	// Encodes from a non-ASCII unit up to the next ASCII one. Never writes more than 3 bytes per unit it reads.
+	static inline void ConvertUTF16Run(const wchar_t*& pSource, const wchar_t* pEnd, unsigned char*& pDestination) {
+		while ((pSource < pEnd) && (static_cast<WIDE_UNIT>(*pSource) >= 0x80)) {
+			char32_t unCodePoint = static_cast<WIDE_UNIT>(*pSource++);
 
-		if (bUpdateIO) {
-			int nInDescriptor = _open_osfhandle(reinterpret_cast<intptr_t>(hIn), _O_TEXT);
-			if (nInDescriptor == -1) {
-				return false;
+			if (unCodePoint < 0x800) {
+				*pDestination++ = static_cast<unsigned char>(0xC0 | (unCodePoint >> 6));
+				*pDestination++ = static_cast<unsigned char>(0x80 | (unCodePoint & 0x3F));
+				continue;
 			}
 
-			FILE* pIn = _tfdopen(nInDescriptor, _T("r"));
-			if (!pIn) {
-				return false;
-			}
+			if ((unCodePoint >= 0xD800) && (unCodePoint <= 0xDBFF) && (pSource < pEnd)) {
+				const char32_t unLow = static_cast<WIDE_UNIT>(*pSource);
+				if ((unLow >= 0xDC00) && (unLow <= 0xDFFF)) {
+					++pSource;
 
-			m_pIn = pIn;
+					unCodePoint = 0x10000 + ((unCodePoint - 0xD800) << 10) + (unLow - 0xDC00);
 
-			if (_dup2(_fileno(pIn), _fileno(stdin)) != 0) {
-				return false;
+					*pDestination++ = static_cast<unsigned char>(0xF0 | (unCodePoint >> 18));
+					*pDestination++ = static_cast<unsigned char>(0x80 | ((unCodePoint >> 12) & 0x3F));
+					*pDestination++ = static_cast<unsigned char>(0x80 | ((unCodePoint >> 6) & 0x3F));
+					*pDestination++ = static_cast<unsigned char>(0x80 | (unCodePoint & 0x3F));
+					continue;
+				}
 			}
 
-			if (setvbuf(stdin, nullptr, _IONBF, 0) != 0) {
-				return false;
+			// Unpaired surrogates, and anything past the BMP where wchar_t is wider than a UTF-16 unit.
+			if (((unCodePoint >= 0xD800) && (unCodePoint <= 0xDFFF)) || (unCodePoint > 0xFFFF)) {
+				unCodePoint = 0xFFFD;
 			}
-		}
 
-		HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
-		if (!hOut || (hOut == INVALID_HANDLE_VALUE)) {
-			return false;
+			*pDestination++ = static_cast<unsigned char>(0xE0 | (unCodePoint >> 12));
+			*pDestination++ = static_cast<unsigned char>(0x80 | ((unCodePoint >> 6) & 0x3F));
+			*pDestination++ = static_cast<unsigned char>(0x80 | (unCodePoint & 0x3F));
 		}
+	}
 
-		m_hOut = hOut;
+	static size_t ConvertUTF8ToUTF16Scalar(const unsigned char* pSource, size_t unLength, wchar_t* pDestination) {
+		const unsigned char* const pEnd = pSource + unLength;
+		wchar_t* const pStart = pDestination;
 
-		if (bUpdateIO) {
-			int nOutDescriptor = _open_osfhandle(reinterpret_cast<intptr_t>(hOut), _O_TEXT);
-			if (nOutDescriptor == -1) {
-				return false;
+		while (pSource < pEnd) {
+			if (*pSource < 0x80) {
+				*pDestination++ = static_cast<wchar_t>(*pSource++);
+				continue;
 			}
 
-			FILE* pOut = _tfdopen(nOutDescriptor, _T("w"));
-			if (!pOut) {
-				return false;
-			}
+			ConvertUTF8Run(pSource, pEnd, pDestination);
+		}
 
-			m_pOut = pOut;
+		return static_cast<size_t>(pDestination - pStart);
+	}
 
-			if (_dup2(_fileno(pOut), _fileno(stdout)) != 0) {
-				return false;
-			}
+	static size_t ConvertUTF16ToUTF8Scalar(const wchar_t* pSource, size_t unLength, unsigned char* pDestination) {
+		const wchar_t* const pEnd = pSource + unLength;
+		unsigned char* const pStart = pDestination;
 
-			if (setvbuf(stdout, nullptr, _IONBF, 0) != 0) {
-				return false;
+		while (pSource < pEnd) {
+			if (static_cast<WIDE_UNIT>(*pSource) < 0x80) {
+				*pDestination++ = static_cast<unsigned char>(*pSource++);
+				continue;
 			}
+
+			ConvertUTF16Run(pSource, pEnd, pDestination);
 		}
 
-		setlocale(LC_ALL, "");
+		return static_cast<size_t>(pDestination - pStart);
+	}
 
-		if (GetConsoleMode(hIn, &m_unOriginalMode)) {
-			SetConsoleMode(hIn, m_unOriginalMode | ENABLE_INSERT_MODE);
-		}
+#ifdef CONSOLEUTILS_X86
+	// Blocks are stored whole and the pointers only move past their ASCII prefix. That stays in bounds, since no output
+	// gets ahead of its input and a block is only loaded when a whole one is left.
 
-		LONG nStyle = GetWindowLong(m_hWindow, GWL_STYLE);
-		if (nStyle != 0) {
-			m_nOriginalStyle = nStyle;
-			SetWindowLong(m_hWindow, GWL_STYLE, nStyle & ~(WS_MAXIMIZEBOX | WS_MINIMIZEBOX));
+	static inline void StoreWideSSE2(wchar_t* pDestination, __m128i Bytes) {
+		const __m128i Zero = _mm_setzero_si128();
+		const __m128i Low = _mm_unpacklo_epi8(Bytes, Zero);
+		const __m128i High = _mm_unpackhi_epi8(Bytes, Zero);
+
+		if constexpr (sizeof(wchar_t) == 2) {
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pDestination), Low);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pDestination + 8), High);
+		} else {
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pDestination), _mm_unpacklo_epi16(Low, Zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pDestination + 4), _mm_unpackhi_epi16(Low, Zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pDestination + 8), _mm_unpacklo_epi16(High, Zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pDestination + 12), _mm_unpackhi_epi16(High, Zero));
 		}
+	}
 
-		LONG nStyleEx = GetWindowLong(m_hWindow, GWL_EXSTYLE);
-		if (nStyleEx != 0) {
-			m_nOriginalStyleEx = nStyleEx;
-			SetWindowLong(m_hWindow, GWL_EXSTYLE, nStyleEx | WS_EX_LAYERED);
+	// Eight units as 16-bit lanes. Wider units saturate, which keeps them out of the ASCII range.
+	static inline __m128i LoadWideSSE2(const wchar_t* pSource) {
+		if constexpr (sizeof(wchar_t) == 2) {
+			return _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSource));
+		} else {
+			const __m128i Low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSource));
+			const __m128i High = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSource + 4));
+			return _mm_packs_epi32(Low, High);
 		}
+	}
 
-		SetWindowPos(m_hWindow, nullptr, 0, 0, 0, 0, SWP_NOSIZE | SWP_NOMOVE | SWP_NOZORDER | SWP_FRAMECHANGED | SWP_NOOWNERZORDER);
+	static size_t ConvertUTF8ToUTF16SSE2(const unsigned char* pSource, size_t unLength, wchar_t* pDestination) {
+		const unsigned char* const pEnd = pSource + unLength;
+		wchar_t* const pStart = pDestination;
 
-		return true;
-	}
+		while (pSource < pEnd) {
+			if (pEnd - pSource >= 16) {
+				const __m128i Bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSource));
+				const unsigned int unMask = static_cast<unsigned int>(_mm_movemask_epi8(Bytes));
 
-	bool SmartConsole::Close() {
-		if (!m_hWindow) {
-			return false;
+				StoreWideSSE2(pDestination, Bytes);
+
+				const unsigned int unASCII = unMask ? static_cast<unsigned int>(std::countr_zero(unMask)) : 16;
+				pSource += unASCII;
+				pDestination += unASCII;
+
+				if (unASCII == 16) {
+					continue;
+				}
+			} else if (*pSource < 0x80) {
+				*pDestination++ = static_cast<wchar_t>(*pSource++);
+				continue;
+			}
+
+			ConvertUTF8Run(pSource, pEnd, pDestination);
 		}
 
-		if (m_nOriginalStyle != 0) {
-			SetWindowLong(m_hWindow, GWL_STYLE, m_nOriginalStyle);
+		return static_cast<size_t>(pDestination - pStart);
+	}
+
+	static size_t ConvertUTF16ToUTF8SSE2(const wchar_t* pSource, size_t unLength, unsigned char* pDestination) {
+		const wchar_t* const pEnd = pSource + unLength;
+		unsigned char* const pStart = pDestination;
+
+		const __m128i Zero = _mm_setzero_si128();
+		const __m128i NonASCII = _mm_set1_epi16(static_cast<short>(0xFF80));
+
+		while (pSource < pEnd) {
+			if (pEnd - pSource >= 8) {
+				const __m128i Units = LoadWideSSE2(pSource);
+				const unsigned int unMask = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(Units, NonASCII), Zero)));
+
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(pDestination), _mm_packus_epi16(Units, Units));
+
+				// Two mask bits per unit.
+				const unsigned int unASCII = (unMask == 0xFFFF) ? 8 : static_cast<unsigned int>(std::countr_one(unMask)) / 2;
+				pSource += unASCII;
+				pDestination += unASCII;
+
+				if (unASCII == 8) {
+					continue;
+				}
+			} else if (static_cast<WIDE_UNIT>(*pSource) < 0x80) {
+				*pDestination++ = static_cast<unsigned char>(*pSource++);
+				continue;
+			}
+
+			ConvertUTF16Run(pSource, pEnd, pDestination);
 		}
 
-		if (m_nOriginalStyleEx != 0) {
-			SetWindowLong(m_hWindow, GWL_EXSTYLE, m_nOriginalStyleEx);
+		return static_cast<size_t>(pDestination - pStart);
+	}
+
+	CONSOLEUTILS_TARGET_AVX2 static inline void StoreWideAVX2(wchar_t* pDestination, __m256i Bytes) {
+		const __m128i Low = _mm256_castsi256_si128(Bytes);
+		const __m128i High = _mm256_extracti128_si256(Bytes, 1);
+
+		if constexpr (sizeof(wchar_t) == 2) {
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDestination), _mm256_cvtepu8_epi16(Low));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDestination + 16), _mm256_cvtepu8_epi16(High));
+		} else {
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDestination), _mm256_cvtepu8_epi32(Low));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDestination + 8), _mm256_cvtepu8_epi32(_mm_srli_si128(Low, 8)));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDestination + 16), _mm256_cvtepu8_epi32(High));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDestination + 24), _mm256_cvtepu8_epi32(_mm_srli_si128(High, 8)));
 		}
+	}
 
-		if (m_hIn && (m_hIn != INVALID_HANDLE_VALUE) && m_unOriginalMode) {
-			SetConsoleMode(m_hIn, m_unOriginalMode);
+	// Sixteen units as 16-bit lanes, in order.
+	CONSOLEUTILS_TARGET_AVX2 static inline __m256i LoadWideAVX2(const wchar_t* pSource) {
+		if constexpr (sizeof(wchar_t) == 2) {
+			return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSource));
+		} else {
+			const __m256i Low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSource));
+			const __m256i High = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSource + 8));
+			return _mm256_permute4x64_epi64(_mm256_packs_epi32(Low, High), 0xD8);
 		}
+	}
 
-		if (m_pIn) {
-			if (_tfreopen_s(&m_pIn, _T("nul"), _T("r"), stdin)) {
-				return false;
-			}
-			if (m_pIn) {
-				fclose(m_pIn);
+	CONSOLEUTILS_TARGET_AVX2 static size_t ConvertUTF8ToUTF16AVX2(const unsigned char* pSource, size_t unLength, wchar_t* pDestination) {
+		const unsigned char* const pEnd = pSource + unLength;
+		wchar_t* const pStart = pDestination;
+
+		while (pSource < pEnd) {
+			if (pEnd - pSource >= 32) {
+				const __m256i Bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSource));
+				const unsigned int unMask = static_cast<unsigned int>(_mm256_movemask_epi8(Bytes));
+
+				StoreWideAVX2(pDestination, Bytes);
+
+				const unsigned int unASCII = unMask ? static_cast<unsigned int>(std::countr_zero(unMask)) : 32;
+				pSource += unASCII;
+				pDestination += unASCII;
+
+				if (unASCII == 32) {
+					continue;
+				}
+			} else if (*pSource < 0x80) {
+				*pDestination++ = static_cast<wchar_t>(*pSource++);
+				continue;
 			}
-			m_pIn = nullptr;
+
+			ConvertUTF8Run(pSource, pEnd, pDestination);
 		}
 
-		if (m_pOut) {
-			if (_tfreopen_s(&m_pOut, _T("nul"), _T("w"), stdout)) {
-				return false;
-			}
-			if (m_pOut) {
-				fclose(m_pOut);
+		return static_cast<size_t>(pDestination - pStart);
+	}
+
+	CONSOLEUTILS_TARGET_AVX2 static size_t ConvertUTF16ToUTF8AVX2(const wchar_t* pSource, size_t unLength, unsigned char* pDestination) {
+		const wchar_t* const pEnd = pSource + unLength;
+		unsigned char* const pStart = pDestination;
+
+		const __m256i Zero = _mm256_setzero_si256();
+		const __m256i NonASCII = _mm256_set1_epi16(static_cast<short>(0xFF80));
+
+		while (pSource < pEnd) {
+			if (pEnd - pSource >= 16) {
+				const __m256i Units = LoadWideAVX2(pSource);
+				const unsigned int unMask = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_and_si256(Units, NonASCII), Zero)));
+
+				// Packing works per 128-bit lane, so the two halves are gathered into the low lane first.
+				const __m256i Packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(Units, Units), 0x08);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pDestination), _mm256_castsi256_si128(Packed));
+
+				const unsigned int unASCII = (unMask == 0xFFFFFFFF) ? 16 : static_cast<unsigned int>(std::countr_one(unMask)) / 2;
+				pSource += unASCII;
+				pDestination += unASCII;
+
+				if (unASCII == 16) {
+					continue;
+				}
+			} else if (static_cast<WIDE_UNIT>(*pSource) < 0x80) {
+				*pDestination++ = static_cast<unsigned char>(*pSource++);
+				continue;
 			}
-			m_pOut = nullptr;
-		}
 
-		if (!FreeConsole()) {
-			return false;
+			ConvertUTF16Run(pSource, pEnd, pDestination);
 		}
 
-		if (!DestroyWindow(m_hWindow)) {
-			return false;
+		return static_cast<size_t>(pDestination - pStart);
+	}
+#endif
+
+	size_t ConvertUTF8ToUTF16(char const* const pSource, size_t unLength, wchar_t* const pDestination) {
+		if (!pSource || !pDestination) {
+			return 0;
 		}
 
-		m_hWindow = nullptr;
+		const unsigned char* pBytes = reinterpret_cast<const unsigned char*>(pSource);
 
-		return true;
+		switch (GetSimdLevel()) {
+#ifdef CONSOLEUTILS_X86
+			case SIMD_LEVEL::SIMD_LEVEL_AVX2:
+				return ConvertUTF8ToUTF16AVX2(pBytes, unLength, pDestination);
+
+			case SIMD_LEVEL::SIMD_LEVEL_SSE2:
+				return ConvertUTF8ToUTF16SSE2(pBytes, unLength, pDestination);
+#endif
+			default:
+				break;
+		}
+
+		return ConvertUTF8ToUTF16Scalar(pBytes, unLength, pDestination);
 	}
 
-	bool SmartConsole::Show() {
-		if (!m_hWindow) {
-			return false;
+	size_t ConvertUTF16ToUTF8(wchar_t const* const pSource, size_t unLength, char* const pDestination) {
+		if (!pSource || !pDestination) {
+			return 0;
 		}
 
-		if (!ShowWindow(m_hWindow, SW_SHOW)) {
-			return false;
+		unsigned char* pBytes = reinterpret_cast<unsigned char*>(pDestination);
+
+		switch (GetSimdLevel()) {
+#ifdef CONSOLEUTILS_X86
+			case SIMD_LEVEL::SIMD_LEVEL_AVX2:
+				return ConvertUTF16ToUTF8AVX2(pSource, unLength, pBytes);
+
+			case SIMD_LEVEL::SIMD_LEVEL_SSE2:
+				return ConvertUTF16ToUTF8SSE2(pSource, unLength, pBytes);
+#endif
+			default:
+				break;
 		}
 
-		return true;
+		return ConvertUTF16ToUTF8Scalar(pSource, unLength, pBytes);
 	}
 
-	bool SmartConsole::Hide() {
-		if (!m_hWindow) {
-			return false;
-		}
+	// ----------------------------------------------------------------
+	// InputReader
+	// ----------------------------------------------------------------
 
-		if (!ShowWindow(m_hWindow, SW_HIDE)) {
-			return false;
-		}
+	// Input records read per call.
+	static constexpr DWORD g_unInputRecords = 64;
+
+	// How long the reader waits for input before checking whether it should stop.
+	static constexpr DWORD g_unInputWaitMilliseconds = 50;
+
+	InputReader::InputReader() {
+		m_hIn = nullptr;
+		m_pEvents = nullptr;
+		m_unCapacity = 0;
+		m_unMask = 0;
+		m_unHead = 0;
+		m_unTail = 0;
+		m_unDropped = 0;
+		m_bResized = false;
+		m_bWaiting = false;
+		m_bStopping = false;
+	}
 
-		return true;
+	InputReader::~InputReader() {
+		Stop();
 	}
 
-	bool SmartConsole::ReadA(char* const szBuffer, unsigned int unCount) {
-		if (!m_hWindow) {
+	bool InputReader::Start(HANDLE hIn, unsigned int unEvents) {
+		if (!hIn || (hIn == INVALID_HANDLE_VALUE) || m_Thread.joinable()) {
 			return false;
 		}
 
-		if (!fgets(szBuffer, unCount, stdin)) {
-			return false;
+		size_t unCapacity = 2;
+		while (unCapacity < unEvents) {
+			unCapacity <<= 1;
 		}
 
+		m_pEvents.reset(new INPUT_EVENT[unCapacity]);
+
+		m_hIn = hIn;
+		m_unCapacity = unCapacity;
+		m_unMask = unCapacity - 1;
+		m_unHead = 0;
+		m_unTail = 0;
+		m_unDropped = 0;
+		m_bResized = false;
+		m_bWaiting = false;
+		m_bStopping = false;
+
+		m_Thread = std::thread(&InputReader::Run, this);
+
 		return true;
 	}
 
-	bool SmartConsole::ReadW(wchar_t* const szBuffer, unsigned int unCount) {
-		if (!m_hWindow) {
+	// Takes up to one wait slice for the reader to notice. Events still in the ring can be drained afterwards.
+	bool InputReader::Stop() {
+		if (!m_Thread.joinable()) {
 			return false;
 		}
 
-		if (!fgetws(szBuffer, unCount, stdin)) {
-			return false;
+		m_bStopping = true;
+
+		m_Thread.join();
+
+		{
+			std::lock_guard<std::mutex> Lock(m_WaitLock);
 		}
+		m_WaitEvent.notify_all();
 
 		return true;
 	}
 
-#ifdef UNICODE
-	bool SmartConsole::Read(wchar_t* const szBuffer, unsigned int unCount) {
-		return ReadW(szBuffer, unCount);
-	}
-#else
-	bool SmartConsole::Read(char* const szBuffer, unsigned int unCount) {
-		return ReadA(szBuffer, unCount);
+	bool InputReader::IsRunning() {
+		return m_Thread.joinable() && !m_bStopping.load();
 	}
-#endif
 
-	bool SmartConsole::WriteA(char const* const szBuffer) {
-		if (!m_hWindow) {
+	bool InputReader::Poll(PINPUT_EVENT pEvent) {
+		if (!pEvent) {
 			return false;
 		}
 
-		if (fputs(szBuffer, stdout) == EOF) {
+		const size_t unTail = m_unTail.load(std::memory_order_relaxed);
+		if (unTail == m_unHead.load(std::memory_order_acquire)) {
 			return false;
 		}
 
+		*pEvent = m_pEvents[unTail & m_unMask];
+
+		m_unTail.store(unTail + 1, std::memory_order_release);
+
 		return true;
 	}
 
-	bool SmartConsole::WriteW(wchar_t const* const szBuffer) {
-		if (!m_hWindow) {
+	bool InputReader::Wait(PINPUT_EVENT pEvent, unsigned int unMilliseconds) {
+		if (!pEvent) {
 			return false;
 		}
 
-		if (fputws(szBuffer, stdout) == EOF) {
+		if (Poll(pEvent)) {
+			return true;
+		}
+
+		if (!unMilliseconds) {
 			return false;
 		}
 
-		return true;
-	}
+		const auto Deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(unMilliseconds);
 
-#ifdef UNICODE
+		std::unique_lock<std::mutex> Lock(m_WaitLock);
+
+		for (;;) {
+			// Pairs with the fence in Wake(), either the reader sees us waiting or we see its event.
+			m_bWaiting.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			if (Poll(pEvent)) {
+				m_bWaiting.store(false, std::memory_order_relaxed);
+				return true;
+			}
+
+			if (!IsRunning()) {
+				m_bWaiting.store(false, std::memory_order_relaxed);
+				return false;
+			}
+
+			if (unMilliseconds == INFINITE) {
+				m_WaitEvent.wait(Lock);
+			} else if (m_WaitEvent.wait_until(Lock, Deadline) == std::cv_status::timeout) {
+				m_bWaiting.store(false, std::memory_order_relaxed);
+				return Poll(pEvent);
+			}
+		}
+	}
+
+	unsigned int InputReader::Drain(PINPUT_EVENT pEvents, unsigned int unCount) {
+		if (!pEvents || !unCount) {
+			return 0;
+		}
+
+		const size_t unTail = m_unTail.load(std::memory_order_relaxed);
+		size_t unAvailable = m_unHead.load(std::memory_order_acquire) - unTail;
+		if (unAvailable > unCount) {
+			unAvailable = unCount;
+		}
+
+		for (size_t i = 0; i < unAvailable; ++i) {
+			pEvents[i] = m_pEvents[(unTail + i) & m_unMask];
+		}
+
+		m_unTail.store(unTail + unAvailable, std::memory_order_release);
+
+		return static_cast<unsigned int>(unAvailable);
+	}
+
+	// Whether a resize event was read since the last call, independent of the events still queued.
+	bool InputReader::TakeResized() {
+		return m_bResized.exchange(false);
+	}
+
+	unsigned long long InputReader::GetDropped() {
+		return m_unDropped.load();
+	}
+
+	void InputReader::Run() {
+		INPUT_RECORD Records[g_unInputRecords];
+
+		while (!m_bStopping.load()) {
+			const DWORD unWait = GetConsoleApi()->WaitForSingleObject(m_hIn, g_unInputWaitMilliseconds);
+			if (unWait == WAIT_TIMEOUT) {
+				continue;
+			}
+
+			DWORD unRead = 0;
+			if ((unWait != WAIT_OBJECT_0) || !GetConsoleApi()->ReadConsoleInputW(m_hIn, Records, g_unInputRecords, &unRead)) {
+				break;
+			}
+
+			const unsigned long long unTimestamp = static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+
+			bool bPushed = false;
+			for (DWORD i = 0; i < unRead; ++i) {
+				const INPUT_RECORD& Record = Records[i];
+
+				INPUT_EVENT Event;
+				memset(&Event, 0, sizeof(Event));
+				Event.Timestamp = unTimestamp;
+
+				switch (Record.EventType) {
+					case KEY_EVENT:
+						Event.Type = INPUT_EVENT_TYPE::INPUT_EVENT_TYPE_KEY;
+						Event.KeyDown = Record.Event.KeyEvent.bKeyDown != FALSE;
+						Event.RepeatCount = Record.Event.KeyEvent.wRepeatCount;
+						Event.VirtualKeyCode = Record.Event.KeyEvent.wVirtualKeyCode;
+						Event.Char = Record.Event.KeyEvent.uChar.UnicodeChar;
+						Event.ControlKeyState = Record.Event.KeyEvent.dwControlKeyState;
+						break;
+
+					case WINDOW_BUFFER_SIZE_EVENT:
+						Event.Type = INPUT_EVENT_TYPE::INPUT_EVENT_TYPE_RESIZE;
+						Event.Size = Record.Event.WindowBufferSizeEvent.dwSize;
+						m_bResized = true;
+						break;
+
+					case FOCUS_EVENT:
+						Event.Type = INPUT_EVENT_TYPE::INPUT_EVENT_TYPE_FOCUS;
+						Event.Focus = Record.Event.FocusEvent.bSetFocus != FALSE;
+						break;
+
+					default:
+						continue;
+				}
+
+				if (Push(Event)) {
+					bPushed = true;
+				}
+			}
+
+			if (bPushed) {
+				Wake();
+			}
+		}
+
+		// The input is gone or we are stopping, a waiting consumer has nothing more to wait for.
+		m_bStopping = true;
+		Wake();
+	}
+
+	bool InputReader::Push(const INPUT_EVENT& Event) {
+		const size_t unHead = m_unHead.load(std::memory_order_relaxed);
+		if (unHead - m_unTail.load(std::memory_order_acquire) >= m_unCapacity) {
+			m_unDropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		m_pEvents[unHead & m_unMask] = Event;
+
+		m_unHead.store(unHead + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	void InputReader::Wake() {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (m_bWaiting.load(std::memory_order_relaxed)) {
+			{
+				std::lock_guard<std::mutex> Lock(m_WaitLock);
+			}
+			m_WaitEvent.notify_one();
+		}
+	}
+
+	// ----------------------------------------------------------------
+	// SmartConsole
+	// ----------------------------------------------------------------
+
+	SmartConsole::SmartConsole(bool bAutoClose) {
+		m_bAutoClose = bAutoClose;
+		m_hWindow = GetConsoleApi()->GetConsoleWindow();
+		m_pIn = nullptr;
+		m_pOut = nullptr;
+		m_hIn = GetConsoleApi()->GetStdHandle(STD_INPUT_HANDLE);
+		m_hOut = GetConsoleApi()->GetStdHandle(STD_OUTPUT_HANDLE);
+		m_unOriginalMode = 0;
+		m_nOriginalStyle = 0;
+		m_nOriginalStyleEx = 0;
+		m_OutputPolicy = OUTPUT_POLICY::OUTPUT_POLICY_UNBUFFERED;
+		m_unOutputThreshold = 4096;
+		m_unOutputMilliseconds = 50;
+		m_OutputTarget = OUTPUT_TARGET::OUTPUT_TARGET_STREAM;
+		m_bOutputDeadline = false;
+		m_bStopOutputTimer = false;
+		m_unRawInputOriginalMode = 0;
+		m_pInputReader = nullptr;
+		ResetStatistics();
+		UpdateOutputTarget();
+		if (m_hWindow) {
+			setlocale(LC_ALL, "");
+
+			if (m_hIn && (m_hIn != INVALID_HANDLE_VALUE)) {
+				if (GetConsoleApi()->GetConsoleMode(m_hIn, &m_unOriginalMode)) {
+					GetConsoleApi()->SetConsoleMode(m_hIn, m_unOriginalMode | ENABLE_INSERT_MODE);
+				}
+			}
+
+			LONG nStyle = GetConsoleApi()->GetWindowLongW(m_hWindow, GWL_STYLE);
+			if (nStyle != 0) {
+				m_nOriginalStyle = nStyle;
+				GetConsoleApi()->SetWindowLongW(m_hWindow, GWL_STYLE, nStyle & ~(WS_MAXIMIZEBOX | WS_MINIMIZEBOX));
+			}
+
+			LONG nStyleEx = GetConsoleApi()->GetWindowLongW(m_hWindow, GWL_EXSTYLE);
+			if (nStyleEx != 0) {
+				m_nOriginalStyleEx = nStyleEx;
+				GetConsoleApi()->SetWindowLongW(m_hWindow, GWL_EXSTYLE, nStyleEx | WS_EX_LAYERED);
+			}
+
+			GetConsoleApi()->SetWindowPos(m_hWindow, nullptr, 0, 0, 0, 0, SWP_NOSIZE | SWP_NOMOVE | SWP_NOZORDER | SWP_FRAMECHANGED | SWP_NOOWNERZORDER);
+		}
+	}
+
+	SmartConsole::~SmartConsole() {
+		DisableRawInput();
+		StopOutputTimer();
+		FlushOutput();
+
+		if (m_bAutoClose) {
+			Close();
+		} else {
+			RestoreWindowStyle();
+
+			if (m_hIn && (m_hIn != INVALID_HANDLE_VALUE) && m_unOriginalMode) {
+				GetConsoleApi()->SetConsoleMode(m_hIn, m_unOriginalMode);
+			}
+		}
+	}
+
+	bool SmartConsole::Open(bool bUpdateIO) {
+		if (m_hWindow) {
+			return true;
+		}
+
+		if (m_pIn) {
+			if (_tfreopen_s(&m_pIn, _T("nul"), _T("r"), stdin)) {
+				return false;
+			}
+			if (m_pIn) {
+				fclose(m_pIn);
+			}
+			m_pIn = nullptr;
+		}
+
+		if (m_pOut) {
+			if (_tfreopen_s(&m_pOut, _T("nul"), _T("w"), stdout)) {
+				return false;
+			}
+			if (m_pOut) {
+				fclose(m_pOut);
+			}
+			m_pOut = nullptr;
+		}
+
+		if (!GetConsoleApi()->AllocConsole()) {
+			return false;
+		}
+
+		// Emulated handles can't back the CRT streams, text goes through the console API instead.
+		if (GetConsoleApi()->bEmulated) {
+			bUpdateIO = false;
+		}
+
+		m_hWindow = GetConsoleApi()->GetConsoleWindow();
+		if (!m_hWindow) {
+			return false;
+		}
+
+		if (bUpdateIO) {
+			if (_tfreopen_s(&m_pIn, _T("nul"), _T("r"), stdin)) {
+				return false;
+			}
+
+			if (_tfreopen_s(&m_pOut, _T("nul"), _T("w"), stdout)) {
+				return false;
+			}
+		}
+
+		HANDLE hIn = GetConsoleApi()->GetStdHandle(STD_INPUT_HANDLE);
+		if (!hIn || (hIn == INVALID_HANDLE_VALUE)) {
+			return false;
+		}
+
+		m_hIn = hIn;
+
+		if (bUpdateIO) {
+			int nInDescriptor = _open_osfhandle(reinterpret_cast<intptr_t>(hIn), _O_TEXT);
+			if (nInDescriptor == -1) {
+				return false;
+			}
+
+			FILE* pIn = _tfdopen(nInDescriptor, _T("r"));
+			if (!pIn) {
+				return false;
+			}
+
+			m_pIn = pIn;
+
+			if (_dup2(_fileno(pIn), _fileno(stdin)) != 0) {
+				return false;
+			}
+
+			if (setvbuf(stdin, nullptr, _IONBF, 0) != 0) {
+				return false;
+			}
+		}
+
+		HANDLE hOut = GetConsoleApi()->GetStdHandle(STD_OUTPUT_HANDLE);
+		if (!hOut || (hOut == INVALID_HANDLE_VALUE)) {
+			return false;
+		}
+
+		m_hOut = hOut;
+
+		if (bUpdateIO) {
+			int nOutDescriptor = _open_osfhandle(reinterpret_cast<intptr_t>(hOut), _O_TEXT);
+			if (nOutDescriptor == -1) {
+				return false;
+			}
+
+			FILE* pOut = _tfdopen(nOutDescriptor, _T("w"));
+			if (!pOut) {
+				return false;
+			}
+
+			m_pOut = pOut;
+
+			if (_dup2(_fileno(pOut), _fileno(stdout)) != 0) {
+				return false;
+			}
+
+			if (setvbuf(stdout, nullptr, _IONBF, 0) != 0) {
+				return false;
+			}
+		}
+
+		UpdateOutputTarget();
+
+		setlocale(LC_ALL, "");
+
+		if (GetConsoleApi()->GetConsoleMode(hIn, &m_unOriginalMode)) {
+			GetConsoleApi()->SetConsoleMode(hIn, m_unOriginalMode | ENABLE_INSERT_MODE);
+		}
+
+		LONG nStyle = GetConsoleApi()->GetWindowLongW(m_hWindow, GWL_STYLE);
+		if (nStyle != 0) {
+			m_nOriginalStyle = nStyle;
+			GetConsoleApi()->SetWindowLongW(m_hWindow, GWL_STYLE, nStyle & ~(WS_MAXIMIZEBOX | WS_MINIMIZEBOX));
+		}
+
+		LONG nStyleEx = GetConsoleApi()->GetWindowLongW(m_hWindow, GWL_EXSTYLE);
+		if (nStyleEx != 0) {
+			m_nOriginalStyleEx = nStyleEx;
+			GetConsoleApi()->SetWindowLongW(m_hWindow, GWL_EXSTYLE, nStyleEx | WS_EX_LAYERED);
+		}
+
+		GetConsoleApi()->SetWindowPos(m_hWindow, nullptr, 0, 0, 0, 0, SWP_NOSIZE | SWP_NOMOVE | SWP_NOZORDER | SWP_FRAMECHANGED | SWP_NOOWNERZORDER);
+
+		return true;
+	}
+
+	bool SmartConsole::Close() {
+		if (!m_hWindow) {
+			return false;
+		}
+
+		DisableRawInput();
+		FlushOutput();
+
+		RestoreWindowStyle();
+
+		if (m_hIn && (m_hIn != INVALID_HANDLE_VALUE) && m_unOriginalMode) {
+			GetConsoleApi()->SetConsoleMode(m_hIn, m_unOriginalMode);
+		}
+
+		if (m_pIn) {
+			if (_tfreopen_s(&m_pIn, _T("nul"), _T("r"), stdin)) {
+				return false;
+			}
+			if (m_pIn) {
+				fclose(m_pIn);
+			}
+			m_pIn = nullptr;
+		}
+
+		if (m_pOut) {
+			if (_tfreopen_s(&m_pOut, _T("nul"), _T("w"), stdout)) {
+				return false;
+			}
+			if (m_pOut) {
+				fclose(m_pOut);
+			}
+			m_pOut = nullptr;
+		}
+
+		if (!GetConsoleApi()->FreeConsole()) {
+			return false;
+		}
+
+		if (!GetConsoleApi()->DestroyWindow(m_hWindow)) {
+			return false;
+		}
+
+		m_hWindow = nullptr;
+
+		return true;
+	}
+
+	bool SmartConsole::Show() {
+		if (!m_hWindow) {
+			return false;
+		}
+
+		if (!GetConsoleApi()->ShowWindow(m_hWindow, SW_SHOW)) {
+			return false;
+		}
+
+		return true;
+	}
+
+	bool SmartConsole::Hide() {
+		if (!m_hWindow) {
+			return false;
+		}
+
+		if (!GetConsoleApi()->ShowWindow(m_hWindow, SW_HIDE)) {
+			return false;
+		}
+
+		return true;
+	}
+
+	// Puts back the window styles changed when the console was opened.
+	bool SmartConsole::RestoreWindowStyle() {
+		if (!m_hWindow) {
+			return false;
+		}
+
+		if (!m_nOriginalStyle && !m_nOriginalStyleEx) {
+			return true;
+		}
+
+		if (m_nOriginalStyle != 0) {
+			GetConsoleApi()->SetWindowLongW(m_hWindow, GWL_STYLE, m_nOriginalStyle);
+			m_nOriginalStyle = 0;
+		}
+
+		if (m_nOriginalStyleEx != 0) {
+			GetConsoleApi()->SetWindowLongW(m_hWindow, GWL_EXSTYLE, m_nOriginalStyleEx);
+			m_nOriginalStyleEx = 0;
+		}
+
+		if (!GetConsoleApi()->SetWindowPos(m_hWindow, nullptr, 0, 0, 0, 0, SWP_NOSIZE | SWP_NOMOVE | SWP_NOZORDER | SWP_FRAMECHANGED | SWP_NOOWNERZORDER)) {
+			return false;
+		}
+
+		return true;
+	}
+
+	bool SmartConsole::ReadA(char* const szBuffer, unsigned int unCount) {
+		if (!m_hWindow) {
+			return false;
+		}
+
+		// A prompt still sitting in the buffer has to be visible before we block.
+		FlushOutput();
+
+		CountCall(CONSOLE_CALL::CONSOLE_CALL_READ);
+
+		const CONSOLE_API* pApi = GetConsoleApi();
+		if (pApi->bEmulated) {
+			DWORD unRead = 0;
+			if (!unCount || !pApi->ReadConsoleA(m_hIn, szBuffer, unCount - 1, &unRead, nullptr) || !unRead) {
+				return false;
+			}
+
+			szBuffer[unRead] = 0;
+			return true;
+		}
+
+		if (!fgets(szBuffer, unCount, stdin)) {
+			return false;
+		}
+
+		return true;
+	}
+
+	bool SmartConsole::ReadW(wchar_t* const szBuffer, unsigned int unCount) {
+		if (!m_hWindow) {
+			return false;
+		}
+
+		// A prompt still sitting in the buffer has to be visible before we block.
+		FlushOutput();
+
+		CountCall(CONSOLE_CALL::CONSOLE_CALL_READ);
+
+		const CONSOLE_API* pApi = GetConsoleApi();
+		if (pApi->bEmulated) {
+			DWORD unRead = 0;
+			if (!unCount || !pApi->ReadConsoleW(m_hIn, szBuffer, unCount - 1, &unRead, nullptr) || !unRead) {
+				return false;
+			}
+
+			szBuffer[unRead] = 0;
+			return true;
+		}
+
+		if (!fgetws(szBuffer, unCount, stdin)) {
+			return false;
+		}
+
+		return true;
+	}
+
+#ifdef UNICODE
+	bool SmartConsole::Read(wchar_t* const szBuffer, unsigned int unCount) {
+		return ReadW(szBuffer, unCount);
+	}
+#else
+	bool SmartConsole::Read(char* const szBuffer, unsigned int unCount) {
+		return ReadA(szBuffer, unCount);
+	}
+#endif
+
+	bool SmartConsole::WriteA(char const* const szBuffer) {
+		return WriteA(std::string_view(szBuffer));
+	}
+
+	bool SmartConsole::WriteA(std::string_view Text) {
+		if (!m_hWindow) {
+			return false;
+		}
+
+		std::lock_guard<std::mutex> Lock(m_OutputBufferLock);
+
+		if (m_OutputPolicy == OUTPUT_POLICY::OUTPUT_POLICY_UNBUFFERED) {
+			return WriteOutputA(Text.data(), Text.size());
+		}
+
+		if (!m_OutputBufferW.empty() && !FlushOutputBuffer()) {
+			return false;
+		}
+
+		m_OutputBufferA.append(Text);
+
+		return UpdateOutputBuffer(Text.find('\n') != std::string_view::npos);
+	}
+
+	bool SmartConsole::WriteW(wchar_t const* const szBuffer) {
+		return WriteW(std::wstring_view(szBuffer));
+	}
+
+	bool SmartConsole::WriteW(std::wstring_view Text) {
+		if (!m_hWindow) {
+			return false;
+		}
+
+		std::lock_guard<std::mutex> Lock(m_OutputBufferLock);
+
+		if (m_OutputPolicy == OUTPUT_POLICY::OUTPUT_POLICY_UNBUFFERED) {
+			return WriteOutputW(Text.data(), Text.size());
+		}
+
+		if (!m_OutputBufferA.empty() && !FlushOutputBuffer()) {
+			return false;
+		}
+
+		m_OutputBufferW.append(Text);
+
+		return UpdateOutputBuffer(Text.find(L'\n') != std::wstring_view::npos);
+	}
+
+#ifdef UNICODE
 	bool SmartConsole::Write(wchar_t const* const szBuffer) {
 		return WriteW(szBuffer);
 	}
-#else
-	bool SmartConsole::Write(char const* const szBuffer) {
-		return WriteA(szBuffer);
+
+	bool SmartConsole::Write(std::wstring_view Text) {
+		return WriteW(Text);
+	}
+#else
+	bool SmartConsole::Write(char const* const szBuffer) {
+		return WriteA(szBuffer);
+	}
+
+	bool SmartConsole::Write(std::string_view Text) {
+		return WriteA(Text);
+	}
+#endif
+
+	// The segments are joined in the output buffer, which an unbuffered console sends right away.
+	bool SmartConsole::WriteVA(const std::string_view* pSegments, unsigned int unSegments) {
+		if (!m_hWindow || (!pSegments && unSegments)) {
+			return false;
+		}
+
+		std::lock_guard<std::mutex> Lock(m_OutputBufferLock);
+
+		if (!m_OutputBufferW.empty() && !FlushOutputBuffer()) {
+			return false;
+		}
+
+		size_t unLength = m_OutputBufferA.size();
+		for (unsigned int i = 0; i < unSegments; ++i) {
+			unLength += pSegments[i].size();
+		}
+
+		m_OutputBufferA.reserve(unLength);
+
+		bool bNewLine = false;
+		for (unsigned int i = 0; i < unSegments; ++i) {
+			m_OutputBufferA.append(pSegments[i]);
+			bNewLine = bNewLine || (pSegments[i].find('\n') != std::string_view::npos);
+		}
+
+		if (m_OutputPolicy == OUTPUT_POLICY::OUTPUT_POLICY_UNBUFFERED) {
+			return FlushOutputBuffer();
+		}
+
+		return UpdateOutputBuffer(bNewLine);
+	}
+
+	bool SmartConsole::WriteVW(const std::wstring_view* pSegments, unsigned int unSegments) {
+		if (!m_hWindow || (!pSegments && unSegments)) {
+			return false;
+		}
+
+		std::lock_guard<std::mutex> Lock(m_OutputBufferLock);
+
+		if (!m_OutputBufferA.empty() && !FlushOutputBuffer()) {
+			return false;
+		}
+
+		size_t unLength = m_OutputBufferW.size();
+		for (unsigned int i = 0; i < unSegments; ++i) {
+			unLength += pSegments[i].size();
+		}
+
+		m_OutputBufferW.reserve(unLength);
+
+		bool bNewLine = false;
+		for (unsigned int i = 0; i < unSegments; ++i) {
+			m_OutputBufferW.append(pSegments[i]);
+			bNewLine = bNewLine || (pSegments[i].find(L'\n') != std::wstring_view::npos);
+		}
+
+		if (m_OutputPolicy == OUTPUT_POLICY::OUTPUT_POLICY_UNBUFFERED) {
+			return FlushOutputBuffer();
+		}
+
+		return UpdateOutputBuffer(bNewLine);
+	}
+
+#ifdef UNICODE
+	bool SmartConsole::WriteV(const std::wstring_view* pSegments, unsigned int unSegments) {
+		return WriteVW(pSegments, unSegments);
+	}
+#else
+	bool SmartConsole::WriteV(const std::string_view* pSegments, unsigned int unSegments) {
+		return WriteVA(pSegments, unSegments);
+	}
+#endif
+
+	// Converted into the wide output buffer, except for a pipe that takes UTF-8 anyway. That one gets the bytes unchanged.
+	bool SmartConsole::WriteUTF8(std::string_view Text) {
+		if (!m_hWindow) {
+			return false;
+		}
+
+		if ((m_OutputTarget == OUTPUT_TARGET::OUTPUT_TARGET_PIPE) && (GetConsoleApi()->GetConsoleOutputCP() == CP_UTF8)) {
+			return WriteA(Text);
+		}
+
+		std::lock_guard<std::mutex> Lock(m_OutputBufferLock);
+
+		if (!m_OutputBufferA.empty() && !FlushOutputBuffer()) {
+			return false;
+		}
+
+		const size_t unOffset = m_OutputBufferW.size();
+		m_OutputBufferW.resize(unOffset + Text.size());
+		m_OutputBufferW.resize(unOffset + ConvertUTF8ToUTF16(Text.data(), Text.size(), m_OutputBufferW.data() + unOffset));
+
+		if (m_OutputPolicy == OUTPUT_POLICY::OUTPUT_POLICY_UNBUFFERED) {
+			return FlushOutputBuffer();
+		}
+
+		return UpdateOutputBuffer(Text.find('\n') != std::string_view::npos);
+	}
+
+	// Key, resize and focus events instead of lines. Input is neither line buffered nor echoed until DisableRawInput().
+	bool SmartConsole::EnableRawInput(unsigned int unEvents) {
+		if (m_pInputReader && m_pInputReader->IsRunning()) {
+			return true;
+		}
+
+		HANDLE hIn = GetIn();
+		if (!hIn) {
+			return false;
+		}
+
+		DWORD unMode = 0;
+		if (!GetConsoleApi()->GetConsoleMode(hIn, &unMode)) {
+			return false;
+		}
+
+		if (!GetConsoleApi()->SetConsoleMode(hIn, (unMode & ~(ENABLE_LINE_INPUT | ENABLE_ECHO_INPUT)) | ENABLE_WINDOW_INPUT)) {
+			return false;
+		}
+
+		// A reader that stopped on its own still holds the events it read.
+		m_pInputReader.reset(new InputReader());
+		if (!m_pInputReader->Start(hIn, unEvents)) {
+			m_pInputReader = nullptr;
+			GetConsoleApi()->SetConsoleMode(hIn, unMode);
+			return false;
+		}
+
+		m_unRawInputOriginalMode = unMode;
+
+		return true;
+	}
+
+	// Queued events stay available to PollEvent and DrainEvents.
+	bool SmartConsole::DisableRawInput() {
+		if (!m_pInputReader || !m_pInputReader->Stop()) {
+			return true;
+		}
+
+		HANDLE hIn = GetIn();
+		if (hIn && !GetConsoleApi()->SetConsoleMode(hIn, m_unRawInputOriginalMode)) {
+			return false;
+		}
+
+		return true;
+	}
+
+	bool SmartConsole::IsRawInput() {
+		return m_pInputReader && m_pInputReader->IsRunning();
+	}
+
+	bool SmartConsole::PollEvent(PINPUT_EVENT pEvent) {
+		if (!m_pInputReader) {
+			return false;
+		}
+
+		return m_pInputReader->Poll(pEvent);
+	}
+
+	bool SmartConsole::WaitEvent(PINPUT_EVENT pEvent, unsigned int unMilliseconds) {
+		if (!m_pInputReader) {
+			return false;
+		}
+
+		return m_pInputReader->Wait(pEvent, unMilliseconds);
+	}
+
+	unsigned int SmartConsole::DrainEvents(PINPUT_EVENT pEvents, unsigned int unCount) {
+		if (!m_pInputReader) {
+			return 0;
+		}
+
+		return m_pInputReader->Drain(pEvents, unCount);
+	}
+
+	unsigned long long SmartConsole::GetDroppedEvents() {
+		if (!m_pInputReader) {
+			return 0;
+		}
+
+		return m_pInputReader->GetDropped();
+	}
+
+	// Whether the buffer was resized since the last call. Only known while raw input is on.
+	bool SmartConsole::CheckResized() {
+		if (!m_pInputReader) {
+			return false;
+		}
+
+		return m_pInputReader->TakeResized();
+	}
+
+	bool SmartConsole::SetOutputPolicy(OUTPUT_POLICY Policy, unsigned int unThreshold, unsigned int unMilliseconds) {
+		if (!unThreshold) {
+			return false;
+		}
+
+		{
+			std::lock_guard<std::mutex> Lock(m_OutputBufferLock);
+
+			FlushOutputBuffer();
+
+			m_OutputPolicy = Policy;
+			m_unOutputThreshold = unThreshold;
+			m_unOutputMilliseconds = unMilliseconds;
+		}
+
+		if (Policy == OUTPUT_POLICY::OUTPUT_POLICY_TIME) {
+			StartOutputTimer();
+		} else {
+			StopOutputTimer();
+		}
+
+		return true;
+	}
+
+	OUTPUT_POLICY SmartConsole::GetOutputPolicy() {
+		std::lock_guard<std::mutex> Lock(m_OutputBufferLock);
+		return m_OutputPolicy;
+	}
+
+	bool SmartConsole::FlushOutput() {
+		std::lock_guard<std::mutex> Lock(m_OutputBufferLock);
+		return FlushOutputBuffer();
+	}
+
+	void SmartConsole::CountCall(CONSOLE_CALL Call, unsigned long long unCount) {
+		if (Call >= CONSOLE_CALL::CONSOLE_CALL_COUNT) {
+			return;
+		}
+
+		m_unCalls[static_cast<unsigned char>(Call)].fetch_add(unCount, std::memory_order_relaxed);
+	}
+
+	void SmartConsole::CountWrittenCharacters(unsigned long long unCount) {
+		m_unWrittenCharacters.fetch_add(unCount, std::memory_order_relaxed);
+	}
+
+	bool SmartConsole::GetStatistics(PCONSOLE_STATISTICS pStatistics) {
+		if (!pStatistics) {
+			return false;
+		}
+
+		for (unsigned char i = 0; i < static_cast<unsigned char>(CONSOLE_CALL::CONSOLE_CALL_COUNT); ++i) {
+			pStatistics->Calls[i] = m_unCalls[i].load(std::memory_order_relaxed);
+		}
+
+		pStatistics->WrittenCharacters = m_unWrittenCharacters.load(std::memory_order_relaxed);
+
+		return true;
+	}
+
+	void SmartConsole::ResetStatistics() {
+		for (unsigned char i = 0; i < static_cast<unsigned char>(CONSOLE_CALL::CONSOLE_CALL_COUNT); ++i) {
+			m_unCalls[i].store(0, std::memory_order_relaxed);
+		}
+
+		m_unWrittenCharacters.store(0, std::memory_order_relaxed);
+	}
+
+	HWND SmartConsole::GetWindow() {
+		return m_hWindow;
+	}
+
+	HANDLE SmartConsole::GetIn() {
+		if (m_hIn == INVALID_HANDLE_VALUE) {
+			return nullptr;
+		}
+		return m_hIn;
+	}
+
+	HANDLE SmartConsole::GetOut() {
+		if (m_hOut == INVALID_HANDLE_VALUE) {
+			return nullptr;
+		}
+		return m_hOut;
+	}
+
+	OUTPUT_TARGET SmartConsole::GetOutputTarget() {
+		std::lock_guard<std::mutex> Lock(m_OutputBufferLock);
+		return m_OutputTarget;
+	}
+
+	// The stream is only bypassed when it writes to our own output handle, so nothing comes out somewhere else than before.
+	void SmartConsole::UpdateOutputTarget() {
+		m_OutputTarget = OUTPUT_TARGET::OUTPUT_TARGET_STREAM;
+
+		if (!m_hOut || (m_hOut == INVALID_HANDLE_VALUE) || GetConsoleApi()->bEmulated) {
+			return;
+		}
+
+		if (reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(stdout))) != m_hOut) {
+			return;
+		}
+
+		DWORD unMode = 0;
+		if (GetConsoleApi()->GetConsoleMode(m_hOut, &unMode)) {
+			m_OutputTarget = OUTPUT_TARGET::OUTPUT_TARGET_CONSOLE;
+		} else if (GetFileType(m_hOut) == FILE_TYPE_PIPE) {
+			m_OutputTarget = OUTPUT_TARGET::OUTPUT_TARGET_PIPE;
+		}
+	}
+
+	// Expects m_OutputBufferLock to be held. Text printed through the CRT directly is flushed first to keep the order.
+	bool SmartConsole::WriteOutputA(char const* const szBuffer, size_t unLength) {
+		CountCall(CONSOLE_CALL::CONSOLE_CALL_WRITE);
+		CountWrittenCharacters(unLength);
+
+		const CONSOLE_API* pApi = GetConsoleApi();
+		if (pApi->bEmulated) {
+			DWORD unWritten = 0;
+			return pApi->WriteConsoleA(m_hOut, szBuffer, static_cast<DWORD>(unLength), &unWritten, nullptr) != FALSE;
+		}
+
+		switch (m_OutputTarget) {
+			case OUTPUT_TARGET::OUTPUT_TARGET_CONSOLE: {
+				fflush(stdout);
+
+				DWORD unWritten = 0;
+				return pApi->WriteConsoleA(m_hOut, szBuffer, static_cast<DWORD>(unLength), &unWritten, nullptr) != FALSE;
+			}
+
+			case OUTPUT_TARGET::OUTPUT_TARGET_PIPE:
+				fflush(stdout);
+				return WriteOutputHandle(szBuffer, unLength);
+
+			default:
+				break;
+		}
+
+		return fwrite(szBuffer, sizeof(char), unLength, stdout) == unLength;
+	}
+
+	// Expects m_OutputBufferLock to be held. Pipes get the text in the console output code page, like the CRT stream would give it.
+	bool SmartConsole::WriteOutputW(wchar_t const* const szBuffer, size_t unLength) {
+		CountCall(CONSOLE_CALL::CONSOLE_CALL_WRITE);
+		CountWrittenCharacters(unLength);
+
+		const CONSOLE_API* pApi = GetConsoleApi();
+		if (pApi->bEmulated) {
+			DWORD unWritten = 0;
+			return pApi->WriteConsoleW(m_hOut, szBuffer, static_cast<DWORD>(unLength), &unWritten, nullptr) != FALSE;
+		}
+
+		switch (m_OutputTarget) {
+			case OUTPUT_TARGET::OUTPUT_TARGET_CONSOLE: {
+				fflush(stdout);
+
+				DWORD unWritten = 0;
+				return pApi->WriteConsoleW(m_hOut, szBuffer, static_cast<DWORD>(unLength), &unWritten, nullptr) != FALSE;
+			}
+
+			case OUTPUT_TARGET::OUTPUT_TARGET_PIPE: {
+				fflush(stdout);
+
+				if (!unLength) {
+					return true;
+				}
+
+				const UINT unCodePage = pApi->GetConsoleOutputCP();
+				if (unCodePage == CP_UTF8) {
+					m_OutputBytes.resize(unLength * 3);
+					m_OutputBytes.resize(ConvertUTF16ToUTF8(szBuffer, unLength, m_OutputBytes.data()));
+
+					return WriteOutputHandle(m_OutputBytes.data(), m_OutputBytes.size());
+				}
+
+				const int nSize = WideCharToMultiByte(unCodePage, 0, szBuffer, static_cast<int>(unLength), nullptr, 0, nullptr, nullptr);
+				if (nSize <= 0) {
+					return false;
+				}
+
+				m_OutputBytes.resize(static_cast<size_t>(nSize));
+
+				if (WideCharToMultiByte(unCodePage, 0, szBuffer, static_cast<int>(unLength), m_OutputBytes.data(), nSize, nullptr, nullptr) != nSize) {
+					return false;
+				}
+
+				return WriteOutputHandle(m_OutputBytes.data(), m_OutputBytes.size());
+			}
+
+			default:
+				break;
+		}
+
+		return fwprintf(stdout, L"%.*ls", static_cast<int>(unLength), szBuffer) >= 0;
+	}
+
+	// Expects m_OutputBufferLock to be held. A pipe may take less than asked for at once.
+	bool SmartConsole::WriteOutputHandle(char const* const pData, size_t unSize) {
+		size_t unOffset = 0;
+
+		while (unOffset < unSize) {
+			DWORD unWritten = 0;
+			if (!WriteFile(m_hOut, pData + unOffset, static_cast<DWORD>(unSize - unOffset), &unWritten, nullptr) || !unWritten) {
+				return false;
+			}
+
+			unOffset += unWritten;
+		}
+
+		return true;
+	}
+
+	// Expects m_OutputBufferLock to be held.
+	bool SmartConsole::FlushOutputBuffer() {
+		m_bOutputDeadline = false;
+
+		bool bResult = true;
+
+		if (!m_OutputBufferA.empty()) {
+			bResult = m_hWindow && WriteOutputA(m_OutputBufferA.c_str(), m_OutputBufferA.size());
+			m_OutputBufferA.clear();
+		}
+
+		if (!m_OutputBufferW.empty()) {
+			bResult = m_hWindow && WriteOutputW(m_OutputBufferW.c_str(), m_OutputBufferW.size());
+			m_OutputBufferW.clear();
+		}
+
+		// Text written through the CRT directly has to come out before the caller touches the console.
+		fflush(stdout);
+
+		return bResult;
+	}
+
+	// Expects m_OutputBufferLock to be held.
+	bool SmartConsole::UpdateOutputBuffer(bool bNewLine) {
+		const size_t unSize = m_OutputBufferA.size() + m_OutputBufferW.size();
+		if (unSize >= m_unOutputThreshold) {
+			return FlushOutputBuffer();
+		}
+
+		switch (m_OutputPolicy) {
+			case OUTPUT_POLICY::OUTPUT_POLICY_LINE:
+				if (bNewLine) {
+					return FlushOutputBuffer();
+				}
+				break;
+
+			case OUTPUT_POLICY::OUTPUT_POLICY_TIME:
+				if (!m_bOutputDeadline) {
+					m_OutputDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_unOutputMilliseconds);
+					m_bOutputDeadline = true;
+					m_OutputTimer.notify_one();
+				}
+				break;
+
+			default:
+				break;
+		}
+
+		return true;
+	}
+
+	void SmartConsole::StartOutputTimer() {
+		if (m_OutputTimerThread.joinable()) {
+			return;
+		}
+
+		m_bStopOutputTimer = false;
+		m_OutputTimerThread = std::thread(&SmartConsole::RunOutputTimer, this);
+	}
+
+	void SmartConsole::StopOutputTimer() {
+		if (!m_OutputTimerThread.joinable()) {
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> Lock(m_OutputBufferLock);
+			m_bStopOutputTimer = true;
+		}
+
+		m_OutputTimer.notify_one();
+		m_OutputTimerThread.join();
+	}
+
+	// Flushes text that sat in the buffer for m_unOutputMilliseconds without reaching the threshold.
+	void SmartConsole::RunOutputTimer() {
+		std::unique_lock<std::mutex> Lock(m_OutputBufferLock);
+
+		while (!m_bStopOutputTimer) {
+			if (!m_bOutputDeadline) {
+				m_OutputTimer.wait(Lock);
+				continue;
+			}
+
+			if (std::chrono::steady_clock::now() >= m_OutputDeadline) {
+				FlushOutputBuffer();
+				continue;
+			}
+
+			m_OutputTimer.wait_until(Lock, m_OutputDeadline);
+		}
+	}
+
+	// ----------------------------------------------------------------
+	// Colors
+	// ----------------------------------------------------------------
+
+	// Applies a color pair over existing attributes, unknown colors keep the current ones.
+	static WORD MakeAttributes(COLOR_PAIR ColorPair, WORD unAttributes) {
+		if (ColorPair.ColorBackground != COLOR::COLOR_UNKNOWN) {
+			unAttributes = (unAttributes & ~0xF0) | ((static_cast<unsigned char>(ColorPair.ColorBackground) & 0x0F) << 4);
+		}
+
+		if (ColorPair.ColorForeground != COLOR::COLOR_UNKNOWN) {
+			unAttributes = (unAttributes & ~0x0F) | (static_cast<unsigned char>(ColorPair.ColorForeground) & 0x0F);
+		}
+
+		return unAttributes;
+	}
+
+	// ----------------------------------------------------------------
+	// Virtual terminal
+	// ----------------------------------------------------------------
+
+	// 16 colors plus COLOR_UNKNOWN for each of foreground and background.
+	static constexpr unsigned int g_unColorSequenceColors = 17;
+
+	typedef struct _COLOR_SEQUENCE {
+		char Sequence[12];
+		unsigned int Length;
+	} COLOR_SEQUENCE;
+
+	typedef struct _COLOR_SEQUENCE_TABLE {
+		COLOR_SEQUENCE Sequences[g_unColorSequenceColors * g_unColorSequenceColors];
+	} COLOR_SEQUENCE_TABLE;
+
+	// Console attributes are BGR ordered, SGR colors are RGB ordered.
+	static constexpr unsigned int ToSGRColor(unsigned int unColor) {
+		return ((unColor & 0x01) << 2) | (unColor & 0x02) | ((unColor & 0x04) >> 2);
+	}
+
+	static constexpr COLOR_SEQUENCE_TABLE MakeColorSequenceTable() {
+		COLOR_SEQUENCE_TABLE Table {};
+
+		for (unsigned int unForeground = 0; unForeground < g_unColorSequenceColors; ++unForeground) {
+			for (unsigned int unBackground = 0; unBackground < g_unColorSequenceColors; ++unBackground) {
+				const bool bForeground = unForeground < 16;
+				const bool bBackground = unBackground < 16;
+				if (!bForeground && !bBackground) {
+					continue;
+				}
+
+				COLOR_SEQUENCE& Sequence = Table.Sequences[unForeground * g_unColorSequenceColors + unBackground];
+				unsigned int unLength = 0;
+
+				Sequence.Sequence[unLength++] = '\x1B';
+				Sequence.Sequence[unLength++] = '[';
+
+				if (bForeground) {
+					const unsigned int unCode = ((unForeground & 0x08) ? 90 : 30) + ToSGRColor(unForeground);
+					Sequence.Sequence[unLength++] = static_cast<char>('0' + unCode / 10);
+					Sequence.Sequence[unLength++] = static_cast<char>('0' + unCode % 10);
+				}
+
+				if (bForeground && bBackground) {
+					Sequence.Sequence[unLength++] = ';';
+				}
+
+				if (bBackground) {
+					const unsigned int unCode = ((unBackground & 0x08) ? 100 : 40) + ToSGRColor(unBackground);
+					if (unCode >= 100) {
+						Sequence.Sequence[unLength++] = '1';
+					}
+					Sequence.Sequence[unLength++] = static_cast<char>('0' + (unCode / 10) % 10);
+					Sequence.Sequence[unLength++] = static_cast<char>('0' + unCode % 10);
+				}
+
+				Sequence.Sequence[unLength++] = 'm';
+				Sequence.Length = unLength;
+			}
+		}
+
+		return Table;
+	}
+
+	static constexpr COLOR_SEQUENCE_TABLE g_ColorSequenceTable = MakeColorSequenceTable();
+
+	// Room to reserve for a sequence that is only known once the output lock is held.
+	static constexpr unsigned int g_unMaxColorSequenceLength = sizeof(COLOR_SEQUENCE::Sequence);
+
+	static_assert(g_ColorSequenceTable.Sequences[15 * g_unColorSequenceColors + 9].Length == 9, "Unexpected SGR sequence length");
+
+	char const* GetColorSequence(COLOR_PAIR ColorPair, unsigned int* pLength) {
+		const unsigned int unForeground = static_cast<unsigned char>(ColorPair.ColorForeground) < 16 ? static_cast<unsigned char>(ColorPair.ColorForeground) : 16;
+		const unsigned int unBackground = static_cast<unsigned char>(ColorPair.ColorBackground) < 16 ? static_cast<unsigned char>(ColorPair.ColorBackground) : 16;
+
+		const COLOR_SEQUENCE& Sequence = g_ColorSequenceTable.Sequences[unForeground * g_unColorSequenceColors + unBackground];
+		if (pLength) {
+			*pLength = Sequence.Length;
+		}
+
+		return Sequence.Sequence;
+	}
+
+	static unsigned int AppendColorComponent(char* szBuffer, unsigned int unValue) {
+		unsigned int unLength = 0;
+
+		if (unValue >= 100) {
+			szBuffer[unLength++] = static_cast<char>('0' + unValue / 100);
+		}
+
+		if (unValue >= 10) {
+			szBuffer[unLength++] = static_cast<char>('0' + (unValue / 10) % 10);
+		}
+
+		szBuffer[unLength++] = static_cast<char>('0' + unValue % 10);
+
+		return unLength;
+	}
+
+	static unsigned int AppendExtendedColor(char* szBuffer, const EXTENDED_COLOR& Color, bool bBackground) {
+		unsigned int unLength = 0;
+
+		switch (Color.Kind) {
+			case EXTENDED_COLOR_KIND::EXTENDED_COLOR_KIND_LEGACY:
+				if (bBackground) {
+					unLength += AppendColorComponent(szBuffer, ((Color.Index & 0x08) ? 100 : 40) + ToSGRColor(Color.Index));
+				} else {
+					unLength += AppendColorComponent(szBuffer, ((Color.Index & 0x08) ? 90 : 30) + ToSGRColor(Color.Index));
+				}
+				break;
+
+			case EXTENDED_COLOR_KIND::EXTENDED_COLOR_KIND_INDEXED:
+				memcpy(szBuffer, bBackground ? "48;5;" : "38;5;", 5);
+				unLength += 5;
+				unLength += AppendColorComponent(szBuffer + unLength, Color.Index);
+				break;
+
+			case EXTENDED_COLOR_KIND::EXTENDED_COLOR_KIND_RGB:
+				memcpy(szBuffer, bBackground ? "48;2;" : "38;2;", 5);
+				unLength += 5;
+				unLength += AppendColorComponent(szBuffer + unLength, Color.Red);
+				szBuffer[unLength++] = ';';
+				unLength += AppendColorComponent(szBuffer + unLength, Color.Green);
+				szBuffer[unLength++] = ';';
+				unLength += AppendColorComponent(szBuffer + unLength, Color.Blue);
+				break;
+
+			default:
+				break;
+		}
+
+		return unLength;
+	}
+
+	unsigned int GetExtendedColorSequence(const EXTENDED_COLOR_PAIR& ColorPair, char* szBuffer) {
+		if (!szBuffer) {
+			return 0;
+		}
+
+		const bool bForeground = ColorPair.ColorForeground.Kind != EXTENDED_COLOR_KIND::EXTENDED_COLOR_KIND_UNKNOWN;
+		const bool bBackground = ColorPair.ColorBackground.Kind != EXTENDED_COLOR_KIND::EXTENDED_COLOR_KIND_UNKNOWN;
+		if (!bForeground && !bBackground) {
+			szBuffer[0] = '\0';
+			return 0;
+		}
+
+		unsigned int unLength = 0;
+
+		szBuffer[unLength++] = '\x1B';
+		szBuffer[unLength++] = '[';
+
+		if (bForeground) {
+			unLength += AppendExtendedColor(szBuffer + unLength, ColorPair.ColorForeground, false);
+		}
+
+		if (bForeground && bBackground) {
+			szBuffer[unLength++] = ';';
+		}
+
+		if (bBackground) {
+			unLength += AppendExtendedColor(szBuffer + unLength, ColorPair.ColorBackground, true);
+		}
+
+		szBuffer[unLength++] = 'm';
+		szBuffer[unLength] = '\0';
+
+		return unLength;
+	}
+
+	// ----------------------------------------------------------------
+	// ColorQuantizer
+	// ----------------------------------------------------------------
+
+	static constexpr unsigned int g_unQuantizerShift = 3;
+	static constexpr unsigned int g_unQuantizerLevels = 256 >> g_unQuantizerShift;
+	static constexpr unsigned char g_ColorCubeLevels[6] = { 0, 95, 135, 175, 215, 255 };
+
+	// Weighted by the mean red, which tracks perceived differences much better than plain RGB distance.
+	static unsigned int GetColorDistance(int nR1, int nG1, int nB1, int nR2, int nG2, int nB2) {
+		const int nMeanR = (nR1 + nR2) / 2;
+		const int nR = nR1 - nR2;
+		const int nG = nG1 - nG2;
+		const int nB = nB1 - nB2;
+
+		return static_cast<unsigned int>((((512 + nMeanR) * nR * nR) >> 8) + 4 * nG * nG + (((767 - nMeanR) * nB * nB) >> 8));
+	}
+
+	static unsigned int GetNearestCubeLevel(unsigned char unValue) {
+		if (unValue < 48) {
+			return 0;
+		}
+
+		if (unValue < 115) {
+			return 1;
+		}
+
+		return (unValue - 35) / 40;
+	}
+
+	ColorQuantizer::ColorQuantizer() {
+		memset(m_ColorTable, 0, sizeof(m_ColorTable));
+		m_bBuilt = false;
+		m_pTable = nullptr;
+	}
+
+	ColorQuantizer::~ColorQuantizer() {
+		m_bBuilt = false;
+		m_pTable = nullptr;
+	}
+
+	bool ColorQuantizer::Build(const COLORREF* pColorTable) {
+		if (!pColorTable) {
+			return false;
+		}
+
+		if (m_bBuilt && !memcmp(m_ColorTable, pColorTable, sizeof(m_ColorTable))) {
+			return true;
+		}
+
+		if (!m_pTable) {
+			m_pTable = std::make_unique<unsigned char[]>(g_unQuantizerLevels * g_unQuantizerLevels * g_unQuantizerLevels);
+		}
+
+		memcpy(m_ColorTable, pColorTable, sizeof(m_ColorTable));
+
+		int PaletteR[16], PaletteG[16], PaletteB[16];
+		for (unsigned char i = 0; i < 16; ++i) {
+			PaletteR[i] = GetRValue(m_ColorTable[i]);
+			PaletteG[i] = GetGValue(m_ColorTable[i]);
+			PaletteB[i] = GetBValue(m_ColorTable[i]);
+		}
+
+		// Each entry holds the palette color nearest to the center of its cell. The red and green terms only change in the outer loops.
+		unsigned char* pEntry = m_pTable.get();
+		for (unsigned int unR = 0; unR < g_unQuantizerLevels; ++unR) {
+			const int nR = static_cast<int>((unR << g_unQuantizerShift) | (1 << (g_unQuantizerShift - 1)));
+
+			int DistanceR[16], WeightB[16];
+			for (unsigned char i = 0; i < 16; ++i) {
+				const int nMeanR = (nR + PaletteR[i]) / 2;
+				DistanceR[i] = ((512 + nMeanR) * (nR - PaletteR[i]) * (nR - PaletteR[i])) >> 8;
+				WeightB[i] = 767 - nMeanR;
+			}
+
+			for (unsigned int unG = 0; unG < g_unQuantizerLevels; ++unG) {
+				const int nG = static_cast<int>((unG << g_unQuantizerShift) | (1 << (g_unQuantizerShift - 1)));
+
+				int DistanceRG[16];
+				for (unsigned char i = 0; i < 16; ++i) {
+					DistanceRG[i] = DistanceR[i] + 4 * (nG - PaletteG[i]) * (nG - PaletteG[i]);
+				}
+
+				for (unsigned int unB = 0; unB < g_unQuantizerLevels; ++unB) {
+					const int nB = static_cast<int>((unB << g_unQuantizerShift) | (1 << (g_unQuantizerShift - 1)));
+
+					unsigned char unNearest = 0;
+					int nNearestDistance = DistanceRG[0] + ((WeightB[0] * (nB - PaletteB[0]) * (nB - PaletteB[0])) >> 8);
+					for (unsigned char i = 1; i < 16; ++i) {
+						const int nDistance = DistanceRG[i] + ((WeightB[i] * (nB - PaletteB[i]) * (nB - PaletteB[i])) >> 8);
+						if (nDistance < nNearestDistance) {
+							nNearestDistance = nDistance;
+							unNearest = i;
+						}
+					}
+
+					*pEntry++ = unNearest;
+				}
+			}
+		}
+
+		m_bBuilt = true;
+
+		return true;
+	}
+
+	bool ColorQuantizer::IsBuilt() {
+		return m_bBuilt;
+	}
+
+	COLOR ColorQuantizer::Quantize(unsigned char unR, unsigned char unG, unsigned char unB) {
+		if (!m_bBuilt) {
+			return COLOR::COLOR_UNKNOWN;
+		}
+
+		const unsigned int unIndex = (((unR >> g_unQuantizerShift) * g_unQuantizerLevels) + (unG >> g_unQuantizerShift)) * g_unQuantizerLevels + (unB >> g_unQuantizerShift);
+
+		return static_cast<COLOR>(m_pTable[unIndex]);
+	}
+
+	COLOR ColorQuantizer::Quantize(const EXTENDED_COLOR& Color) {
+		switch (Color.Kind) {
+			case EXTENDED_COLOR_KIND::EXTENDED_COLOR_KIND_LEGACY:
+				return static_cast<COLOR>(Color.Index & 0x0F);
+
+			case EXTENDED_COLOR_KIND::EXTENDED_COLOR_KIND_INDEXED: {
+				// The first 16 indices are the terminal's own colors, in SGR order.
+				if (Color.Index < 16) {
+					return static_cast<COLOR>(ToSGRColor(Color.Index) | (Color.Index & 0x08));
+				}
+
+				unsigned char unR = 0, unG = 0, unB = 0;
+				GetIndexColor(Color.Index, &unR, &unG, &unB);
+
+				return Quantize(unR, unG, unB);
+			}
+
+			case EXTENDED_COLOR_KIND::EXTENDED_COLOR_KIND_RGB:
+				return Quantize(Color.Red, Color.Green, Color.Blue);
+
+			default:
+				break;
+		}
+
+		return COLOR::COLOR_UNKNOWN;
+	}
+
+	bool ColorQuantizer::Quantize(const EXTENDED_COLOR* pColors, PCOLOR pResult, size_t unCount) {
+		if (!m_bBuilt || !pColors || !pResult) {
+			return false;
+		}
+
+		for (size_t i = 0; i < unCount; ++i) {
+			pResult[i] = Quantize(pColors[i]);
+		}
+
+		return true;
+	}
+
+	// Unknown colors take their half of the default attributes.
+	bool ColorQuantizer::Quantize(const EXTENDED_COLOR_PAIR* pColorPairs, PWORD pAttributes, size_t unCount, WORD unDefaultAttributes) {
+		if (!m_bBuilt || !pColorPairs || !pAttributes) {
+			return false;
+		}
+
+		for (size_t i = 0; i < unCount; ++i) {
+			const COLOR Foreground = Quantize(pColorPairs[i].ColorForeground);
+			const COLOR Background = Quantize(pColorPairs[i].ColorBackground);
+
+			WORD unAttributes = unDefaultAttributes;
+
+			if (Foreground != COLOR::COLOR_UNKNOWN) {
+				unAttributes = static_cast<WORD>((unAttributes & ~0x0F) | static_cast<unsigned char>(Foreground));
+			}
+
+			if (Background != COLOR::COLOR_UNKNOWN) {
+				unAttributes = static_cast<WORD>((unAttributes & ~0xF0) | (static_cast<unsigned char>(Background) << 4));
+			}
+
+			pAttributes[i] = unAttributes;
+		}
+
+		return true;
+	}
+
+	// Nearest entry of the 6x6x6 cube or the gray ramp. The first 16 indices are left out since their colors are up to the terminal.
+	unsigned char ColorQuantizer::GetNearestIndex(unsigned char unR, unsigned char unG, unsigned char unB) {
+		const unsigned int unCubeR = GetNearestCubeLevel(unR);
+		const unsigned int unCubeG = GetNearestCubeLevel(unG);
+		const unsigned int unCubeB = GetNearestCubeLevel(unB);
+
+		const unsigned int unAverage = (static_cast<unsigned int>(unR) + unG + unB) / 3;
+		const unsigned int unGray = (unAverage > 238) ? 23 : ((unAverage < 3) ? 0 : (unAverage - 3) / 10);
+		const int nGray = static_cast<int>(8 + unGray * 10);
+
+		const unsigned int unCubeDistance = GetColorDistance(unR, unG, unB, g_ColorCubeLevels[unCubeR], g_ColorCubeLevels[unCubeG], g_ColorCubeLevels[unCubeB]);
+		const unsigned int unGrayDistance = GetColorDistance(unR, unG, unB, nGray, nGray, nGray);
+
+		if (unGrayDistance < unCubeDistance) {
+			return static_cast<unsigned char>(232 + unGray);
+		}
+
+		return static_cast<unsigned char>(16 + unCubeR * 36 + unCubeG * 6 + unCubeB);
+	}
+
+	bool ColorQuantizer::GetIndexColor(unsigned char unIndex, unsigned char* pR, unsigned char* pG, unsigned char* pB) {
+		if ((unIndex < 16) || !pR || !pG || !pB) {
+			return false;
+		}
+
+		if (unIndex >= 232) {
+			const unsigned char unGray = static_cast<unsigned char>(8 + (unIndex - 232) * 10);
+			*pR = unGray;
+			*pG = unGray;
+			*pB = unGray;
+			return true;
+		}
+
+		const unsigned int unCube = unIndex - 16;
+		*pR = g_ColorCubeLevels[unCube / 36];
+		*pG = g_ColorCubeLevels[(unCube / 6) % 6];
+		*pB = g_ColorCubeLevels[unCube % 6];
+
+		return true;
+	}
+
+	// ----------------------------------------------------------------
+	// SmartConsoleUtils
+	// ----------------------------------------------------------------
+
+	static bool IntersectRect(SMALL_RECT& Rect, const SMALL_RECT& Clip) {
+		Rect.Left = Rect.Left > Clip.Left ? Rect.Left : Clip.Left;
+		Rect.Top = Rect.Top > Clip.Top ? Rect.Top : Clip.Top;
+		Rect.Right = Rect.Right < Clip.Right ? Rect.Right : Clip.Right;
+		Rect.Bottom = Rect.Bottom < Clip.Bottom ? Rect.Bottom : Clip.Bottom;
+		return (Rect.Left <= Rect.Right) && (Rect.Top <= Rect.Bottom);
+	}
+
+	static SMALL_RECT GetBufferBounds(const CONSOLE_SCREEN_BUFFER_INFOEX& BufferInfoEx) {
+		SMALL_RECT Bounds;
+		Bounds.Left = 0;
+		Bounds.Top = 0;
+		Bounds.Right = BufferInfoEx.dwSize.X - 1;
+		Bounds.Bottom = BufferInfoEx.dwSize.Y - 1;
+		return Bounds;
+	}
+
+	// Unknown colors keep their half of the attributes.
+	static WORD MergeAttributes(WORD unAttributes, COLOR_PAIR ColorPair) {
+		unAttributes &= 0xFF;
+
+		if (ColorPair.ColorBackground != COLOR::COLOR_UNKNOWN) {
+			unAttributes = static_cast<WORD>((unAttributes & 0x0F) | ((static_cast<unsigned char>(ColorPair.ColorBackground) & 0x0F) << 4));
+		}
+
+		if (ColorPair.ColorForeground != COLOR::COLOR_UNKNOWN) {
+			unAttributes = static_cast<WORD>((unAttributes & 0xF0) | (static_cast<unsigned char>(ColorPair.ColorForeground) & 0x0F));
+		}
+
+		return unAttributes;
+	}
+
+	SmartConsoleUtils::SmartConsoleUtils(bool bAutoClose, bool bAutoRestoreColors) : SmartConsole(bAutoClose) {
+		HWND hWindow = GetWindow();
+		HANDLE hOut = GetOut();
+
+		m_bAutoRestoreColors = bAutoRestoreColors;
+		m_unCacheGeneration = 0;
+		m_bCacheValid = false;
+		m_bCachedPositionValid = false;
+		memset(&m_CachedBufferInfo, 0, sizeof(m_CachedBufferInfo));
+		m_unAvoidedCalls = 0;
+		m_nContentRows = 0;
+		m_bCleanRowsKnown = false;
+		m_unCleanAttributes = 0;
+		m_bVirtualTerminal = false;
+		m_unOriginalOutputMode = 0;
+		m_ColorDepth = COLOR_DEPTH::COLOR_DEPTH_TRUE;
+		m_bExtendedColor = false;
+		m_pScreenBuffer = nullptr;
+		m_pAsyncSink = nullptr;
+		m_pActiveSink = nullptr;
+		m_pLineEditor = nullptr;
+		m_pProgressGroup = nullptr;
+		m_bLineEditor = false;
+
+		if (bAutoRestoreColors && hWindow && hOut) {
+			GetColor(&m_OriginalColorPair);
+		}
+
+		if (bAutoRestoreColors && hWindow && hOut) {
+			GetCursorColor(&m_OriginalCursorColorPair);
+		}
+
+		for (unsigned char i = 0; i < 16; ++i) {
+			m_OriginalColorTable[i] = 0x00000000;
+		}
+
+		if (bAutoRestoreColors && hWindow && hOut) {
+			CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+			if (GetBufferInfo(&csbi)) {
+				for (unsigned char i = 0; i < 16; ++i) {
+					m_OriginalColorTable[i] = csbi.ColorTable[i];
+				}
+			}
+		}
+	}
+
+	SmartConsoleUtils::~SmartConsoleUtils() {
+		UnbindConsole(this);
+		DisableAsync();
+		DisableProgress();
+
+		if (m_bAutoRestoreColors && GetWindow() && GetOut()) {
+			CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+			if (GetBufferInfo(&csbi)) {
+				for (unsigned char i = 0; i < 16; ++i) {
+					csbi.ColorTable[i] = m_OriginalColorTable[i];
+				}
+				SetBufferInfo(csbi);
+			}
+			SetColor(m_OriginalColorPair);
+			SetCursorColor(m_OriginalCursorColorPair);
+		}
+
+		DisableVirtualTerminal();
+	}
+
+	bool SmartConsoleUtils::Open(bool bUpdateIO) {
+		InvalidateCache();
+
+		if (!SmartConsole::Open(bUpdateIO)) {
+			return false;
+		}
+
+		HWND hWindow = GetWindow();
+		HANDLE hOut = GetOut();
+
+		m_OriginalColorPair = COLOR_PAIR();
+		if (m_bAutoRestoreColors && hWindow && hOut) {
+			GetColor(&m_OriginalColorPair);
+		}
+
+		m_OriginalCursorColorPair = COLOR_PAIR();
+		if (m_bAutoRestoreColors && hWindow && hOut) {
+			GetCursorColor(&m_OriginalCursorColorPair);
+		}
+
+		m_PreviousColorPair = COLOR_PAIR();
+		m_PreviousCursorColorPair = COLOR_PAIR();
+
+		for (unsigned char i = 0; i < 16; ++i) {
+			m_OriginalColorTable[i] = 0x00000000;
+		}
+
+		if (m_bAutoRestoreColors && hWindow && hOut) {
+			CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+			if (GetBufferInfo(&csbi)) {
+				for (unsigned char i = 0; i < 16; ++i) {
+					m_OriginalColorTable[i] = csbi.ColorTable[i];
+				}
+			}
+		}
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::Close() {
+		DisableAsync();
+		DisableProgress();
+
+		if (m_bAutoRestoreColors && GetWindow() && GetOut()) {
+			CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+			if (GetBufferInfo(&csbi)) {
+				for (unsigned char i = 0; i < 16; ++i) {
+					csbi.ColorTable[i] = m_OriginalColorTable[i];
+				}
+				SetBufferInfo(csbi);
+			}
+			SetColor(m_OriginalColorPair);
+			SetCursorColor(m_OriginalCursorColorPair);
+		}
+
+		DisableVirtualTerminal();
+		InvalidateCache();
+
+		return SmartConsole::Close();
+	}
+
+	bool SmartConsoleUtils::ReadA(char* const szBuffer, unsigned int unCount) {
+		// Queued prompts have to be on screen before we block on input.
+		AsyncSink* pSink = GetAsyncSink();
+		if (pSink) {
+			pSink->Flush();
+		}
+
+		if (m_bLineEditor) {
+			return m_pLineEditor->ReadLineA(szBuffer, unCount);
+		}
+
+		InvalidateCache(true);
+		return SmartConsole::ReadA(szBuffer, unCount);
+	}
+
+	bool SmartConsoleUtils::ReadW(wchar_t* const szBuffer, unsigned int unCount) {
+		// Queued prompts have to be on screen before we block on input.
+		AsyncSink* pSink = GetAsyncSink();
+		if (pSink) {
+			pSink->Flush();
+		}
+
+		if (m_bLineEditor) {
+			return m_pLineEditor->ReadLineW(szBuffer, unCount);
+		}
+
+		InvalidateCache(true);
+		return SmartConsole::ReadW(szBuffer, unCount);
+	}
+
+#ifdef UNICODE
+	bool SmartConsoleUtils::Read(wchar_t* const szBuffer, unsigned int unCount) {
+		return ReadW(szBuffer, unCount);
+	}
+#else
+	bool SmartConsoleUtils::Read(char* const szBuffer, unsigned int unCount) {
+		return ReadA(szBuffer, unCount);
+	}
+#endif
+
+	bool SmartConsoleUtils::WriteA(char const* const szBuffer) {
+		HideProgress();
+		InvalidateCache(true);
+		return SmartConsole::WriteA(szBuffer);
+	}
+
+	bool SmartConsoleUtils::WriteA(std::string_view Text) {
+		HideProgress();
+		InvalidateCache(true);
+		return SmartConsole::WriteA(Text);
+	}
+
+	bool SmartConsoleUtils::WriteW(wchar_t const* const szBuffer) {
+		HideProgress();
+		InvalidateCache(true);
+		return SmartConsole::WriteW(szBuffer);
+	}
+
+	bool SmartConsoleUtils::WriteW(std::wstring_view Text) {
+		HideProgress();
+		InvalidateCache(true);
+		return SmartConsole::WriteW(Text);
+	}
+
+#ifdef UNICODE
+	bool SmartConsoleUtils::Write(wchar_t const* const szBuffer) {
+		return WriteW(szBuffer);
+	}
+
+	bool SmartConsoleUtils::Write(std::wstring_view Text) {
+		return WriteW(Text);
+	}
+#else
+	bool SmartConsoleUtils::Write(char const* const szBuffer) {
+		return WriteA(szBuffer);
+	}
+
+	bool SmartConsoleUtils::Write(std::string_view Text) {
+		return WriteA(Text);
+	}
+#endif
+
+	bool SmartConsoleUtils::WriteVA(const std::string_view* pSegments, unsigned int unSegments) {
+		HideProgress();
+		InvalidateCache(true);
+		return SmartConsole::WriteVA(pSegments, unSegments);
+	}
+
+	bool SmartConsoleUtils::WriteVW(const std::wstring_view* pSegments, unsigned int unSegments) {
+		HideProgress();
+		InvalidateCache(true);
+		return SmartConsole::WriteVW(pSegments, unSegments);
+	}
+
+#ifdef UNICODE
+	bool SmartConsoleUtils::WriteV(const std::wstring_view* pSegments, unsigned int unSegments) {
+		return WriteVW(pSegments, unSegments);
+	}
+#else
+	bool SmartConsoleUtils::WriteV(const std::string_view* pSegments, unsigned int unSegments) {
+		return WriteVA(pSegments, unSegments);
+	}
+#endif
+
+	bool SmartConsoleUtils::WriteUTF8(std::string_view Text) {
+		HideProgress();
+		InvalidateCache(true);
+		return SmartConsole::WriteUTF8(Text);
+	}
+
+	void SmartConsoleUtils::InvalidateCache(bool bPositionOnly) {
+		std::lock_guard<std::mutex> Lock(m_CacheLock);
+
+		++m_unCacheGeneration;
+		if (!bPositionOnly) {
+			m_bCacheValid = false;
+			m_bCleanRowsKnown = false;
+		}
+		m_bCachedPositionValid = false;
+	}
+
+	unsigned long long SmartConsoleUtils::GetAvoidedCalls() {
+		return m_unAvoidedCalls.load(std::memory_order_relaxed);
+	}
+
+	void SmartConsoleUtils::ResetAvoidedCalls() {
+		m_unAvoidedCalls = 0;
+	}
+
+	bool SmartConsoleUtils::GetBufferInfo(PCONSOLE_SCREEN_BUFFER_INFOEX pBufferInfo) {
+		if (!pBufferInfo) {
+			return false;
+		}
+
+		if (!GetWindow()) {
+			return false;
+		}
+
+		HANDLE hOut = GetOut();
+		if (!hOut) {
+			return false;
+		}
+
+		// The cursor position is only right once buffered text is out.
+		FlushOutput();
+
+		memset(pBufferInfo, 0, sizeof(CONSOLE_SCREEN_BUFFER_INFOEX));
+		pBufferInfo->cbSize = sizeof(CONSOLE_SCREEN_BUFFER_INFOEX);
+
+		const unsigned int unGeneration = m_unCacheGeneration.load();
+
+		CountCall(CONSOLE_CALL::CONSOLE_CALL_QUERY);
+
+		if (!GetConsoleApi()->GetConsoleScreenBufferInfoEx(hOut, pBufferInfo)) {
+			InvalidateCache();
+			return false;
+		}
+
+		std::lock_guard<std::mutex> Lock(m_CacheLock);
+
+		UpdateContentRows(pBufferInfo->dwCursorPosition.Y > pBufferInfo->srWindow.Bottom ? pBufferInfo->dwCursorPosition.Y : pBufferInfo->srWindow.Bottom, pBufferInfo->dwSize.Y);
+
+		// Output of another thread may have moved the cursor since the query.
+		if (m_unCacheGeneration.load() == unGeneration) {
+			m_CachedBufferInfo = *pBufferInfo;
+			m_bCacheValid = true;
+			m_bCachedPositionValid = true;
+		}
+
+		return true;
+	}
+
+	// The window can be resized or scrolled without any event reaching us, so window-relative callers always query it.
+	bool SmartConsoleUtils::GetCachedBufferInfo(PCONSOLE_SCREEN_BUFFER_INFOEX pBufferInfo, bool bNeedPosition, bool bNeedWindow) {
+		if (!pBufferInfo) {
+			return false;
+		}
+
+		if (CheckResized()) {
+			InvalidateCache();
+		}
+
+		if (!GetWindow() || !GetOut()) {
+			return false;
+		}
+
+		if (!bNeedWindow) {
+			std::lock_guard<std::mutex> Lock(m_CacheLock);
+
+			if (m_bCacheValid && (!bNeedPosition || m_bCachedPositionValid)) {
+				*pBufferInfo = m_CachedBufferInfo;
+				m_unAvoidedCalls.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+
+		return GetBufferInfo(pBufferInfo);
+	}
+
+	// Rows up to nRow may hold content from now on. The console reaches rows only through the cursor and the window.
+	void SmartConsoleUtils::UpdateContentRows(SHORT nRow, SHORT nBufferRows) {
+		if (m_nContentRows > nBufferRows) {
+			m_nContentRows = nBufferRows;
+		}
+
+		if (nRow >= nBufferRows) {
+			nRow = nBufferRows - 1;
+		}
+
+		if (nRow >= m_nContentRows) {
+			m_nContentRows = nRow + 1;
+		}
+	}
+
+	// A fill cut short by the end of the buffer means the cached size is stale.
+	bool SmartConsoleUtils::ClearCells(HANDLE hOut, COORD Start, DWORD unLength, WORD unAttributes) {
+		DWORD unWritten = 0;
+		CountCall(CONSOLE_CALL::CONSOLE_CALL_FILL);
+
+		if (!GetConsoleApi()->FillConsoleOutputCharacterW(hOut, L' ', unLength, Start, &unWritten) || (unWritten != unLength)) {
+			InvalidateCache();
+			return false;
+		}
+
+		CountCall(CONSOLE_CALL::CONSOLE_CALL_FILL);
+
+		if (!GetConsoleApi()->FillConsoleOutputAttribute(hOut, unAttributes, unLength, Start, &unWritten) || (unWritten != unLength)) {
+			InvalidateCache();
+			return false;
+		}
+
+		return true;
+	}
+
+	// Moves the window rows to the top and blanks everything below them. Expects an up to date cursor position in BufferInfoEx and leaves the new layout there.
+	bool SmartConsoleUtils::DropScrollback(HANDLE hOut, CONSOLE_SCREEN_BUFFER_INFOEX& BufferInfoEx) {
+		const SHORT nBufferRows = BufferInfoEx.dwSize.Y;
+		const SHORT nWindowRows = BufferInfoEx.srWindow.Bottom - BufferInfoEx.srWindow.Top + 1;
+		if (nWindowRows >= nBufferRows) {
+			return true;
+		}
+
+		if (BufferInfoEx.srWindow.Top > 0) {
+			SMALL_RECT Scroll;
+			Scroll.Left = 0;
+			Scroll.Top = BufferInfoEx.srWindow.Top;
+			Scroll.Right = BufferInfoEx.dwSize.X - 1;
+			Scroll.Bottom = BufferInfoEx.srWindow.Bottom;
+
+			COORD ScrollTarget;
+			ScrollTarget.X = 0;
+			ScrollTarget.Y = 0;
+
+			CHAR_INFO Fill;
+			memset(&Fill, 0, sizeof(Fill));
+			Fill.Char.UnicodeChar = L' ';
+			Fill.Attributes = BufferInfoEx.wAttributes;
+
+			CountCall(CONSOLE_CALL::CONSOLE_CALL_FILL);
+
+			if (!GetConsoleApi()->ScrollConsoleScreenBufferW(hOut, &Scroll, nullptr, ScrollTarget, &Fill)) {
+				return false;
+			}
+		}
+
+		CONSOLE_SCREEN_BUFFER_INFOEX BufferInfo = BufferInfoEx;
+		BufferInfo.srWindow.Top = 0;
+		BufferInfo.srWindow.Bottom = nWindowRows - 1;
+		BufferInfo.dwCursorPosition.Y -= BufferInfoEx.srWindow.Top;
+		if (BufferInfo.dwCursorPosition.Y < 0) {
+			BufferInfo.dwCursorPosition.Y = 0;
+		} else if (BufferInfo.dwCursorPosition.Y >= nWindowRows) {
+			BufferInfo.dwCursorPosition.Y = nWindowRows - 1;
+		}
+
+		if (m_bCleanRowsKnown && (m_unCleanAttributes == BufferInfoEx.wAttributes)) {
+			// Clean rows already look blank, so only content rows below the window need it.
+			if (m_nContentRows > nWindowRows) {
+				COORD Start;
+				Start.X = 0;
+				Start.Y = nWindowRows;
+
+				if (!ClearCells(hOut, Start, static_cast<DWORD>(BufferInfoEx.dwSize.X) * static_cast<DWORD>(m_nContentRows - nWindowRows), BufferInfoEx.wAttributes)) {
+					return false;
+				}
+			}
+
+			if (!SetBufferInfo(BufferInfo)) {
+				return false;
+			}
+
+			m_nContentRows = nWindowRows;
+		} else {
+			// Shrinking the buffer to the window drops the rest, growing it back adds blank rows with the current attributes.
+			BufferInfo.dwSize.Y = nWindowRows;
+
+			if (!SetBufferInfo(BufferInfo)) {
+				return false;
+			}
+
+			BufferInfo.dwSize.Y = nBufferRows;
+
+			if (!SetBufferInfo(BufferInfo)) {
+				return false;
+			}
+
+			m_bCleanRowsKnown = true;
+			m_unCleanAttributes = BufferInfo.wAttributes;
+		}
+
+		BufferInfoEx = BufferInfo;
+
+		return true;
+	}
+
+	// One rectangle write, or one sequence stream over the part of Region inside the window when virtual terminal sequences are on.
+	bool SmartConsoleUtils::WriteCells(HANDLE hOut, const CONSOLE_SCREEN_BUFFER_INFOEX& BufferInfoEx, SMALL_RECT Region, const CHAR_INFO* pCells, COORD CellsSize, COORD CellsCoord) {
+		if (!m_bVirtualTerminal) {
+			CountCall(CONSOLE_CALL::CONSOLE_CALL_WRITE);
+
+			// Region was clipped to the cached buffer already, the console clipping it further means the cache is stale.
+			const SMALL_RECT Requested = Region;
+			if (!GetConsoleApi()->WriteConsoleOutputW(hOut, pCells, CellsSize, CellsCoord, &Region) || (Region.Right != Requested.Right) || (Region.Bottom != Requested.Bottom)) {
+				InvalidateCache();
+				return false;
+			}
+
+			UpdateContentRows(Region.Bottom, BufferInfoEx.dwSize.Y);
+
+			return true;
+		}
+
+		// Cursor positions are relative to the window, so rows outside of it can't be reached.
+		SMALL_RECT Visible = Region;
+		if (!IntersectRect(Visible, BufferInfoEx.srWindow)) {
+			return true;
+		}
+
+		m_RectStream.clear();
+
+		// Save cursor and attributes, restored once the cells are written.
+		m_RectStream.push_back(L'\x1B');
+		m_RectStream.push_back(L'7');
+
+		for (SHORT nY = Visible.Top; nY <= Visible.Bottom; ++nY) {
+			char szPosition[32];
+			const int nPosition = sprintf_s(szPosition, sizeof(szPosition), "\x1B[%d;%dH", nY - BufferInfoEx.srWindow.Top + 1, Visible.Left - BufferInfoEx.srWindow.Left + 1);
+			m_RectStream.insert(m_RectStream.end(), szPosition, szPosition + nPosition);
+
+			const CHAR_INFO* pRow = pCells + static_cast<size_t>(CellsCoord.Y + nY - Region.Top) * CellsSize.X + CellsCoord.X + (Visible.Left - Region.Left);
+			WORD unAttributes = 0xFFFF;
+			for (SHORT nX = 0; nX <= Visible.Right - Visible.Left; ++nX) {
+				if (pRow[nX].Attributes != unAttributes) {
+					unAttributes = pRow[nX].Attributes;
+
+					unsigned int unSequenceLength = 0;
+					char const* szSequence = GetColorSequence(COLOR_PAIR(static_cast<COLOR>((unAttributes & 0xF0) >> 4), static_cast<COLOR>(unAttributes & 0x0F)), &unSequenceLength);
+					m_RectStream.insert(m_RectStream.end(), szSequence, szSequence + unSequenceLength);
+				}
+
+				m_RectStream.push_back(pRow[nX].Char.UnicodeChar);
+			}
+		}
+
+		m_RectStream.push_back(L'\x1B');
+		m_RectStream.push_back(L'8');
+
+		InvalidateCache(true);
+
+		CountCall(CONSOLE_CALL::CONSOLE_CALL_WRITE);
+		CountWrittenCharacters(m_RectStream.size());
+
+		DWORD unWritten = 0;
+		if (!GetConsoleApi()->WriteConsoleW(hOut, m_RectStream.data(), static_cast<DWORD>(m_RectStream.size()), &unWritten, nullptr)) {
+			return false;
+		}
+
+		UpdateContentRows(Visible.Bottom, BufferInfoEx.dwSize.Y);
+
+		return true;
+	}
+
+	// Text about to be written takes the place of the progress bars.
+	void SmartConsoleUtils::HideProgress() {
+		if (m_pProgressGroup) {
+			m_pProgressGroup->Hide();
+		}
+	}
+
+	// Content and window scopes expect an up to date cursor position in BufferInfoEx.
+	bool SmartConsoleUtils::FillAttributes(HANDLE hOut, const CONSOLE_SCREEN_BUFFER_INFOEX& BufferInfoEx, WORD unAttributes, COLOR_SCOPE Scope) {
+		SHORT nTop = 0;
+		SHORT nRows = BufferInfoEx.dwSize.Y;
+
+		switch (Scope) {
+			case COLOR_SCOPE::COLOR_SCOPE_CONTENT:
+				nRows = m_nContentRows;
+				break;
+
+			case COLOR_SCOPE::COLOR_SCOPE_WINDOW:
+				nTop = BufferInfoEx.srWindow.Top;
+				nRows = BufferInfoEx.srWindow.Bottom - BufferInfoEx.srWindow.Top + 1;
+				break;
+
+			default:
+				// Clean rows that already hold the attributes don't need another pass.
+				if (m_bCleanRowsKnown && (m_unCleanAttributes == unAttributes)) {
+					nRows = m_nContentRows;
+				}
+				break;
+		}
+
+		if (nRows > 0) {
+			COORD Coord;
+			Coord.X = 0;
+			Coord.Y = nTop;
+			DWORD unWrittenAttributes = 0;
+			CountCall(CONSOLE_CALL::CONSOLE_CALL_FILL);
+
+			const DWORD unLength = static_cast<DWORD>(nRows) * static_cast<DWORD>(BufferInfoEx.dwSize.X);
+			if (!GetConsoleApi()->FillConsoleOutputAttribute(hOut, unAttributes, unLength, Coord, &unWrittenAttributes) || (unWrittenAttributes != unLength)) {
+				InvalidateCache();
+				return false;
+			}
+		}
+
+		if (Scope == COLOR_SCOPE::COLOR_SCOPE_BUFFER) {
+			m_bCleanRowsKnown = true;
+			m_unCleanAttributes = unAttributes;
+		} else if (m_bCleanRowsKnown && (m_unCleanAttributes != unAttributes) && (nTop + nRows > m_nContentRows)) {
+			m_bCleanRowsKnown = false;
+		}
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::SetBufferInfo(CONSOLE_SCREEN_BUFFER_INFOEX BufferInfo) {
+		if (!GetWindow()) {
+			return false;
+		}
+
+		HANDLE hOut = GetOut();
+		if (!hOut) {
+			return false;
+		}
+
+		++BufferInfo.srWindow.Bottom;
+		++BufferInfo.srWindow.Right;
+
+		CountCall(CONSOLE_CALL::CONSOLE_CALL_UPDATE);
+
+		if (!GetConsoleApi()->SetConsoleScreenBufferInfoEx(hOut, &BufferInfo)) {
+			InvalidateCache();
+			return false;
+		}
+
+		--BufferInfo.srWindow.Bottom;
+		--BufferInfo.srWindow.Right;
+
+		std::lock_guard<std::mutex> Lock(m_CacheLock);
+
+		// Rows a resize adds come with whatever attributes the console picks.
+		if (!m_bCacheValid || (m_CachedBufferInfo.dwSize.X != BufferInfo.dwSize.X) || (m_CachedBufferInfo.dwSize.Y != BufferInfo.dwSize.Y)) {
+			m_bCleanRowsKnown = false;
+		}
+
+		UpdateContentRows(BufferInfo.srWindow.Bottom, BufferInfo.dwSize.Y);
+
+		// The console may adjust the window to fit the new buffer size.
+		++m_unCacheGeneration;
+		m_CachedBufferInfo = BufferInfo;
+		m_bCacheValid = true;
+		m_bCachedPositionValid = false;
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::GetAttributes(PWORD pAttributes) {
+		if (!pAttributes) {
+			return false;
+		}
+
+		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+		if (!GetCachedBufferInfo(&csbi)) {
+			return false;
+		}
+
+		*pAttributes = csbi.wAttributes;
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::SetAttributes(WORD unAttributes) {
+		if (!GetWindow()) {
+			return false;
+		}
+
+		HANDLE hOut = GetOut();
+		if (!hOut) {
+			return false;
+		}
+
+		{
+			std::lock_guard<std::mutex> Lock(m_CacheLock);
+
+			if (m_bCacheValid && !m_bExtendedColor && (m_CachedBufferInfo.wAttributes == unAttributes)) {
+				m_unAvoidedCalls.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+
+		// Sequences stay in order with the buffered text, attributes apply to whatever reaches the console next.
+		if (m_bVirtualTerminal) {
+			if (!SmartConsole::WriteA(GetColorSequence(COLOR_PAIR(static_cast<COLOR>((unAttributes & 0xF0) >> 4), static_cast<COLOR>(unAttributes & 0x0F))))) {
+				InvalidateCache();
+				return false;
+			}
+		} else {
+			CountCall(CONSOLE_CALL::CONSOLE_CALL_UPDATE);
+
+			if (!FlushOutput() || !GetConsoleApi()->SetConsoleTextAttribute(hOut, unAttributes)) {
+				InvalidateCache();
+				return false;
+			}
+		}
+
+		std::lock_guard<std::mutex> Lock(m_CacheLock);
+
+		++m_unCacheGeneration;
+		m_CachedBufferInfo.wAttributes = unAttributes;
+		m_bExtendedColor = false;
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::ChangeColorPalette(COLOR Color, unsigned int unRGB) {
+		return ChangeColorPalette(Color, (unRGB >> 16) & 0xFF, (unRGB >> 8) & 0xFF, unRGB & 0xFF);
+	}
+
+	bool SmartConsoleUtils::ChangeColorPalette(COLOR Color, unsigned char unR, unsigned char unG, unsigned char unB) {
+		const unsigned char unIndex = static_cast<unsigned char>(Color);
+		if (unIndex > 15) {
+			return false;
+		}
+
+		PALETTE Palette;
+		memset(&Palette, 0, sizeof(Palette));
+
+		Palette.ColorTable[unIndex] = RGB(unR, unG, unB);
+
+		return SetColorPalette(Palette, static_cast<unsigned short>(1 << unIndex));
+	}
+
+	bool SmartConsoleUtils::GetColorPalette(PPALETTE pPalette) {
+		if (!pPalette) {
+			return false;
+		}
+
+		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+		if (!GetCachedBufferInfo(&csbi)) {
+			return false;
+		}
+
+		memcpy(pPalette->ColorTable, csbi.ColorTable, sizeof(pPalette->ColorTable));
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::SetColorPalette(const PALETTE& Palette, unsigned short unMask) {
+		if (!unMask) {
+			return true;
+		}
+
+		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+		if (!GetCachedBufferInfo(&csbi, true)) {
+			return false;
+		}
+
+		bool bChanged = false;
+		for (unsigned int i = 0; i < 16; ++i) {
+			if ((unMask & (1 << i)) && (csbi.ColorTable[i] != Palette.ColorTable[i])) {
+				csbi.ColorTable[i] = Palette.ColorTable[i];
+				bChanged = true;
+			}
+		}
+
+		// The palette is applied by the console itself, cells keep their attributes.
+		if (!bChanged) {
+			return true;
+		}
+
+		return SetBufferInfo(csbi);
+	}
+
+	static COLORREF MixColor(COLORREF From, COLORREF To, unsigned long long unStep, unsigned long long unSteps) {
+		COLORREF Result = 0;
+		for (unsigned int unShift = 0; unShift < 24; unShift += 8) {
+			const long long nFrom = (From >> unShift) & 0xFF;
+			const long long nTo = (To >> unShift) & 0xFF;
+			Result |= static_cast<COLORREF>(nFrom + (nTo - nFrom) * static_cast<long long>(unStep) / static_cast<long long>(unSteps)) << unShift;
+		}
+
+		return Result;
+	}
+
+	bool SmartConsoleUtils::FadeColorPalette(const PALETTE& Palette, unsigned int unMilliseconds, unsigned int unFramesPerSecond) {
+		if (!unFramesPerSecond) {
+			return false;
+		}
+
+		PALETTE From;
+		if (!GetColorPalette(&From)) {
+			return false;
+		}
+
+		const unsigned long long unDuration = static_cast<unsigned long long>(unMilliseconds) * 1000;
+		unsigned long long unFrames = static_cast<unsigned long long>(unMilliseconds) * unFramesPerSecond / 1000;
+		if (!unFrames) {
+			unFrames = 1;
+		}
+
+		const auto Begin = std::chrono::steady_clock::now();
+
+		unsigned long long unFrame = 0;
+		while (unFrame < unFrames) {
+			++unFrame;
+
+			std::this_thread::sleep_until(Begin + std::chrono::microseconds(unDuration * unFrame / unFrames));
+
+			// Late frames are dropped, only the one due now is shown.
+			const unsigned long long unElapsed = static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - Begin).count());
+			const unsigned long long unDue = (unElapsed >= unDuration) ? unFrames : (unElapsed * unFrames / unDuration);
+			if (unDue > unFrame) {
+				unFrame = unDue;
+			}
+
+			PALETTE Frame;
+			for (unsigned int i = 0; i < 16; ++i) {
+				Frame.ColorTable[i] = MixColor(From.ColorTable[i], Palette.ColorTable[i], unFrame, unFrames);
+			}
+
+			if (!SetColorPalette(Frame)) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::AnimateColorPalette(const PALETTE* pPalettes, size_t unCount, unsigned int unStepMilliseconds, unsigned int unFramesPerSecond) {
+		if (!pPalettes || !unCount) {
+			return false;
+		}
+
+		if (!SetColorPalette(pPalettes[0])) {
+			return false;
+		}
+
+		for (size_t i = 1; i < unCount; ++i) {
+			if (!FadeColorPalette(pPalettes[i], unStepMilliseconds, unFramesPerSecond)) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	COLOR_DEPTH SmartConsoleUtils::GetColorDepth() {
+		if (!m_bVirtualTerminal) {
+			return COLOR_DEPTH::COLOR_DEPTH_16;
+		}
+
+		return m_ColorDepth;
+	}
+
+	bool SmartConsoleUtils::SetColorDepth(COLOR_DEPTH Depth) {
+		if (Depth > COLOR_DEPTH::COLOR_DEPTH_TRUE) {
+			return false;
+		}
+
+		m_ColorDepth = Depth;
+
+		return true;
+	}
+
+	// Colors text written next, like SetAttributes. Colors the output can't show are reduced to the nearest one it has.
+	bool SmartConsoleUtils::SetExtendedColor(const EXTENDED_COLOR_PAIR& ColorPair) {
+		if (!GetWindow()) {
+			return false;
+		}
+
+		HANDLE hOut = GetOut();
+		if (!hOut) {
+			return false;
+		}
+
+		ColorQuantizer* pQuantizer = GetColorQuantizer();
+		if (!pQuantizer) {
+			return false;
+		}
+
+		WORD unCachedAttributes = 0;
+		{
+			std::lock_guard<std::mutex> Lock(m_CacheLock);
+			unCachedAttributes = m_CachedBufferInfo.wAttributes;
+		}
+
+		WORD unAttributes = 0;
+		if (!pQuantizer->Quantize(&ColorPair, &unAttributes, 1, unCachedAttributes)) {
+			return false;
+		}
+
+		const COLOR_DEPTH Depth = GetColorDepth();
+		const bool bForeground = ColorPair.ColorForeground.Kind > EXTENDED_COLOR_KIND::EXTENDED_COLOR_KIND_LEGACY;
+		const bool bBackground = ColorPair.ColorBackground.Kind > EXTENDED_COLOR_KIND::EXTENDED_COLOR_KIND_LEGACY;
+		if ((Depth == COLOR_DEPTH::COLOR_DEPTH_16) || (!bForeground && !bBackground)) {
+			return SetAttributes(unAttributes);
+		}
+
+		EXTENDED_COLOR_PAIR Output = ColorPair;
+		if (Depth == COLOR_DEPTH::COLOR_DEPTH_256) {
+			if (Output.ColorForeground.Kind == EXTENDED_COLOR_KIND::EXTENDED_COLOR_KIND_RGB) {
+				Output.ColorForeground = EXTENDED_COLOR::FromIndex(ColorQuantizer::GetNearestIndex(Output.ColorForeground.Red, Output.ColorForeground.Green, Output.ColorForeground.Blue));
+			}
+
+			if (Output.ColorBackground.Kind == EXTENDED_COLOR_KIND::EXTENDED_COLOR_KIND_RGB) {
+				Output.ColorBackground = EXTENDED_COLOR::FromIndex(ColorQuantizer::GetNearestIndex(Output.ColorBackground.Red, Output.ColorBackground.Green, Output.ColorBackground.Blue));
+			}
+		}
+
+		char szSequence[MAX_EXTENDED_COLOR_SEQUENCE_LENGTH + 1];
+		GetExtendedColorSequence(Output, szSequence);
+
+		if (!SmartConsole::WriteA(szSequence)) {
+			InvalidateCache();
+			return false;
+		}
+
+		std::lock_guard<std::mutex> Lock(m_CacheLock);
+
+		++m_unCacheGeneration;
+		m_CachedBufferInfo.wAttributes = unAttributes;
+		m_bExtendedColor = true;
+
+		return true;
+	}
+
+	// Built against the live palette, and rebuilt only when the palette changes.
+	ColorQuantizer* SmartConsoleUtils::GetColorQuantizer() {
+		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+		if (!GetCachedBufferInfo(&csbi)) {
+			return nullptr;
+		}
+
+		if (!m_ColorQuantizer.Build(csbi.ColorTable)) {
+			return nullptr;
+		}
+
+		return &m_ColorQuantizer;
+	}
+
+	bool SmartConsoleUtils::EnableVirtualTerminal() {
+		if (m_bVirtualTerminal) {
+			return true;
+		}
+
+		if (!GetWindow()) {
+			return false;
+		}
+
+		HANDLE hOut = GetOut();
+		if (!hOut) {
+			return false;
+		}
+
+		// Redirected output has no console mode, sequences are passed through as-is.
+		DWORD unMode = 0;
+		if (GetConsoleApi()->GetConsoleMode(hOut, &unMode)) {
+			if (!GetConsoleApi()->SetConsoleMode(hOut, unMode | ENABLE_VIRTUAL_TERMINAL_PROCESSING)) {
+				return false;
+			}
+
+			m_unOriginalOutputMode = unMode;
+		}
+
+		m_bVirtualTerminal = true;
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::DisableVirtualTerminal() {
+		if (!m_bVirtualTerminal) {
+			return true;
+		}
+
+		m_bVirtualTerminal = false;
+
+		HANDLE hOut = GetOut();
+		if (hOut && m_unOriginalOutputMode) {
+			if (!GetConsoleApi()->SetConsoleMode(hOut, m_unOriginalOutputMode)) {
+				return false;
+			}
+		}
+
+		m_unOriginalOutputMode = 0;
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::IsVirtualTerminal() {
+		return m_bVirtualTerminal;
+	}
+
+	bool SmartConsoleUtils::Flush(bool bClear, bool bUpdateOriginalColorPair, bool bResetPreviousColorPair, COLOR_SCOPE Scope) {
+		if (!GetWindow()) {
+			return false;
+		}
+
+		HANDLE hOut = GetOut();
+		if (!hOut) {
+			return false;
+		}
+
+		FlushOutput();
+
+		if (bClear && !Clear(CLEAR_MODE::CLEAR_MODE_BUFFER)) {
+			return false;
+		}
+
+		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+		if (!GetCachedBufferInfo(&csbi, (Scope != COLOR_SCOPE::COLOR_SCOPE_BUFFER) || m_bCleanRowsKnown, Scope == COLOR_SCOPE::COLOR_SCOPE_WINDOW)) {
+			return false;
+		}
+
+		if (!FillAttributes(hOut, csbi, csbi.wAttributes, Scope)) {
+			return false;
+		}
+
+		if (bUpdateOriginalColorPair) {
+			COLOR_PAIR CurrentColorPair;
+			if (!GetColor(&CurrentColorPair)) {
+				m_OriginalColorPair = CurrentColorPair;
+			}
+		}
+
+		if (bResetPreviousColorPair) {
+			m_PreviousColorPair = COLOR_PAIR();
+		}
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::GetColor(PCOLOR_PAIR pColorPair) {
+		if (!pColorPair) {
+			return false;
+		}
+
+		WORD unAttributes = 0;
+		if (!GetAttributes(&unAttributes)) {
+			return false;
+		}
+
+		*pColorPair = COLOR_PAIR(static_cast<COLOR>((unAttributes & 0xF0) >> 4), static_cast<COLOR>(unAttributes & 0x0F));
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::SetColor(COLOR_PAIR ColorPair, COLOR_SCOPE Scope) {
+		if (!GetWindow()) {
+			return false;
+		}
+
+		HANDLE hOut = GetOut();
+		if (!hOut) {
+			return false;
+		}
+
+		FlushOutput();
+
+		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+		if (!GetCachedBufferInfo(&csbi, (Scope != COLOR_SCOPE::COLOR_SCOPE_BUFFER) || m_bCleanRowsKnown, Scope == COLOR_SCOPE::COLOR_SCOPE_WINDOW)) {
+			return false;
+		}
+
+		WORD unAttributes = csbi.wAttributes;
+
+		COLOR_PAIR CurrentColorPair(static_cast<COLOR>((unAttributes & 0xF0) >> 4), static_cast<COLOR>(unAttributes & 0x0F));
+
+		if (ColorPair.ColorBackground != COLOR::COLOR_UNKNOWN) {
+			unAttributes = static_cast<unsigned char>((static_cast<unsigned char>(ColorPair.ColorBackground) & 0x0F) << 4);
+		} else {
+			unAttributes = static_cast<unsigned char>(CurrentColorPair.ColorBackground);
+		}
+
+		if (ColorPair.ColorForeground != COLOR::COLOR_UNKNOWN) {
+			unAttributes |= static_cast<unsigned char>((static_cast<unsigned char>(ColorPair.ColorForeground) & 0x0F));
+		} else {
+			unAttributes |= static_cast<unsigned char>(CurrentColorPair.ColorForeground);
+		}
+
+		m_PreviousColorPair = CurrentColorPair;
+
+		if (!FillAttributes(hOut, csbi, unAttributes, Scope)) {
+			return false;
+		}
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::RestoreColor(bool bRestorePrevious, COLOR_SCOPE Scope) {
+		if (bRestorePrevious) {
+			return SetColor(m_PreviousColorPair, Scope);
+		}
+		return SetColor(m_OriginalColorPair, Scope);
+	}
+
+	// Region is in buffer coordinates and gets clipped to the buffer. Unknown colors come from the current attributes.
+	bool SmartConsoleUtils::RecolorRegion(SMALL_RECT Region, COLOR_PAIR ColorPair) {
+		if (!GetWindow()) {
+			return false;
+		}
+
+		HANDLE hOut = GetOut();
+		if (!hOut) {
+			return false;
+		}
+
+		FlushOutput();
+
+		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+		if (!GetCachedBufferInfo(&csbi)) {
+			return false;
+		}
+
+		if (!IntersectRect(Region, GetBufferBounds(csbi))) {
+			return false;
+		}
+
+		const WORD unAttributes = MergeAttributes(csbi.wAttributes, ColorPair);
+
+		const DWORD unWidth = static_cast<DWORD>(Region.Right - Region.Left + 1);
+
+		// Full-width rows are contiguous in the buffer, so they take a single fill.
+		if (unWidth == static_cast<DWORD>(csbi.dwSize.X)) {
+			COORD Coord;
+			Coord.X = 0;
+			Coord.Y = Region.Top;
+			DWORD unWrittenAttributes = 0;
+			CountCall(CONSOLE_CALL::CONSOLE_CALL_FILL);
+
+			if (!GetConsoleApi()->FillConsoleOutputAttribute(hOut, unAttributes, unWidth * static_cast<DWORD>(Region.Bottom - Region.Top + 1), Coord, &unWrittenAttributes)) {
+				return false;
+			}
+		} else {
+			for (SHORT nY = Region.Top; nY <= Region.Bottom; ++nY) {
+				COORD Coord;
+				Coord.X = Region.Left;
+				Coord.Y = nY;
+				DWORD unWrittenAttributes = 0;
+				CountCall(CONSOLE_CALL::CONSOLE_CALL_FILL);
+
+				if (!GetConsoleApi()->FillConsoleOutputAttribute(hOut, unAttributes, unWidth, Coord, &unWrittenAttributes)) {
+					return false;
+				}
+			}
+		}
+
+		if (m_bCleanRowsKnown && (Region.Bottom >= m_nContentRows) && (unAttributes != m_unCleanAttributes)) {
+			m_bCleanRowsKnown = false;
+		}
+
+		return true;
+	}
+
+	// Virtual terminal sequences where they exist, otherwise fills over the window. Scrollback and buffer clears only touch
+	// rows that hold content, or swap the buffer size while the attributes of clean rows are unknown.
+	bool SmartConsoleUtils::Clear(CLEAR_MODE Mode) {
+		if (!GetWindow()) {
+			return false;
+		}
+
+		HANDLE hOut = GetOut();
+		if (!hOut) {
+			return false;
+		}
+
+		if (m_bVirtualTerminal && (Mode != CLEAR_MODE::CLEAR_MODE_BUFFER)) {
+			char const* szSequence = nullptr;
+
+			switch (Mode) {
+				case CLEAR_MODE::CLEAR_MODE_WINDOW:
+					szSequence = "\x1B[H\x1B[2J";
+					break;
+
+				case CLEAR_MODE::CLEAR_MODE_TO_END:
+					szSequence = "\x1B[0J";
+					break;
+
+				case CLEAR_MODE::CLEAR_MODE_LINE:
+					szSequence = "\x1B[2K";
+					break;
+
+				case CLEAR_MODE::CLEAR_MODE_SCROLLBACK:
+					szSequence = "\x1B[3J";
+					break;
+
+				default:
+					return false;
+			}
+
+			if (!WriteA(szSequence) || !FlushOutput()) {
+				return false;
+			}
+
+			// Dropping the scrollback moves rows around in ways we can't follow.
+			InvalidateCache(Mode != CLEAR_MODE::CLEAR_MODE_SCROLLBACK);
+
+			return true;
+		}
+
+		FlushOutput();
+
+		// Every mode is placed by the window or the buffer width, either can change without us knowing.
+		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+		if (!GetCachedBufferInfo(&csbi, true, true)) {
+			return false;
+		}
+
+		const DWORD unWidth = static_cast<DWORD>(csbi.dwSize.X);
+		const COORD CursorPosition = csbi.dwCursorPosition;
+
+		COORD Start;
+		Start.X = 0;
+		Start.Y = csbi.srWindow.Top;
+		DWORD unLength = unWidth * static_cast<DWORD>(csbi.srWindow.Bottom - csbi.srWindow.Top + 1);
+
+		switch (Mode) {
+			case CLEAR_MODE::CLEAR_MODE_WINDOW:
+				break;
+
+			case CLEAR_MODE::CLEAR_MODE_TO_END:
+				Start = CursorPosition;
+				unLength = unWidth - static_cast<DWORD>(CursorPosition.X);
+				if (CursorPosition.Y < csbi.srWindow.Bottom) {
+					unLength += unWidth * static_cast<DWORD>(csbi.srWindow.Bottom - CursorPosition.Y);
+				}
+				break;
+
+			case CLEAR_MODE::CLEAR_MODE_LINE:
+				Start.Y = CursorPosition.Y;
+				unLength = unWidth;
+				break;
+
+			case CLEAR_MODE::CLEAR_MODE_SCROLLBACK:
+				return DropScrollback(hOut, csbi);
+
+			case CLEAR_MODE::CLEAR_MODE_BUFFER:
+				if (!DropScrollback(hOut, csbi)) {
+					return false;
+				}
+
+				Start.Y = 0;
+				break;
+
+			default:
+				return false;
+		}
+
+		if (!ClearCells(hOut, Start, unLength, csbi.wAttributes)) {
+			return false;
+		}
+
+		if ((Mode == CLEAR_MODE::CLEAR_MODE_WINDOW) || (Mode == CLEAR_MODE::CLEAR_MODE_BUFFER)) {
+			if (!SetCursorPosition(Start)) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::GetCursorInfo(PCONSOLE_CURSOR_INFO pCursorInfo) {
+		if (!pCursorInfo) {
+			return false;
+		}
+
+		if (!GetWindow()) {
+			return false;
+		}
+
+		HANDLE hOut = GetOut();
+		if (!hOut) {
+			return false;
+		}
+
+		memset(pCursorInfo, 0, sizeof(CONSOLE_CURSOR_INFO));
+
+		CountCall(CONSOLE_CALL::CONSOLE_CALL_QUERY);
+
+		if (!GetConsoleApi()->GetConsoleCursorInfo(hOut, pCursorInfo)) {
+			return false;
+		}
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::SetCursorInfo(CONSOLE_CURSOR_INFO CursorInfo) {
+		if (!GetWindow()) {
+			return false;
+		}
+
+		HANDLE hOut = GetOut();
+		if (!hOut) {
+			return false;
+		}
+
+		CountCall(CONSOLE_CALL::CONSOLE_CALL_UPDATE);
+
+		if (!GetConsoleApi()->SetConsoleCursorInfo(hOut, &CursorInfo)) {
+			return false;
+		}
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::GetCursorPosition(PCOORD pCursorPosition) {
+		if (!pCursorPosition) {
+			return false;
+		}
+
+		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+		if (!GetCachedBufferInfo(&csbi, true)) {
+			return false;
+		}
+
+		pCursorPosition->X = csbi.dwCursorPosition.X;
+		pCursorPosition->Y = csbi.dwCursorPosition.Y;
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::SetCursorPosition(COORD CursorPosition) {
+		if (!GetWindow()) {
+			return false;
+		}
+
+		HANDLE hOut = GetOut();
+		if (!hOut) {
+			return false;
+		}
+
+		FlushOutput();
+
+		CountCall(CONSOLE_CALL::CONSOLE_CALL_UPDATE);
+
+		if (!GetConsoleApi()->SetConsoleCursorPosition(hOut, CursorPosition)) {
+			InvalidateCache(true);
+			return false;
+		}
+
+		std::lock_guard<std::mutex> Lock(m_CacheLock);
+
+		++m_unCacheGeneration;
+		m_CachedBufferInfo.dwCursorPosition = CursorPosition;
+
+		UpdateContentRows(CursorPosition.Y, m_CachedBufferInfo.dwSize.Y);
+
+		// Moving the cursor out of the window scrolls it.
+		const SMALL_RECT& Window = m_CachedBufferInfo.srWindow;
+		if ((CursorPosition.X < Window.Left) || (CursorPosition.X > Window.Right) || (CursorPosition.Y < Window.Top) || (CursorPosition.Y > Window.Bottom)) {
+			m_bCachedPositionValid = false;
+		}
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::ShowCursor() {
+		CONSOLE_CURSOR_INFO cci;
+		if (!GetCursorInfo(&cci)) {
+			return false;
+		}
+
+		cci.bVisible = TRUE;
+
+		if (!SetCursorInfo(cci)) {
+			return false;
+		}
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::HideCursor() {
+		CONSOLE_CURSOR_INFO cci;
+		if (!GetCursorInfo(&cci)) {
+			return false;
+		}
+
+		cci.bVisible = FALSE;
+
+		if (!SetCursorInfo(cci)) {
+			return false;
+		}
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::ToggleCursor() {
+		CONSOLE_CURSOR_INFO cci;
+		if (!GetCursorInfo(&cci)) {
+			return false;
+		}
+
+		cci.bVisible = !static_cast<bool>(cci.bVisible & 1);
+
+		if (!SetCursorInfo(cci)) {
+			return false;
+		}
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::GetCursorColor(PCOLOR_PAIR pColorPair) {
+		if (!pColorPair) {
+			return false;
+		}
+
+		WORD unAttributes = 0;
+		if (!GetAttributes(&unAttributes)) {
+			return false;
+		}
+
+		*pColorPair = COLOR_PAIR(static_cast<COLOR>((unAttributes & 0xF0) >> 4), static_cast<COLOR>(unAttributes & 0x0F));
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::SetCursorColor(COLOR_PAIR ColorPair) {
+		WORD unAttributes = 0;
+		if (!GetAttributes(&unAttributes)) {
+			return false;
+		}
+
+		COLOR_PAIR CurrentColorPair(static_cast<COLOR>((unAttributes & 0xF0) >> 4), static_cast<COLOR>(unAttributes & 0x0F));
+
+		if (ColorPair.ColorBackground != COLOR::COLOR_UNKNOWN) {
+			unAttributes = static_cast<unsigned char>((static_cast<unsigned char>(ColorPair.ColorBackground) & 0x0F) << 4);
+		} else {
+			unAttributes = static_cast<unsigned char>(CurrentColorPair.ColorBackground);
+		}
+
+		if (ColorPair.ColorForeground != COLOR::COLOR_UNKNOWN) {
+			unAttributes |= static_cast<unsigned char>((static_cast<unsigned char>(ColorPair.ColorForeground) & 0x0F));
+		} else {
+			unAttributes |= static_cast<unsigned char>(CurrentColorPair.ColorForeground);
+		}
+
+		m_PreviousCursorColorPair = CurrentColorPair;
+
+		if (!SetAttributes(unAttributes)) {
+			return false;
+		}
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::RestoreCursorColor(bool bRestorePrevious) {
+		if (bRestorePrevious) {
+			return SetCursorColor(m_PreviousCursorColorPair);
+		}
+		return SetCursorColor(m_OriginalCursorColorPair);
+	}
+
+	bool SmartConsoleUtils::Erase(COORD CursorPosition, unsigned int unLength) {
+		if (!GetWindow()) {
+			return false;
+		}
+
+		HANDLE hOut = GetOut();
+		if (!hOut) {
+			return false;
+		}
+
+		FlushOutput();
+		CountCall(CONSOLE_CALL::CONSOLE_CALL_FILL);
+
+		DWORD unWrittenAttributes = 0;
+		if (!GetConsoleApi()->FillConsoleOutputCharacterW(hOut, L' ', unLength, CursorPosition, &unWrittenAttributes)) {
+			return false;
+		}
+
+		WORD unAttributes = 0;
+		if (!GetAttributes(&unAttributes)) {
+			return false;
+		}
+
+		CountCall(CONSOLE_CALL::CONSOLE_CALL_FILL);
+
+		unWrittenAttributes = 0;
+		if (!GetConsoleApi()->FillConsoleOutputAttribute(hOut, unAttributes, unLength, CursorPosition, &unWrittenAttributes)) {
+			return false;
+		}
+
+		return true;
+	}
+
+	// Region is in buffer coordinates and gets clipped to the buffer. Unknown colors come from the current attributes.
+	bool SmartConsoleUtils::FillRect(SMALL_RECT Region, wchar_t unChar, COLOR_PAIR ColorPair) {
+		if (!GetWindow()) {
+			return false;
+		}
+
+		HANDLE hOut = GetOut();
+		if (!hOut) {
+			return false;
+		}
+
+		FlushOutput();
+
+		// Sequences address rows relative to the window.
+		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+		if (!GetCachedBufferInfo(&csbi, m_bVirtualTerminal, m_bVirtualTerminal)) {
+			return false;
+		}
+
+		if (!IntersectRect(Region, GetBufferBounds(csbi))) {
+			return false;
+		}
+
+		CHAR_INFO Cell;
+		Cell.Char.UnicodeChar = unChar;
+		Cell.Attributes = MergeAttributes(csbi.wAttributes, ColorPair);
+
+		COORD CellsSize;
+		CellsSize.X = Region.Right - Region.Left + 1;
+		CellsSize.Y = Region.Bottom - Region.Top + 1;
+
+		m_RectCells.assign(static_cast<size_t>(CellsSize.X) * CellsSize.Y, Cell);
+
+		COORD CellsCoord;
+		CellsCoord.X = 0;
+		CellsCoord.Y = 0;
+
+		return WriteCells(hOut, csbi, Region, m_RectCells.data(), CellsSize, CellsCoord);
+	}
+
+	bool SmartConsoleUtils::EraseRect(SMALL_RECT Region) {
+		return FillRect(Region, L' ');
+	}
+
+	// pCells holds the whole region row by row, the part outside the buffer is skipped.
+	bool SmartConsoleUtils::BlitCells(SMALL_RECT Region, const CHAR_INFO* pCells) {
+		if (!pCells || (Region.Left > Region.Right) || (Region.Top > Region.Bottom)) {
+			return false;
+		}
+
+		if (!GetWindow()) {
+			return false;
+		}
+
+		HANDLE hOut = GetOut();
+		if (!hOut) {
+			return false;
+		}
+
+		FlushOutput();
+
+		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+		if (!GetCachedBufferInfo(&csbi, m_bVirtualTerminal, m_bVirtualTerminal)) {
+			return false;
+		}
+
+		SMALL_RECT Clipped = Region;
+		if (!IntersectRect(Clipped, GetBufferBounds(csbi))) {
+			return false;
+		}
+
+		COORD CellsSize;
+		CellsSize.X = Region.Right - Region.Left + 1;
+		CellsSize.Y = Region.Bottom - Region.Top + 1;
+
+		COORD CellsCoord;
+		CellsCoord.X = Clipped.Left - Region.Left;
+		CellsCoord.Y = Clipped.Top - Region.Top;
+
+		return WriteCells(hOut, csbi, Clipped, pCells, CellsSize, CellsCoord);
+	}
+
+	// pCells receives the whole region row by row, the part outside the buffer is left as it is.
+	bool SmartConsoleUtils::ReadCells(SMALL_RECT Region, PCHAR_INFO pCells) {
+		if (!pCells || (Region.Left > Region.Right) || (Region.Top > Region.Bottom)) {
+			return false;
+		}
+
+		if (!GetWindow()) {
+			return false;
+		}
+
+		HANDLE hOut = GetOut();
+		if (!hOut) {
+			return false;
+		}
+
+		FlushOutput();
+
+		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+		if (!GetCachedBufferInfo(&csbi)) {
+			return false;
+		}
+
+		SMALL_RECT Clipped = Region;
+		if (!IntersectRect(Clipped, GetBufferBounds(csbi))) {
+			return false;
+		}
+
+		COORD CellsSize;
+		CellsSize.X = Region.Right - Region.Left + 1;
+		CellsSize.Y = Region.Bottom - Region.Top + 1;
+
+		COORD CellsCoord;
+		CellsCoord.X = Clipped.Left - Region.Left;
+		CellsCoord.Y = Clipped.Top - Region.Top;
+
+		CountCall(CONSOLE_CALL::CONSOLE_CALL_READ);
+
+		if (!GetConsoleApi()->ReadConsoleOutputW(hOut, pCells, CellsSize, CellsCoord, &Clipped)) {
+			return false;
+		}
+
+		return true;
+	}
+
+	ScreenBuffer* SmartConsoleUtils::GetScreenBuffer() {
+		if (!m_pScreenBuffer) {
+			m_pScreenBuffer.reset(new ScreenBuffer(this));
+		}
+
+		return m_pScreenBuffer.get();
+	}
+
+	// Read() goes through the line editor, which keeps its history while it is off.
+	bool SmartConsoleUtils::EnableLineEditor() {
+		if (!GetWindow() || !GetIn()) {
+			return false;
+		}
+
+		GetLineEditor();
+
+		m_bLineEditor = true;
+
+		return true;
+	}
+
+	bool SmartConsoleUtils::DisableLineEditor() {
+		m_bLineEditor = false;
+
+		return true;
+	}
+
+	LineEditor* SmartConsoleUtils::GetLineEditor() {
+		if (!m_pLineEditor) {
+			m_pLineEditor.reset(new LineEditor(this));
+		}
+
+		return m_pLineEditor.get();
+	}
+
+	bool SmartConsoleUtils::EnableAsync(unsigned int unRecords, ASYNC_POLICY Policy) {
+		if (m_pActiveSink.load()) {
+			return true;
+		}
+
+		if (!GetWindow() || !GetOut()) {
+			return false;
+		}
+
+		if (!m_pAsyncSink) {
+			m_pAsyncSink.reset(new AsyncSink(this));
+		}
+
+		if (!m_pAsyncSink->Start(unRecords, Policy)) {
+			return false;
+		}
+
+		m_pActiveSink = m_pAsyncSink.get();
+
+		return true;
+	}
+
+	// Threads still printing are fine. Their pushes either finish before Stop() returns or are written synchronously.
+	bool SmartConsoleUtils::DisableAsync() {
+		if (!m_pActiveSink.load()) {
+			return true;
+		}
+
+		m_pActiveSink = nullptr;
+
+		return m_pAsyncSink->Stop();
+	}
+
+	AsyncSink* SmartConsoleUtils::GetAsyncSink() {
+		return m_pActiveSink.load();
+	}
+
+	bool SmartConsoleUtils::EnableProgress(unsigned int unFramesPerSecond, unsigned int unBars) {
+		if (m_pProgressGroup) {
+			return true;
+		}
+
+		if (!GetWindow() || !GetOut()) {
+			return false;
+		}
+
+		std::unique_ptr<ProgressGroup> pGroup(new ProgressGroup(this));
+		if (!pGroup->Start(unFramesPerSecond, unBars)) {
+			return false;
+		}
+
+		m_pProgressGroup = std::move(pGroup);
+
+		return true;
+	}
+
+	// Other threads must be done with the bars and with writing. The bars are left on screen with the output continuing below them.
+	bool SmartConsoleUtils::DisableProgress() {
+		if (!m_pProgressGroup) {
+			return true;
+		}
+
+		const bool bResult = m_pProgressGroup->Stop();
+		m_pProgressGroup.reset();
+
+		return bResult;
+	}
+
+	ProgressGroup* SmartConsoleUtils::GetProgressGroup() {
+		return m_pProgressGroup.get();
+	}
+
+	std::mutex& SmartConsoleUtils::GetOutputLock() {
+		return m_OutputLock;
+	}
+
+	// ----------------------------------------------------------------
+	// PaletteTransaction
+	// ----------------------------------------------------------------
+
+	PaletteTransaction::PaletteTransaction(SmartConsoleUtils* pConsole) {
+		m_pConsole = pConsole;
+		memset(&m_Palette, 0, sizeof(m_Palette));
+		m_unStaged = 0;
+	}
+
+	PaletteTransaction::~PaletteTransaction() {
+		m_pConsole = nullptr;
+		m_unStaged = 0;
+	}
+
+	bool PaletteTransaction::Set(COLOR Color, unsigned int unRGB) {
+		return Set(Color, (unRGB >> 16) & 0xFF, (unRGB >> 8) & 0xFF, unRGB & 0xFF);
+	}
+
+	bool PaletteTransaction::Set(COLOR Color, unsigned char unR, unsigned char unG, unsigned char unB) {
+		const unsigned char unIndex = static_cast<unsigned char>(Color);
+		if (unIndex > 15) {
+			return false;
+		}
+
+		m_Palette.ColorTable[unIndex] = RGB(unR, unG, unB);
+		m_unStaged |= static_cast<unsigned short>(1 << unIndex);
+
+		return true;
+	}
+
+	bool PaletteTransaction::Set(const PALETTE& Palette) {
+		m_Palette = Palette;
+		m_unStaged = 0xFFFF;
+
+		return true;
+	}
+
+	bool PaletteTransaction::LoadA(char const* const szFile) {
+		if (!szFile) {
+			return false;
+		}
+
+		FILE* pFile = nullptr;
+		if (fopen_s(&pFile, szFile, "r") || !pFile) {
+			return false;
+		}
+
+		const bool bResult = LoadFile(pFile);
+
+		fclose(pFile);
+
+		return bResult;
+	}
+
+	bool PaletteTransaction::LoadW(wchar_t const* const szFile) {
+		if (!szFile) {
+			return false;
+		}
+
+		FILE* pFile = nullptr;
+		if (_wfopen_s(&pFile, szFile, L"r") || !pFile) {
+			return false;
+		}
+
+		const bool bResult = LoadFile(pFile);
+
+		fclose(pFile);
+
+		return bResult;
+	}
+
+#ifdef UNICODE
+	bool PaletteTransaction::Load(wchar_t const* const szFile) {
+		return LoadW(szFile);
+	}
+#else
+	bool PaletteTransaction::Load(char const* const szFile) {
+		return LoadA(szFile);
+	}
+#endif
+
+	static std::string_view TrimThemeText(std::string_view Text) {
+		while (!Text.empty() && ((Text.front() == ' ') || (Text.front() == '\t') || (Text.front() == '\r'))) {
+			Text.remove_prefix(1);
+		}
+
+		while (!Text.empty() && ((Text.back() == ' ') || (Text.back() == '\t') || (Text.back() == '\r'))) {
+			Text.remove_suffix(1);
+		}
+
+		return Text;
+	}
+
+	bool PaletteTransaction::Parse(char const* const szTheme) {
+		if (!szTheme) {
+			return false;
+		}
+
+		// Staged only if every line is valid.
+		PALETTE Palette = m_Palette;
+		unsigned short unStaged = m_unStaged;
+
+		std::string_view Theme(szTheme);
+		while (!Theme.empty()) {
+			const size_t unEnd = Theme.find('\n');
+			std::string_view Line = TrimThemeText(Theme.substr(0, unEnd));
+			Theme.remove_prefix((unEnd == std::string_view::npos) ? Theme.size() : (unEnd + 1));
+
+			if (Line.empty() || (Line.front() == ';')) {
+				continue;
+			}
+
+			const size_t unSplit = Line.find('=');
+			if (unSplit == std::string_view::npos) {
+				return false;
+			}
+
+			const std::string_view Name = TrimThemeText(Line.substr(0, unSplit));
+			std::string_view Value = TrimThemeText(Line.substr(unSplit + 1));
+
+			unsigned int unIndex = 0;
+			const auto NameResult = std::from_chars(Name.data(), Name.data() + Name.size(), unIndex);
+			if ((NameResult.ec != std::errc()) || (NameResult.ptr != Name.data() + Name.size())) {
+				COLOR Color = COLOR::COLOR_UNKNOWN;
+				if (!GetMarkupColor(Name.data(), Name.size(), &Color)) {
+					return false;
+				}
+
+				unIndex = static_cast<unsigned char>(Color);
+			}
+
+			if (unIndex > 15) {
+				return false;
+			}
+
+			if (!Value.empty() && (Value.front() == '#')) {
+				Value.remove_prefix(1);
+			}
+
+			unsigned int unRGB = 0;
+			const auto ValueResult = std::from_chars(Value.data(), Value.data() + Value.size(), unRGB, 16);
+			if ((Value.size() != 6) || (ValueResult.ec != std::errc()) || (ValueResult.ptr != Value.data() + Value.size())) {
+				return false;
+			}
+
+			Palette.ColorTable[unIndex] = RGB((unRGB >> 16) & 0xFF, (unRGB >> 8) & 0xFF, unRGB & 0xFF);
+			unStaged |= static_cast<unsigned short>(1 << unIndex);
+		}
+
+		m_Palette = Palette;
+		m_unStaged = unStaged;
+
+		return true;
+	}
+
+	void PaletteTransaction::Discard() {
+		m_unStaged = 0;
+	}
+
+	unsigned short PaletteTransaction::GetStaged() {
+		return m_unStaged;
+	}
+
+	bool PaletteTransaction::Commit() {
+		if (!m_pConsole) {
+			return false;
+		}
+
+		if (!m_unStaged) {
+			return true;
+		}
+
+		if (!m_pConsole->SetColorPalette(m_Palette, m_unStaged)) {
+			return false;
+		}
+
+		m_unStaged = 0;
+
+		return true;
+	}
+
+	bool PaletteTransaction::LoadFile(FILE* pFile) {
+		std::string Text;
+
+		char Chunk[512];
+		size_t unRead = 0;
+		while ((unRead = fread(Chunk, 1, sizeof(Chunk), pFile)) > 0) {
+			Text.append(Chunk, unRead);
+		}
+
+		if (ferror(pFile)) {
+			return false;
+		}
+
+		return Parse(Text.c_str());
+	}
+
+	// ----------------------------------------------------------------
+	// Console context
+	// ----------------------------------------------------------------
+
+	static std::mutex g_ConsoleLock;
+	static std::unique_ptr<SmartConsoleUtils> g_pDefaultConsole;
+	// Replaced defaults. Other threads may still be printing through them.
+	static std::vector<std::unique_ptr<SmartConsoleUtils>> g_RetiredConsoles;
+	static std::atomic<SmartConsoleUtils*> g_pCachedDefaultConsole(nullptr);
+	static std::atomic<SmartConsoleUtils*> g_pBoundConsole(nullptr);
+	// Console references, counted in the slot of the epoch they started in. Waiting drains both slots in turn, so new references can't hold it up.
+	static std::mutex g_ConsoleEpochLock;
+	static std::atomic<unsigned int> g_unConsoleEpoch(0);
+	static std::atomic<unsigned int> g_unConsoleReferences[2];
+	static thread_local unsigned int g_unThreadConsoleReferences[2] = {};
+
+	SmartConsoleUtils* GetConsole() {
+		SmartConsoleUtils* pConsole = g_pBoundConsole.load();
+		if (pConsole) {
+			return pConsole;
+		}
+
+		// Without a window the default only has to be replaced once one appears.
+		pConsole = g_pCachedDefaultConsole.load(std::memory_order_acquire);
+		if (pConsole && (pConsole->GetWindow() || !GetConsoleApi()->GetConsoleWindow())) {
+			return pConsole;
+		}
+
+		std::lock_guard<std::mutex> Lock(g_ConsoleLock);
+
+		// The console may have been allocated after the default context was created.
+		if (!g_pDefaultConsole || (!g_pDefaultConsole->GetWindow() && GetConsoleApi()->GetConsoleWindow())) {
+			if (g_pDefaultConsole) {
+				g_RetiredConsoles.push_back(std::move(g_pDefaultConsole));
+			}
+
+			g_pDefaultConsole.reset(new SmartConsoleUtils());
+
+			// Printing doesn't need the window styles, so the window keeps its own rather than ours for the rest of the process.
+			g_pDefaultConsole->RestoreWindowStyle();
+
+			g_pCachedDefaultConsole.store(g_pDefaultConsole.get(), std::memory_order_release);
+		}
+
+		return g_pDefaultConsole.get();
+	}
+
+	// Pairs with ConsoleReference, either we see its count or it sees the new binding. References of this thread are skipped.
+	static void WaitConsoleReferences() {
+		std::lock_guard<std::mutex> Lock(g_ConsoleEpochLock);
+
+		for (unsigned int i = 0; i < 2; ++i) {
+			const unsigned int unSlot = g_unConsoleEpoch.fetch_add(1) & 1;
+			while (g_unConsoleReferences[unSlot].load() > g_unThreadConsoleReferences[unSlot]) {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	bool BindConsole(SmartConsoleUtils* pConsole) {
+		if (!pConsole) {
+			return false;
+		}
+
+		SmartConsoleUtils* pPrevious = g_pBoundConsole.exchange(pConsole);
+		if (pPrevious && (pPrevious != pConsole)) {
+			WaitConsoleReferences();
+		}
+
+		return true;
+	}
+
+	bool UnbindConsole(SmartConsoleUtils* pConsole) {
+		if (!pConsole) {
+			if (!g_pBoundConsole.exchange(nullptr)) {
+				return false;
+			}
+		} else if (!g_pBoundConsole.compare_exchange_strong(pConsole, nullptr)) {
+			return false;
+		}
+
+		WaitConsoleReferences();
+
+		return true;
+	}
+
+	// ----------------------------------------------------------------
+	// ConsoleReference
+	// ----------------------------------------------------------------
+
+	ConsoleReference::ConsoleReference() {
+		m_unSlot = g_unConsoleEpoch.load() & 1;
+		g_unConsoleReferences[m_unSlot].fetch_add(1);
+		++g_unThreadConsoleReferences[m_unSlot];
+
+		m_pConsole = GetConsole();
+	}
+
+	ConsoleReference::~ConsoleReference() {
+		--g_unThreadConsoleReferences[m_unSlot];
+		g_unConsoleReferences[m_unSlot].fetch_sub(1, std::memory_order_release);
+	}
+
+	SmartConsoleUtils* ConsoleReference::Get() {
+		return m_pConsole;
+	}
+
+	// ----------------------------------------------------------------
+	// SpanWriter
+	// ----------------------------------------------------------------
+
+	// Control characters move the cursor and wide characters take two cells, so such text can't be colored by a linear attribute run.
+	// Line breaks are the exception, the run skips the rest of their row.
+	static bool IsSimpleText(wchar_t const* const szText, size_t unLength) {
+		for (size_t i = 0; i < unLength; ++i) {
+			const wchar_t unChar = szText[i];
+			if (!(((unChar >= 0x20) && (unChar < 0x7F)) || ((unChar >= 0xA0) && (unChar < 0x1100)) || (unChar == L'\n'))) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	SpanWriter::SpanWriter() {
+		m_unLength = 0;
+		m_unCodePage = 0;
+		m_bSimple = true;
+	}
+
+	SpanWriter::~SpanWriter() {
+	}
+
+	void SpanWriter::Reserve(unsigned int unLength, unsigned int unSpans) {
+		m_Text.reserve(unLength + unSpans);
+		m_Spans.reserve(unSpans);
+		m_Stream.reserve(unLength + unSpans * 12 + 13);
+		m_Attributes.reserve(unLength);
+	}
+
+	void SpanWriter::Clear() {
+		m_Text.clear();
+		m_Spans.clear();
+		m_unLength = 0;
+		m_unCodePage = 0;
+		m_bSimple = true;
+	}
+
+	unsigned int SpanWriter::GetLength() {
+		return m_unLength;
+	}
+
+	unsigned int SpanWriter::GetSpans() {
+		return static_cast<unsigned int>(m_Spans.size());
+	}
+
+	bool SpanWriter::AddA(COLOR_PAIR ColorPair, char const* const szText) {
+		if (!szText) {
+			return false;
+		}
+
+		return AddA(ColorPair, szText, static_cast<unsigned int>(strlen(szText)));
+	}
+
+	bool SpanWriter::AddA(COLOR_PAIR ColorPair, char const* const szText, unsigned int unLength) {
+		if (!szText) {
+			return false;
+		}
+
+		const int nLength = static_cast<int>(unLength);
+		if (!nLength) {
+			return true;
+		}
+
+		// Narrow text reaches the console in its output code page.
+		if (!m_unCodePage) {
+			m_unCodePage = GetConsoleApi()->GetConsoleOutputCP();
+		}
+
+		const int nWideLength = MultiByteToWideChar(m_unCodePage, 0, szText, nLength, nullptr, 0);
+		if (nWideLength <= 0) {
+			return false;
+		}
+
+		const size_t unOffset = m_Text.size();
+		m_Text.resize(unOffset + nWideLength + 1);
+
+		if (MultiByteToWideChar(m_unCodePage, 0, szText, nLength, m_Text.data() + unOffset, nWideLength) != nWideLength) {
+			m_Text.resize(unOffset);
+			return false;
+		}
+
+		m_Text[unOffset + nWideLength] = 0;
+
+		if (m_bSimple) {
+			m_bSimple = IsSimpleText(m_Text.data() + unOffset, nWideLength);
+		}
+
+		SPAN Span;
+		Span.ColorPair = ColorPair;
+		Span.unOffset = static_cast<unsigned int>(unOffset);
+		Span.unLength = static_cast<unsigned int>(nWideLength);
+		m_Spans.push_back(Span);
+
+		m_unLength += Span.unLength;
+
+		return true;
+	}
+
+	bool SpanWriter::AddW(COLOR_PAIR ColorPair, wchar_t const* const szText) {
+		if (!szText) {
+			return false;
+		}
+
+		return AddW(ColorPair, szText, static_cast<unsigned int>(wcslen(szText)));
+	}
+
+	bool SpanWriter::AddW(COLOR_PAIR ColorPair, wchar_t const* const szText, unsigned int unLength) {
+		if (!szText) {
+			return false;
+		}
+
+		if (!unLength) {
+			return true;
+		}
+
+		const size_t unOffset = m_Text.size();
+		m_Text.insert(m_Text.end(), szText, szText + unLength);
+		m_Text.push_back(0);
+
+		if (m_bSimple) {
+			m_bSimple = IsSimpleText(szText, unLength);
+		}
+
+		SPAN Span;
+		Span.ColorPair = ColorPair;
+		Span.unOffset = static_cast<unsigned int>(unOffset);
+		Span.unLength = static_cast<unsigned int>(unLength);
+		m_Spans.push_back(Span);
+
+		m_unLength += Span.unLength;
+
+		return true;
+	}
+
+#ifdef UNICODE
+	bool SpanWriter::Add(COLOR_PAIR ColorPair, wchar_t const* const szText) {
+		return AddW(ColorPair, szText);
+	}
+
+	bool SpanWriter::Add(COLOR_PAIR ColorPair, wchar_t const* const szText, unsigned int unLength) {
+		return AddW(ColorPair, szText, unLength);
+	}
+#else
+	bool SpanWriter::Add(COLOR_PAIR ColorPair, char const* const szText) {
+		return AddA(ColorPair, szText);
+	}
+
+	bool SpanWriter::Add(COLOR_PAIR ColorPair, char const* const szText, unsigned int unLength) {
+		return AddA(ColorPair, szText, unLength);
+	}
+#endif
+
+	bool SpanWriter::Commit(SmartConsoleUtils* pConsole, PASYNC_TICKET pTicket) {
+		std::optional<ConsoleReference> Reference;
+		if (!pConsole) {
+			pConsole = Reference.emplace().Get();
+		}
+
+		if (pTicket) {
+			pTicket->unRecords = 0;
+			pTicket->unSpans = 0;
+		}
+
+		if (m_Spans.empty()) {
+			return true;
+		}
+
+		AsyncSink* pSink = pConsole->GetAsyncSink();
+		if (pSink && !pSink->IsWriterThread()) {
+			const bool bResult = CommitAsync(pSink, pTicket);
+			Clear();
+			return bResult;
+		}
+
+		if (!pConsole->GetWindow() || !pConsole->GetOut()) {
+			return false;
+		}
+
+		bool bResult = false;
+
+		{
+			std::lock_guard<std::mutex> Lock(pConsole->GetOutputLock());
+
+			// The text takes the place of the progress bars.
+			ProgressGroup* pProgress = pConsole->GetProgressGroup();
+			if (pProgress) {
+				pProgress->Hide();
+			}
+
+			// Keep the order with anything still sitting in the output buffer.
+			pConsole->FlushOutput();
+
+			if (pConsole->IsVirtualTerminal()) {
+				bResult = CommitVirtualTerminal(pConsole);
+			} else {
+				bResult = CommitAttributes(pConsole);
+			}
+		}
+
+		Clear();
+
+		return bResult;
+	}
+
+	bool SpanWriter::CommitVirtualTerminal(SmartConsoleUtils* pConsole) {
+		m_Stream.clear();
+
+		// Unknown colors take the console's, like they do with attributes, instead of whatever the previous span left.
+		WORD unAttributes = 0;
+		const bool bAttributes = pConsole->GetAttributes(&unAttributes);
+
+		for (const SPAN& Span : m_Spans) {
+			COLOR_PAIR ColorPair = Span.ColorPair;
+			if (bAttributes) {
+				const WORD unSpanAttributes = MakeAttributes(ColorPair, unAttributes);
+				ColorPair = COLOR_PAIR(static_cast<COLOR>((unSpanAttributes & 0xF0) >> 4), static_cast<COLOR>(unSpanAttributes & 0x0F));
+			}
+
+			unsigned int unSequenceLength = 0;
+			char const* szSequence = GetColorSequence(ColorPair, &unSequenceLength);
+			m_Stream.insert(m_Stream.end(), szSequence, szSequence + unSequenceLength);
+
+			wchar_t const* szText = m_Text.data() + Span.unOffset;
+			m_Stream.insert(m_Stream.end(), szText, szText + Span.unLength);
+		}
+
+		if (bAttributes) {
+			unsigned int unSequenceLength = 0;
+			char const* szSequence = GetColorSequence(COLOR_PAIR(static_cast<COLOR>((unAttributes & 0xF0) >> 4), static_cast<COLOR>(unAttributes & 0x0F)), &unSequenceLength);
+			m_Stream.insert(m_Stream.end(), szSequence, szSequence + unSequenceLength);
+		} else {
+			static const char szReset[] = "\x1B[0m";
+			m_Stream.insert(m_Stream.end(), szReset, szReset + sizeof(szReset) - 1);
+		}
+
+		return WriteStream(pConsole);
+	}
+
+	bool SpanWriter::CommitAttributes(SmartConsoleUtils* pConsole) {
+		if (!m_bSimple) {
+			return CommitSpans(pConsole);
+		}
+
+		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+		if (!pConsole->GetBufferInfo(&csbi)) {
+			return CommitSpans(pConsole);
+		}
+
+		const unsigned long long unWidth = static_cast<unsigned long long>(csbi.dwSize.X);
+		const unsigned long long unStart = csbi.dwCursorPosition.Y * unWidth + csbi.dwCursorPosition.X;
+		const unsigned long long unEnd = csbi.dwSize.Y * unWidth;
+
+		const WORD unCurrentAttributes = csbi.wAttributes;
+
+		m_Stream.clear();
+		m_Attributes.clear();
+
+		for (const SPAN& Span : m_Spans) {
+			const WORD unAttributes = MakeAttributes(Span.ColorPair, unCurrentAttributes);
+
+			wchar_t const* szText = m_Text.data() + Span.unOffset;
+			m_Stream.insert(m_Stream.end(), szText, szText + Span.unLength);
+
+			// Cells a line break skips take the current attributes, like the rows output scrolls in.
+			for (unsigned int i = 0; i < Span.unLength; ++i) {
+				if (szText[i] == L'\n') {
+					m_Attributes.insert(m_Attributes.end(), static_cast<size_t>(unWidth - (unStart + m_Attributes.size()) % unWidth), unCurrentAttributes);
+				} else {
+					m_Attributes.push_back(unAttributes);
+				}
+			}
+		}
+
+		if (!WriteStream(pConsole)) {
+			return false;
+		}
+
+		// Text that runs past the last row scrolls the buffer, and the run moves up with it. Cells that left the top are dropped.
+		const unsigned long long unCursor = unStart + m_Attributes.size();
+
+		unsigned long long unScrolled = 0;
+		if (unCursor >= unEnd) {
+			CONSOLE_SCREEN_BUFFER_INFOEX After;
+			if (!pConsole->GetBufferInfo(&After)) {
+				return false;
+			}
+
+			const unsigned long long unRow = unCursor / unWidth;
+			if (unRow > static_cast<unsigned long long>(After.dwCursorPosition.Y)) {
+				unScrolled = (unRow - After.dwCursorPosition.Y) * unWidth;
+			}
+		}
+
+		const size_t unSkip = (unScrolled > unStart) ? static_cast<size_t>(unScrolled - unStart) : 0;
+		if (unSkip >= m_Attributes.size()) {
+			return true;
+		}
+
+		const unsigned long long unFirst = unStart + unSkip - unScrolled;
+
+		COORD First;
+		First.X = static_cast<SHORT>(unFirst % unWidth);
+		First.Y = static_cast<SHORT>(unFirst / unWidth);
+
+		DWORD unWrittenAttributes = 0;
+		pConsole->CountCall(CONSOLE_CALL::CONSOLE_CALL_WRITE);
+
+		if (!GetConsoleApi()->WriteConsoleOutputAttribute(pConsole->GetOut(), m_Attributes.data() + unSkip, static_cast<DWORD>(m_Attributes.size() - unSkip), First, &unWrittenAttributes)) {
+			return false;
+		}
+
+		return true;
+	}
+
+	bool SpanWriter::CommitSpans(SmartConsoleUtils* pConsole) {
+		WORD unAttributes = 0;
+		const bool bRestore = pConsole->GetAttributes(&unAttributes);
+
+		bool bResult = true;
+		for (const SPAN& Span : m_Spans) {
+			if (!pConsole->SetCursorColor(Span.ColorPair) || !pConsole->WriteW(m_Text.data() + Span.unOffset)) {
+				bResult = false;
+				break;
+			}
+		}
+
+		if (bRestore && !pConsole->SetAttributes(unAttributes)) {
+			return false;
+		}
+
+		return bResult;
+	}
+
+	bool SpanWriter::CommitAsync(AsyncSink* pSink, PASYNC_TICKET pTicket) {
+		m_AsyncSpans.clear();
+
+		for (const SPAN& Span : m_Spans) {
+			ASYNC_SPAN AsyncSpan;
+			AsyncSpan.ColorPair = Span.ColorPair;
+			AsyncSpan.pText = m_Text.data() + Span.unOffset;
+			AsyncSpan.unSize = static_cast<size_t>(Span.unLength) * sizeof(wchar_t);
+			AsyncSpan.bWide = true;
+			m_AsyncSpans.push_back(AsyncSpan);
+		}
+
+		return pSink->Push(m_AsyncSpans.data(), static_cast<unsigned int>(m_AsyncSpans.size()), pTicket);
+	}
+
+	bool SpanWriter::WriteStream(SmartConsoleUtils* pConsole) {
+		pConsole->InvalidateCache(true);
+
+		pConsole->CountCall(CONSOLE_CALL::CONSOLE_CALL_WRITE);
+		pConsole->CountWrittenCharacters(m_Stream.size());
+
+		DWORD unWritten = 0;
+		if (GetConsoleApi()->WriteConsoleW(pConsole->GetOut(), m_Stream.data(), static_cast<DWORD>(m_Stream.size()), &unWritten, nullptr)) {
+			return true;
+		}
+
+		// Not a console, go through the CRT.
+		m_Stream.push_back(0);
+
+		return pConsole->WriteW(m_Stream.data());
+	}
+
+	// ----------------------------------------------------------------
+	// AsyncSink
+	// ----------------------------------------------------------------
+
+	AsyncSink::AsyncSink(SmartConsoleUtils* pConsole) {
+		m_pConsole = pConsole;
+		m_Policy = ASYNC_POLICY::ASYNC_POLICY_BLOCK;
+		m_pRecords = nullptr;
+		m_unCapacity = 0;
+		m_unMask = 0;
+		m_unEnqueue = 0;
+		m_unDequeue = 0;
+		m_unRecordBase = 0;
+		m_unCompleted = 0;
+		m_unOverflowSubmitted = 0;
+		m_unOverflowCompleted = 0;
+		m_unDropped = 0;
+		m_unSignal = 0;
+		m_bSleeping = false;
+		m_unProducers = 0;
+		m_bStopping = true;
+		m_bExit = false;
+		m_bOverflow = false;
+	}
+
+	AsyncSink::~AsyncSink() {
+		Stop();
+	}
+
+	bool AsyncSink::Start(unsigned int unRecords, ASYNC_POLICY Policy) {
+		if (!m_pConsole || m_Thread.joinable()) {
+			return false;
+		}
+
+		size_t unCapacity = 2;
+		while (unCapacity < unRecords) {
+			unCapacity <<= 1;
+		}
+
+		m_pRecords.reset(new RECORD[unCapacity]);
+		for (size_t i = 0; i < unCapacity; ++i) {
+			m_pRecords[i].Sequence.store(i, std::memory_order_relaxed);
+		}
+
+		m_Policy = Policy;
+		m_unCapacity = unCapacity;
+		m_unMask = unCapacity - 1;
+		// The last run drained everything, so position 0 of this one follows its last record.
+		m_unRecordBase = m_unCompleted.load();
+		m_unEnqueue = 0;
+		m_unDequeue = 0;
+		m_unDropped = 0;
+		m_bSleeping = false;
+		m_bExit = false;
+		m_bOverflow = false;
+		m_Overflow.clear();
+		m_Staging.clear();
+		m_Writer.Clear();
+
+		m_Thread = std::thread(&AsyncSink::Run, this);
+
+		// Producers only touch the ring after seeing this.
+		m_bStopping = false;
+
+		return true;
+	}
+
+	// Drains everything queued so far. The ring stays until the last producer inside a push is done with it.
+	bool AsyncSink::Stop() {
+		if (!m_Thread.joinable() || IsWriterThread()) {
+			return false;
+		}
+
+		m_bStopping = true;
+
+		// Blocked producers still get through, the writer keeps draining until they are gone.
+		unsigned int unProducers = m_unProducers.load();
+		while (unProducers) {
+			m_unProducers.wait(unProducers);
+			unProducers = m_unProducers.load();
+		}
+
+		m_bExit = true;
+
+		m_unSignal.fetch_add(1);
+		m_unSignal.notify_one();
+
+		m_Thread.join();
+		m_WriterThreadId = std::thread::id();
+
+		m_pRecords.reset();
+		m_unCapacity = 0;
+		m_unMask = 0;
+
+		m_Overflow.clear();
+		m_OverflowBatch.clear();
+
+		return true;
+	}
+
+	bool AsyncSink::Flush() {
+		if (IsWriterThread() || !Enter()) {
+			return false;
+		}
+
+		// Records claimed but still being filled are waited for too, the writer drains in claim order.
+		ASYNC_TICKET Target;
+		Target.unRecords = m_unRecordBase + m_unEnqueue.load();
+		Target.unSpans = m_unOverflowSubmitted.load();
+
+		m_unSignal.fetch_add(1);
+		m_unSignal.notify_one();
+
+		WaitWritten(Target);
+
+		Leave();
+
+		return true;
+	}
+
+	bool AsyncSink::IsRunning() {
+		return !m_bStopping.load();
+	}
+
+	// A stopped sink has written everything, what it completed is then as far as any ticket goes.
+	ASYNC_TICKET AsyncSink::GetTicket() {
+		ASYNC_TICKET Ticket;
+
+		if (!Enter()) {
+			Ticket.unRecords = m_unCompleted.load();
+			Ticket.unSpans = m_unOverflowCompleted.load();
+			return Ticket;
+		}
+
+		Ticket.unRecords = m_unRecordBase + m_unEnqueue.load();
+		Ticket.unSpans = m_unOverflowSubmitted.load();
+
+		Leave();
+
+		return Ticket;
+	}
+
+	bool AsyncSink::IsWritten(const ASYNC_TICKET& Ticket) {
+		return (m_unCompleted.load() >= Ticket.unRecords) && (m_unOverflowCompleted.load() >= Ticket.unSpans);
+	}
+
+	// A sink that stops drains first, so every ticket handed out gets written.
+	bool AsyncSink::WaitWritten(const ASYNC_TICKET& Ticket) {
+		if (IsWriterThread()) {
+			return false;
+		}
+
+		unsigned long long unCompleted = m_unCompleted.load();
+		while (unCompleted < Ticket.unRecords) {
+			m_unCompleted.wait(unCompleted);
+			unCompleted = m_unCompleted.load();
+		}
+
+		unCompleted = m_unOverflowCompleted.load();
+		while (unCompleted < Ticket.unSpans) {
+			m_unOverflowCompleted.wait(unCompleted);
+			unCompleted = m_unOverflowCompleted.load();
+		}
+
+		return true;
+	}
+
+	bool AsyncSink::IsWriterThread() {
+		return m_WriterThreadId.load(std::memory_order_relaxed) == std::this_thread::get_id();
+	}
+
+	bool AsyncSink::PushA(COLOR_PAIR ColorPair, char const* const szText, unsigned int unLength, PASYNC_TICKET pTicket) {
+		ASYNC_SPAN Span;
+		Span.ColorPair = ColorPair;
+		Span.pText = szText;
+		Span.unSize = unLength;
+		Span.bWide = false;
+		return Push(&Span, 1, pTicket);
+	}
+
+	bool AsyncSink::PushW(COLOR_PAIR ColorPair, wchar_t const* const szText, unsigned int unLength, PASYNC_TICKET pTicket) {
+		ASYNC_SPAN Span;
+		Span.ColorPair = ColorPair;
+		Span.pText = szText;
+		Span.unSize = static_cast<size_t>(unLength) * sizeof(wchar_t);
+		Span.bWide = true;
+		return Push(&Span, 1, pTicket);
+	}
+
+	// All spans of one push land next to each other, so a message is never interleaved with other threads.
+	bool AsyncSink::Push(const ASYNC_SPAN* pSpans, unsigned int unSpans, PASYNC_TICKET pTicket) {
+		if (!pSpans) {
+			return false;
+		}
+
+		if (pTicket) {
+			pTicket->unRecords = 0;
+			pTicket->unSpans = 0;
+		}
+
+		size_t unRecords = 0;
+		for (unsigned int i = 0; i < unSpans; ++i) {
+			if (!pSpans[i].pText) {
+				return false;
+			}
+
+			unRecords += (pSpans[i].unSize + RecordData - 1) / RecordData;
+		}
+
+		if (!unRecords) {
+			return true;
+		}
+
+		if (!Enter()) {
+			return PushDirect(pSpans, unSpans);
+		}
+
+		bool bResult = false;
+
+		// Once something went to the overflow queue everything follows it there until the writer caught up.
+		if (m_bOverflow.load()) {
+			bResult = EnqueueOverflow(pSpans, unSpans, pTicket);
+		} else if (unRecords <= m_unCapacity) {
+			bResult = PushRecords(pSpans, unSpans, unRecords, pTicket);
+		} else if (m_Policy == ASYNC_POLICY::ASYNC_POLICY_BLOCK) {
+			bResult = PushStream(pSpans, unSpans, pTicket);
+		} else if (m_Policy == ASYNC_POLICY::ASYNC_POLICY_GROW) {
+			bResult = EnqueueOverflow(pSpans, unSpans, pTicket);
+		} else {
+			m_unDropped.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		Leave();
+
+		return bResult;
+	}
+
+	unsigned long long AsyncSink::GetDropped() {
+		return m_unDropped.load(std::memory_order_relaxed);
+	}
+
+	// Pairs with Stop(), either it sees us inside or we see it stopping and stay out of the ring.
+	bool AsyncSink::Enter() {
+		m_unProducers.fetch_add(1);
+
+		if (m_bStopping.load()) {
+			Leave();
+			return false;
+		}
+
+		return true;
+	}
+
+	void AsyncSink::Leave() {
+		if (m_unProducers.fetch_sub(1) == 1) {
+			m_unProducers.notify_all();
+		}
+	}
+
+	bool AsyncSink::PushRecords(const ASYNC_SPAN* pSpans, unsigned int unSpans, size_t unRecords, PASYNC_TICKET pTicket) {
+		for (;;) {
+			const unsigned long long unCompleted = m_unCompleted.load();
+
+			if (Enqueue(pSpans, unSpans, unRecords, pTicket)) {
+				Wake();
+				return true;
+			}
+
+			if (m_Policy == ASYNC_POLICY::ASYNC_POLICY_DROP) {
+				m_unDropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+
+			if (m_Policy == ASYNC_POLICY::ASYNC_POLICY_GROW) {
+				return EnqueueOverflow(pSpans, unSpans, pTicket);
+			}
+
+			Wake();
+			m_unCompleted.wait(unCompleted);
+		}
+	}
+
+	// Cuts spans into pieces of at most a full ring. Pieces don't end inside a surrogate pair or a UTF-8 sequence.
+	bool AsyncSink::PushStream(const ASYNC_SPAN* pSpans, unsigned int unSpans, PASYNC_TICKET pTicket) {
+		const size_t unLimit = m_unCapacity * RecordData;
+
+		for (unsigned int i = 0; i < unSpans; ++i) {
+			char const* pData = static_cast<char const*>(pSpans[i].pText);
+			size_t unLeft = pSpans[i].unSize;
+
+			while (unLeft) {
+				size_t unSize = (unLeft > unLimit) ? unLimit : unLeft;
+				if (unSize < unLeft) {
+					if (pSpans[i].bWide) {
+						const wchar_t chLast = *reinterpret_cast<wchar_t const*>(pData + unSize - sizeof(wchar_t));
+						if ((chLast >= 0xD800) && (chLast <= 0xDBFF)) {
+							unSize -= sizeof(wchar_t);
+						}
+					} else {
+						size_t unCut = unSize;
+						while ((unCut > unSize - 3) && ((static_cast<unsigned char>(pData[unCut]) & 0xC0) == 0x80)) {
+							--unCut;
+						}
+
+						if ((static_cast<unsigned char>(pData[unCut]) & 0xC0) != 0x80) {
+							unSize = unCut;
+						}
+					}
+				}
+
+				ASYNC_SPAN Piece = pSpans[i];
+				Piece.pText = pData;
+				Piece.unSize = unSize;
+
+				// Pieces go out in order, the last one's ticket covers them all.
+				if (!PushRecords(&Piece, 1, (unSize + RecordData - 1) / RecordData, pTicket)) {
+					return false;
+				}
+
+				pData += unSize;
+				unLeft -= unSize;
+			}
+		}
+
+		return true;
+	}
+
+	// Used once the sink stopped. The console has no running sink then, so the commit goes straight out.
+	bool AsyncSink::PushDirect(const ASYNC_SPAN* pSpans, unsigned int unSpans) {
+		SpanWriter Writer;
+
+		for (unsigned int i = 0; i < unSpans; ++i) {
+			if (pSpans[i].bWide) {
+				Writer.AddW(pSpans[i].ColorPair, static_cast<wchar_t const*>(pSpans[i].pText), static_cast<unsigned int>(pSpans[i].unSize / sizeof(wchar_t)));
+			} else {
+				Writer.AddA(pSpans[i].ColorPair, static_cast<char const*>(pSpans[i].pText), static_cast<unsigned int>(pSpans[i].unSize));
+			}
+		}
+
+		return Writer.Commit(m_pConsole);
+	}
+
+	bool AsyncSink::Enqueue(const ASYNC_SPAN* pSpans, unsigned int unSpans, size_t unRecords, PASYNC_TICKET pTicket) {
+		// The writer frees records in order, so the last record of the claim being free means all of them are.
+		size_t unPosition = m_unEnqueue.load(std::memory_order_relaxed);
+		for (;;) {
+			const size_t unLast = unPosition + unRecords - 1;
+			const size_t unSequence = m_pRecords[unLast & m_unMask].Sequence.load(std::memory_order_acquire);
+			const intptr_t nDifference = static_cast<intptr_t>(unSequence - unLast);
+
+			if (!nDifference) {
+				if (m_unEnqueue.compare_exchange_weak(unPosition, unPosition + unRecords, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (nDifference < 0) {
+				return false;
+			} else {
+				unPosition = m_unEnqueue.load(std::memory_order_relaxed);
+			}
+		}
+
+		size_t unIndex = unPosition;
+		for (unsigned int i = 0; i < unSpans; ++i) {
+			char const* pData = static_cast<char const*>(pSpans[i].pText);
+			size_t unLeft = pSpans[i].unSize;
+
+			while (unLeft) {
+				const size_t unSize = (unLeft > RecordData) ? RecordData : unLeft;
+
+				RECORD& Record = m_pRecords[unIndex & m_unMask];
+				Record.ColorPair = pSpans[i].ColorPair;
+				Record.Flags = (pSpans[i].bWide ? RecordWide : 0) | ((unLeft > unSize) ? RecordContinued : 0);
+				Record.unSize = static_cast<unsigned short>(unSize);
+				memcpy(Record.Data, pData, unSize);
+
+				pData += unSize;
+				unLeft -= unSize;
+				++unIndex;
+			}
+		}
+
+		// Publish back to front so the writer only ever sees complete messages.
+		for (size_t i = unRecords; i-- > 0;) {
+			m_pRecords[(unPosition + i) & m_unMask].Sequence.store(unPosition + i + 1, std::memory_order_release);
+		}
+
+		if (pTicket) {
+			pTicket->unRecords = m_unRecordBase + unPosition + unRecords;
+		}
+
+		return true;
+	}
+
+	bool AsyncSink::EnqueueOverflow(const ASYNC_SPAN* pSpans, unsigned int unSpans, PASYNC_TICKET pTicket) {
+		{
+			std::lock_guard<std::mutex> Lock(m_OverflowLock);
+
+			for (unsigned int i = 0; i < unSpans; ++i) {
+				if (!pSpans[i].unSize) {
+					continue;
+				}
+
+				OVERFLOW_SPAN Span;
+				Span.ColorPair = pSpans[i].ColorPair;
+				Span.bWide = pSpans[i].bWide;
+				Span.Data.assign(static_cast<char const*>(pSpans[i].pText), static_cast<char const*>(pSpans[i].pText) + pSpans[i].unSize);
+				m_Overflow.push_back(std::move(Span));
+
+				const unsigned long long unSubmitted = m_unOverflowSubmitted.fetch_add(1) + 1;
+				if (pTicket) {
+					pTicket->unSpans = unSubmitted;
+				}
+			}
+
+			m_bOverflow = true;
+		}
+
+		Wake();
+
+		return true;
+	}
+
+	void AsyncSink::Wake() {
+		// Pairs with the fence in Run(), either the writer sees the new record or we see it going to sleep.
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (m_bSleeping.load(std::memory_order_relaxed)) {
+			m_unSignal.fetch_add(1);
+			m_unSignal.notify_one();
+		}
+	}
+
+	void AsyncSink::Run() {
+		m_WriterThreadId = std::this_thread::get_id();
+
+		for (;;) {
+			unsigned int unDone = Drain();
+			if (unDone) {
+				m_unCompleted.fetch_add(unDone);
+				m_unCompleted.notify_all();
+				continue;
+			}
+
+			unDone = DrainOverflow();
+			if (unDone) {
+				m_unOverflowCompleted.fetch_add(unDone);
+				m_unOverflowCompleted.notify_all();
+				continue;
+			}
+
+			if (m_bExit.load()) {
+				// A producer may still be filling the records it claimed.
+				if (m_unEnqueue.load() == m_unDequeue) {
+					break;
+				}
+
+				std::this_thread::yield();
+				continue;
+			}
+
+			const unsigned int unSignal = m_unSignal.load();
+
+			m_bSleeping.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			if (IsEmpty()) {
+				m_unSignal.wait(unSignal);
+			}
+
+			m_bSleeping.store(false, std::memory_order_relaxed);
+		}
+	}
+
+	bool AsyncSink::IsEmpty() {
+		if (m_bOverflow.load(std::memory_order_relaxed)) {
+			return false;
+		}
+
+		return m_pRecords[m_unDequeue & m_unMask].Sequence.load(std::memory_order_acquire) != (m_unDequeue + 1);
+	}
+
+	unsigned int AsyncSink::Drain() {
+		unsigned int unRecords = 0;
+
+		while (unRecords < m_unCapacity) {
+			RECORD& Record = m_pRecords[m_unDequeue & m_unMask];
+			if (Record.Sequence.load(std::memory_order_acquire) != (m_unDequeue + 1)) {
+				break;
+			}
+
+			const COLOR_PAIR ColorPair = Record.ColorPair;
+			const unsigned char unFlags = Record.Flags;
+			m_Staging.insert(m_Staging.end(), Record.Data, Record.Data + Record.unSize);
+
+			Record.Sequence.store(m_unDequeue + m_unCapacity, std::memory_order_release);
+			++m_unDequeue;
+			++unRecords;
+
+			if (!(unFlags & RecordContinued)) {
+				AddText(ColorPair, (unFlags & RecordWide) != 0, m_Staging.data(), m_Staging.size());
+				m_Staging.clear();
+			}
+		}
+
+		if (unRecords) {
+			m_Writer.Commit(m_pConsole);
+		}
+
+		return unRecords;
+	}
+
+	unsigned int AsyncSink::DrainOverflow() {
+		m_OverflowBatch.clear();
+
+		{
+			std::lock_guard<std::mutex> Lock(m_OverflowLock);
+
+			// Records published before the overflow was appended to have to go out first.
+			if (m_pRecords[m_unDequeue & m_unMask].Sequence.load(std::memory_order_acquire) == (m_unDequeue + 1)) {
+				return 0;
+			}
+
+			if (m_Overflow.empty()) {
+				m_bOverflow = false;
+				return 0;
+			}
+
+			m_OverflowBatch.swap(m_Overflow);
+		}
+
+		for (const OVERFLOW_SPAN& Span : m_OverflowBatch) {
+			AddText(Span.ColorPair, Span.bWide, Span.Data.data(), Span.Data.size());
+		}
+
+		m_Writer.Commit(m_pConsole);
+
+		return static_cast<unsigned int>(m_OverflowBatch.size());
+	}
+
+	bool AsyncSink::AddText(COLOR_PAIR ColorPair, bool bWide, char const* pData, size_t unSize) {
+		if (bWide) {
+			// Staged text lives in heap blocks, which are aligned for wchar_t.
+			return m_Writer.AddW(ColorPair, reinterpret_cast<wchar_t const*>(pData), static_cast<unsigned int>(unSize / sizeof(wchar_t)));
+		}
+
+		return m_Writer.AddA(ColorPair, pData, static_cast<unsigned int>(unSize));
+	}
+
+	// ----------------------------------------------------------------
+	// ScreenBuffer
+	// ----------------------------------------------------------------
+
+	static bool IsSameCell(const CHAR_INFO& A, const CHAR_INFO& B) {
+		return (A.Char.UnicodeChar == B.Char.UnicodeChar) && (A.Attributes == B.Attributes);
+	}
+
+	ScreenBuffer::ScreenBuffer(SmartConsoleUtils* pConsole) {
+		m_pConsole = pConsole;
+		m_Size.X = 0;
+		m_Size.Y = 0;
+		m_Origin.X = 0;
+		m_Origin.Y = 0;
+		m_bInvalid = true;
+		m_unPresentedCells = 0;
+		m_unPresentedRows = 0;
+		m_unPresentedBytes = 0;
+	}
+
+	ScreenBuffer::~ScreenBuffer() {
+	}
+
+	bool ScreenBuffer::Update() {
+		if (!m_pConsole) {
+			return false;
+		}
+
+		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+		if (!m_pConsole->GetBufferInfo(&csbi)) {
+			return false;
+		}
+
+		COORD Size;
+		Size.X = csbi.srWindow.Right - csbi.srWindow.Left + 1;
+		Size.Y = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+
+		if ((m_Origin.X != csbi.srWindow.Left) || (m_Origin.Y != csbi.srWindow.Top)) {
+			m_Origin.X = csbi.srWindow.Left;
+			m_Origin.Y = csbi.srWindow.Top;
+			m_bInvalid = true;
+		}
+
+		if ((Size.X != m_Size.X) || (Size.Y != m_Size.Y)) {
+			return Resize(Size);
+		}
+
+		return true;
+	}
+
+	bool ScreenBuffer::Resize(COORD Size) {
+		if ((Size.X <= 0) || (Size.Y <= 0)) {
+			return false;
+		}
+
+		CHAR_INFO Blank;
+		memset(&Blank, 0, sizeof(Blank));
+		Blank.Char.UnicodeChar = L' ';
+		Blank.Attributes = GetDefaultAttributes();
+
+		const size_t unCells = static_cast<size_t>(Size.X) * Size.Y;
+
+		// Keep whatever still fits, the rest of the new area is blank.
+		std::vector<CHAR_INFO> Back(unCells, Blank);
+		for (SHORT Y = 0; (Y < Size.Y) && (Y < m_Size.Y); ++Y) {
+			for (SHORT X = 0; (X < Size.X) && (X < m_Size.X); ++X) {
+				Back[static_cast<size_t>(Y) * Size.X + X] = m_Back[static_cast<size_t>(Y) * m_Size.X + X];
+			}
+		}
+
+		m_Back.swap(Back);
+		m_Front.assign(unCells, Blank);
+		m_DirtyRows.assign(Size.Y, DIRTY_ROW());
+		m_Size = Size;
+		m_bInvalid = true;
+
+		return true;
+	}
+
+	COORD ScreenBuffer::GetSize() {
+		return m_Size;
+	}
+
+	PCHAR_INFO ScreenBuffer::GetCells() {
+		if (m_Back.empty()) {
+			return nullptr;
+		}
+
+		return m_Back.data();
+	}
+
+	void ScreenBuffer::Clear(COLOR_PAIR ColorPair) {
+		CHAR_INFO Blank;
+		memset(&Blank, 0, sizeof(Blank));
+		Blank.Char.UnicodeChar = L' ';
+		Blank.Attributes = MakeAttributes(ColorPair, GetDefaultAttributes());
+
+		std::fill(m_Back.begin(), m_Back.end(), Blank);
+	}
+
+	void ScreenBuffer::Invalidate() {
+		m_bInvalid = true;
+	}
+
+	bool ScreenBuffer::GetCell(COORD Position, PCHAR_INFO pCell) {
+		if (!pCell) {
+			return false;
+		}
+
+		if ((Position.X < 0) || (Position.Y < 0) || (Position.X >= m_Size.X) || (Position.Y >= m_Size.Y)) {
+			return false;
+		}
+
+		*pCell = m_Back[static_cast<size_t>(Position.Y) * m_Size.X + Position.X];
+
+		return true;
+	}
+
+	bool ScreenBuffer::SetCell(COORD Position, wchar_t unChar, COLOR_PAIR ColorPair) {
+		if ((Position.X < 0) || (Position.Y < 0) || (Position.X >= m_Size.X) || (Position.Y >= m_Size.Y)) {
+			return false;
+		}
+
+		CHAR_INFO& Cell = m_Back[static_cast<size_t>(Position.Y) * m_Size.X + Position.X];
+		Cell.Char.UnicodeChar = unChar;
+		Cell.Attributes = MakeAttributes(ColorPair, Cell.Attributes);
+
+		return true;
+	}
+
+	unsigned int ScreenBuffer::WriteA(COORD Position, COLOR_PAIR ColorPair, char const* const szText) {
+		if (!szText) {
+			return 0;
+		}
+
+		const int nLength = static_cast<int>(strlen(szText));
+		if (!nLength) {
+			return 0;
+		}
+
+		const UINT unCodePage = GetConsoleApi()->GetConsoleOutputCP();
+
+		const int nWideLength = MultiByteToWideChar(unCodePage, 0, szText, nLength, nullptr, 0);
+		if (nWideLength <= 0) {
+			return 0;
+		}
+
+		m_Stream.resize(static_cast<size_t>(nWideLength) + 1);
+		if (MultiByteToWideChar(unCodePage, 0, szText, nLength, m_Stream.data(), nWideLength) != nWideLength) {
+			return 0;
+		}
+
+		m_Stream[nWideLength] = 0;
+
+		return WriteW(Position, ColorPair, m_Stream.data());
+	}
+
+	unsigned int ScreenBuffer::WriteW(COORD Position, COLOR_PAIR ColorPair, wchar_t const* const szText) {
+		if (!szText) {
+			return 0;
+		}
+
+		if ((Position.Y < 0) || (Position.Y >= m_Size.Y)) {
+			return 0;
+		}
+
+		// Clipped against the grid, no wrapping.
+		unsigned int unWritten = 0;
+		for (size_t i = 0; szText[i] && (Position.X < m_Size.X); ++i, ++Position.X) {
+			if (Position.X < 0) {
+				continue;
+			}
+
+			CHAR_INFO& Cell = m_Back[static_cast<size_t>(Position.Y) * m_Size.X + Position.X];
+			Cell.Char.UnicodeChar = szText[i];
+			Cell.Attributes = MakeAttributes(ColorPair, Cell.Attributes);
+
+			++unWritten;
+		}
+
+		return unWritten;
+	}
+
+#ifdef UNICODE
+	unsigned int ScreenBuffer::Write(COORD Position, COLOR_PAIR ColorPair, wchar_t const* const szText) {
+		return WriteW(Position, ColorPair, szText);
+	}
+#else
+	unsigned int ScreenBuffer::Write(COORD Position, COLOR_PAIR ColorPair, char const* const szText) {
+		return WriteA(Position, ColorPair, szText);
+	}
+#endif
+
+	bool ScreenBuffer::Present() {
+		if (!m_pConsole || !m_pConsole->GetWindow() || !m_pConsole->GetOut()) {
+			return false;
+		}
+
+		if (!Diff()) {
+			return true;
+		}
+
+		bool bResult = false;
+
+		{
+			std::lock_guard<std::mutex> Lock(m_pConsole->GetOutputLock());
+
+			m_pConsole->FlushOutput();
+
+			if (m_pConsole->IsVirtualTerminal()) {
+				bResult = PresentVirtualTerminal();
+			} else {
+				bResult = PresentAttributes();
+			}
+		}
+
+		if (!bResult) {
+			// The console state is unknown now.
+			m_bInvalid = true;
+			return false;
+		}
+
+		Swap();
+
+		return true;
+	}
+
+	bool ScreenBuffer::Present(PCHAR_INFO pTarget) {
+		if (!pTarget) {
+			return false;
+		}
+
+		if (!Diff()) {
+			return true;
+		}
+
+		for (SHORT Y = 0; Y < m_Size.Y; ++Y) {
+			const DIRTY_ROW& Row = m_DirtyRows[Y];
+			if (Row.Left > Row.Right) {
+				continue;
+			}
+
+			const size_t unOffset = static_cast<size_t>(Y) * m_Size.X + Row.Left;
+			memcpy(pTarget + unOffset, m_Back.data() + unOffset, sizeof(CHAR_INFO) * (Row.Right - Row.Left + 1));
+		}
+
+		m_unPresentedBytes = m_unPresentedCells * sizeof(CHAR_INFO);
+
+		Swap();
+
+		return true;
+	}
+
+	unsigned int ScreenBuffer::GetPresentedCells() {
+		return m_unPresentedCells;
+	}
+
+	unsigned int ScreenBuffer::GetPresentedRows() {
+		return m_unPresentedRows;
+	}
+
+	unsigned int ScreenBuffer::GetPresentedBytes() {
+		return m_unPresentedBytes;
+	}
+
+	bool ScreenBuffer::Diff() {
+		m_unPresentedCells = 0;
+		m_unPresentedRows = 0;
+		m_unPresentedBytes = 0;
+
+		for (SHORT Y = 0; Y < m_Size.Y; ++Y) {
+			DIRTY_ROW& Row = m_DirtyRows[Y];
+			Row.Left = m_Size.X;
+			Row.Right = -1;
+
+			const CHAR_INFO* pFront = m_Front.data() + static_cast<size_t>(Y) * m_Size.X;
+			const CHAR_INFO* pBack = m_Back.data() + static_cast<size_t>(Y) * m_Size.X;
+
+			if (m_bInvalid) {
+				Row.Left = 0;
+				Row.Right = m_Size.X - 1;
+			} else {
+				SHORT X = 0;
+				while ((X < m_Size.X) && IsSameCell(pFront[X], pBack[X])) {
+					++X;
+				}
+
+				if (X == m_Size.X) {
+					continue;
+				}
+
+				Row.Left = X;
+
+				X = m_Size.X - 1;
+				while (IsSameCell(pFront[X], pBack[X])) {
+					--X;
+				}
+
+				Row.Right = X;
+			}
+
+			m_unPresentedCells += Row.Right - Row.Left + 1;
+			++m_unPresentedRows;
+		}
+
+		return m_unPresentedRows != 0;
+	}
+
+	bool ScreenBuffer::PresentAttributes() {
+		HANDLE hOut = m_pConsole->GetOut();
+
+		// Consecutive dirty rows go out as one rectangle spanning their columns.
+		for (SHORT Y = 0; Y < m_Size.Y; ++Y) {
+			if (m_DirtyRows[Y].Left > m_DirtyRows[Y].Right) {
+				continue;
+			}
+
+			SHORT Top = Y;
+			SHORT Left = m_DirtyRows[Y].Left;
+			SHORT Right = m_DirtyRows[Y].Right;
+
+			while (((Y + 1) < m_Size.Y) && (m_DirtyRows[Y + 1].Left <= m_DirtyRows[Y + 1].Right)) {
+				++Y;
+				if (m_DirtyRows[Y].Left < Left) {
+					Left = m_DirtyRows[Y].Left;
+				}
+				if (m_DirtyRows[Y].Right > Right) {
+					Right = m_DirtyRows[Y].Right;
+				}
+			}
+
+			COORD BufferCoord;
+			BufferCoord.X = Left;
+			BufferCoord.Y = Top;
+
+			SMALL_RECT Region;
+			Region.Left = m_Origin.X + Left;
+			Region.Top = m_Origin.Y + Top;
+			Region.Right = m_Origin.X + Right;
+			Region.Bottom = m_Origin.Y + Y;
+
+			m_pConsole->CountCall(CONSOLE_CALL::CONSOLE_CALL_WRITE);
+
+			// Clipped by the console means the buffer shrank since Update().
+			const SMALL_RECT Requested = Region;
+			if (!GetConsoleApi()->WriteConsoleOutputW(hOut, m_Back.data(), m_Size, BufferCoord, &Region) || (Region.Right != Requested.Right) || (Region.Bottom != Requested.Bottom)) {
+				m_pConsole->InvalidateCache();
+				return false;
+			}
+
+			m_unPresentedBytes += static_cast<unsigned int>((Right - Left + 1) * (Y - Top + 1) * sizeof(CHAR_INFO));
+		}
+
+		return true;
+	}
+
+	bool ScreenBuffer::PresentVirtualTerminal() {
+		m_Stream.clear();
+
+		// Save cursor and attributes, restored once the frame is written.
+		m_Stream.push_back(L'\x1B');
+		m_Stream.push_back(L'7');
+
+		for (SHORT Y = 0; Y < m_Size.Y; ++Y) {
+			const DIRTY_ROW& Row = m_DirtyRows[Y];
+			if (Row.Left > Row.Right) {
+				continue;
+			}
+
+			char szPosition[32];
+			const int nPosition = sprintf_s(szPosition, sizeof(szPosition), "\x1B[%d;%dH", Y + 1, Row.Left + 1);
+			m_Stream.insert(m_Stream.end(), szPosition, szPosition + nPosition);
+
+			const CHAR_INFO* pCells = m_Back.data() + static_cast<size_t>(Y) * m_Size.X;
+			WORD unAttributes = 0xFFFF;
+			for (SHORT X = Row.Left; X <= Row.Right; ++X) {
+				if (pCells[X].Attributes != unAttributes) {
+					unAttributes = pCells[X].Attributes;
+
+					unsigned int unSequenceLength = 0;
+					char const* szSequence = GetColorSequence(COLOR_PAIR(static_cast<COLOR>((unAttributes & 0xF0) >> 4), static_cast<COLOR>(unAttributes & 0x0F)), &unSequenceLength);
+					m_Stream.insert(m_Stream.end(), szSequence, szSequence + unSequenceLength);
+				}
+
+				m_Stream.push_back(pCells[X].Char.UnicodeChar);
+			}
+		}
+
+		m_Stream.push_back(L'\x1B');
+		m_Stream.push_back(L'8');
+
+		m_unPresentedBytes = static_cast<unsigned int>(m_Stream.size() * sizeof(wchar_t));
+
+		m_pConsole->InvalidateCache(true);
+
+		m_pConsole->CountCall(CONSOLE_CALL::CONSOLE_CALL_WRITE);
+		m_pConsole->CountWrittenCharacters(m_Stream.size());
+
+		DWORD unWritten = 0;
+		if (!GetConsoleApi()->WriteConsoleW(m_pConsole->GetOut(), m_Stream.data(), static_cast<DWORD>(m_Stream.size()), &unWritten, nullptr)) {
+			return false;
+		}
+
+		return true;
+	}
+
+	void ScreenBuffer::Swap() {
+		for (SHORT Y = 0; Y < m_Size.Y; ++Y) {
+			const DIRTY_ROW& Row = m_DirtyRows[Y];
+			if (Row.Left > Row.Right) {
+				continue;
+			}
+
+			const size_t unOffset = static_cast<size_t>(Y) * m_Size.X + Row.Left;
+			memcpy(m_Front.data() + unOffset, m_Back.data() + unOffset, sizeof(CHAR_INFO) * (Row.Right - Row.Left + 1));
+		}
+
+		m_bInvalid = false;
+	}
+
+	WORD ScreenBuffer::GetDefaultAttributes() {
+		WORD unAttributes = 0;
+		if (m_pConsole && m_pConsole->GetAttributes(&unAttributes)) {
+			return unAttributes;
+		}
+
+		return FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+	}
+
+	// ----------------------------------------------------------------
+	// LineEditor
+	// ----------------------------------------------------------------
+
+	// Large enough that a pasted command is not dropped while the editor catches up.
+	static constexpr unsigned int g_unLineEditorEvents = 16384;
+
+	static bool IsWordCharacter(wchar_t unCharacter) {
+		return iswalnum(unCharacter) || (unCharacter == L'_');
+	}
+
+	// Narrow text is in the console output code page, like the rest of the narrow output.
+	static bool ToWideText(char const* const szText, UINT unCodePage, std::wstring& Text) {
+		Text.clear();
+
+		const int nLength = static_cast<int>(strlen(szText));
+		if (!nLength) {
+			return true;
+		}
+
+		const int nWideLength = MultiByteToWideChar(unCodePage, 0, szText, nLength, nullptr, 0);
+		if (nWideLength <= 0) {
+			return false;
+		}
+
+		Text.resize(static_cast<size_t>(nWideLength));
+
+		return MultiByteToWideChar(unCodePage, 0, szText, nLength, Text.data(), nWideLength) == nWideLength;
+	}
+
+	static bool ToNarrowText(const std::wstring& Text, UINT unCodePage, std::string& Narrow) {
+		Narrow.clear();
+
+		if (Text.empty()) {
+			return true;
+		}
+
+		const int nLength = WideCharToMultiByte(unCodePage, 0, Text.data(), static_cast<int>(Text.size()), nullptr, 0, nullptr, nullptr);
+		if (nLength <= 0) {
+			return false;
+		}
+
+		Narrow.resize(static_cast<size_t>(nLength));
+
+		return WideCharToMultiByte(unCodePage, 0, Text.data(), static_cast<int>(Text.size()), Narrow.data(), nLength, nullptr, nullptr) == nLength;
+	}
+
+	LineEditor::LineEditor(SmartConsoleUtils* pConsole) {
+		m_pConsole = pConsole;
+		m_unCursor = 0;
+		m_Origin.X = 0;
+		m_Origin.Y = 0;
+		m_nWidth = 1;
+		m_nHeight = 1;
+		m_unPhysicalCursor = 0;
+		m_bPhysicalCursorKnown = false;
+		m_unHistoryLimit = 1000;
+		m_unHistoryIndex = 0;
+	}
+
+	LineEditor::~LineEditor() {
+		m_pConsole = nullptr;
+	}
+
+	bool LineEditor::SetPromptA(char const* const szPrompt, COLOR_PAIR ColorPair) {
+		if (!szPrompt) {
+			return false;
+		}
+
+		std::wstring Prompt;
+		if (!ToWideText(szPrompt, GetConsoleApi()->GetConsoleOutputCP(), Prompt)) {
+			return false;
+		}
+
+		m_Prompt.swap(Prompt);
+		m_PromptColorPair = ColorPair;
+
+		return true;
+	}
+
+	bool LineEditor::SetPromptW(wchar_t const* const szPrompt, COLOR_PAIR ColorPair) {
+		if (!szPrompt) {
+			return false;
+		}
+
+		m_Prompt = szPrompt;
+		m_PromptColorPair = ColorPair;
+
+		return true;
+	}
+
+#ifdef UNICODE
+	bool LineEditor::SetPrompt(wchar_t const* const szPrompt, COLOR_PAIR ColorPair) {
+		return SetPromptW(szPrompt, ColorPair);
+	}
+#else
+	bool LineEditor::SetPrompt(char const* const szPrompt, COLOR_PAIR ColorPair) {
+		return SetPromptA(szPrompt, ColorPair);
+	}
+#endif
+
+	bool LineEditor::ReadLineA(char* const szBuffer, unsigned int unCount) {
+		if (!szBuffer || (unCount < 2)) {
+			return false;
+		}
+
+		std::wstring Line;
+		if (!Edit(Line)) {
+			return false;
+		}
+
+		std::string Narrow;
+		if (!ToNarrowText(Line, GetConsoleApi()->GetConsoleOutputCP(), Narrow)) {
+			return false;
+		}
+
+		size_t unLength = Narrow.size();
+		if (unLength > unCount - 2) {
+			unLength = unCount - 2;
+		}
+
+		memcpy(szBuffer, Narrow.data(), unLength);
+		szBuffer[unLength++] = '\n';
+		szBuffer[unLength] = '\0';
+
+		return true;
+	}
+
+	bool LineEditor::ReadLineW(wchar_t* const szBuffer, unsigned int unCount) {
+		if (!szBuffer || (unCount < 2)) {
+			return false;
+		}
+
+		std::wstring Line;
+		if (!Edit(Line)) {
+			return false;
+		}
+
+		size_t unLength = Line.size();
+		if (unLength > unCount - 2) {
+			unLength = unCount - 2;
+		}
+
+		wmemcpy(szBuffer, Line.data(), unLength);
+		szBuffer[unLength++] = L'\n';
+		szBuffer[unLength] = L'\0';
+
+		return true;
+	}
+
+#ifdef UNICODE
+	bool LineEditor::ReadLine(wchar_t* const szBuffer, unsigned int unCount) {
+		return ReadLineW(szBuffer, unCount);
+	}
+#else
+	bool LineEditor::ReadLine(char* const szBuffer, unsigned int unCount) {
+		return ReadLineA(szBuffer, unCount);
+	}
+#endif
+
+	// Empty lines and repeats of the last entry are not kept. The oldest entries go once the limit is reached.
+	bool LineEditor::AddHistoryW(wchar_t const* const szLine) {
+		if (!szLine) {
+			return false;
+		}
+
+		if (!szLine[0] || (!m_History.empty() && (m_History.back() == szLine))) {
+			return true;
+		}
+
+		m_History.emplace_back(szLine);
+
+		if (m_History.size() > m_unHistoryLimit) {
+			m_History.erase(m_History.begin(), m_History.begin() + (m_History.size() - m_unHistoryLimit));
+		}
+
+		return true;
+	}
+
+	void LineEditor::ClearHistory() {
+		m_History.clear();
+	}
+
+	void LineEditor::SetHistoryLimit(unsigned int unLimit) {
+		m_unHistoryLimit = unLimit;
+
+		if (m_History.size() > m_unHistoryLimit) {
+			m_History.erase(m_History.begin(), m_History.begin() + (m_History.size() - m_unHistoryLimit));
+		}
+	}
+
+	unsigned int LineEditor::GetHistorySize() {
+		return static_cast<unsigned int>(m_History.size());
+	}
+
+	bool LineEditor::LoadHistoryA(char const* const szFile) {
+		if (!szFile) {
+			return false;
+		}
+
+		FILE* pFile = nullptr;
+		if (fopen_s(&pFile, szFile, "rb") || !pFile) {
+			return false;
+		}
+
+		const bool bResult = LoadHistoryFile(pFile);
+
+		fclose(pFile);
+
+		return bResult;
+	}
+
+	bool LineEditor::LoadHistoryW(wchar_t const* const szFile) {
+		if (!szFile) {
+			return false;
+		}
+
+		FILE* pFile = nullptr;
+		if (_wfopen_s(&pFile, szFile, L"rb") || !pFile) {
+			return false;
+		}
+
+		const bool bResult = LoadHistoryFile(pFile);
+
+		fclose(pFile);
+
+		return bResult;
+	}
+
+	bool LineEditor::SaveHistoryA(char const* const szFile) {
+		if (!szFile) {
+			return false;
+		}
+
+		FILE* pFile = nullptr;
+		if (fopen_s(&pFile, szFile, "wb") || !pFile) {
+			return false;
+		}
+
+		const bool bResult = SaveHistoryFile(pFile);
+
+		if (fclose(pFile)) {
+			return false;
+		}
+
+		return bResult;
+	}
+
+	bool LineEditor::SaveHistoryW(wchar_t const* const szFile) {
+		if (!szFile) {
+			return false;
+		}
+
+		FILE* pFile = nullptr;
+		if (_wfopen_s(&pFile, szFile, L"wb") || !pFile) {
+			return false;
+		}
+
+		const bool bResult = SaveHistoryFile(pFile);
+
+		if (fclose(pFile)) {
+			return false;
+		}
+
+		return bResult;
+	}
+
+#ifdef UNICODE
+	bool LineEditor::LoadHistory(wchar_t const* const szFile) {
+		return LoadHistoryW(szFile);
+	}
+
+	bool LineEditor::SaveHistory(wchar_t const* const szFile) {
+		return SaveHistoryW(szFile);
+	}
+#else
+	bool LineEditor::LoadHistory(char const* const szFile) {
+		return LoadHistoryA(szFile);
+	}
+
+	bool LineEditor::SaveHistory(char const* const szFile) {
+		return SaveHistoryA(szFile);
+	}
+#endif
+
+	// Shows the prompt and reads keys until Enter. Turns raw input on for the duration if it was off.
+	bool LineEditor::Edit(std::wstring& Line) {
+		if (!m_pConsole) {
+			return false;
+		}
+
+		const bool bRawInput = m_pConsole->IsRawInput();
+		if (!bRawInput && !m_pConsole->EnableRawInput(g_unLineEditorEvents)) {
+			return false;
+		}
+
+		bool bResult = Start();
+		bool bDone = false;
+
+		while (bResult && !bDone) {
+			INPUT_EVENT Event;
+			if (!m_pConsole->WaitEvent(&Event)) {
+				bResult = false;
+				break;
+			}
+
+			// Everything already queued is applied first, so a paste costs one redraw.
+			do {
+				bResult = Feed(Event, &bDone);
+			} while (bResult && !bDone && m_pConsole->PollEvent(&Event));
+
+			if (bResult && !bDone) {
+				bResult = Update();
+			}
+		}
+
+		if (bResult) {
+			bResult = Finish(&Line);
+		} else {
+			Abort();
+		}
+
+		if (!bRawInput) {
+			m_pConsole->DisableRawInput();
+		}
+
+		return bResult;
+	}
+
+	bool LineEditor::Start() {
+		if (!m_pConsole) {
+			return false;
+		}
+
+		m_Line.clear();
+		m_unCursor = 0;
+		m_unHistoryIndex = m_History.size();
+		m_HistoryPrefix.clear();
+		m_Draft.clear();
+
+		return Begin();
+	}
+
+	bool LineEditor::Feed(const INPUT_EVENT& Event, bool* pDone) {
+		if (!m_pConsole || !pDone) {
+			return false;
+		}
+
+		if (Event.Type == INPUT_EVENT_TYPE::INPUT_EVENT_TYPE_RESIZE) {
+			// Rows reflow with the new width, so the line starts over below what is on screen.
+			m_pConsole->InvalidateCache();
+			return MoveCursor(m_Shown.size()) && m_pConsole->WriteW(L"\r\n") && Begin();
+		}
+
+		if ((Event.Type != INPUT_EVENT_TYPE::INPUT_EVENT_TYPE_KEY) || !Event.KeyDown) {
+			return true;
+		}
+
+		for (WORD i = 0; (i < (Event.RepeatCount ? Event.RepeatCount : 1)) && !*pDone; ++i) {
+			HandleKey(Event, pDone);
+		}
+
+		return true;
+	}
+
+	bool LineEditor::Update() {
+		if (!m_pConsole) {
+			return false;
+		}
+
+		return Redraw();
+	}
+
+	// Leaves the line on screen, moves below it and hands it over.
+	bool LineEditor::Finish(std::wstring* pLine) {
+		if (!m_pConsole || !pLine) {
+			return false;
+		}
+
+		m_unCursor = m_Line.size();
+
+		if (!Redraw() || !m_pConsole->WriteW(L"\r\n") || !m_pConsole->FlushOutput()) {
+			return false;
+		}
+
+		AddHistoryW(m_Line.c_str());
+
+		pLine->swap(m_Line);
+		m_Line.clear();
+		m_Shown.clear();
+
+		return true;
+	}
+
+	// Like Finish, but the line is dropped and not added to the history.
+	bool LineEditor::Abort() {
+		if (!m_pConsole) {
+			return false;
+		}
+
+		const bool bResult = MoveCursor(m_Shown.size()) && m_pConsole->WriteW(L"\r\n") && m_pConsole->FlushOutput();
+
+		m_Line.clear();
+		m_unCursor = 0;
+		m_Shown.clear();
+
+		return bResult;
+	}
+
+	// Writes the prompt and takes the cursor position after it as the start of the line.
+	bool LineEditor::Begin() {
+		m_Shown.clear();
+
+		if (!m_Prompt.empty()) {
+			WORD unAttributes = 0;
+			if (!m_pConsole->GetAttributes(&unAttributes)) {
+				return false;
+			}
+
+			const WORD unPromptAttributes = MergeAttributes(unAttributes, m_PromptColorPair);
+
+			if (!m_pConsole->SetAttributes(unPromptAttributes) || !m_pConsole->WriteW(m_Prompt.c_str()) || !m_pConsole->SetAttributes(unAttributes)) {
+				return false;
+			}
+		}
+
+		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+		if (!m_pConsole->GetBufferInfo(&csbi)) {
+			return false;
+		}
+
+		m_Origin = csbi.dwCursorPosition;
+		m_nWidth = csbi.dwSize.X;
+		m_nHeight = csbi.dwSize.Y;
+		m_unPhysicalCursor = 0;
+		m_bPhysicalCursorKnown = true;
+
+		return true;
+	}
+
+	void LineEditor::HandleKey(const INPUT_EVENT& Event, bool* pDone) {
+		const bool bControl = (Event.ControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) != 0;
+		const bool bAlt = (Event.ControlKeyState & (LEFT_ALT_PRESSED | RIGHT_ALT_PRESSED)) != 0;
+
+		switch (Event.VirtualKeyCode) {
+			case VK_RETURN:
+				*pDone = true;
+				return;
+
+			case VK_LEFT:
+				m_unCursor = bControl ? FindWordLeft() : (m_unCursor ? m_unCursor - 1 : 0);
+				return;
+
+			case VK_RIGHT:
+				m_unCursor = bControl ? FindWordRight() : (m_unCursor < m_Line.size() ? m_unCursor + 1 : m_unCursor);
+				return;
+
+			case VK_HOME:
+				m_unCursor = 0;
+				return;
+
+			case VK_END:
+				m_unCursor = m_Line.size();
+				return;
+
+			case VK_UP:
+			case VK_DOWN:
+				SearchHistory(Event.VirtualKeyCode == VK_UP);
+				return;
+
+			case VK_BACK: {
+				const size_t unStart = bControl ? FindWordLeft() : (m_unCursor ? m_unCursor - 1 : 0);
+				m_Line.erase(unStart, m_unCursor - unStart);
+				m_unCursor = unStart;
+				StopHistorySearch();
+				return;
+			}
+
+			case VK_DELETE: {
+				const size_t unEnd = bControl ? FindWordRight() : (m_unCursor < m_Line.size() ? m_unCursor + 1 : m_unCursor);
+				m_Line.erase(m_unCursor, unEnd - m_unCursor);
+				StopHistorySearch();
+				return;
+			}
+
+			case VK_ESCAPE:
+				m_Line.clear();
+				m_unCursor = 0;
+				StopHistorySearch();
+				return;
+
+			default:
+				break;
+		}
+
+		// Control characters as the console reports them for Ctrl+letter.
+		switch (Event.Char) {
+			case 0x17: {
+				const size_t unStart = FindWordLeft();
+				m_Line.erase(unStart, m_unCursor - unStart);
+				m_unCursor = unStart;
+				StopHistorySearch();
+				return;
+			}
+
+			case 0x15:
+				m_Line.erase(0, m_unCursor);
+				m_unCursor = 0;
+				StopHistorySearch();
+				return;
+
+			case 0x0B:
+				m_Line.erase(m_unCursor);
+				StopHistorySearch();
+				return;
+
+			default:
+				break;
+		}
+
+		// AltGr arrives as Ctrl+Alt and still types a character.
+		if ((Event.Char < L' ') || (Event.Char == 0x7F) || (bControl && !bAlt)) {
+			return;
+		}
+
+		m_Line.insert(m_unCursor, 1, Event.Char);
+		++m_unCursor;
+		StopHistorySearch();
+	}
+
+	// Rewrites the line from the first character that differs from what is on screen, and blanks what is left of a longer line.
+	bool LineEditor::Redraw() {
+		size_t unSame = 0;
+		while ((unSame < m_Line.size()) && (unSame < m_Shown.size()) && (m_Line[unSame] == m_Shown[unSame])) {
+			++unSame;
+		}
+
+		if ((unSame == m_Line.size()) && (unSame == m_Shown.size())) {
+			return MoveCursor(m_unCursor);
+		}
+
+		if (!MoveCursor(unSame)) {
+			return false;
+		}
+
+		m_Output.assign(m_Line, unSame, std::wstring::npos);
+		if (m_Shown.size() > m_Line.size()) {
+			m_Output.append(m_Shown.size() - m_Line.size(), L' ');
+		}
+
+		if (!m_pConsole->WriteW(m_Output.c_str())) {
+			return false;
+		}
+
+		UpdateOrigin(unSame + m_Output.size());
+
+		m_Shown = m_Line;
+
+		return MoveCursor(m_unCursor);
+	}
+
+	bool LineEditor::MoveCursor(size_t unOffset) {
+		if (m_bPhysicalCursorKnown && (m_unPhysicalCursor == unOffset)) {
+			return true;
+		}
+
+		if (!m_pConsole->SetCursorPosition(GetPosition(unOffset))) {
+			return false;
+		}
+
+		m_unPhysicalCursor = unOffset;
+		m_bPhysicalCursorKnown = true;
+
+		return true;
+	}
+
+	COORD LineEditor::GetPosition(size_t unOffset) {
+		const size_t unCells = static_cast<size_t>(m_Origin.X) + unOffset;
+
+		COORD Position;
+		Position.X = static_cast<SHORT>(unCells % static_cast<size_t>(m_nWidth));
+		Position.Y = static_cast<SHORT>(m_Origin.Y + static_cast<long long>(unCells / static_cast<size_t>(m_nWidth)));
+
+		// The end of a line that fills the last row of the buffer has nowhere to go.
+		if (Position.Y >= m_nHeight) {
+			Position.X = m_nWidth - 1;
+			Position.Y = m_nHeight - 1;
+		}
+
+		return Position;
+	}
+
+	// Text written up to unEnd may have scrolled the buffer. That is only possible near its bottom, so only there the cursor is read back.
+	void LineEditor::UpdateOrigin(size_t unEnd) {
+		const size_t unCells = static_cast<size_t>(m_Origin.X) + unEnd;
+		const size_t unRows = unCells / static_cast<size_t>(m_nWidth);
+		const bool bRowBoundary = unEnd && !(unCells % static_cast<size_t>(m_nWidth));
+
+		m_unPhysicalCursor = unEnd;
+		m_bPhysicalCursorKnown = !bRowBoundary;
+
+		if (static_cast<size_t>(m_Origin.Y) + unRows < static_cast<size_t>(m_nHeight)) {
+			return;
+		}
+
+		COORD Position;
+		if (!m_pConsole->GetCursorPosition(&Position)) {
+			m_bPhysicalCursorKnown = false;
+			return;
+		}
+
+		// Consoles either wrap right after the last column or only once the next character comes.
+		if (bRowBoundary && (Position.X == m_nWidth - 1)) {
+			m_Origin.Y = static_cast<SHORT>(Position.Y - static_cast<long long>((unCells - 1) / static_cast<size_t>(m_nWidth)));
+		} else {
+			m_Origin.Y = static_cast<SHORT>(Position.Y - static_cast<long long>(unRows));
+		}
+	}
+
+	size_t LineEditor::FindWordLeft() {
+		size_t unOffset = m_unCursor;
+
+		while (unOffset && !IsWordCharacter(m_Line[unOffset - 1])) {
+			--unOffset;
+		}
+
+		while (unOffset && IsWordCharacter(m_Line[unOffset - 1])) {
+			--unOffset;
+		}
+
+		return unOffset;
+	}
+
+	size_t LineEditor::FindWordRight() {
+		size_t unOffset = m_unCursor;
+
+		while ((unOffset < m_Line.size()) && !IsWordCharacter(m_Line[unOffset])) {
+			++unOffset;
+		}
+
+		while ((unOffset < m_Line.size()) && IsWordCharacter(m_Line[unOffset])) {
+			++unOffset;
+		}
+
+		return unOffset;
+	}
+
+	// The prefix is taken when the search starts and kept until the line is edited again.
+	void LineEditor::SearchHistory(bool bBackward) {
+		if (m_unHistoryIndex == m_History.size()) {
+			m_HistoryPrefix.assign(m_Line, 0, m_unCursor);
+			m_Draft = m_Line;
+		}
+
+		size_t unIndex = m_unHistoryIndex;
+
+		for (;;) {
+			if (bBackward) {
+				if (!unIndex) {
+					return;
+				}
+
+				--unIndex;
+			} else {
+				if (unIndex >= m_History.size()) {
+					return;
+				}
+
+				++unIndex;
+
+				if (unIndex == m_History.size()) {
+					m_unHistoryIndex = unIndex;
+					m_Line = m_Draft;
+					m_unCursor = m_Line.size();
+					return;
+				}
+			}
+
+			const std::wstring& Entry = m_History[unIndex];
+			if (!Entry.compare(0, m_HistoryPrefix.size(), m_HistoryPrefix) && (Entry != m_Line)) {
+				break;
+			}
+		}
+
+		m_unHistoryIndex = unIndex;
+		m_Line = m_History[unIndex];
+		m_unCursor = m_Line.size();
+	}
+
+	void LineEditor::StopHistorySearch() {
+		m_unHistoryIndex = m_History.size();
+	}
+
+	bool LineEditor::LoadHistoryFile(FILE* pFile) {
+		std::string Text;
+
+		char Chunk[4096];
+		size_t unRead = 0;
+		while ((unRead = fread(Chunk, 1, sizeof(Chunk), pFile)) > 0) {
+			Text.append(Chunk, unRead);
+		}
+
+		if (ferror(pFile)) {
+			return false;
+		}
+
+		std::wstring Entry;
+		size_t unStart = 0;
+		while (unStart < Text.size()) {
+			size_t unEnd = Text.find('\n', unStart);
+			if (unEnd == std::string::npos) {
+				unEnd = Text.size();
+			}
+
+			std::string Line = Text.substr(unStart, unEnd - unStart);
+			if (!Line.empty() && (Line.back() == '\r')) {
+				Line.pop_back();
+			}
+
+			if (!ToWideText(Line.c_str(), CP_UTF8, Entry)) {
+				return false;
+			}
+
+			AddHistoryW(Entry.c_str());
+
+			unStart = unEnd + 1;
+		}
+
+		return true;
+	}
+
+	bool LineEditor::SaveHistoryFile(FILE* pFile) {
+		std::string Line;
+
+		for (const auto& Entry : m_History) {
+			if (!ToNarrowText(Entry, CP_UTF8, Line)) {
+				return false;
+			}
+
+			Line.push_back('\n');
+
+			if (fwrite(Line.data(), 1, Line.size(), pFile) != Line.size()) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// ----------------------------------------------------------------
+	// ConsoleExecutor
+	// ----------------------------------------------------------------
+
+	ConsoleExecutor::SleepAwaiter::SleepAwaiter(ConsoleExecutor* pExecutor, unsigned int unMilliseconds) {
+		m_pExecutor = pExecutor;
+		m_Deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(unMilliseconds);
+	}
+
+	// Even a zero delay goes through the loop, which lets other tasks run.
+	bool ConsoleExecutor::SleepAwaiter::await_ready() {
+		return false;
+	}
+
+	void ConsoleExecutor::SleepAwaiter::await_suspend(std::coroutine_handle<> hCoroutine) {
+		m_pExecutor->AddTimer(m_Deadline, hCoroutine);
+	}
+
+	void ConsoleExecutor::SleepAwaiter::await_resume() {}
+
+	ConsoleExecutor::KeyAwaiter::KeyAwaiter(ConsoleExecutor* pExecutor, PINPUT_EVENT pEvent) {
+		m_pExecutor = pExecutor;
+		m_pEvent = pEvent;
+		m_hCoroutine = nullptr;
+		m_bResult = false;
+	}
+
+	// A key that is already queued is taken without suspending, unless another read is ahead of this one.
+	bool ConsoleExecutor::KeyAwaiter::await_ready() {
+		if (!m_pEvent || !m_pExecutor->EnableInput()) {
+			return true;
+		}
+
+		if (m_pExecutor->HasReaders()) {
+			return false;
+		}
+
+		INPUT_EVENT Event;
+		while (m_pExecutor->m_pConsole->PollEvent(&Event)) {
+			if ((Event.Type == INPUT_EVENT_TYPE::INPUT_EVENT_TYPE_KEY) && Event.KeyDown) {
+				*m_pEvent = Event;
+				m_bResult = true;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void ConsoleExecutor::KeyAwaiter::await_suspend(std::coroutine_handle<> hCoroutine) {
+		m_hCoroutine = hCoroutine;
+		m_pExecutor->m_KeyWaiters.push_back(this);
+	}
+
+	bool ConsoleExecutor::KeyAwaiter::await_resume() {
+		return m_bResult;
+	}
+
+	ConsoleExecutor::LineAwaiter::LineAwaiter(ConsoleExecutor* pExecutor, std::wstring* pLine) {
+		m_pExecutor = pExecutor;
+		m_pLine = pLine;
+		m_hCoroutine = nullptr;
+		m_bResult = false;
+	}
+
+	bool ConsoleExecutor::LineAwaiter::await_ready() {
+		if (!m_pLine || m_pExecutor->m_pLineWaiter || !m_pExecutor->EnableInput()) {
+			return true;
+		}
+
+		return !m_pExecutor->m_pConsole->GetLineEditor()->Start();
+	}
+
+	void ConsoleExecutor::LineAwaiter::await_suspend(std::coroutine_handle<> hCoroutine) {
+		m_hCoroutine = hCoroutine;
+		m_pExecutor->m_pLineWaiter = this;
+		m_pExecutor->m_bLineChanged = false;
+	}
+
+	bool ConsoleExecutor::LineAwaiter::await_resume() {
+		return m_bResult;
+	}
+
+	ConsoleExecutor::WriteAwaiter::WriteAwaiter(ConsoleExecutor* pExecutor, SpanWriter* pWriter) {
+		m_pExecutor = pExecutor;
+		m_pWriter = pWriter;
+		m_Ticket.unRecords = 0;
+		m_Ticket.unSpans = 0;
+		m_bResult = false;
+	}
+
+	bool ConsoleExecutor::WriteAwaiter::await_ready() {
+		return !m_pWriter;
+	}
+
+	// Doesn't suspend when the text went out synchronously or couldn't be queued.
+	bool ConsoleExecutor::WriteAwaiter::await_suspend(std::coroutine_handle<> hCoroutine) {
+		AsyncSink* pSink = m_pExecutor->GetWriteSink();
+
+		m_bResult = m_pWriter->Commit(m_pExecutor->m_pConsole, &m_Ticket);
+		if (!pSink || !m_bResult) {
+			return false;
+		}
+
+		m_hCoroutine = hCoroutine;
+		m_pExecutor->m_WriteWaiters.push_back(this);
+
+		return true;
+	}
+
+	bool ConsoleExecutor::WriteAwaiter::await_resume() {
+		return m_bResult;
+	}
+
+	ConsoleExecutor::ConsoleExecutor(SmartConsoleUtils* pConsole) {
+		m_pConsole = pConsole ? pConsole : ConsoleUtils::GetConsole();
+		m_bRunning = false;
+		m_bStopping = false;
+		m_bRawInput = false;
+		m_unTimerSequence = 0;
+		m_pLineWaiter = nullptr;
+		m_bLineChanged = false;
+		m_bAsyncSink = false;
+	}
+
+	// Tasks that have not finished are destroyed without being resumed.
+	ConsoleExecutor::~ConsoleExecutor() {
+		if (m_pLineWaiter) {
+			m_pConsole->GetLineEditor()->Abort();
+			m_pLineWaiter = nullptr;
+		}
+
+		m_WriteWaiters.clear();
+		m_KeyWaiters.clear();
+		m_Timers.clear();
+		m_Ready.clear();
+		m_Tasks.clear();
+
+		if (m_bRawInput) {
+			m_pConsole->DisableRawInput();
+		}
+
+		m_pConsole = nullptr;
+	}
+
+	bool ConsoleExecutor::Spawn(ConsoleTask<>&& Task) {
+		if (Task.IsDone()) {
+			return false;
+		}
+
+		m_Ready.push_back(Task.GetHandle());
+		m_Tasks.push_back(std::move(Task));
+
+		return true;
+	}
+
+	// Returns once every spawned task has finished or Stop() was called. False when the remaining tasks wait on nothing the loop drives.
+	bool ConsoleExecutor::Run() {
+		if (!m_pConsole || m_bRunning) {
+			return false;
+		}
+
+		m_bRunning = true;
+		m_bStopping = false;
+
+		bool bResult = true;
+
+		while (!m_bStopping) {
+			FireTimers();
+			FinishWrites();
+
+			if (!m_Ready.empty()) {
+				// Only what is ready now, so a task that keeps yielding doesn't hold off input and timers.
+				for (size_t unReady = m_Ready.size(); unReady && !m_bStopping; --unReady) {
+					const std::coroutine_handle<> hCoroutine = m_Ready.front();
+					m_Ready.pop_front();
+					hCoroutine.resume();
+				}
+
+				RemoveDoneTasks();
+				continue;
+			}
+
+			RemoveDoneTasks();
+
+			if (m_Tasks.empty()) {
+				break;
+			}
+
+			unsigned int unTimeout = INFINITE;
+			if (!m_Timers.empty()) {
+				const auto Remaining = std::chrono::ceil<std::chrono::milliseconds>(m_Timers.front().Deadline - std::chrono::steady_clock::now());
+				unTimeout = Remaining.count() > 0 ? static_cast<unsigned int>(Remaining.count()) : 0;
+			}
+
+			// Only writes pending, block on the sink. Next to input or timers they are polled every millisecond.
+			if (!m_WriteWaiters.empty()) {
+				AsyncSink* pSink = m_pConsole->GetAsyncSink();
+				if (pSink && !HasReaders() && m_Timers.empty()) {
+					pSink->WaitWritten(m_WriteWaiters.front()->m_Ticket);
+					continue;
+				}
+
+				if (unTimeout > 1) {
+					unTimeout = 1;
+				}
+			}
+
+			if (HasReaders()) {
+				if (!WaitInput(unTimeout)) {
+					bResult = false;
+					break;
+				}
+
+				continue;
+			}
+
+			if (!m_WriteWaiters.empty()) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(unTimeout));
+				continue;
+			}
+
+			if (m_Timers.empty()) {
+				bResult = false;
+				break;
+			}
+
+			std::this_thread::sleep_until(m_Timers.front().Deadline);
+		}
+
+		if (m_bRawInput && !HasReaders()) {
+			m_pConsole->DisableRawInput();
+			m_bRawInput = false;
+		}
+
+		// Writes still waiting resume on the next run, their text is out once the sink stopped.
+		if (m_bAsyncSink) {
+			m_pConsole->DisableAsync();
+			m_bAsyncSink = false;
+		}
+
+		m_bRunning = false;
+
+		return bResult;
+	}
+
+	void ConsoleExecutor::Stop() {
+		m_bStopping = true;
+	}
+
+	bool ConsoleExecutor::IsRunning() {
+		return m_bRunning;
+	}
+
+	ConsoleExecutor::SleepAwaiter ConsoleExecutor::Sleep(unsigned int unMilliseconds) {
+		return SleepAwaiter(this, unMilliseconds);
+	}
+
+	ConsoleExecutor::KeyAwaiter ConsoleExecutor::NextKey(PINPUT_EVENT pEvent) {
+		return KeyAwaiter(this, pEvent);
+	}
+
+	ConsoleExecutor::LineAwaiter ConsoleExecutor::ReadLineAsync(std::wstring* pLine) {
+		return LineAwaiter(this, pLine);
+	}
+
+	ConsoleExecutor::WriteAwaiter ConsoleExecutor::WriteAsync(SpanWriter& Writer) {
+		return WriteAwaiter(this, &Writer);
+	}
+
+	// Pending reads resume with false on the next turn of the loop. A line being edited is left on screen.
+	unsigned int ConsoleExecutor::CancelReads() {
+		unsigned int unCancelled = 0;
+
+		for (KeyAwaiter* pWaiter : m_KeyWaiters) {
+			pWaiter->m_bResult = false;
+			m_Ready.push_back(pWaiter->m_hCoroutine);
+			++unCancelled;
+		}
+
+		m_KeyWaiters.clear();
+
+		if (m_pLineWaiter) {
+			FinishLine(false);
+			++unCancelled;
+		}
+
+		return unCancelled;
+	}
+
+	SmartConsoleUtils* ConsoleExecutor::GetConsole() {
+		return m_pConsole;
+	}
+
+	bool ConsoleExecutor::EnableInput() {
+		if (!m_pConsole) {
+			return false;
+		}
+
+		if (m_pConsole->IsRawInput()) {
+			return true;
+		}
+
+		if (!m_pConsole->EnableRawInput(g_unLineEditorEvents)) {
+			return false;
+		}
+
+		m_bRawInput = true;
+
+		return true;
+	}
+
+	AsyncSink* ConsoleExecutor::GetWriteSink() {
+		AsyncSink* pSink = m_pConsole->GetAsyncSink();
+		if (pSink) {
+			return pSink;
+		}
+
+		if (!m_pConsole->EnableAsync()) {
+			return nullptr;
+		}
+
+		m_bAsyncSink = true;
+
+		return m_pConsole->GetAsyncSink();
+	}
+
+	// The sink writes in order, so the first write still pending holds up the ones behind it.
+	void ConsoleExecutor::FinishWrites() {
+		AsyncSink* pSink = m_pConsole->GetAsyncSink();
+
+		while (!m_WriteWaiters.empty()) {
+			WriteAwaiter* pWaiter = m_WriteWaiters.front();
+
+			// Without a running sink everything queued is out already.
+			if (pSink && !pSink->IsWritten(pWaiter->m_Ticket)) {
+				break;
+			}
+
+			m_Ready.push_back(pWaiter->m_hCoroutine);
+			m_WriteWaiters.pop_front();
+		}
+	}
+
+	bool ConsoleExecutor::HasReaders() {
+		return m_pLineWaiter || !m_KeyWaiters.empty();
+	}
+
+	// Hands out everything queued while someone still reads, then redraws the line once for the whole batch.
+	bool ConsoleExecutor::WaitInput(unsigned int unMilliseconds) {
+		INPUT_EVENT Event;
+		if (!m_pConsole->WaitEvent(&Event, unMilliseconds)) {
+			// A timeout, unless raw input was turned off under us.
+			return m_pConsole->IsRawInput();
+		}
+
+		Dispatch(Event);
+
+		while (HasReaders() && m_pConsole->PollEvent(&Event)) {
+			Dispatch(Event);
+		}
+
+		if (m_pLineWaiter && m_bLineChanged) {
+			m_bLineChanged = false;
+
+			if (!m_pConsole->GetLineEditor()->Update()) {
+				FinishLine(false);
+			}
+		}
+
+		return true;
+	}
+
+	// A line being read takes every event. Otherwise key presses go to the oldest NextKey and the rest are dropped.
+	void ConsoleExecutor::Dispatch(const INPUT_EVENT& Event) {
+		if (m_pLineWaiter) {
+			bool bDone = false;
+			if (!m_pConsole->GetLineEditor()->Feed(Event, &bDone)) {
+				FinishLine(false);
+				return;
+			}
+
+			m_bLineChanged = true;
+
+			if (bDone) {
+				FinishLine(true);
+			}
+
+			return;
+		}
+
+		if ((Event.Type != INPUT_EVENT_TYPE::INPUT_EVENT_TYPE_KEY) || !Event.KeyDown || m_KeyWaiters.empty()) {
+			return;
+		}
+
+		KeyAwaiter* pWaiter = m_KeyWaiters.front();
+		m_KeyWaiters.pop_front();
+
+		*pWaiter->m_pEvent = Event;
+		pWaiter->m_bResult = true;
+		m_Ready.push_back(pWaiter->m_hCoroutine);
+	}
+
+	void ConsoleExecutor::FinishLine(bool bResult) {
+		LineAwaiter* pWaiter = m_pLineWaiter;
+		m_pLineWaiter = nullptr;
+		m_bLineChanged = false;
+
+		LineEditor* pEditor = m_pConsole->GetLineEditor();
+		if (bResult) {
+			pWaiter->m_bResult = pEditor->Finish(pWaiter->m_pLine);
+		} else {
+			pEditor->Abort();
+			pWaiter->m_bResult = false;
+		}
+
+		m_Ready.push_back(pWaiter->m_hCoroutine);
+	}
+
+	void ConsoleExecutor::AddTimer(std::chrono::steady_clock::time_point Deadline, std::coroutine_handle<> hCoroutine) {
+		TIMER Timer;
+		Timer.Deadline = Deadline;
+		Timer.Sequence = m_unTimerSequence++;
+		Timer.hCoroutine = hCoroutine;
+
+		m_Timers.push_back(Timer);
+		std::push_heap(m_Timers.begin(), m_Timers.end(), IsLaterTimer);
+	}
+
+	void ConsoleExecutor::FireTimers() {
+		if (m_Timers.empty()) {
+			return;
+		}
+
+		const auto Now = std::chrono::steady_clock::now();
+
+		while (!m_Timers.empty() && (m_Timers.front().Deadline <= Now)) {
+			std::pop_heap(m_Timers.begin(), m_Timers.end(), IsLaterTimer);
+			m_Ready.push_back(m_Timers.back().hCoroutine);
+			m_Timers.pop_back();
+		}
+	}
+
+	void ConsoleExecutor::RemoveDoneTasks() {
+		std::erase_if(m_Tasks, [](const ConsoleTask<>& Task) { return Task.IsDone(); });
+	}
+
+	bool ConsoleExecutor::IsLaterTimer(const TIMER& A, const TIMER& B) {
+		if (A.Deadline != B.Deadline) {
+			return A.Deadline > B.Deadline;
+		}
+
+		return A.Sequence > B.Sequence;
+	}
+
+	// ----------------------------------------------------------------
+	// ProgressGroup
+	// ----------------------------------------------------------------
+
+	// Seconds the throughput average looks back, roughly.
+	static constexpr double g_fProgressRateSeconds = 3.0;
+
+	// Width of the percentage, counts, rate and ETA after the bar.
+	static constexpr SHORT g_nProgressStatsWidth = 36;
+
+	// Set while the renderer writes itself, so its own output doesn't hide the bars.
+	static thread_local bool g_bDrawingProgress = false;
+
+	// Three significant digits at most, with a k/M/G/T/P suffix, so the columns keep their width.
+	static void FormatCount(double fValue, wchar_t* szBuffer, size_t unSize) {
+		static const wchar_t g_szSuffixes[] = L" kMGTP";
+
+		unsigned int unSuffix = 0;
+		while ((fValue >= 999.5) && (unSuffix < 5)) {
+			fValue /= 1000.0;
+			++unSuffix;
+		}
+
+		if (!unSuffix) {
+			swprintf_s(szBuffer, unSize, L"%.0f", fValue);
+		} else if (fValue < 9.995) {
+			swprintf_s(szBuffer, unSize, L"%.2f%lc", fValue, g_szSuffixes[unSuffix]);
+		} else if (fValue < 99.95) {
+			swprintf_s(szBuffer, unSize, L"%.1f%lc", fValue, g_szSuffixes[unSuffix]);
+		} else {
+			swprintf_s(szBuffer, unSize, L"%.0f%lc", fValue, g_szSuffixes[unSuffix]);
+		}
+	}
+
+	static void FormatDuration(double fSeconds, wchar_t* szBuffer, size_t unSize) {
+		if (!(fSeconds >= 0.0) || (fSeconds >= 360000.0)) {
+			swprintf_s(szBuffer, unSize, L"--:--");
+			return;
+		}
+
+		const unsigned int unSeconds = static_cast<unsigned int>(fSeconds + 0.5);
+		if (unSeconds < 3600) {
+			swprintf_s(szBuffer, unSize, L"%02u:%02u", unSeconds / 60, unSeconds % 60);
+		} else {
+			swprintf_s(szBuffer, unSize, L"%u:%02u:%02u", unSeconds / 3600, (unSeconds / 60) % 60, unSeconds % 60);
+		}
+	}
+
+	// Writes text from nX, cut at nEnd. Returns where the text ended.
+	static SHORT PutCells(CHAR_INFO* pRow, SHORT nX, SHORT nEnd, wchar_t const* szText, WORD unAttributes) {
+		for (; (nX < nEnd) && *szText; ++nX, ++szText) {
+			pRow[nX].Char.UnicodeChar = *szText;
+			pRow[nX].Attributes = unAttributes;
+		}
+
+		return nX;
+	}
+
+	ProgressGroup::ProgressGroup(SmartConsoleUtils* pConsole) {
+		m_pConsole = pConsole;
+		m_pBars = nullptr;
+		m_unCapacity = 0;
+		m_unBars = 0;
+		m_FrameInterval = std::chrono::milliseconds(66);
+		m_unMaxRows = 0;
+		m_bShown = false;
+		m_Anchor.X = 0;
+		m_Anchor.Y = 0;
+		m_nTop = 0;
+		m_nRows = 0;
+		m_nWidth = 0;
+		m_unAttributes = 0;
+		m_unFrames = 0;
+		m_unDrawnCells = 0;
+		m_bStopping = false;
+	}
+
+	ProgressGroup::~ProgressGroup() {
+		Stop();
+	}
+
+	// Bars of an earlier run are dropped. The renderer draws the first frame once a bar is added.
+	bool ProgressGroup::Start(unsigned int unFramesPerSecond, unsigned int unBars) {
+		if (!m_pConsole || !unFramesPerSecond || !unBars || m_Thread.joinable()) {
+			return false;
+		}
+
+		m_pBars.reset(new BAR[unBars]);
+		for (unsigned int i = 0; i < unBars; ++i) {
+			m_pBars[i].Value.store(0, std::memory_order_relaxed);
+			m_pBars[i].Total.store(0, std::memory_order_relaxed);
+			m_pBars[i].bFinished.store(false, std::memory_order_relaxed);
+			m_pBars[i].bReady.store(false, std::memory_order_relaxed);
+		}
+
+		m_unCapacity = unBars;
+		m_unBars = 0;
+		m_FrameInterval = std::chrono::milliseconds(std::max(1000u / unFramesPerSecond, 1u));
+		m_Rates.clear();
+		m_unFrames = 0;
+		m_unDrawnCells = 0;
+		m_bStopping = false;
+
+		m_Thread = std::thread(&ProgressGroup::Run, this);
+
+		return true;
+	}
+
+	// Draws the final state and moves the output below the bars, which stay on screen. Workers must be done with the group.
+	bool ProgressGroup::Stop() {
+		if (!m_Thread.joinable() || IsRendererThread()) {
+			return false;
+		}
+
+		{
+			std::lock_guard<std::mutex> Lock(m_StopLock);
+			m_bStopping = true;
+		}
+
+		m_StopSignal.notify_one();
+
+		m_Thread.join();
+
+		bool bResult = Redraw();
+
+		std::lock_guard<std::mutex> Lock(m_pConsole->GetOutputLock());
+		std::lock_guard<std::mutex> DrawLock(m_DrawLock);
+
+		if (m_bShown.load(std::memory_order_relaxed)) {
+			// The cursor is parked at the start of the last row.
+			g_bDrawingProgress = true;
+			bResult = m_pConsole->WriteW(L"\n") && bResult;
+			g_bDrawingProgress = false;
+
+			m_bShown = false;
+			m_nRows = 0;
+			m_Drawn.clear();
+		}
+
+		return bResult;
+	}
+
+	bool ProgressGroup::IsRunning() {
+		return m_Thread.joinable() && !m_bStopping.load();
+	}
+
+	bool ProgressGroup::IsRendererThread() {
+		return m_Thread.get_id() == std::this_thread::get_id();
+	}
+
+	bool ProgressGroup::AddBarA(char const* const szLabel, unsigned long long unTotal, COLOR_PAIR ColorPair, unsigned int* pBar) {
+		if (!szLabel) {
+			return false;
+		}
+
+		std::wstring Label;
+		if (!ToWideText(szLabel, GetConsoleApi()->GetConsoleOutputCP(), Label)) {
+			return false;
+		}
+
+		return AddBarW(Label.c_str(), unTotal, ColorPair, pBar);
+	}
+
+	// A total of zero shows the bar without a percentage or ETA until SetTotal() gives one.
+	bool ProgressGroup::AddBarW(wchar_t const* const szLabel, unsigned long long unTotal, COLOR_PAIR ColorPair, unsigned int* pBar) {
+		if (!szLabel || !pBar || !m_pBars) {
+			return false;
+		}
+
+		const unsigned int unBar = m_unBars.fetch_add(1, std::memory_order_relaxed);
+		if (unBar >= m_unCapacity) {
+			return false;
+		}
+
+		BAR& Bar = m_pBars[unBar];
+		Bar.Value.store(0, std::memory_order_relaxed);
+		Bar.Total.store(unTotal, std::memory_order_relaxed);
+		Bar.bFinished.store(false, std::memory_order_relaxed);
+		Bar.ColorPair = ColorPair;
+		Bar.Label = szLabel;
+		Bar.bReady.store(true, std::memory_order_release);
+
+		*pBar = unBar;
+
+		return true;
+	}
+
+#ifdef UNICODE
+	bool ProgressGroup::AddBar(wchar_t const* const szLabel, unsigned long long unTotal, COLOR_PAIR ColorPair, unsigned int* pBar) {
+		return AddBarW(szLabel, unTotal, ColorPair, pBar);
+	}
+#else
+	bool ProgressGroup::AddBar(char const* const szLabel, unsigned long long unTotal, COLOR_PAIR ColorPair, unsigned int* pBar) {
+		return AddBarA(szLabel, unTotal, ColorPair, pBar);
+	}
+#endif
+
+	bool ProgressGroup::Advance(unsigned int unBar, unsigned long long unCount) {
+		if (unBar >= m_unCapacity) {
+			return false;
+		}
+
+		m_pBars[unBar].Value.fetch_add(unCount, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	bool ProgressGroup::SetProgress(unsigned int unBar, unsigned long long unValue) {
+		if (unBar >= m_unCapacity) {
+			return false;
+		}
+
+		m_pBars[unBar].Value.store(unValue, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	bool ProgressGroup::SetTotal(unsigned int unBar, unsigned long long unTotal) {
+		if (unBar >= m_unCapacity) {
+			return false;
+		}
+
+		m_pBars[unBar].Total.store(unTotal, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	// Finished bars give their rows to running ones when there are more bars than rows.
+	bool ProgressGroup::Finish(unsigned int unBar) {
+		if (unBar >= m_unCapacity) {
+			return false;
+		}
+
+		m_pBars[unBar].bFinished.store(true, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	unsigned long long ProgressGroup::GetProgress(unsigned int unBar) {
+		if (unBar >= m_unCapacity) {
+			return 0;
+		}
+
+		return m_pBars[unBar].Value.load(std::memory_order_relaxed);
+	}
+
+	// Zero takes all but one row of the window, so the latest output line stays visible.
+	bool ProgressGroup::SetMaxRows(unsigned int unRows) {
+		m_unMaxRows = unRows;
+
+		return true;
+	}
+
+	// Draws a frame now. Must not be called with the output lock held.
+	bool ProgressGroup::Redraw() {
+		if (!m_pConsole || !m_pBars) {
+			return false;
+		}
+
+		std::lock_guard<std::mutex> Lock(m_pConsole->GetOutputLock());
+		std::lock_guard<std::mutex> DrawLock(m_DrawLock);
+
+		g_bDrawingProgress = true;
+		const bool bResult = Draw();
+		g_bDrawingProgress = false;
+
+		return bResult;
+	}
+
+	// Blanks the bars and puts the cursor back where the output left off. The console calls this before it writes.
+	void ProgressGroup::Hide() {
+		if (g_bDrawingProgress || !m_bShown.load(std::memory_order_acquire)) {
+			return;
+		}
+
+		std::lock_guard<std::mutex> DrawLock(m_DrawLock);
+
+		if (!m_bShown.load(std::memory_order_relaxed)) {
+			return;
+		}
+
+		g_bDrawingProgress = true;
+
+		CHAR_INFO Blank;
+		Blank.Char.UnicodeChar = L' ';
+		Blank.Attributes = m_unAttributes;
+
+		m_Frame.assign(static_cast<size_t>(m_nRows) * m_nWidth, Blank);
+
+		SMALL_RECT Region;
+		Region.Left = 0;
+		Region.Top = m_nTop;
+		Region.Right = m_nWidth - 1;
+		Region.Bottom = m_nTop + m_nRows - 1;
+
+		m_pConsole->BlitCells(Region, m_Frame.data());
+		m_pConsole->SetCursorPosition(m_Anchor);
+
+		m_bShown = false;
+		m_nRows = 0;
+		m_Drawn.clear();
+
+		g_bDrawingProgress = false;
+	}
+
+	bool ProgressGroup::IsShown() {
+		return m_bShown.load();
+	}
+
+	unsigned long long ProgressGroup::GetFrames() {
+		return m_unFrames.load();
+	}
+
+	unsigned long long ProgressGroup::GetDrawnCells() {
+		return m_unDrawnCells.load();
+	}
+
+	void ProgressGroup::Run() {
+		std::unique_lock<std::mutex> Lock(m_StopLock);
+
+		while (!m_bStopping.load()) {
+			Lock.unlock();
+			Redraw();
+			Lock.lock();
+
+			m_StopSignal.wait_for(Lock, m_FrameInterval, [this] { return m_bStopping.load(); });
+		}
+	}
+
+	// Expects the output lock and m_DrawLock to be held. Only rows that differ from the last frame are written.
+	bool ProgressGroup::Draw() {
+		// Text still in the output buffer goes above the bars.
+		m_pConsole->FlushOutput();
+
+		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+		if (!m_pConsole->GetBufferInfo(&csbi)) {
+			return false;
+		}
+
+		// The last column stays empty. Writing it moves the cursor on, which scrolls the buffer on its last row.
+		const SHORT nWidth = csbi.srWindow.Right - csbi.srWindow.Left;
+		const SHORT nHeight = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+		if ((nWidth <= 0) || (nHeight <= 1)) {
+			return false;
+		}
+
+		unsigned int unMaxRows = static_cast<unsigned int>(nHeight - 1);
+		const unsigned int unLimit = m_unMaxRows.load(std::memory_order_relaxed);
+		if (unLimit && (unLimit < unMaxRows)) {
+			unMaxRows = unLimit;
+		}
+
+		UpdateRates();
+
+		unsigned int unReady = 0;
+		unsigned int unFinished = 0;
+		const unsigned int unShown = SelectBars(unMaxRows, &unReady, &unFinished);
+		const bool bSummary = unShown < unReady;
+
+		SHORT nRows = static_cast<SHORT>(unShown + (bSummary ? 1 : 0));
+		if (m_bShown.load(std::memory_order_relaxed)) {
+			// The area never shrinks while it is shown, or output would have to be moved up into it.
+			nRows = std::max(nRows, m_nRows);
+		}
+
+		if (!nRows) {
+			return true;
+		}
+
+		if (nWidth != m_nWidth) {
+			m_nWidth = nWidth;
+			m_Drawn.clear();
+		}
+
+		const WORD unAttributes = csbi.wAttributes;
+		m_unAttributes = unAttributes;
+
+		CHAR_INFO Blank;
+		Blank.Char.UnicodeChar = L' ';
+		Blank.Attributes = unAttributes;
+
+		m_Frame.assign(static_cast<size_t>(nRows) * nWidth, Blank);
+
+		SHORT nLabel = 0;
+		for (unsigned int unBar : m_Visible) {
+			nLabel = std::max(nLabel, static_cast<SHORT>(std::min<size_t>(m_pBars[unBar].Label.size(), 0x7FFF)));
+		}
+
+		nLabel = std::min<SHORT>(nLabel, nWidth / 3);
+
+		SHORT nRow = 0;
+		for (unsigned int unBar : m_Visible) {
+			ComposeBar(m_Frame.data() + static_cast<size_t>(nRow) * nWidth, nWidth, nLabel, unBar);
+			++nRow;
+		}
+
+		if (bSummary) {
+			ComposeSummary(m_Frame.data() + static_cast<size_t>(nRow) * nWidth, nWidth, unReady - unShown, unReady, unFinished);
+		}
+
+		if (!m_bShown.load(std::memory_order_relaxed)) {
+			if (!Place(nRows, csbi.dwCursorPosition)) {
+				return false;
+			}
+		} else if (nRows > m_nRows) {
+			if (!Grow(nRows)) {
+				return false;
+			}
+		}
+
+		// Rows never drawn compare unequal to anything.
+		CHAR_INFO Unknown;
+		Unknown.Char.UnicodeChar = 0;
+		Unknown.Attributes = 0xFFFF;
+
+		m_Drawn.resize(m_Frame.size(), Unknown);
+
+		// Runs of changed rows go out as one rectangle each.
+		for (SHORT nFirst = 0; nFirst < nRows;) {
+			const size_t unOffset = static_cast<size_t>(nFirst) * nWidth;
+			if (!memcmp(m_Frame.data() + unOffset, m_Drawn.data() + unOffset, sizeof(CHAR_INFO) * nWidth)) {
+				++nFirst;
+				continue;
+			}
+
+			SHORT nLast = nFirst;
+			while ((nLast + 1 < nRows) && memcmp(m_Frame.data() + unOffset + static_cast<size_t>(nLast + 1 - nFirst) * nWidth, m_Drawn.data() + unOffset + static_cast<size_t>(nLast + 1 - nFirst) * nWidth, sizeof(CHAR_INFO) * nWidth)) {
+				++nLast;
+			}
+
+			SMALL_RECT Region;
+			Region.Left = 0;
+			Region.Top = m_nTop + nFirst;
+			Region.Right = nWidth - 1;
+			Region.Bottom = m_nTop + nLast;
+
+			if (!m_pConsole->BlitCells(Region, m_Frame.data() + unOffset)) {
+				m_Drawn.clear();
+				return false;
+			}
+
+			const size_t unCells = static_cast<size_t>(nLast - nFirst + 1) * nWidth;
+			memcpy(m_Drawn.data() + unOffset, m_Frame.data() + unOffset, sizeof(CHAR_INFO) * unCells);
+			m_unDrawnCells.fetch_add(unCells, std::memory_order_relaxed);
+
+			nFirst = nLast + 1;
+		}
+
+		m_unFrames.fetch_add(1, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	// Expects m_DrawLock to be held. Makes room below the output with line breaks, and reads back how far the buffer scrolled for them.
+	bool ProgressGroup::Place(SHORT nRows, COORD Cursor) {
+		std::wstring Breaks;
+		if (Cursor.X) {
+			Breaks.append(L"\r\n");
+		}
+
+		Breaks.append(static_cast<size_t>(nRows - 1), L'\n');
+
+		const SHORT nExpected = Cursor.Y + (Cursor.X ? 1 : 0) + nRows - 1;
+
+		COORD Last = Cursor;
+		if (!Breaks.empty()) {
+			if (!m_pConsole->WriteW(std::wstring_view(Breaks)) || !m_pConsole->FlushOutput() || !m_pConsole->GetCursorPosition(&Last)) {
+				return false;
+			}
+		}
+
+		const SHORT nScrolled = nExpected - Last.Y;
+
+		m_Anchor.X = Cursor.X;
+		m_Anchor.Y = std::max<SHORT>(Cursor.Y - nScrolled, 0);
+		m_nTop = Last.Y - nRows + 1;
+		m_nRows = nRows;
+		m_Drawn.clear();
+		m_bShown = true;
+
+		return true;
+	}
+
+	// Expects m_DrawLock to be held and the cursor parked at the start of the last row.
+	bool ProgressGroup::Grow(SHORT nRows) {
+		const std::wstring Breaks(static_cast<size_t>(nRows - m_nRows), L'\n');
+
+		COORD Last;
+		if (!m_pConsole->WriteW(std::wstring_view(Breaks)) || !m_pConsole->FlushOutput() || !m_pConsole->GetCursorPosition(&Last)) {
+			return false;
+		}
+
+		// What is already drawn scrolled along with the buffer.
+		const SHORT nScrolled = m_nTop + nRows - 1 - Last.Y;
+
+		m_Anchor.Y = std::max<SHORT>(m_Anchor.Y - nScrolled, 0);
+		m_nTop -= nScrolled;
+		m_nRows = nRows;
+
+		return true;
+	}
+
+	// Expects m_DrawLock to be held. Throughput is an exponential average over time, so it doesn't depend on the frame rate.
+	void ProgressGroup::UpdateRates() {
+		const unsigned int unBars = std::min(m_unBars.load(std::memory_order_relaxed), m_unCapacity);
+		const std::chrono::steady_clock::time_point Now = std::chrono::steady_clock::now();
+
+		if (m_Rates.size() < unBars) {
+			BAR_RATE Rate;
+			Rate.bSeen = false;
+			Rate.unLastValue = 0;
+			Rate.fRate = 0.0;
+			m_Rates.resize(unBars, Rate);
+		}
+
+		for (unsigned int i = 0; i < unBars; ++i) {
+			const BAR& Bar = m_pBars[i];
+			if (!Bar.bReady.load(std::memory_order_acquire) || Bar.bFinished.load(std::memory_order_relaxed)) {
+				continue;
+			}
+
+			BAR_RATE& Rate = m_Rates[i];
+			const unsigned long long unValue = Bar.Value.load(std::memory_order_relaxed);
+
+			if (!Rate.bSeen) {
+				Rate.bSeen = true;
+				Rate.unLastValue = unValue;
+				Rate.LastTime = Now;
+				continue;
+			}
+
+			const double fSeconds = std::chrono::duration<double>(Now - Rate.LastTime).count();
+			if (fSeconds <= 0.0) {
+				continue;
+			}
+
+			const double fSample = (unValue > Rate.unLastValue) ? static_cast<double>(unValue - Rate.unLastValue) / fSeconds : 0.0;
+			Rate.fRate += (1.0 - std::exp(-fSeconds / g_fProgressRateSeconds)) * (fSample - Rate.fRate);
+			Rate.unLastValue = unValue;
+			Rate.LastTime = Now;
+		}
+	}
+
+	// Expects m_DrawLock to be held. With more bars than rows, running bars go first and the latest finished ones fill what is left.
+	// The chosen bars keep the order they were added in. Returns how many there are.
+	unsigned int ProgressGroup::SelectBars(unsigned int unMaxRows, unsigned int* pReady, unsigned int* pFinished) {
+		const unsigned int unBars = std::min(m_unBars.load(std::memory_order_relaxed), m_unCapacity);
+
+		unsigned int unReady = 0;
+		unsigned int unFinished = 0;
+		for (unsigned int i = 0; i < unBars; ++i) {
+			if (!m_pBars[i].bReady.load(std::memory_order_acquire)) {
+				continue;
+			}
+
+			++unReady;
+			if (m_pBars[i].bFinished.load(std::memory_order_relaxed)) {
+				++unFinished;
+			}
+		}
+
+		*pReady = unReady;
+		*pFinished = unFinished;
+
+		m_Visible.clear();
+
+		const unsigned int unSlots = (unReady > unMaxRows) ? unMaxRows - 1 : unReady;
+
+		for (unsigned int i = 0; (i < unBars) && (m_Visible.size() < unSlots); ++i) {
+			if (m_pBars[i].bReady.load(std::memory_order_relaxed) && ((unReady <= unMaxRows) || !m_pBars[i].bFinished.load(std::memory_order_relaxed))) {
+				m_Visible.push_back(i);
+			}
+		}
+
+		if (m_Visible.size() < unSlots) {
+			for (unsigned int i = unBars; (i > 0) && (m_Visible.size() < unSlots); --i) {
+				if (m_pBars[i - 1].bReady.load(std::memory_order_relaxed) && m_pBars[i - 1].bFinished.load(std::memory_order_relaxed)) {
+					m_Visible.push_back(i - 1);
+				}
+			}
+
+			std::sort(m_Visible.begin(), m_Visible.end());
+		}
+
+		return static_cast<unsigned int>(m_Visible.size());
+	}
+
+	// Label, bar and, if the row is wide enough, percentage, counts, rate and ETA. A bar without a total shows a moving block instead.
+	void ProgressGroup::ComposeBar(CHAR_INFO* pRow, SHORT nWidth, SHORT nLabel, unsigned int unBar) {
+		const BAR& Bar = m_pBars[unBar];
+		const BAR_RATE& Rate = m_Rates[unBar];
+		const bool bFinished = Bar.bFinished.load(std::memory_order_relaxed);
+		const unsigned long long unTotal = Bar.Total.load(std::memory_order_relaxed);
+		unsigned long long unValue = Bar.Value.load(std::memory_order_relaxed);
+		if (unTotal && (unValue > unTotal)) {
+			unValue = unTotal;
+		}
+
+		const WORD unAttributes = m_unAttributes;
+
+		PutCells(pRow, 0, nLabel, Bar.Label.c_str(), unAttributes);
+
+		SHORT nBarLeft = nLabel ? nLabel + 1 : 0;
+		SHORT nBarRight = nWidth;
+
+		if (nWidth - nBarLeft >= g_nProgressStatsWidth + 11) {
+			nBarRight = nWidth - g_nProgressStatsWidth - 1;
+
+			wchar_t szPercent[8];
+			wchar_t szValue[16];
+			wchar_t szTotal[16];
+			wchar_t szRate[16];
+			wchar_t szTime[16];
+
+			FormatCount(static_cast<double>(unValue), szValue, 16);
+
+			if (unTotal) {
+				swprintf_s(szPercent, 8, L"%3u%%", static_cast<unsigned int>((unValue * 100.0) / unTotal));
+				FormatCount(static_cast<double>(unTotal), szTotal, 16);
+			} else {
+				swprintf_s(szPercent, 8, L"   -");
+				swprintf_s(szTotal, 16, L"?");
+			}
+
+			FormatCount(Rate.fRate, szRate, 16);
+
+			wchar_t szStats[64];
+			if (bFinished) {
+				swprintf_s(szStats, 64, L"%ls %5ls/%-5ls %5ls/s %11ls", szPercent, szValue, szTotal, szRate, L"done");
+			} else {
+				if (unTotal && (Rate.fRate > 0.0)) {
+					FormatDuration(static_cast<double>(unTotal - unValue) / Rate.fRate, szTime, 16);
+				} else {
+					FormatDuration(-1.0, szTime, 16);
+				}
+
+				swprintf_s(szStats, 64, L"%ls %5ls/%-5ls %5ls/s ETA %7ls", szPercent, szValue, szTotal, szRate, szTime);
+			}
+
+			PutCells(pRow, nBarRight + 1, nWidth, szStats, unAttributes);
+		}
+
+		const SHORT nBar = nBarRight - nBarLeft;
+		if (nBar <= 0) {
+			return;
+		}
+
+		const WORD unBarAttributes = MergeAttributes(unAttributes, Bar.ColorPair);
+
+		SHORT nFilledLeft = 0;
+		SHORT nFilledRight = nBar;
+		if (bFinished) {
+			// Full, whatever the counts say.
+		} else if (unTotal) {
+			nFilledRight = static_cast<SHORT>((static_cast<double>(unValue) / unTotal) * nBar);
+		} else {
+			// Bounces from one end to the other, one cell per frame.
+			const SHORT nBlock = std::min<SHORT>(4, nBar);
+			const SHORT nSpan = nBar - nBlock;
+			const SHORT nStep = nSpan ? static_cast<SHORT>(m_unFrames.load(std::memory_order_relaxed) % (2 * nSpan)) : 0;
+			nFilledLeft = (nStep <= nSpan) ? nStep : 2 * nSpan - nStep;
+			nFilledRight = nFilledLeft + nBlock;
+		}
+
+		for (SHORT i = 0; i < nBar; ++i) {
+			CHAR_INFO& Cell = pRow[nBarLeft + i];
+			if ((i >= nFilledLeft) && (i < nFilledRight)) {
+				Cell.Char.UnicodeChar = L'\x2588';
+				Cell.Attributes = unBarAttributes;
+			} else {
+				Cell.Char.UnicodeChar = L'\x2591';
+				Cell.Attributes = unAttributes;
+			}
+		}
+	}
+
+	// Stands in for the bars that got no row, with the throughput of all of them.
+	void ProgressGroup::ComposeSummary(CHAR_INFO* pRow, SHORT nWidth, unsigned int unHidden, unsigned int unReady, unsigned int unFinished) {
+		double fRate = 0.0;
+		for (size_t i = 0; i < m_Rates.size(); ++i) {
+			if (!m_pBars[i].bFinished.load(std::memory_order_relaxed)) {
+				fRate += m_Rates[i].fRate;
+			}
+		}
+
+		wchar_t szRate[16];
+		FormatCount(fRate, szRate, 16);
+
+		wchar_t szSummary[128];
+		swprintf_s(szSummary, 128, L"... %u more, %u of %u done, %ls/s in total", unHidden, unFinished, unReady, szRate);
+
+		PutCells(pRow, 0, nWidth, szSummary, m_unAttributes);
+	}
+
+	// ----------------------------------------------------------------
+	// Table
+	// ----------------------------------------------------------------
+
+	// Width limit of columns that don't set one. It also bounds how much of a cell is kept.
+	static constexpr unsigned int g_unTableMaxWidth = 256;
+
+	static constexpr wchar_t g_szTableSeparator[] = L"  ";
+
+	static bool IsSameColorPair(COLOR_PAIR A, COLOR_PAIR B) {
+		return (A.ColorBackground == B.ColorBackground) && (A.ColorForeground == B.ColorForeground);
+	}
+
+	Table::Table(SmartConsoleUtils* pConsole, TABLE_MODE Mode) {
+		m_pConsole = pConsole;
+		m_Mode = Mode;
+		m_HeaderColor = COLOR_PAIR();
+		m_unSampleRows = 256;
+		m_unBatchRows = 64;
+		m_bHeader = false;
+		m_unRows = 0;
+		m_unStoredRows = 0;
+		m_unBatchedRows = 0;
+		m_RunColor = COLOR_PAIR();
+	}
+
+	Table::~Table() {
+		Flush();
+	}
+
+	bool Table::AddColumnA(char const* const szTitle, TABLE_ALIGN Align, COLOR_PAIR ColorPair, unsigned int unMaxWidth) {
+		if (!szTitle) {
+			return false;
+		}
+
+		std::wstring Title;
+		if (!ToWideText(szTitle, GetConsoleApi()->GetConsoleOutputCP(), Title)) {
+			return false;
+		}
+
+		return AddColumnW(Title.c_str(), Align, ColorPair, unMaxWidth);
+	}
+
+	// A width limit of zero takes g_unTableMaxWidth.
+	bool Table::AddColumnW(wchar_t const* const szTitle, TABLE_ALIGN Align, COLOR_PAIR ColorPair, unsigned int unMaxWidth) {
+		if (!szTitle || m_unRows || m_bHeader) {
+			return false;
+		}
+
+		COLUMN Column;
+		Column.Title = szTitle;
+		Column.Align = Align;
+		Column.ColorPair = ColorPair;
+		Column.unMaxWidth = std::min(unMaxWidth ? unMaxWidth : g_unTableMaxWidth, 0x7FFFu);
+		Column.unWidth = static_cast<unsigned int>(std::min<size_t>(Column.Title.size(), Column.unMaxWidth));
+		Column.unWindowMax = 0;
+		Column.unNarrowRows = 0;
+
+		m_Columns.push_back(std::move(Column));
+
+		return true;
+	}
+
+#ifdef UNICODE
+	bool Table::AddColumn(wchar_t const* const szTitle, TABLE_ALIGN Align, COLOR_PAIR ColorPair, unsigned int unMaxWidth) {
+		return AddColumnW(szTitle, Align, ColorPair, unMaxWidth);
+	}
+#else
+	bool Table::AddColumn(char const* const szTitle, TABLE_ALIGN Align, COLOR_PAIR ColorPair, unsigned int unMaxWidth) {
+		return AddColumnA(szTitle, Align, ColorPair, unMaxWidth);
+	}
+#endif
+
+	bool Table::SetHeaderColor(COLOR_PAIR ColorPair) {
+		m_HeaderColor = ColorPair;
+
+		return true;
+	}
+
+	// Rows a streaming table holds back to size its columns before the header goes out, and the length of the window after that.
+	bool Table::SetSampleRows(unsigned int unRows) {
+		if (!unRows || m_unRows) {
+			return false;
+		}
+
+		m_unSampleRows = unRows;
+
+		return true;
+	}
+
+	bool Table::SetBatchRows(unsigned int unRows) {
+		if (!unRows) {
+			return false;
+		}
+
+		m_unBatchRows = unRows;
+
+		return true;
+	}
+
+	unsigned int Table::GetColumns() {
+		return static_cast<unsigned int>(m_Columns.size());
+	}
+
+	// Cells are in the console output code page, like the rest of the narrow output.
+	bool Table::AddRowA(const std::string_view* pCells, unsigned int unCells) {
+		if (!pCells && unCells) {
+			return false;
+		}
+
+		const UINT unCodePage = GetConsoleApi()->GetConsoleOutputCP();
+
+		m_Convert.clear();
+		m_ConvertEnds.clear();
+
+		for (unsigned int i = 0; i < unCells; ++i) {
+			const int nLength = static_cast<int>(pCells[i].size());
+			if (nLength) {
+				const int nWideLength = MultiByteToWideChar(unCodePage, 0, pCells[i].data(), nLength, nullptr, 0);
+				if (nWideLength <= 0) {
+					return false;
+				}
+
+				const size_t unOffset = m_Convert.size();
+				m_Convert.resize(unOffset + nWideLength);
+
+				if (MultiByteToWideChar(unCodePage, 0, pCells[i].data(), nLength, m_Convert.data() + unOffset, nWideLength) != nWideLength) {
+					return false;
+				}
+			}
+
+			m_ConvertEnds.push_back(m_Convert.size());
+		}
+
+		m_ConvertCells.clear();
+
+		size_t unStart = 0;
+		for (size_t unEnd : m_ConvertEnds) {
+			m_ConvertCells.emplace_back(m_Convert.data() + unStart, unEnd - unStart);
+			unStart = unEnd;
+		}
+
+		return AddRowW(m_ConvertCells.data(), unCells);
+	}
+
+	// A streaming table holds the first rows back until the sample is complete, then writes each row as it comes.
+	bool Table::AddRowW(const std::wstring_view* pCells, unsigned int unCells) {
+		if ((!pCells && unCells) || m_Columns.empty()) {
+			return false;
+		}
+
+		if (m_Mode == TABLE_MODE::TABLE_MODE_STREAMING) {
+			AddToWindow(pCells, unCells);
+
+			if (m_bHeader) {
+				WriteRow(pCells, unCells);
+				++m_unRows;
+				return EndRow();
+			}
+		}
+
+		StoreRow(pCells, unCells);
+		++m_unRows;
+
+		if ((m_Mode == TABLE_MODE::TABLE_MODE_STREAMING) && (m_unStoredRows >= m_unSampleRows)) {
+			return WriteStored();
+		}
+
+		return true;
+	}
+
+#ifdef UNICODE
+	bool Table::AddRow(const std::wstring_view* pCells, unsigned int unCells) {
+		return AddRowW(pCells, unCells);
+	}
+#else
+	bool Table::AddRow(const std::string_view* pCells, unsigned int unCells) {
+		return AddRowA(pCells, unCells);
+	}
+#endif
+
+	// Writes what is held back, the header at least, and sends the open batch. Buffered tables size their columns for these rows.
+	bool Table::Flush() {
+		if (m_Columns.empty()) {
+			return false;
+		}
+
+		bool bResult = true;
+		if (m_unStoredRows || !m_bHeader) {
+			bResult = WriteStored();
+		}
+
+		EndRun();
+		m_unBatchedRows = 0;
+
+		return m_Writer.Commit(m_pConsole) && bResult;
+	}
+
+	unsigned long long Table::GetRows() {
+		return m_unRows;
+	}
+
+	// Held by the table itself. The batch being written adds at most a batch of rows on top.
+	size_t Table::GetBufferedBytes() {
+		size_t unBytes = m_Window.capacity() * sizeof(unsigned int) + m_Run.capacity() * sizeof(wchar_t);
+		for (const COLUMN& Column : m_Columns) {
+			unBytes += Column.Lengths.capacity() * sizeof(unsigned int) + Column.Text.capacity() * sizeof(wchar_t) + Column.Ends.capacity() * sizeof(size_t);
+		}
+
+		return unBytes;
+	}
+
+	// Columns widen as soon as a row needs it, and narrow to the window only after a whole window of rows fit into less.
+	// The window keeps a count per cell length, so the longest cell in it is found without going over its rows.
+	void Table::AddToWindow(const std::wstring_view* pCells, unsigned int unCells) {
+		const size_t unColumns = m_Columns.size();
+
+		if (m_Window.empty()) {
+			m_Window.assign(static_cast<size_t>(m_unSampleRows) * unColumns, 0);
+
+			for (COLUMN& Column : m_Columns) {
+				Column.Lengths.assign(static_cast<size_t>(Column.unMaxWidth) + 2, 0);
+			}
+		}
+
+		const size_t unSlot = static_cast<size_t>(m_unRows % m_unSampleRows) * unColumns;
+		const bool bFull = m_unRows >= m_unSampleRows;
+
+		for (size_t i = 0; i < unColumns; ++i) {
+			COLUMN& Column = m_Columns[i];
+
+			const unsigned int unLength = (i < unCells) ? static_cast<unsigned int>(std::min<size_t>(pCells[i].size(), static_cast<size_t>(Column.unMaxWidth) + 1)) : 0;
+
+			if (bFull) {
+				--Column.Lengths[m_Window[unSlot + i]];
+			}
+
+			m_Window[unSlot + i] = unLength;
+			++Column.Lengths[unLength];
+
+			if (unLength > Column.unWindowMax) {
+				Column.unWindowMax = unLength;
+			}
+
+			while (Column.unWindowMax && !Column.Lengths[Column.unWindowMax]) {
+				--Column.unWindowMax;
+			}
+
+			const unsigned int unWidth = std::min(std::max(Column.unWindowMax, static_cast<unsigned int>(std::min<size_t>(Column.Title.size(), Column.unMaxWidth))), Column.unMaxWidth);
+
+			if (unWidth >= Column.unWidth) {
+				Column.unWidth = unWidth;
+				Column.unNarrowRows = 0;
+			} else if (++Column.unNarrowRows >= m_unSampleRows) {
+				Column.unWidth = unWidth;
+				Column.unNarrowRows = 0;
+			}
+		}
+	}
+
+	// Only as much of a cell is kept as its column can show, plus one character to tell that it has to be cut.
+	void Table::StoreRow(const std::wstring_view* pCells, unsigned int unCells) {
+		for (size_t i = 0; i < m_Columns.size(); ++i) {
+			COLUMN& Column = m_Columns[i];
+
+			if (i < unCells) {
+				Column.Text.append(pCells[i].data(), std::min<size_t>(pCells[i].size(), static_cast<size_t>(Column.unMaxWidth) + 1));
+			}
+
+			Column.Ends.push_back(Column.Text.size());
+		}
+
+		++m_unStoredRows;
+	}
+
+	bool Table::WriteStored() {
+		if (m_Mode == TABLE_MODE::TABLE_MODE_BUFFERED) {
+			// Exact widths from one pass over the cell ends of each column.
+			for (COLUMN& Column : m_Columns) {
+				unsigned int unWidth = static_cast<unsigned int>(std::min<size_t>(Column.Title.size(), Column.unMaxWidth));
+
+				size_t unStart = 0;
+				for (size_t unEnd : Column.Ends) {
+					unWidth = std::max(unWidth, static_cast<unsigned int>(std::min<size_t>(unEnd - unStart, Column.unMaxWidth)));
+					unStart = unEnd;
+				}
+
+				Column.unWidth = unWidth;
+			}
+		}
+
+		if (!m_bHeader) {
+			WriteHeader();
+			m_bHeader = true;
+		}
+
+		bool bResult = true;
+
+		for (size_t i = 0; i < m_unStoredRows; ++i) {
+			m_Cells.clear();
+
+			for (const COLUMN& Column : m_Columns) {
+				const size_t unStart = i ? Column.Ends[i - 1] : 0;
+				m_Cells.emplace_back(Column.Text.data() + unStart, Column.Ends[i] - unStart);
+			}
+
+			WriteRow(m_Cells.data(), static_cast<unsigned int>(m_Cells.size()));
+
+			if (!EndRow()) {
+				bResult = false;
+			}
+		}
+
+		for (COLUMN& Column : m_Columns) {
+			Column.Text.clear();
+			Column.Ends.clear();
+		}
+
+		m_unStoredRows = 0;
+
+		return bResult;
+	}
+
+	// Titles, and a rule under each of them as wide as the column.
+	void Table::WriteHeader() {
+		for (size_t i = 0; i < m_Columns.size(); ++i) {
+			if (i) {
+				SetRunColor(COLOR_PAIR());
+				m_Run.append(g_szTableSeparator);
+			}
+
+			WriteCell(m_Columns[i].Title, static_cast<unsigned int>(i), m_HeaderColor);
+		}
+
+		SetRunColor(COLOR_PAIR());
+		m_Run.push_back(L'\n');
+
+		for (size_t i = 0; i < m_Columns.size(); ++i) {
+			if (i) {
+				SetRunColor(COLOR_PAIR());
+				m_Run.append(g_szTableSeparator);
+			}
+
+			SetRunColor(m_HeaderColor);
+			m_Run.append(m_Columns[i].unWidth, L'-');
+		}
+
+		SetRunColor(COLOR_PAIR());
+		m_Run.push_back(L'\n');
+	}
+
+	void Table::WriteRow(const std::wstring_view* pCells, unsigned int unCells) {
+		for (size_t i = 0; i < m_Columns.size(); ++i) {
+			if (i) {
+				SetRunColor(COLOR_PAIR());
+				m_Run.append(g_szTableSeparator);
+			}
+
+			WriteCell((i < unCells) ? pCells[i] : std::wstring_view(), static_cast<unsigned int>(i), m_Columns[i].ColorPair);
+		}
+
+		SetRunColor(COLOR_PAIR());
+		m_Run.push_back(L'\n');
+	}
+
+	// Pads the cell to the column width, or cuts it. Control characters become spaces so they can't break the layout.
+	// The last column isn't padded on the right unless its background shows.
+	void Table::WriteCell(const std::wstring_view& Cell, unsigned int unColumn, COLOR_PAIR ColorPair) {
+		const COLUMN& Column = m_Columns[unColumn];
+		const size_t unWidth = Column.unWidth;
+
+		size_t unText = Cell.size();
+		bool bCut = false;
+		if (unText > unWidth) {
+			bCut = unWidth > 3;
+			unText = bCut ? unWidth - 3 : unWidth;
+		}
+
+		const size_t unPadding = unWidth - unText - (bCut ? 3 : 0);
+
+		size_t unLeft = 0;
+		if (Column.Align == TABLE_ALIGN::TABLE_ALIGN_RIGHT) {
+			unLeft = unPadding;
+		} else if (Column.Align == TABLE_ALIGN::TABLE_ALIGN_CENTER) {
+			unLeft = unPadding / 2;
+		}
+
+		size_t unRight = unPadding - unLeft;
+		if ((unColumn + 1 == m_Columns.size()) && (ColorPair.ColorBackground == COLOR::COLOR_UNKNOWN)) {
+			unRight = 0;
+		}
+
+		SetRunColor(ColorPair);
+
+		m_Run.append(unLeft, L' ');
+
+		for (size_t i = 0; i < unText; ++i) {
+			const wchar_t unChar = Cell[i];
+			m_Run.push_back(((unChar < 0x20) || (unChar == 0x7F)) ? L' ' : unChar);
+		}
+
+		if (bCut) {
+			m_Run.append(L"...");
+		}
+
+		m_Run.append(unRight, L' ');
+	}
+
+	// Text of one color is gathered into a single span, which is what keeps the span count per row low.
+	void Table::SetRunColor(COLOR_PAIR ColorPair) {
+		if (IsSameColorPair(ColorPair, m_RunColor)) {
+			return;
+		}
+
+		EndRun();
+
+		m_RunColor = ColorPair;
+	}
+
+	void Table::EndRun() {
+		if (m_Run.empty()) {
+			return;
+		}
+
+		m_Writer.AddW(m_RunColor, m_Run.data(), static_cast<unsigned int>(m_Run.size()));
+		m_Run.clear();
+	}
+
+	bool Table::EndRow() {
+		if (++m_unBatchedRows < m_unBatchRows) {
+			return true;
+		}
+
+		EndRun();
+		m_unBatchedRows = 0;
+
+		return m_Writer.Commit(m_pConsole);
+	}
+
+	// ----------------------------------------------------------------
+	// Format buffers
+	// ----------------------------------------------------------------
+
+	// Characters formatted on the stack before falling back to the thread-local buffer.
+	static constexpr size_t g_unStackFormatLength = 1024;
+
+	static thread_local std::vector<char> g_FormatBufferA;
+	static thread_local std::vector<wchar_t> g_FormatBufferW;
+	static thread_local std::vector<char> g_PrintBufferA;
+	static thread_local std::vector<wchar_t> g_PrintBufferW;
+
+	std::vector<char>& GetPrintBuffer(char) {
+		return g_PrintBufferA;
+	}
+
+	std::vector<wchar_t>& GetPrintBuffer(wchar_t) {
+		return g_PrintBufferW;
+	}
+
+	// Formats into szStackBuffer when the text fits, otherwise into a thread-local buffer that only grows.
+	// unPrefix characters are kept free in front of the text and unSuffix characters plus the terminator after it.
+	static char* FormatA(char* szStackBuffer, size_t unStackSize, size_t unPrefix, size_t unSuffix, char const* const _Format, va_list vargs, int* pLength) {
+		va_list vargsCopy;
+		va_copy(vargsCopy, vargs);
+		int nLength = vsnprintf(szStackBuffer + unPrefix, unStackSize - unPrefix - unSuffix, _Format, vargsCopy);
+		va_end(vargsCopy);
+
+		if (nLength < 0) {
+			return nullptr;
+		}
+
+		*pLength = nLength;
+
+		if (static_cast<size_t>(nLength) < unStackSize - unPrefix - unSuffix) {
+			return szStackBuffer;
+		}
+
+		const size_t unRequired = unPrefix + nLength + unSuffix + 1;
+		if (g_FormatBufferA.size() < unRequired) {
+			g_FormatBufferA.resize(unRequired);
+		}
+
+		if (vsnprintf(g_FormatBufferA.data() + unPrefix, static_cast<size_t>(nLength) + 1, _Format, vargs) != nLength) {
+			return nullptr;
+		}
+
+		return g_FormatBufferA.data();
+	}
+
+	static wchar_t* FormatW(wchar_t* szStackBuffer, size_t unStackSize, size_t unPrefix, size_t unSuffix, wchar_t const* const _Format, va_list vargs, int* pLength) {
+		va_list vargsCopy;
+		va_copy(vargsCopy, vargs);
+		int nLength = vswprintf(szStackBuffer + unPrefix, unStackSize - unPrefix - unSuffix, _Format, vargsCopy);
+		va_end(vargsCopy);
+
+		if (nLength >= 0) {
+			*pLength = nLength;
+			return szStackBuffer;
+		}
+
+		// vswprintf doesn't report the required length on truncation.
+		va_copy(vargsCopy, vargs);
+		nLength = _vscwprintf(_Format, vargsCopy);
+		va_end(vargsCopy);
+
+		if (nLength < 0) {
+			return nullptr;
+		}
+
+		*pLength = nLength;
+
+		const size_t unRequired = unPrefix + nLength + unSuffix + 1;
+		if (g_FormatBufferW.size() < unRequired) {
+			g_FormatBufferW.resize(unRequired);
+		}
+
+		if (vswprintf(g_FormatBufferW.data() + unPrefix, static_cast<size_t>(nLength) + 1, _Format, vargs) != nLength) {
+			return nullptr;
+		}
+
+		return g_FormatBufferW.data();
+	}
+
+	// ----------------------------------------------------------------
+	// print/scan with format and color support
+	// ----------------------------------------------------------------
+
+	// Without console attributes (e.g. redirected output) the colors are reset to the terminal defaults afterwards.
+	static char const* GetRestoreSequence(SmartConsoleUtils* pSCU, unsigned int* pLength) {
+		WORD unAttributes = 0;
+		if (!pSCU->GetAttributes(&unAttributes)) {
+			if (pLength) {
+				*pLength = 4;
+			}
+			return "\x1B[0m";
+		}
+
+		return GetColorSequence(COLOR_PAIR(static_cast<COLOR>((unAttributes & 0xF0) >> 4), static_cast<COLOR>(unAttributes & 0x0F)), pLength);
+	}
+
+	// Writes the color switch, the text and the color restore in a single write.
+	// Formatting happens outside the output lock, the restore sequence depends on the console state and is filled in under it.
+	static int clrvprintfVT(SmartConsoleUtils* pSCU, COLOR_PAIR ColorPair, char const* const _Format, va_list vargs) {
+		unsigned int unPrefixLength = 0;
+		char const* szPrefix = GetColorSequence(ColorPair, &unPrefixLength);
+
+		char szStackBuffer[g_unStackFormatLength];
+
+		int nLength = 0;
+		char* szBuffer = FormatA(szStackBuffer, g_unStackFormatLength, unPrefixLength, g_unMaxColorSequenceLength, _Format, vargs, &nLength);
+		if (!szBuffer) {
+			return -1;
+		}
+
+		memcpy(szBuffer, szPrefix, unPrefixLength);
+
+		std::lock_guard<std::mutex> Lock(pSCU->GetOutputLock());
+
+		unsigned int unSuffixLength = 0;
+		char const* szSuffix = GetRestoreSequence(pSCU, &unSuffixLength);
+
+		memcpy(szBuffer + unPrefixLength + nLength, szSuffix, unSuffixLength);
+		szBuffer[unPrefixLength + nLength + unSuffixLength] = 0;
+
+		if (!pSCU->WriteA(szBuffer)) {
+			return -1;
+		}
+
+		return nLength;
+	}
+
+	static int clrvwprintfVT(SmartConsoleUtils* pSCU, COLOR_PAIR ColorPair, wchar_t const* const _Format, va_list vargs) {
+		unsigned int unPrefixLength = 0;
+		char const* szPrefix = GetColorSequence(ColorPair, &unPrefixLength);
+
+		wchar_t szStackBuffer[g_unStackFormatLength];
+
+		int nLength = 0;
+		wchar_t* szBuffer = FormatW(szStackBuffer, g_unStackFormatLength, unPrefixLength, g_unMaxColorSequenceLength, _Format, vargs, &nLength);
+		if (!szBuffer) {
+			return -1;
+		}
+
+		for (unsigned int i = 0; i < unPrefixLength; ++i) {
+			szBuffer[i] = static_cast<wchar_t>(szPrefix[i]);
+		}
+
+		std::lock_guard<std::mutex> Lock(pSCU->GetOutputLock());
+
+		unsigned int unSuffixLength = 0;
+		char const* szSuffix = GetRestoreSequence(pSCU, &unSuffixLength);
+
+		for (unsigned int i = 0; i < unSuffixLength; ++i) {
+			szBuffer[unPrefixLength + nLength + i] = static_cast<wchar_t>(szSuffix[i]);
+		}
+		szBuffer[unPrefixLength + nLength + unSuffixLength] = 0;
+
+		if (!pSCU->WriteW(szBuffer)) {
+			return -1;
+		}
+
+		return nLength;
+	}
+
+	// Formats on the calling thread and leaves the console calls to the writer thread.
+	static int clrvprintfAsync(AsyncSink* pSink, COLOR_PAIR ColorPair, char const* const _Format, va_list vargs) {
+		char szStackBuffer[g_unStackFormatLength];
+
+		int nLength = 0;
+		char* szBuffer = FormatA(szStackBuffer, g_unStackFormatLength, 0, 0, _Format, vargs, &nLength);
+		if (!szBuffer) {
+			return -1;
+		}
+
+		if (!pSink->PushA(ColorPair, szBuffer, static_cast<unsigned int>(nLength))) {
+			return -1;
+		}
+
+		return nLength;
+	}
+
+	static int clrvwprintfAsync(AsyncSink* pSink, COLOR_PAIR ColorPair, wchar_t const* const _Format, va_list vargs) {
+		wchar_t szStackBuffer[g_unStackFormatLength];
+
+		int nLength = 0;
+		wchar_t* szBuffer = FormatW(szStackBuffer, g_unStackFormatLength, 0, 0, _Format, vargs, &nLength);
+		if (!szBuffer) {
+			return -1;
+		}
+
+		if (!pSink->PushW(ColorPair, szBuffer, static_cast<unsigned int>(nLength))) {
+			return -1;
+		}
+
+		return nLength;
+	}
+
+	int clrvprintf(COLOR_PAIR ColorPair, char const* const _Format, va_list vargs) {
+		ConsoleReference Reference;
+		SmartConsoleUtils* pSCU = Reference.Get();
+
+		AsyncSink* pSink = pSCU->GetAsyncSink();
+		if (pSink && !pSink->IsWriterThread()) {
+			return clrvprintfAsync(pSink, ColorPair, _Format, vargs);
+		}
+
+		if (pSCU->IsVirtualTerminal()) {
+			return clrvprintfVT(pSCU, ColorPair, _Format, vargs);
+		}
+
+		char szStackBuffer[g_unStackFormatLength];
+
+		int nLength = 0;
+		char* szBuffer = FormatA(szStackBuffer, g_unStackFormatLength, 0, 0, _Format, vargs, &nLength);
+		if (!szBuffer) {
+			return -1;
+		}
+
+		std::lock_guard<std::mutex> Lock(pSCU->GetOutputLock());
+
+		if (!pSCU->SetCursorColor(ColorPair)) {
+			return -1;
+		}
+
+		if (!pSCU->WriteA(szBuffer)) {
+			pSCU->RestoreCursorColor(true);
+			return -1;
+		}
+
+		if (!pSCU->RestoreCursorColor(true)) {
+			return -1;
+		}
+
+		return nLength;
+	}
+
+	int clrvprintf(COLOR unForegroundColor, char const* const _Format, va_list vargs) {
+		return clrvprintf(COLOR_PAIR(unForegroundColor), _Format, vargs);
+	}
+
+	int clrprintf(COLOR_PAIR ColorPair, char const* const _Format, ...) {
+		va_list vargs;
+		va_start(vargs, _Format);
+		int nLength = clrvprintf(ColorPair, _Format, vargs);
+		va_end(vargs);
+		return nLength;
+	}
+
+	int clrprintf(COLOR unForegroundColor, char const* const _Format, ...) {
+		va_list vargs;
+		va_start(vargs, _Format);
+		int nLength = clrvprintf(unForegroundColor, _Format, vargs);
+		va_end(vargs);
+		return nLength;
+	}
+
+	int clrvwprintf(COLOR_PAIR ColorPair, wchar_t const* const _Format, va_list vargs) {
+		ConsoleReference Reference;
+		SmartConsoleUtils* pSCU = Reference.Get();
+
+		AsyncSink* pSink = pSCU->GetAsyncSink();
+		if (pSink && !pSink->IsWriterThread()) {
+			return clrvwprintfAsync(pSink, ColorPair, _Format, vargs);
+		}
+
+		if (pSCU->IsVirtualTerminal()) {
+			return clrvwprintfVT(pSCU, ColorPair, _Format, vargs);
+		}
+
+		wchar_t szStackBuffer[g_unStackFormatLength];
+
+		int nLength = 0;
+		wchar_t* szBuffer = FormatW(szStackBuffer, g_unStackFormatLength, 0, 0, _Format, vargs, &nLength);
+		if (!szBuffer) {
+			return -1;
+		}
+
+		std::lock_guard<std::mutex> Lock(pSCU->GetOutputLock());
+
+		if (!pSCU->SetCursorColor(ColorPair)) {
+			return -1;
+		}
+
+		if (!pSCU->WriteW(szBuffer)) {
+			pSCU->RestoreCursorColor(true);
+			return -1;
+		}
+
+		if (!pSCU->RestoreCursorColor(true)) {
+			return -1;
+		}
+
+		return nLength;
+	}
+
+	int clrvwprintf(COLOR unForegroundColor, wchar_t const* const _Format, va_list vargs) {
+		return clrvwprintf(COLOR_PAIR(unForegroundColor), _Format, vargs);
+	}
+
+	int clrwprintf(COLOR_PAIR ColorPair, wchar_t const* const _Format, ...) {
+		va_list vargs;
+		va_start(vargs, _Format);
+		int nLength = clrvwprintf(ColorPair, _Format, vargs);
+		va_end(vargs);
+		return nLength;
+	}
+
+	int clrwprintf(COLOR unForegroundColor, wchar_t const* const _Format, ...) {
+		va_list vargs;
+		va_start(vargs, _Format);
+		int nLength = clrvwprintf(unForegroundColor, _Format, vargs);
+		va_end(vargs);
+		return nLength;
+	}
+
+#ifdef UNICODE
+	int tclrvprintf(COLOR_PAIR ColorPair, wchar_t const* const _Format, va_list vargs) {
+		return clrvwprintf(ColorPair, _Format, vargs);
+	}
+
+	int tclrvprintf(COLOR unForegroundColor, wchar_t const* const _Format, va_list vargs) {
+		return clrvwprintf(unForegroundColor, _Format, vargs);
+	}
+
+	int tclrprintf(COLOR_PAIR ColorPair, wchar_t const* const _Format, ...) {
+		va_list vargs;
+		va_start(vargs, _Format);
+		int nLength = tclrvprintf(ColorPair, _Format, vargs);
+		va_end(vargs);
+		return nLength;
+	}
+
+	int tclrprintf(COLOR unForegroundColor, wchar_t const* const _Format, ...) {
+		va_list vargs;
+		va_start(vargs, _Format);
+		int nLength = tclrvprintf(unForegroundColor, _Format, vargs);
+		va_end(vargs);
+		return nLength;
+	}
+#else
+	int tclrvprintf(COLOR_PAIR ColorPair, char const* const _Format, va_list vargs) {
+		return clrvprintf(ColorPair, _Format, vargs);
+	}
+
+	int tclrvprintf(COLOR unForegroundColor, char const* const _Format, va_list vargs) {
+		return clrvprintf(unForegroundColor, _Format, vargs);
+	}
+
+	int tclrprintf(COLOR_PAIR ColorPair, char const* const _Format, ...) {
+		va_list vargs;
+		va_start(vargs, _Format);
+		int nLength = tclrvprintf(ColorPair, _Format, vargs);
+		va_end(vargs);
+		return nLength;
+	}
+
+	int tclrprintf(COLOR unForegroundColor, char const* const _Format, ...) {
+		va_list vargs;
+		va_start(vargs, _Format);
+		int nLength = tclrvprintf(unForegroundColor, _Format, vargs);
+		va_end(vargs);
+		return nLength;
+	}
+#endif
+
+	int clrputs(COLOR_PAIR ColorPair, char const* const szText) {
+		if (!szText) {
+			return -1;
+		}
+
+		const size_t unLength = strlen(szText);
+
+		ConsoleReference Reference;
+		SmartConsoleUtils* pSCU = Reference.Get();
+
+		AsyncSink* pSink = pSCU->GetAsyncSink();
+		if (pSink && !pSink->IsWriterThread()) {
+			if (!pSink->PushA(ColorPair, szText, static_cast<unsigned int>(unLength))) {
+				return -1;
+			}
+
+			return static_cast<int>(unLength);
+		}
+
+		if (pSCU->IsVirtualTerminal()) {
+			unsigned int unPrefixLength = 0;
+			char const* szPrefix = GetColorSequence(ColorPair, &unPrefixLength);
+
+			char szStackBuffer[g_unStackFormatLength];
+			char* szBuffer = szStackBuffer;
+
+			const size_t unRequired = unPrefixLength + unLength + g_unMaxColorSequenceLength + 1;
+			if (unRequired > g_unStackFormatLength) {
+				if (g_FormatBufferA.size() < unRequired) {
+					g_FormatBufferA.resize(unRequired);
+				}
+				szBuffer = g_FormatBufferA.data();
+			}
+
+			memcpy(szBuffer, szPrefix, unPrefixLength);
+			memcpy(szBuffer + unPrefixLength, szText, unLength);
+
+			std::lock_guard<std::mutex> Lock(pSCU->GetOutputLock());
+
+			unsigned int unSuffixLength = 0;
+			char const* szSuffix = GetRestoreSequence(pSCU, &unSuffixLength);
+
+			memcpy(szBuffer + unPrefixLength + unLength, szSuffix, unSuffixLength);
+			szBuffer[unPrefixLength + unLength + unSuffixLength] = 0;
+
+			if (!pSCU->WriteA(szBuffer)) {
+				return -1;
+			}
+
+			return static_cast<int>(unLength);
+		}
+
+		std::lock_guard<std::mutex> Lock(pSCU->GetOutputLock());
+
+		if (!pSCU->SetCursorColor(ColorPair)) {
+			return -1;
+		}
+
+		if (!pSCU->WriteA(szText)) {
+			pSCU->RestoreCursorColor(true);
+			return -1;
+		}
+
+		if (!pSCU->RestoreCursorColor(true)) {
+			return -1;
+		}
+
+		return static_cast<int>(unLength);
+	}
+
+	int clrputs(COLOR unForegroundColor, char const* const szText) {
+		return clrputs(COLOR_PAIR(unForegroundColor), szText);
+	}
+
+	int clrwputs(COLOR_PAIR ColorPair, wchar_t const* const szText) {
+		if (!szText) {
+			return -1;
+		}
+
+		const size_t unLength = wcslen(szText);
+
+		ConsoleReference Reference;
+		SmartConsoleUtils* pSCU = Reference.Get();
+
+		AsyncSink* pSink = pSCU->GetAsyncSink();
+		if (pSink && !pSink->IsWriterThread()) {
+			if (!pSink->PushW(ColorPair, szText, static_cast<unsigned int>(unLength))) {
+				return -1;
+			}
+
+			return static_cast<int>(unLength);
+		}
+
+		if (pSCU->IsVirtualTerminal()) {
+			unsigned int unPrefixLength = 0;
+			char const* szPrefix = GetColorSequence(ColorPair, &unPrefixLength);
+
+			wchar_t szStackBuffer[g_unStackFormatLength];
+			wchar_t* szBuffer = szStackBuffer;
+
+			const size_t unRequired = unPrefixLength + unLength + g_unMaxColorSequenceLength + 1;
+			if (unRequired > g_unStackFormatLength) {
+				if (g_FormatBufferW.size() < unRequired) {
+					g_FormatBufferW.resize(unRequired);
+				}
+				szBuffer = g_FormatBufferW.data();
+			}
+
+			for (unsigned int i = 0; i < unPrefixLength; ++i) {
+				szBuffer[i] = static_cast<wchar_t>(szPrefix[i]);
+			}
+
+			memcpy(szBuffer + unPrefixLength, szText, unLength * sizeof(wchar_t));
+
+			std::lock_guard<std::mutex> Lock(pSCU->GetOutputLock());
+
+			unsigned int unSuffixLength = 0;
+			char const* szSuffix = GetRestoreSequence(pSCU, &unSuffixLength);
+
+			for (unsigned int i = 0; i < unSuffixLength; ++i) {
+				szBuffer[unPrefixLength + unLength + i] = static_cast<wchar_t>(szSuffix[i]);
+			}
+			szBuffer[unPrefixLength + unLength + unSuffixLength] = 0;
+
+			if (!pSCU->WriteW(szBuffer)) {
+				return -1;
+			}
+
+			return static_cast<int>(unLength);
+		}
+
+		std::lock_guard<std::mutex> Lock(pSCU->GetOutputLock());
+
+		if (!pSCU->SetCursorColor(ColorPair)) {
+			return -1;
+		}
+
+		if (!pSCU->WriteW(szText)) {
+			pSCU->RestoreCursorColor(true);
+			return -1;
+		}
+
+		if (!pSCU->RestoreCursorColor(true)) {
+			return -1;
+		}
+
+		return static_cast<int>(unLength);
+	}
+
+	int clrwputs(COLOR unForegroundColor, wchar_t const* const szText) {
+		return clrwputs(COLOR_PAIR(unForegroundColor), szText);
+	}
+
+#ifdef UNICODE
+	int tclrputs(COLOR_PAIR ColorPair, wchar_t const* const szText) {
+		return clrwputs(ColorPair, szText);
+	}
+
+	int tclrputs(COLOR unForegroundColor, wchar_t const* const szText) {
+		return clrwputs(unForegroundColor, szText);
+	}
+#else
+	int tclrputs(COLOR_PAIR ColorPair, char const* const szText) {
+		return clrputs(ColorPair, szText);
+	}
+
+	int tclrputs(COLOR unForegroundColor, char const* const szText) {
+		return clrputs(unForegroundColor, szText);
+	}
+#endif
+
+	int clrvscanf(COLOR_PAIR ColorPair, char const* const _Format, va_list vargs) {
+		char* szBuffer = new char[8192];
+		if (!szBuffer) {
+			return -1;
+		}
+
+		memset(szBuffer, 0, sizeof(char) * 8192);
+
+		ConsoleReference Reference;
+		SmartConsoleUtils* pSCU = Reference.Get();
+
+		// Input can take forever, so the output lock only covers the color switches around it.
+		// Prints in between change the console's previous color, so the one to go back to is kept here.
+		COLOR_PAIR PreviousColorPair;
+		{
+			std::lock_guard<std::mutex> Lock(pSCU->GetOutputLock());
+
+			if (!pSCU->GetCursorColor(&PreviousColorPair) || !pSCU->SetCursorColor(ColorPair)) {
+				delete[] szBuffer;
+				return -1;
+			}
+		}
+
+		const bool bRead = pSCU->ReadA(szBuffer, 8191);
+
+		{
+			std::lock_guard<std::mutex> Lock(pSCU->GetOutputLock());
+
+			if (!pSCU->SetCursorColor(PreviousColorPair) || !bRead) {
+				delete[] szBuffer;
+				return -1;
+			}
+		}
+
+		int nLength = vsscanf_s(szBuffer, _Format, vargs);
+
+		delete[] szBuffer;
+		return nLength;
+	}
+
+	int clrvscanf(COLOR unForegroundColor, char const* const _Format, va_list vargs) {
+		return clrvscanf(COLOR_PAIR(unForegroundColor), _Format, vargs);
+	}
+
+	int clrscanf(COLOR_PAIR ColorPair, char const* const _Format, ...) {
+		va_list vargs;
+		va_start(vargs, _Format);
+		int nLength = clrvscanf(ColorPair, _Format, vargs);
+		va_end(vargs);
+		return nLength;
+	}
+
+	int clrscanf(COLOR unForegroundColor, char const* const _Format, ...) {
+		va_list vargs;
+		va_start(vargs, _Format);
+		int nLength = clrvscanf(COLOR_PAIR(unForegroundColor), _Format, vargs);
+		va_end(vargs);
+		return nLength;
+	}
+
+	int clrvwscanf(COLOR_PAIR ColorPair, wchar_t const* const _Format, va_list vargs) {
+		wchar_t* szBuffer = new wchar_t[8192];
+		if (!szBuffer) {
+			return -1;
+		}
+
+		memset(szBuffer, 0, sizeof(wchar_t) * 8192);
+
+		ConsoleReference Reference;
+		SmartConsoleUtils* pSCU = Reference.Get();
+
+		// Input can take forever, so the output lock only covers the color switches around it.
+		// Prints in between change the console's previous color, so the one to go back to is kept here.
+		COLOR_PAIR PreviousColorPair;
+		{
+			std::lock_guard<std::mutex> Lock(pSCU->GetOutputLock());
+
+			if (!pSCU->GetCursorColor(&PreviousColorPair) || !pSCU->SetCursorColor(ColorPair)) {
+				delete[] szBuffer;
+				return -1;
+			}
+		}
+
+		const bool bRead = pSCU->ReadW(szBuffer, 8191);
+
+		{
+			std::lock_guard<std::mutex> Lock(pSCU->GetOutputLock());
+
+			if (!pSCU->SetCursorColor(PreviousColorPair) || !bRead) {
+				delete[] szBuffer;
+				return -1;
+			}
+		}
+
+		int nLength = vswscanf_s(szBuffer, _Format, vargs);
+
+		delete[] szBuffer;
+		return nLength;
+	}
+
+	int clrvwscanf(COLOR unForegroundColor, wchar_t const* const _Format, va_list vargs) {
+		return clrvwscanf(COLOR_PAIR(unForegroundColor), _Format, vargs);
+	}
+
+	int clrwscanf(COLOR_PAIR ColorPair, wchar_t const* const _Format, ...) {
+		va_list vargs;
+		va_start(vargs, _Format);
+		int nLength = clrvwscanf(ColorPair, _Format, vargs);
+		va_end(vargs);
+		return nLength;
+	}
+
+	int clrwscanf(COLOR unForegroundColor, wchar_t const* const _Format, ...) {
+		va_list vargs;
+		va_start(vargs, _Format);
+		int nLength = clrvwscanf(COLOR_PAIR(unForegroundColor), _Format, vargs);
+		va_end(vargs);
+		return nLength;
+	}
+
+#ifdef UNICODE
+	int tclrvscanf(COLOR_PAIR ColorPair, wchar_t const* const _Format, va_list vargs) {
+		return clrvwscanf(ColorPair, _Format, vargs);
+	}
+
+	int tclrvscanf(COLOR unForegroundColor, wchar_t const* const _Format, va_list vargs) {
+		return clrvwscanf(unForegroundColor, _Format, vargs);
+	}
+
+	int tclrscanf(COLOR_PAIR ColorPair, wchar_t const* const _Format, ...) {
+		va_list vargs;
+		va_start(vargs, _Format);
+		int nLength = tclrvscanf(ColorPair, _Format, vargs);
+		va_end(vargs);
+		return nLength;
+	}
+
+	int tclrscanf(COLOR unForegroundColor, wchar_t const* const _Format, ...) {
+		va_list vargs;
+		va_start(vargs, _Format);
+		int nLength = tclrvscanf(unForegroundColor, _Format, vargs);
+		va_end(vargs);
+		return nLength;
+	}
+#else
+	int tclrvscanf(COLOR_PAIR ColorPair, char const* const _Format, va_list vargs) {
+		return clrvscanf(ColorPair, _Format, vargs);
+	}
+
+	int tclrvscanf(COLOR unForegroundColor, char const* const _Format, va_list vargs) {
+		return clrvscanf(unForegroundColor, _Format, vargs);
+	}
+
+	int tclrscanf(COLOR_PAIR ColorPair, char const* const _Format, ...) {
+		va_list vargs;
+		va_start(vargs, _Format);
+		int nLength = tclrvscanf(ColorPair, _Format, vargs);
+		va_end(vargs);
+		return nLength;
+	}
+
+	int tclrscanf(COLOR unForegroundColor, char const* const _Format, ...) {
+		va_list vargs;
+		va_start(vargs, _Format);
+		int nLength = tclrvscanf(unForegroundColor, _Format, vargs);
+		va_end(vargs);
+		return nLength;
+	}
+#endif
+
+	// ----------------------------------------------------------------
+	// Markup
+	// ----------------------------------------------------------------
+
+	static thread_local SpanWriter g_MarkupWriter;
+	static thread_local std::vector<COLOR_PAIR> g_MarkupStack;
+
+	static bool AddMarkupText(SpanWriter& Writer, COLOR_PAIR ColorPair, char const* const pText, size_t unLength) {
+		return Writer.AddA(ColorPair, pText, static_cast<unsigned int>(unLength));
+	}
+
+	static bool AddMarkupText(SpanWriter& Writer, COLOR_PAIR ColorPair, wchar_t const* const pText, size_t unLength) {
+		return Writer.AddW(ColorPair, pText, static_cast<unsigned int>(unLength));
+	}
+
+	// Adds text that still contains doubled braces, keeping one of each pair.
+	template <typename T>
+	static bool AddEscapedMarkupText(SpanWriter& Writer, COLOR_PAIR ColorPair, T const* const pText, size_t unLength) {
+		size_t unStart = 0;
+		for (size_t i = 0; (i + 1) < unLength; ++i) {
+			if (((pText[i] == T('{')) || (pText[i] == T('}'))) && (pText[i + 1] == pText[i])) {
+				if (!AddMarkupText(Writer, ColorPair, pText + unStart, i + 1 - unStart)) {
+					return false;
+				}
+
+				++i;
+				unStart = i + 1;
+			}
+		}
+
+		return AddMarkupText(Writer, ColorPair, pText + unStart, unLength - unStart);
+	}
+
+	static int CommitMarkup(SpanWriter& Writer) {
+		const int nLength = static_cast<int>(Writer.GetLength());
+
+		if (!Writer.Commit()) {
+			return -1;
+		}
+
+		return nLength;
+	}
+
+	template <typename T>
+	static int PrintRuntimeMarkup(std::basic_string_view<T> Markup);
+
+	template <typename T>
+	static int PrintMarkup(const BasicMarkupString<T>& Markup) {
+		if (Markup.IsRuntime()) {
+			return PrintRuntimeMarkup(Markup.GetMarkup());
+		}
+
+		SpanWriter& Writer = g_MarkupWriter;
+		Writer.Clear();
+
+		T const* const pMarkup = Markup.GetMarkup().data();
+		for (size_t i = 0; i < Markup.GetSpans(); ++i) {
+			const MARKUP_SPAN& Span = Markup.GetSpan(i);
+
+			const bool bAdded = Span.bEscaped ? AddEscapedMarkupText(Writer, Span.ColorPair, pMarkup + Span.Offset, Span.Length) : AddMarkupText(Writer, Span.ColorPair, pMarkup + Span.Offset, Span.Length);
+			if (!bAdded) {
+				Writer.Clear();
+				return -1;
+			}
+		}
+
+		return CommitMarkup(Writer);
+	}
+
+	// Single pass over the markup. Unknown tags and unbalanced {/} are kept as text.
+	template <typename T>
+	static int PrintRuntimeMarkup(std::basic_string_view<T> Markup) {
+		SpanWriter& Writer = g_MarkupWriter;
+		Writer.Clear();
+
+		std::vector<COLOR_PAIR>& Stack = g_MarkupStack;
+		Stack.clear();
+
+		COLOR_PAIR Current;
+
+		T const* const pMarkup = Markup.data();
+		const size_t unLength = Markup.size();
+		size_t unStart = 0;
+		bool bEscaped = false;
+
+		size_t i = 0;
+		while (i < unLength) {
+			const T unChar = pMarkup[i];
+
+			if ((unChar == T('{')) || (unChar == T('}'))) {
+				if (((i + 1) < unLength) && (pMarkup[i + 1] == unChar)) {
+					bEscaped = true;
+					i += 2;
+					continue;
+				}
+			}
+
+			if (unChar != T('{')) {
+				++i;
+				continue;
+			}
+
+			size_t unEnd = i + 1;
+			while ((unEnd < unLength) && (pMarkup[unEnd] != T('}')) && (pMarkup[unEnd] != T('{'))) {
+				++unEnd;
+			}
+
+			if ((unEnd >= unLength) || (pMarkup[unEnd] != T('}'))) {
+				++i;
+				continue;
+			}
+
+			COLOR_PAIR Next;
+			const MARKUP_TAG Tag = ParseMarkupTag(pMarkup + i + 1, unEnd - i - 1, Current, &Next);
+
+			const bool bClose = (Tag == MARKUP_TAG::MARKUP_TAG_CLOSE) && !Stack.empty();
+			const bool bOpen = (Tag == MARKUP_TAG::MARKUP_TAG_COLOR);
+			if (!bClose && !bOpen) {
+				i = unEnd + 1;
+				continue;
+			}
+
+			const bool bAdded = bEscaped ? AddEscapedMarkupText(Writer, Current, pMarkup + unStart, i - unStart) : AddMarkupText(Writer, Current, pMarkup + unStart, i - unStart);
+			if (!bAdded) {
+				Writer.Clear();
+				return -1;
+			}
+
+			if (bClose) {
+				Current = Stack.back();
+				Stack.pop_back();
+			} else {
+				Stack.push_back(Current);
+				Current = Next;
+			}
+
+			i = unEnd + 1;
+			unStart = i;
+			bEscaped = false;
+		}
+
+		const bool bAdded = bEscaped ? AddEscapedMarkupText(Writer, Current, pMarkup + unStart, unLength - unStart) : AddMarkupText(Writer, Current, pMarkup + unStart, unLength - unStart);
+		if (!bAdded) {
+			Writer.Clear();
+			return -1;
+		}
+
+		return CommitMarkup(Writer);
+	}
+
+	int mprint(const MarkupString& Markup) {
+		return PrintMarkup(Markup);
 	}
-#endif
 
-	HWND SmartConsole::GetWindow() {
-		return m_hWindow;
+	int mprint(const WMarkupString& Markup) {
+		return PrintMarkup(Markup);
 	}
 
-	HANDLE SmartConsole::GetIn() {
-		if (m_hIn == INVALID_HANDLE_VALUE) {
-			return nullptr;
-		}
-		return m_hIn;
+	int mprint(BasicRuntimeMarkup<char> Markup) {
+		return PrintRuntimeMarkup(Markup.Markup);
 	}
 
-	HANDLE SmartConsole::GetOut() {
-		if (m_hOut == INVALID_HANDLE_VALUE) {
-			return nullptr;
-		}
-		return m_hOut;
+	int mprint(BasicRuntimeMarkup<wchar_t> Markup) {
+		return PrintRuntimeMarkup(Markup.Markup);
 	}
 
 	// ----------------------------------------------------------------
-	// SmartConsoleUtils
+	// EmulatedConsole
 	// ----------------------------------------------------------------
 
-	SmartConsoleUtils::SmartConsoleUtils(bool bAutoClose, bool bAutoRestoreColors) : SmartConsole(bAutoClose) {
-		HWND hWindow = GetWindow();
-		HANDLE hOut = GetOut();
+	static std::atomic<EmulatedConsole*> g_pEmulatedConsole = nullptr;
+
+	// Only ever handed out and accepted by the emulated entry points.
+	static HANDLE const g_hEmulatedIn = reinterpret_cast<HANDLE>(static_cast<uintptr_t>(0xEC00));
+	static HANDLE const g_hEmulatedOut = reinterpret_cast<HANDLE>(static_cast<uintptr_t>(0xEC04));
+	static HWND const g_hEmulatedWindow = reinterpret_cast<HWND>(static_cast<uintptr_t>(0xEC08));
+
+	static constexpr WORD g_unEmulatedAttributes = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+	static constexpr size_t g_unMaxEmulatedSequenceLength = 64;
+	static constexpr size_t g_unMaxEmulatedSequenceParameters = 16;
+
+	const CONSOLE_API EmulatedConsole::m_EmulatedApi = {
+		EmulatedConsole::ApiGetConsoleWindow,
+		EmulatedConsole::ApiAllocConsole,
+		EmulatedConsole::ApiFreeConsole,
+		EmulatedConsole::ApiGetStdHandle,
+		EmulatedConsole::ApiGetConsoleMode,
+		EmulatedConsole::ApiSetConsoleMode,
+		EmulatedConsole::ApiGetConsoleOutputCP,
+		EmulatedConsole::ApiGetConsoleScreenBufferInfoEx,
+		EmulatedConsole::ApiSetConsoleScreenBufferInfoEx,
+		EmulatedConsole::ApiSetConsoleTextAttribute,
+		EmulatedConsole::ApiGetConsoleCursorInfo,
+		EmulatedConsole::ApiSetConsoleCursorInfo,
+		EmulatedConsole::ApiSetConsoleCursorPosition,
+		EmulatedConsole::ApiFillConsoleOutputAttribute,
+		EmulatedConsole::ApiFillConsoleOutputCharacterW,
+		EmulatedConsole::ApiWriteConsoleA,
+		EmulatedConsole::ApiWriteConsoleW,
+		EmulatedConsole::ApiWriteConsoleOutputW,
+		EmulatedConsole::ApiWriteConsoleOutputAttribute,
+		EmulatedConsole::ApiReadConsoleOutputW,
+		EmulatedConsole::ApiScrollConsoleScreenBufferW,
+		EmulatedConsole::ApiReadConsoleA,
+		EmulatedConsole::ApiReadConsoleW,
+		EmulatedConsole::ApiReadConsoleInputW,
+		EmulatedConsole::ApiWaitForSingleObject,
+		EmulatedConsole::ApiGetWindowLongW,
+		EmulatedConsole::ApiSetWindowLongW,
+		EmulatedConsole::ApiSetWindowPos,
+		EmulatedConsole::ApiShowWindow,
+		EmulatedConsole::ApiDestroyWindow,
+		true
+	};
+
+	static int GetSequenceParameter(const int* pParameters, size_t unParameters, size_t unIndex, int nDefault) {
+		if ((unIndex >= unParameters) || (pParameters[unIndex] < 0)) {
+			return nDefault;
+		}
+
+		return pParameters[unIndex];
+	}
 
-		m_bAutoRestoreColors = bAutoRestoreColors;
-		
-		if (bAutoRestoreColors && hWindow && hOut) {
-			GetColor(&m_OriginalColorPair);
+	static SHORT ClampCoordinate(int nValue, SHORT nMin, SHORT nMax) {
+		if (nValue < nMin) {
+			return nMin;
 		}
 
-		if (bAutoRestoreColors && hWindow && hOut) {
-			GetCursorColor(&m_OriginalCursorColorPair);
+		if (nValue > nMax) {
+			return nMax;
 		}
 
-		for (unsigned char i = 0; i < 16; ++i) {
-			m_OriginalColorTable[i] = 0x00000000;
+		return static_cast<SHORT>(nValue);
+	}
+
+	EmulatedConsole::EmulatedConsole(SHORT nWidth, SHORT nHeight, SHORT nBufferHeight) {
+		if (nWidth < 1) {
+			nWidth = 1;
 		}
 
-		if (bAutoRestoreColors && hWindow && hOut) {
-			CONSOLE_SCREEN_BUFFER_INFOEX csbi;
-			if (GetBufferInfo(&csbi)) {
-				for (unsigned char i = 0; i < 16; ++i) {
-					m_OriginalColorTable[i] = csbi.ColorTable[i];
-				}
-			}
+		if (nHeight < 1) {
+			nHeight = 1;
+		}
+
+		if (nBufferHeight < nHeight) {
+			nBufferHeight = nHeight;
 		}
+
+		m_pPreviousApi = nullptr;
+		m_bAttached = true;
+		m_bVisible = true;
+		m_nStyle = WS_MAXIMIZEBOX | WS_MINIMIZEBOX;
+		m_nStyleEx = 0;
+		m_Size.X = nWidth;
+		m_Size.Y = nBufferHeight;
+		m_Window.Left = 0;
+		m_Window.Top = 0;
+		m_Window.Right = nWidth - 1;
+		m_Window.Bottom = nHeight - 1;
+		m_CursorPosition.X = 0;
+		m_CursorPosition.Y = 0;
+		m_SavedCursorPosition = m_CursorPosition;
+		m_unAttributes = g_unEmulatedAttributes;
+		m_CursorInfo.dwSize = 25;
+		m_CursorInfo.bVisible = TRUE;
+
+		static constexpr COLORREF DefaultColorTable[16] = {
+			RGB(12, 12, 12), RGB(0, 55, 218), RGB(19, 161, 14), RGB(58, 150, 221),
+			RGB(197, 15, 31), RGB(136, 23, 152), RGB(193, 156, 0), RGB(204, 204, 204),
+			RGB(118, 118, 118), RGB(59, 120, 255), RGB(22, 198, 12), RGB(97, 214, 214),
+			RGB(231, 72, 86), RGB(180, 0, 158), RGB(249, 241, 165), RGB(242, 242, 242)
+		};
+
+		memcpy(m_ColorTable, DefaultColorTable, sizeof(m_ColorTable));
+
+		m_unInputMode = ENABLE_PROCESSED_INPUT | ENABLE_LINE_INPUT | ENABLE_ECHO_INPUT;
+		m_unOutputMode = ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT;
+
+		CHAR_INFO Blank;
+		Blank.Char.UnicodeChar = L' ';
+		Blank.Attributes = m_unAttributes;
+		m_Cells.assign(static_cast<size_t>(m_Size.X) * static_cast<size_t>(m_Size.Y), Blank);
+
+		m_unCallCost = 0;
+		ResetCalls();
 	}
 
-	SmartConsoleUtils::~SmartConsoleUtils() {
-		if (m_bAutoRestoreColors && GetWindow() && GetOut()) {
-			CONSOLE_SCREEN_BUFFER_INFOEX csbi;
-			if (GetBufferInfo(&csbi)) {
-				for (unsigned char i = 0; i < 16; ++i) {
-					csbi.ColorTable[i] = m_OriginalColorTable[i];
-				}
-				SetBufferInfo(csbi);
-			}
-			SetColor(m_OriginalColorPair);
-			SetCursorColor(m_OriginalCursorColorPair);
+	EmulatedConsole::~EmulatedConsole() {
+		Uninstall();
+	}
+
+	bool EmulatedConsole::Install() {
+		EmulatedConsole* pExpected = nullptr;
+		if (!g_pEmulatedConsole.compare_exchange_strong(pExpected, this)) {
+			return false;
 		}
+
+		m_pPreviousApi = GetConsoleApi();
+		SetConsoleApi(&m_EmulatedApi);
+
+		return true;
 	}
 
-	bool SmartConsoleUtils::Open(bool bUpdateIO) {
-		if (!SmartConsole::Open(bUpdateIO)) {
+	// Consoles created while installed keep emulated handles, destroy them first.
+	bool EmulatedConsole::Uninstall() {
+		if (g_pEmulatedConsole.load() != this) {
 			return false;
 		}
 
-		HWND hWindow = GetWindow();
-		HANDLE hOut = GetOut();
+		SetConsoleApi(m_pPreviousApi);
+		m_pPreviousApi = nullptr;
 
-		m_OriginalColorPair = COLOR_PAIR();
-		if (m_bAutoRestoreColors && hWindow && hOut) {
-			GetColor(&m_OriginalColorPair);
+		g_pEmulatedConsole.store(nullptr);
+
+		return true;
+	}
+
+	bool EmulatedConsole::IsInstalled() {
+		return g_pEmulatedConsole.load() == this;
+	}
+
+	void EmulatedConsole::SetCallCost(unsigned int unMicroseconds) {
+		m_unCallCost.store(unMicroseconds, std::memory_order_relaxed);
+	}
+
+	bool EmulatedConsole::PushInputA(char const* const szInput) {
+		if (!szInput) {
+			return false;
 		}
 
-		m_OriginalCursorColorPair = COLOR_PAIR();
-		if (m_bAutoRestoreColors && hWindow && hOut) {
-			GetCursorColor(&m_OriginalCursorColorPair);
+		const int nLength = static_cast<int>(strlen(szInput));
+		if (!nLength) {
+			return true;
 		}
 
-		m_PreviousColorPair = COLOR_PAIR();
-		m_PreviousCursorColorPair = COLOR_PAIR();
+		const int nWideLength = MultiByteToWideChar(CP_UTF8, 0, szInput, nLength, nullptr, 0);
+		if (nWideLength <= 0) {
+			return false;
+		}
 
-		for (unsigned char i = 0; i < 16; ++i) {
-			m_OriginalColorTable[i] = 0x00000000;
+		std::wstring Input(static_cast<size_t>(nWideLength), L'\0');
+		if (MultiByteToWideChar(CP_UTF8, 0, szInput, nLength, Input.data(), nWideLength) != nWideLength) {
+			return false;
 		}
 
-		if (m_bAutoRestoreColors && hWindow && hOut) {
-			CONSOLE_SCREEN_BUFFER_INFOEX csbi;
-			if (GetBufferInfo(&csbi)) {
-				for (unsigned char i = 0; i < 16; ++i) {
-					m_OriginalColorTable[i] = csbi.ColorTable[i];
-				}
-			}
+		std::lock_guard<std::mutex> Lock(m_Lock);
+		m_Input.append(Input);
+
+		return true;
+	}
+
+	bool EmulatedConsole::PushInputW(wchar_t const* const szInput) {
+		if (!szInput) {
+			return false;
 		}
 
+		std::lock_guard<std::mutex> Lock(m_Lock);
+		m_Input.append(szInput);
+
 		return true;
 	}
 
-	bool SmartConsoleUtils::Close() {
-		if (m_bAutoRestoreColors && GetWindow() && GetOut()) {
-			CONSOLE_SCREEN_BUFFER_INFOEX csbi;
-			if (GetBufferInfo(&csbi)) {
-				for (unsigned char i = 0; i < 16; ++i) {
-					csbi.ColorTable[i] = m_OriginalColorTable[i];
-				}
-				SetBufferInfo(csbi);
+#ifdef UNICODE
+	bool EmulatedConsole::PushInput(wchar_t const* const szInput) {
+		return PushInputW(szInput);
+	}
+#else
+	bool EmulatedConsole::PushInput(char const* const szInput) {
+		return PushInputA(szInput);
+	}
+#endif
+
+	bool EmulatedConsole::PushInputRecords(const INPUT_RECORD* pRecords, unsigned int unCount) {
+		if (!pRecords && unCount) {
+			return false;
+		}
+
+		{
+			std::lock_guard<std::mutex> Lock(m_Lock);
+			m_InputRecords.insert(m_InputRecords.end(), pRecords, pRecords + unCount);
+		}
+
+		m_InputReady.notify_all();
+
+		return true;
+	}
+
+	// As if the user resized the window. The buffer takes the new width and grows to the new height if needed.
+	bool EmulatedConsole::ResizeWindow(SHORT nWidth, SHORT nHeight) {
+		if ((nWidth < 1) || (nHeight < 1)) {
+			return false;
+		}
+
+		bool bNotify = false;
+
+		{
+			std::lock_guard<std::mutex> Lock(m_Lock);
+
+			COORD Size;
+			Size.X = nWidth;
+			Size.Y = m_Size.Y > nHeight ? m_Size.Y : nHeight;
+
+			Resize(Size);
+
+			m_Window.Left = 0;
+			m_Window.Right = nWidth - 1;
+			m_Window.Top = ClampCoordinate(m_Window.Top, 0, m_Size.Y - nHeight);
+			m_Window.Bottom = m_Window.Top + nHeight - 1;
+
+			FollowCursor();
+
+			if (m_unInputMode & ENABLE_WINDOW_INPUT) {
+				INPUT_RECORD Record;
+				memset(&Record, 0, sizeof(Record));
+				Record.EventType = WINDOW_BUFFER_SIZE_EVENT;
+				Record.Event.WindowBufferSizeEvent.dwSize = m_Size;
+				m_InputRecords.push_back(Record);
+				bNotify = true;
 			}
-			SetColor(m_OriginalColorPair);
-			SetCursorColor(m_OriginalCursorColorPair);
 		}
 
-		return SmartConsole::Close();
+		if (bNotify) {
+			m_InputReady.notify_all();
+		}
+
+		return true;
 	}
 
-	bool SmartConsoleUtils::GetBufferInfo(PCONSOLE_SCREEN_BUFFER_INFOEX pBufferInfo) {
-		if (!pBufferInfo) {
+	bool EmulatedConsole::GetCell(COORD Position, PCHAR_INFO pCell) {
+		if (!pCell) {
 			return false;
 		}
 
-		if (!GetWindow()) {
+		std::lock_guard<std::mutex> Lock(m_Lock);
+
+		if ((Position.X < 0) || (Position.Y < 0) || (Position.X >= m_Size.X) || (Position.Y >= m_Size.Y)) {
 			return false;
 		}
 
-		HANDLE hOut = GetOut();
-		if (!hOut) {
+		*pCell = m_Cells[static_cast<size_t>(Position.Y) * m_Size.X + Position.X];
+
+		return true;
+	}
+
+	// Text of a buffer row without trailing spaces.
+	bool EmulatedConsole::GetLine(SHORT nY, wchar_t* const szBuffer, unsigned int unCount) {
+		if (!szBuffer || !unCount) {
+			return false;
+		}
+
+		std::lock_guard<std::mutex> Lock(m_Lock);
+
+		if ((nY < 0) || (nY >= m_Size.Y)) {
+			return false;
+		}
+
+		const CHAR_INFO* pRow = m_Cells.data() + static_cast<size_t>(nY) * m_Size.X;
+
+		size_t unLength = m_Size.X;
+		while (unLength && (pRow[unLength - 1].Char.UnicodeChar == L' ')) {
+			--unLength;
+		}
+
+		if (unLength >= unCount) {
+			unLength = unCount - 1;
+		}
+
+		for (size_t i = 0; i < unLength; ++i) {
+			szBuffer[i] = pRow[i].Char.UnicodeChar;
+		}
+
+		szBuffer[unLength] = L'\0';
+
+		return true;
+	}
+
+	bool EmulatedConsole::GetCursorPosition(PCOORD pCursorPosition) {
+		if (!pCursorPosition) {
 			return false;
 		}
 
-		memset(pBufferInfo, 0, sizeof(CONSOLE_SCREEN_BUFFER_INFOEX));
-		pBufferInfo->cbSize = sizeof(CONSOLE_SCREEN_BUFFER_INFOEX);
+		std::lock_guard<std::mutex> Lock(m_Lock);
+		*pCursorPosition = m_CursorPosition;
+
+		return true;
+	}
+
+	unsigned long long EmulatedConsole::GetCalls(EMULATED_CALL Call) {
+		if (Call >= EMULATED_CALL::EMULATED_CALL_COUNT) {
+			return 0;
+		}
+
+		return m_unCalls[static_cast<unsigned char>(Call)].load(std::memory_order_relaxed);
+	}
+
+	unsigned long long EmulatedConsole::GetTotalCalls() {
+		unsigned long long unCalls = 0;
+
+		for (unsigned char i = 0; i < static_cast<unsigned char>(EMULATED_CALL::EMULATED_CALL_COUNT); ++i) {
+			unCalls += m_unCalls[i].load(std::memory_order_relaxed);
+		}
+
+		return unCalls;
+	}
+
+	unsigned long long EmulatedConsole::GetTouchedCells() {
+		return m_unTouchedCells.load(std::memory_order_relaxed);
+	}
+
+	void EmulatedConsole::ResetCalls() {
+		for (unsigned char i = 0; i < static_cast<unsigned char>(EMULATED_CALL::EMULATED_CALL_COUNT); ++i) {
+			m_unCalls[i].store(0, std::memory_order_relaxed);
+		}
+
+		m_unTouchedCells.store(0, std::memory_order_relaxed);
+	}
+
+	// Counts the call against the installed console. Entry points running during Uninstall() may still see it.
+	EmulatedConsole* EmulatedConsole::Enter(EMULATED_CALL Call) {
+		EmulatedConsole* pConsole = g_pEmulatedConsole.load(std::memory_order_acquire);
+		if (pConsole) {
+			pConsole->m_unCalls[static_cast<unsigned char>(Call)].fetch_add(1, std::memory_order_relaxed);
+		}
+
+		return pConsole;
+	}
+
+	// Spins for the configured cost. Called with m_Lock held, so calls are serialized like in a real console host.
+	void EmulatedConsole::Simulate() {
+		const unsigned int unCost = m_unCallCost.load(std::memory_order_relaxed);
+		if (!unCost) {
+			return;
+		}
+
+		const auto Deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(unCost);
+		while (std::chrono::steady_clock::now() < Deadline) {
+			std::this_thread::yield();
+		}
+	}
+
+	// Expects m_Lock to be held.
+	void EmulatedConsole::Resize(COORD Size) {
+		if ((Size.X == m_Size.X) && (Size.Y == m_Size.Y)) {
+			return;
+		}
+
+		CHAR_INFO Blank;
+		Blank.Char.UnicodeChar = L' ';
+		Blank.Attributes = m_unAttributes;
+
+		std::vector<CHAR_INFO> Cells(static_cast<size_t>(Size.X) * static_cast<size_t>(Size.Y), Blank);
+
+		const SHORT nWidth = Size.X < m_Size.X ? Size.X : m_Size.X;
+		const SHORT nHeight = Size.Y < m_Size.Y ? Size.Y : m_Size.Y;
+		for (SHORT nY = 0; nY < nHeight; ++nY) {
+			memcpy(Cells.data() + static_cast<size_t>(nY) * Size.X, m_Cells.data() + static_cast<size_t>(nY) * m_Size.X, sizeof(CHAR_INFO) * nWidth);
+		}
+
+		m_Cells.swap(Cells);
+		m_Size = Size;
+		m_unTouchedCells.fetch_add(m_Cells.size(), std::memory_order_relaxed);
+
+		m_CursorPosition.X = ClampCoordinate(m_CursorPosition.X, 0, m_Size.X - 1);
+		m_CursorPosition.Y = ClampCoordinate(m_CursorPosition.Y, 0, m_Size.Y - 1);
+	}
+
+	// Expects m_Lock to be held. Moves the window the least amount needed to show the cursor.
+	void EmulatedConsole::FollowCursor() {
+		if (m_CursorPosition.Y > m_Window.Bottom) {
+			const SHORT nShift = m_CursorPosition.Y - m_Window.Bottom;
+			m_Window.Top += nShift;
+			m_Window.Bottom += nShift;
+		} else if (m_CursorPosition.Y < m_Window.Top) {
+			const SHORT nShift = m_Window.Top - m_CursorPosition.Y;
+			m_Window.Top -= nShift;
+			m_Window.Bottom -= nShift;
+		}
+	}
+
+	// Expects m_Lock to be held. Scrolls the whole buffer once the cursor passes its last row.
+	void EmulatedConsole::NewLine() {
+		m_CursorPosition.X = 0;
+
+		if (m_CursorPosition.Y + 1 < m_Size.Y) {
+			++m_CursorPosition.Y;
+			FollowCursor();
+			return;
+		}
+
+		const size_t unWidth = m_Size.X;
+		memmove(m_Cells.data(), m_Cells.data() + unWidth, sizeof(CHAR_INFO) * (m_Cells.size() - unWidth));
+		m_unTouchedCells.fetch_add(m_Cells.size() - unWidth, std::memory_order_relaxed);
+		EraseCells(m_Cells.size() - unWidth, unWidth);
+	}
+
+	// Expects m_Lock to be held.
+	void EmulatedConsole::EraseCells(size_t unStart, size_t unCount) {
+		if (unStart >= m_Cells.size()) {
+			return;
+		}
+
+		if (unCount > m_Cells.size() - unStart) {
+			unCount = m_Cells.size() - unStart;
+		}
+
+		for (size_t i = unStart; i < unStart + unCount; ++i) {
+			m_Cells[i].Char.UnicodeChar = L' ';
+			m_Cells[i].Attributes = m_unAttributes;
+		}
+
+		m_unTouchedCells.fetch_add(unCount, std::memory_order_relaxed);
+	}
+
+	// Expects m_Lock to be held.
+	void EmulatedConsole::WriteText(wchar_t const* const szText, size_t unLength) {
+		const bool bVirtualTerminal = (m_unOutputMode & ENABLE_VIRTUAL_TERMINAL_PROCESSING) != 0;
+		const bool bProcessed = (m_unOutputMode & ENABLE_PROCESSED_OUTPUT) != 0;
+		const bool bWrap = (m_unOutputMode & ENABLE_WRAP_AT_EOL_OUTPUT) != 0;
+
+		for (size_t i = 0; i < unLength; ++i) {
+			const wchar_t unCharacter = szText[i];
+
+			if (!m_Sequence.empty()) {
+				m_Sequence.push_back(unCharacter);
+
+				if (m_Sequence.size() == 2) {
+					if (unCharacter == L'[') {
+						continue;
+					}
+
+					if (unCharacter == L'7') {
+						m_SavedCursorPosition = m_CursorPosition;
+					} else if (unCharacter == L'8') {
+						m_CursorPosition = m_SavedCursorPosition;
+					}
+
+					m_Sequence.clear();
+					continue;
+				}
+
+				if ((unCharacter >= 0x40) && (unCharacter <= 0x7E)) {
+					ApplyControlSequence();
+					m_Sequence.clear();
+				} else if (m_Sequence.size() >= g_unMaxEmulatedSequenceLength) {
+					m_Sequence.clear();
+				}
+
+				continue;
+			}
+
+			if (bVirtualTerminal && (unCharacter == L'\x1B')) {
+				m_Sequence.push_back(unCharacter);
+				continue;
+			}
+
+			if (bProcessed) {
+				switch (unCharacter) {
+					case L'\r':
+						m_CursorPosition.X = 0;
+						continue;
+
+					case L'\n':
+						NewLine();
+						continue;
+
+					case L'\b':
+						if (m_CursorPosition.X > 0) {
+							--m_CursorPosition.X;
+						}
+						continue;
+
+					case L'\t': {
+						const SHORT nNextStop = static_cast<SHORT>((m_CursorPosition.X / 8 + 1) * 8);
+						m_CursorPosition.X = nNextStop < m_Size.X ? nNextStop : m_Size.X - 1;
+						continue;
+					}
+
+					case L'\a':
+						continue;
+
+					default:
+						break;
+				}
+			}
+
+			CHAR_INFO& Cell = m_Cells[static_cast<size_t>(m_CursorPosition.Y) * m_Size.X + m_CursorPosition.X];
+			Cell.Char.UnicodeChar = unCharacter;
+			Cell.Attributes = m_unAttributes;
+			m_unTouchedCells.fetch_add(1, std::memory_order_relaxed);
+
+			if (m_CursorPosition.X + 1 < m_Size.X) {
+				++m_CursorPosition.X;
+			} else if (bWrap) {
+				NewLine();
+			}
+		}
+
+		FollowCursor();
+	}
+
+	// Expects m_Lock to be held. m_Sequence holds a complete CSI sequence. Unsupported ones are ignored.
+	void EmulatedConsole::ApplyControlSequence() {
+		const wchar_t unFinal = m_Sequence.back();
+		const bool bPrivate = (m_Sequence.size() > 3) && (m_Sequence[2] == L'?');
+
+		int Parameters[g_unMaxEmulatedSequenceParameters];
+		size_t unParameters = 0;
+		int nValue = -1;
+
+		for (size_t i = bPrivate ? 3 : 2; i + 1 < m_Sequence.size(); ++i) {
+			const wchar_t unCharacter = m_Sequence[i];
+			if ((unCharacter >= L'0') && (unCharacter <= L'9')) {
+				nValue = (nValue < 0 ? 0 : nValue) * 10 + (unCharacter - L'0');
+				if (nValue > 0x7FFF) {
+					nValue = 0x7FFF;
+				}
+			} else if (unCharacter == L';') {
+				if (unParameters < g_unMaxEmulatedSequenceParameters) {
+					Parameters[unParameters++] = nValue;
+				}
+				nValue = -1;
+			}
+		}
+
+		if (unParameters < g_unMaxEmulatedSequenceParameters) {
+			Parameters[unParameters++] = nValue;
+		}
+
+		if (bPrivate) {
+			if (GetSequenceParameter(Parameters, unParameters, 0, 0) == 25) {
+				if (unFinal == L'h') {
+					m_CursorInfo.bVisible = TRUE;
+				} else if (unFinal == L'l') {
+					m_CursorInfo.bVisible = FALSE;
+				}
+			}
 
-		if (!GetConsoleScreenBufferInfoEx(hOut, pBufferInfo)) {
-			return false;
-		}
+			return;
+		}
+
+		const size_t unWidth = m_Size.X;
+		const size_t unCursor = static_cast<size_t>(m_CursorPosition.Y) * unWidth + m_CursorPosition.X;
+		const size_t unWindowStart = static_cast<size_t>(m_Window.Top) * unWidth;
+		const size_t unWindowEnd = static_cast<size_t>(m_Window.Bottom + 1) * unWidth;
+		const int nCount = GetSequenceParameter(Parameters, unParameters, 0, 1);
+
+		switch (unFinal) {
+			case L'm':
+				for (size_t i = 0; i < unParameters; ++i) {
+					const int nCode = Parameters[i] < 0 ? 0 : Parameters[i];
+					if (nCode == 0) {
+						m_unAttributes = g_unEmulatedAttributes;
+					} else if (nCode == 1) {
+						m_unAttributes |= FOREGROUND_INTENSITY;
+					} else if (nCode == 22) {
+						m_unAttributes &= ~FOREGROUND_INTENSITY;
+					} else if ((nCode >= 30) && (nCode <= 37)) {
+						m_unAttributes = static_cast<WORD>((m_unAttributes & ~0x0F) | ToSGRColor(nCode - 30));
+					} else if ((nCode >= 90) && (nCode <= 97)) {
+						m_unAttributes = static_cast<WORD>((m_unAttributes & ~0x0F) | ToSGRColor(nCode - 90) | FOREGROUND_INTENSITY);
+					} else if (nCode == 39) {
+						m_unAttributes = static_cast<WORD>((m_unAttributes & ~0x0F) | (g_unEmulatedAttributes & 0x0F));
+					} else if ((nCode >= 40) && (nCode <= 47)) {
+						m_unAttributes = static_cast<WORD>((m_unAttributes & ~0xF0) | (ToSGRColor(nCode - 40) << 4));
+					} else if ((nCode >= 100) && (nCode <= 107)) {
+						m_unAttributes = static_cast<WORD>((m_unAttributes & ~0xF0) | (ToSGRColor(nCode - 100) << 4) | BACKGROUND_INTENSITY);
+					} else if (nCode == 49) {
+						m_unAttributes = static_cast<WORD>((m_unAttributes & ~0xF0) | (g_unEmulatedAttributes & 0xF0));
+					} else if ((nCode == 38) || (nCode == 48)) {
+						// Like the console, deeper colors are reduced to the nearest palette entry.
+						EXTENDED_COLOR Color;
+						if ((GetSequenceParameter(Parameters, unParameters, i + 1, 0) == 5) && (i + 2 < unParameters)) {
+							Color = EXTENDED_COLOR::FromIndex(static_cast<unsigned char>(ClampCoordinate(Parameters[i + 2], 0, 255)));
+							i += 2;
+						} else if ((GetSequenceParameter(Parameters, unParameters, i + 1, 0) == 2) && (i + 4 < unParameters)) {
+							Color = EXTENDED_COLOR(static_cast<unsigned char>(ClampCoordinate(Parameters[i + 2], 0, 255)), static_cast<unsigned char>(ClampCoordinate(Parameters[i + 3], 0, 255)), static_cast<unsigned char>(ClampCoordinate(Parameters[i + 4], 0, 255)));
+							i += 4;
+						} else {
+							break;
+						}
+
+						m_ColorQuantizer.Build(m_ColorTable);
+
+						const COLOR Quantized = m_ColorQuantizer.Quantize(Color);
+						if (nCode == 38) {
+							m_unAttributes = static_cast<WORD>((m_unAttributes & ~0x0F) | static_cast<unsigned char>(Quantized));
+						} else {
+							m_unAttributes = static_cast<WORD>((m_unAttributes & ~0xF0) | (static_cast<unsigned char>(Quantized) << 4));
+						}
+					}
+				}
+				break;
+
+			case L'H':
+			case L'f':
+				m_CursorPosition.Y = ClampCoordinate(m_Window.Top + GetSequenceParameter(Parameters, unParameters, 0, 1) - 1, m_Window.Top, m_Window.Bottom);
+				m_CursorPosition.X = ClampCoordinate(GetSequenceParameter(Parameters, unParameters, 1, 1) - 1, 0, m_Size.X - 1);
+				break;
+
+			case L'A':
+				m_CursorPosition.Y = ClampCoordinate(m_CursorPosition.Y - nCount, m_Window.Top, m_Window.Bottom);
+				break;
+
+			case L'B':
+				m_CursorPosition.Y = ClampCoordinate(m_CursorPosition.Y + nCount, m_Window.Top, m_Window.Bottom);
+				break;
+
+			case L'C':
+				m_CursorPosition.X = ClampCoordinate(m_CursorPosition.X + nCount, 0, m_Size.X - 1);
+				break;
+
+			case L'D':
+				m_CursorPosition.X = ClampCoordinate(m_CursorPosition.X - nCount, 0, m_Size.X - 1);
+				break;
+
+			case L'J':
+				switch (GetSequenceParameter(Parameters, unParameters, 0, 0)) {
+					case 0:
+						EraseCells(unCursor, unWindowEnd - unCursor);
+						break;
+
+					case 1:
+						EraseCells(unWindowStart, unCursor - unWindowStart + 1);
+						break;
+
+					case 2:
+						EraseCells(unWindowStart, unWindowEnd - unWindowStart);
+						break;
+
+					case 3:
+						EraseCells(0, unWindowStart);
+						break;
+
+					default:
+						break;
+				}
+				break;
 
-		return true;
-	}
+			case L'K': {
+				const size_t unLineStart = static_cast<size_t>(m_CursorPosition.Y) * unWidth;
+				switch (GetSequenceParameter(Parameters, unParameters, 0, 0)) {
+					case 0:
+						EraseCells(unCursor, unLineStart + unWidth - unCursor);
+						break;
 
-	bool SmartConsoleUtils::SetBufferInfo(CONSOLE_SCREEN_BUFFER_INFOEX BufferInfo) {
-		if (!GetWindow()) {
-			return false;
-		}
+					case 1:
+						EraseCells(unLineStart, unCursor - unLineStart + 1);
+						break;
 
-		HANDLE hOut = GetOut();
-		if (!hOut) {
-			return false;
-		}
+					case 2:
+						EraseCells(unLineStart, unWidth);
+						break;
 
-		++BufferInfo.srWindow.Bottom;
-		++BufferInfo.srWindow.Right;
+					default:
+						break;
+				}
+				break;
+			}
 
-		if (!SetConsoleScreenBufferInfoEx(hOut, &BufferInfo)) {
-			return false;
+			default:
+				break;
+		}
+	}
+
+	HWND WINAPI EmulatedConsole::ApiGetConsoleWindow() {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_GET_CONSOLE_WINDOW);
+		if (!pConsole) {
+			return nullptr;
 		}
 
-		--BufferInfo.srWindow.Bottom;
-		--BufferInfo.srWindow.Right;
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-		return true;
+		return pConsole->m_bAttached ? g_hEmulatedWindow : nullptr;
 	}
 
-	bool SmartConsoleUtils::GetAttributes(PWORD pAttributes) {
-		if (!pAttributes) {
-			return false;
+	BOOL WINAPI EmulatedConsole::ApiAllocConsole() {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_ALLOC_CONSOLE);
+		if (!pConsole) {
+			return FALSE;
 		}
 
-		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
-		if (!GetBufferInfo(&csbi)) {
-			return false;
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
+
+		if (pConsole->m_bAttached) {
+			return FALSE;
 		}
 
-		*pAttributes = csbi.wAttributes;
+		pConsole->m_bAttached = true;
 
-		return true;
+		return TRUE;
 	}
 
-	bool SmartConsoleUtils::SetAttributes(WORD unAttributes) {
-		if (!GetWindow()) {
-			return false;
+	BOOL WINAPI EmulatedConsole::ApiFreeConsole() {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_FREE_CONSOLE);
+		if (!pConsole) {
+			return FALSE;
 		}
 
-		HANDLE hOut = GetOut();
-		if (!hOut) {
-			return false;
-		}
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-		if (!SetConsoleTextAttribute(hOut, unAttributes)) {
-			return false;
+		if (!pConsole->m_bAttached) {
+			return FALSE;
 		}
 
-		return true;
-	}
+		pConsole->m_bAttached = false;
 
-	bool SmartConsoleUtils::ChangeColorPalette(COLOR Color, unsigned int unRGB) {
-		if (static_cast<unsigned char>(Color) > 15) {
-			return false;
-		}
+		return TRUE;
+	}
 
-		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
-		if (!GetBufferInfo(&csbi)) {
-			return false;
+	HANDLE WINAPI EmulatedConsole::ApiGetStdHandle(DWORD nStdHandle) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_GET_STD_HANDLE);
+		if (!pConsole) {
+			return INVALID_HANDLE_VALUE;
 		}
 
-		unsigned char unR = (unRGB >> 16) & 0xFF;
-		unsigned char unG = (unRGB >> 8) & 0xFF;
-		unsigned char unB = unRGB & 0xFF;
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-		csbi.ColorTable[static_cast<unsigned char>(Color)] = RGB(unR, unG, unB);
+		if (!pConsole->m_bAttached) {
+			return nullptr;
+		}
 
-		if (!SetBufferInfo(csbi)) {
-			return false;
+		if (nStdHandle == STD_INPUT_HANDLE) {
+			return g_hEmulatedIn;
 		}
 
-		if (!Flush()) {
-			return false;
+		if ((nStdHandle == STD_OUTPUT_HANDLE) || (nStdHandle == STD_ERROR_HANDLE)) {
+			return g_hEmulatedOut;
 		}
 
-		return true;
+		return INVALID_HANDLE_VALUE;
 	}
 
-	bool SmartConsoleUtils::ChangeColorPalette(COLOR Color, unsigned char unR, unsigned char unG, unsigned char unB) {
-		if (static_cast<unsigned char>(Color) > 15) {
-			return false;
+	BOOL WINAPI EmulatedConsole::ApiGetConsoleMode(HANDLE hConsoleHandle, LPDWORD lpMode) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_GET_CONSOLE_MODE);
+		if (!pConsole || !lpMode) {
+			return FALSE;
 		}
 
-		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
-		if (!GetBufferInfo(&csbi)) {
-			return false;
-		}
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-		csbi.ColorTable[static_cast<unsigned char>(Color)] = RGB(unR, unG, unB);
+		if (hConsoleHandle == g_hEmulatedIn) {
+			*lpMode = pConsole->m_unInputMode;
+			return TRUE;
+		}
 
-		if (!SetBufferInfo(csbi)) {
-			return false;
+		if (hConsoleHandle == g_hEmulatedOut) {
+			*lpMode = pConsole->m_unOutputMode;
+			return TRUE;
 		}
 
-		return true;
+		return FALSE;
 	}
 
-	bool SmartConsoleUtils::Flush(bool bClear, bool bUpdateOriginalColorPair, bool bResetPreviousColorPair) {
-		if (!GetWindow()) {
-			return false;
+	BOOL WINAPI EmulatedConsole::ApiSetConsoleMode(HANDLE hConsoleHandle, DWORD dwMode) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_SET_CONSOLE_MODE);
+		if (!pConsole) {
+			return FALSE;
 		}
 
-		HANDLE hOut = GetOut();
-		if (!hOut) {
-			return false;
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
+
+		if (hConsoleHandle == g_hEmulatedIn) {
+			pConsole->m_unInputMode = dwMode;
+			return TRUE;
 		}
 
-		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
-		if (!GetBufferInfo(&csbi)) {
-			return false;
+		if (hConsoleHandle == g_hEmulatedOut) {
+			pConsole->m_unOutputMode = dwMode;
+			return TRUE;
 		}
 
-		if (bClear) {
-			SMALL_RECT Scroll;
-			Scroll.Left = 0;
-			Scroll.Top = 0;
-			Scroll.Right = csbi.dwSize.X;
-			Scroll.Bottom = csbi.dwSize.Y;
+		return FALSE;
+	}
 
-			COORD ScrollTarget;
-			memset(&ScrollTarget, 0, sizeof(ScrollTarget));
+	UINT WINAPI EmulatedConsole::ApiGetConsoleOutputCP() {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_GET_CONSOLE_OUTPUT_CP);
+		if (!pConsole) {
+			return 0;
+		}
 
-			ScrollTarget.X = 0;
-			ScrollTarget.Y = -csbi.dwSize.Y;
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-			CHAR_INFO Fill;
-			memset(&Fill, 0, sizeof(Fill));
-#ifdef UNICODE
-			Fill.Char.UnicodeChar = L' ';
-#else
-			Fill.Char.AsciiChar = ' ';
-#endif
-			Fill.Attributes = csbi.wAttributes;
+		return CP_UTF8;
+	}
 
-			if (!ScrollConsoleScreenBuffer(hOut, &Scroll, nullptr, ScrollTarget, &Fill)) {
-				return false;
-			}
+	BOOL WINAPI EmulatedConsole::ApiGetConsoleScreenBufferInfoEx(HANDLE hConsoleOutput, PCONSOLE_SCREEN_BUFFER_INFOEX lpConsoleScreenBufferInfoEx) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_GET_CONSOLE_SCREEN_BUFFER_INFO);
+		if (!pConsole || (hConsoleOutput != g_hEmulatedOut) || !lpConsoleScreenBufferInfoEx || (lpConsoleScreenBufferInfoEx->cbSize != sizeof(CONSOLE_SCREEN_BUFFER_INFOEX))) {
+			return FALSE;
+		}
 
-			csbi.dwCursorPosition.X = 0;
-			csbi.dwCursorPosition.Y = 0;
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-			if (!SetConsoleCursorPosition(hOut, csbi.dwCursorPosition)) {
-				return false;
-			}
-		}
+		lpConsoleScreenBufferInfoEx->dwSize = pConsole->m_Size;
+		lpConsoleScreenBufferInfoEx->dwCursorPosition = pConsole->m_CursorPosition;
+		lpConsoleScreenBufferInfoEx->wAttributes = pConsole->m_unAttributes;
+		lpConsoleScreenBufferInfoEx->srWindow = pConsole->m_Window;
+		lpConsoleScreenBufferInfoEx->dwMaximumWindowSize.X = pConsole->m_Size.X;
+		lpConsoleScreenBufferInfoEx->dwMaximumWindowSize.Y = pConsole->m_Window.Bottom - pConsole->m_Window.Top + 1;
+		lpConsoleScreenBufferInfoEx->wPopupAttributes = BACKGROUND_RED | BACKGROUND_BLUE | FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY;
+		lpConsoleScreenBufferInfoEx->bFullscreenSupported = FALSE;
+		memcpy(lpConsoleScreenBufferInfoEx->ColorTable, pConsole->m_ColorTable, sizeof(pConsole->m_ColorTable));
 
-		COORD Coord;
-		Coord.X = 0;
-		Coord.Y = 0;
-		DWORD unWrittenAttributes = 0;
-		if (!FillConsoleOutputAttribute(hOut, csbi.wAttributes, csbi.dwSize.Y * csbi.dwSize.X, Coord, &unWrittenAttributes)) {
-			return false;
-		}
+		return TRUE;
+	}
 
-		if (bUpdateOriginalColorPair) {
-			COLOR_PAIR CurrentColorPair;
-			if (!GetColor(&CurrentColorPair)) {
-				m_OriginalColorPair = CurrentColorPair;
-			}
+	// Like the real one, the window it applies is one row and column smaller than srWindow.
+	BOOL WINAPI EmulatedConsole::ApiSetConsoleScreenBufferInfoEx(HANDLE hConsoleOutput, PCONSOLE_SCREEN_BUFFER_INFOEX lpConsoleScreenBufferInfoEx) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_SET_CONSOLE_SCREEN_BUFFER_INFO);
+		if (!pConsole || (hConsoleOutput != g_hEmulatedOut) || !lpConsoleScreenBufferInfoEx || (lpConsoleScreenBufferInfoEx->cbSize != sizeof(CONSOLE_SCREEN_BUFFER_INFOEX))) {
+			return FALSE;
 		}
 
-		if (bResetPreviousColorPair) {
-			m_PreviousColorPair = COLOR_PAIR();
+		const COORD Size = lpConsoleScreenBufferInfoEx->dwSize;
+		SMALL_RECT Window = lpConsoleScreenBufferInfoEx->srWindow;
+		--Window.Right;
+		--Window.Bottom;
+
+		if ((Size.X < 1) || (Size.Y < 1) || (Window.Left < 0) || (Window.Top < 0) || (Window.Right < Window.Left) || (Window.Bottom < Window.Top) || (Window.Right >= Size.X) || (Window.Bottom >= Size.Y)) {
+			return FALSE;
 		}
 
-		return true;
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
+
+		pConsole->m_unAttributes = lpConsoleScreenBufferInfoEx->wAttributes;
+		pConsole->Resize(Size);
+		pConsole->m_Window = Window;
+		pConsole->m_CursorPosition.X = ClampCoordinate(lpConsoleScreenBufferInfoEx->dwCursorPosition.X, 0, Size.X - 1);
+		pConsole->m_CursorPosition.Y = ClampCoordinate(lpConsoleScreenBufferInfoEx->dwCursorPosition.Y, 0, Size.Y - 1);
+		memcpy(pConsole->m_ColorTable, lpConsoleScreenBufferInfoEx->ColorTable, sizeof(pConsole->m_ColorTable));
+
+		return TRUE;
 	}
 
-	bool SmartConsoleUtils::GetColor(PCOLOR_PAIR pColorPair) {
-		if (!pColorPair) {
-			return false;
+	BOOL WINAPI EmulatedConsole::ApiSetConsoleTextAttribute(HANDLE hConsoleOutput, WORD wAttributes) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_SET_CONSOLE_TEXT_ATTRIBUTE);
+		if (!pConsole || (hConsoleOutput != g_hEmulatedOut)) {
+			return FALSE;
 		}
 
-		WORD unAttributes = 0;
-		if (!GetAttributes(&unAttributes)) {
-			return false;
-		}
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-		*pColorPair = COLOR_PAIR(static_cast<COLOR>((unAttributes & 0xF0) >> 4), static_cast<COLOR>(unAttributes & 0x0F));
+		pConsole->m_unAttributes = wAttributes;
 
-		return true;
+		return TRUE;
 	}
 
-	bool SmartConsoleUtils::SetColor(COLOR_PAIR ColorPair) {
-		if (!GetWindow()) {
-			return false;
+	BOOL WINAPI EmulatedConsole::ApiGetConsoleCursorInfo(HANDLE hConsoleOutput, PCONSOLE_CURSOR_INFO lpConsoleCursorInfo) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_GET_CONSOLE_CURSOR_INFO);
+		if (!pConsole || (hConsoleOutput != g_hEmulatedOut) || !lpConsoleCursorInfo) {
+			return FALSE;
 		}
 
-		HANDLE hOut = GetOut();
-		if (!hOut) {
-			return false;
-		}
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-		WORD unAttributes = 0;
-		if (!GetAttributes(&unAttributes)) {
-			return false;
-		}
+		*lpConsoleCursorInfo = pConsole->m_CursorInfo;
 
-		COLOR_PAIR CurrentColorPair(static_cast<COLOR>((unAttributes & 0xF0) >> 4), static_cast<COLOR>(unAttributes & 0x0F));
+		return TRUE;
+	}
 
-		if (ColorPair.ColorBackground != COLOR::COLOR_UNKNOWN) {
-			unAttributes = static_cast<unsigned char>((static_cast<unsigned char>(ColorPair.ColorBackground) & 0x0F) << 4);
-		} else {
-			unAttributes = static_cast<unsigned char>(CurrentColorPair.ColorBackground);
+	BOOL WINAPI EmulatedConsole::ApiSetConsoleCursorInfo(HANDLE hConsoleOutput, const CONSOLE_CURSOR_INFO* lpConsoleCursorInfo) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_SET_CONSOLE_CURSOR_INFO);
+		if (!pConsole || (hConsoleOutput != g_hEmulatedOut) || !lpConsoleCursorInfo || (lpConsoleCursorInfo->dwSize < 1) || (lpConsoleCursorInfo->dwSize > 100)) {
+			return FALSE;
 		}
 
-		if (ColorPair.ColorForeground != COLOR::COLOR_UNKNOWN) {
-			unAttributes |= static_cast<unsigned char>((static_cast<unsigned char>(ColorPair.ColorForeground) & 0x0F));
-		} else {
-			unAttributes |= static_cast<unsigned char>(CurrentColorPair.ColorForeground);
-		}
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-		m_PreviousColorPair = CurrentColorPair;
+		pConsole->m_CursorInfo = *lpConsoleCursorInfo;
 
-		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
-		if (!GetBufferInfo(&csbi)) {
-			return false;
-		}
+		return TRUE;
+	}
 
-		COORD Coord;
-		Coord.X = 0;
-		Coord.Y = 0;
-		DWORD unWrittenAttributes = 0;
-		if (!FillConsoleOutputAttribute(hOut, unAttributes, csbi.dwSize.Y * csbi.dwSize.X, Coord, &unWrittenAttributes)) {
-			return false;
+	BOOL WINAPI EmulatedConsole::ApiSetConsoleCursorPosition(HANDLE hConsoleOutput, COORD dwCursorPosition) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_SET_CONSOLE_CURSOR_POSITION);
+		if (!pConsole || (hConsoleOutput != g_hEmulatedOut)) {
+			return FALSE;
 		}
 
-		return true;
-	}
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-	bool SmartConsoleUtils::RestoreColor(bool bRestorePrevious) {
-		if (bRestorePrevious) {
-			return SetColor(m_PreviousColorPair);
+		if ((dwCursorPosition.X < 0) || (dwCursorPosition.Y < 0) || (dwCursorPosition.X >= pConsole->m_Size.X) || (dwCursorPosition.Y >= pConsole->m_Size.Y)) {
+			return FALSE;
 		}
-		return SetColor(m_OriginalColorPair);
+
+		pConsole->m_CursorPosition = dwCursorPosition;
+		pConsole->FollowCursor();
+
+		return TRUE;
 	}
 
-	bool SmartConsoleUtils::GetCursorInfo(PCONSOLE_CURSOR_INFO pCursorInfo) {
-		if (!pCursorInfo) {
-			return false;
+	BOOL WINAPI EmulatedConsole::ApiFillConsoleOutputAttribute(HANDLE hConsoleOutput, WORD wAttribute, DWORD nLength, COORD dwWriteCoord, LPDWORD lpNumberOfAttrsWritten) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_FILL_CONSOLE_OUTPUT_ATTRIBUTE);
+		if (!pConsole || (hConsoleOutput != g_hEmulatedOut) || !lpNumberOfAttrsWritten) {
+			return FALSE;
 		}
 
-		if (!GetWindow()) {
-			return false;
-		}
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-		HANDLE hOut = GetOut();
-		if (!hOut) {
-			return false;
+		if ((dwWriteCoord.X < 0) || (dwWriteCoord.Y < 0) || (dwWriteCoord.X >= pConsole->m_Size.X) || (dwWriteCoord.Y >= pConsole->m_Size.Y)) {
+			return FALSE;
 		}
 
-		memset(pCursorInfo, 0, sizeof(CONSOLE_CURSOR_INFO));
+		const size_t unStart = static_cast<size_t>(dwWriteCoord.Y) * pConsole->m_Size.X + dwWriteCoord.X;
+		const size_t unCount = nLength < pConsole->m_Cells.size() - unStart ? nLength : pConsole->m_Cells.size() - unStart;
 
-		if (!GetConsoleCursorInfo(hOut, pCursorInfo)) {
-			return false;
+		for (size_t i = unStart; i < unStart + unCount; ++i) {
+			pConsole->m_Cells[i].Attributes = wAttribute;
 		}
 
-		return true;
+		pConsole->m_unTouchedCells.fetch_add(unCount, std::memory_order_relaxed);
+
+		*lpNumberOfAttrsWritten = static_cast<DWORD>(unCount);
+
+		return TRUE;
 	}
 
-	bool SmartConsoleUtils::SetCursorInfo(CONSOLE_CURSOR_INFO CursorInfo) {
-		if (!GetWindow()) {
-			return false;
+	BOOL WINAPI EmulatedConsole::ApiFillConsoleOutputCharacterW(HANDLE hConsoleOutput, WCHAR cCharacter, DWORD nLength, COORD dwWriteCoord, LPDWORD lpNumberOfCharsWritten) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_FILL_CONSOLE_OUTPUT_CHARACTER);
+		if (!pConsole || (hConsoleOutput != g_hEmulatedOut) || !lpNumberOfCharsWritten) {
+			return FALSE;
 		}
 
-		HANDLE hOut = GetOut();
-		if (!hOut) {
-			return false;
-		}
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-		if (!SetConsoleCursorInfo(hOut, &CursorInfo)) {
-			return false;
+		if ((dwWriteCoord.X < 0) || (dwWriteCoord.Y < 0) || (dwWriteCoord.X >= pConsole->m_Size.X) || (dwWriteCoord.Y >= pConsole->m_Size.Y)) {
+			return FALSE;
 		}
 
-		return true;
-	}
+		const size_t unStart = static_cast<size_t>(dwWriteCoord.Y) * pConsole->m_Size.X + dwWriteCoord.X;
+		const size_t unCount = nLength < pConsole->m_Cells.size() - unStart ? nLength : pConsole->m_Cells.size() - unStart;
 
-	bool SmartConsoleUtils::GetCursorPosition(PCOORD pCursorPosition) {
-		if (!pCursorPosition) {
-			return false;
+		for (size_t i = unStart; i < unStart + unCount; ++i) {
+			pConsole->m_Cells[i].Char.UnicodeChar = cCharacter;
 		}
 
-		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
-		if (!GetBufferInfo(&csbi)) {
-			return false;
-		}
+		pConsole->m_unTouchedCells.fetch_add(unCount, std::memory_order_relaxed);
 
-		pCursorPosition->X = csbi.dwCursorPosition.X;
-		pCursorPosition->Y = csbi.dwCursorPosition.Y;
+		*lpNumberOfCharsWritten = static_cast<DWORD>(unCount);
 
-		return true;
+		return TRUE;
 	}
 
-	bool SmartConsoleUtils::SetCursorPosition(COORD CursorPosition) {
-		if (!GetWindow()) {
-			return false;
+	BOOL WINAPI EmulatedConsole::ApiWriteConsoleA(HANDLE hConsoleOutput, const VOID* lpBuffer, DWORD nNumberOfCharsToWrite, LPDWORD lpNumberOfCharsWritten, LPVOID lpReserved) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE);
+		if (!pConsole || (hConsoleOutput != g_hEmulatedOut) || (!lpBuffer && nNumberOfCharsToWrite)) {
+			return FALSE;
 		}
 
-		HANDLE hOut = GetOut();
-		if (!hOut) {
-			return false;
-		}
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-		if (!SetConsoleCursorPosition(hOut, CursorPosition)) {
-			return false;
-		}
+		std::wstring& Text = pConsole->m_Converted;
+		Text.clear();
 
-		return true;
-	}
+		if (nNumberOfCharsToWrite) {
+			char const* const pBuffer = reinterpret_cast<char const*>(lpBuffer);
+			const int nWideLength = MultiByteToWideChar(CP_UTF8, 0, pBuffer, static_cast<int>(nNumberOfCharsToWrite), nullptr, 0);
+			if (nWideLength <= 0) {
+				return FALSE;
+			}
 
-	bool SmartConsoleUtils::ShowCursor() {
-		CONSOLE_CURSOR_INFO cci;
-		if (!GetCursorInfo(&cci)) {
-			return false;
+			Text.resize(static_cast<size_t>(nWideLength));
+			if (MultiByteToWideChar(CP_UTF8, 0, pBuffer, static_cast<int>(nNumberOfCharsToWrite), Text.data(), nWideLength) != nWideLength) {
+				return FALSE;
+			}
 		}
 
-		cci.bVisible = TRUE;
+		pConsole->WriteText(Text.data(), Text.size());
 
-		if (!SetCursorInfo(cci)) {
-			return false;
+		if (lpNumberOfCharsWritten) {
+			*lpNumberOfCharsWritten = nNumberOfCharsToWrite;
 		}
 
-		return true;
+		return TRUE;
 	}
 
-	bool SmartConsoleUtils::HideCursor() {
-		CONSOLE_CURSOR_INFO cci;
-		if (!GetCursorInfo(&cci)) {
-			return false;
+	BOOL WINAPI EmulatedConsole::ApiWriteConsoleW(HANDLE hConsoleOutput, const VOID* lpBuffer, DWORD nNumberOfCharsToWrite, LPDWORD lpNumberOfCharsWritten, LPVOID lpReserved) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE);
+		if (!pConsole || (hConsoleOutput != g_hEmulatedOut) || (!lpBuffer && nNumberOfCharsToWrite)) {
+			return FALSE;
 		}
 
-		cci.bVisible = FALSE;
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-		if (!SetCursorInfo(cci)) {
-			return false;
+		pConsole->WriteText(reinterpret_cast<wchar_t const*>(lpBuffer), nNumberOfCharsToWrite);
+
+		if (lpNumberOfCharsWritten) {
+			*lpNumberOfCharsWritten = nNumberOfCharsToWrite;
 		}
 
-		return true;
+		return TRUE;
 	}
 
-	bool SmartConsoleUtils::ToggleCursor() {
-		CONSOLE_CURSOR_INFO cci;
-		if (!GetCursorInfo(&cci)) {
-			return false;
+	BOOL WINAPI EmulatedConsole::ApiWriteConsoleOutputW(HANDLE hConsoleOutput, const CHAR_INFO* lpBuffer, COORD dwBufferSize, COORD dwBufferCoord, PSMALL_RECT lpWriteRegion) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE_OUTPUT);
+		if (!pConsole || (hConsoleOutput != g_hEmulatedOut) || !lpBuffer || !lpWriteRegion) {
+			return FALSE;
 		}
 
-		cci.bVisible = !static_cast<bool>(cci.bVisible & 1);
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-		if (!SetCursorInfo(cci)) {
-			return false;
-		}
+		// Clip against both the screen buffer and the part of the source buffer the region maps to.
+		const SMALL_RECT Requested = *lpWriteRegion;
+		SMALL_RECT Region = Requested;
 
-		return true;
-	}
+		SMALL_RECT Bounds;
+		Bounds.Left = 0;
+		Bounds.Top = 0;
+		Bounds.Right = pConsole->m_Size.X - 1;
+		Bounds.Bottom = pConsole->m_Size.Y - 1;
 
-	bool SmartConsoleUtils::GetCursorColor(PCOLOR_PAIR pColorPair) {
-		if (!pColorPair) {
-			return false;
+		SMALL_RECT Source;
+		Source.Left = Requested.Left - dwBufferCoord.X;
+		Source.Top = Requested.Top - dwBufferCoord.Y;
+		Source.Right = Source.Left + dwBufferSize.X - 1;
+		Source.Bottom = Source.Top + dwBufferSize.Y - 1;
+
+		if (!IntersectRect(Region, Bounds) || !IntersectRect(Region, Source)) {
+			lpWriteRegion->Right = lpWriteRegion->Left - 1;
+			lpWriteRegion->Bottom = lpWriteRegion->Top - 1;
+			return TRUE;
 		}
 
-		WORD unAttributes = 0;
-		if (!GetAttributes(&unAttributes)) {
-			return false;
+		for (SHORT nY = Region.Top; nY <= Region.Bottom; ++nY) {
+			const size_t unSourceRow = static_cast<size_t>(dwBufferCoord.Y + nY - Requested.Top) * dwBufferSize.X;
+			for (SHORT nX = Region.Left; nX <= Region.Right; ++nX) {
+				pConsole->m_Cells[static_cast<size_t>(nY) * pConsole->m_Size.X + nX] = lpBuffer[unSourceRow + dwBufferCoord.X + nX - Requested.Left];
+			}
 		}
 
-		*pColorPair = COLOR_PAIR(static_cast<COLOR>((unAttributes & 0xF0) >> 4), static_cast<COLOR>(unAttributes & 0x0F));
+		pConsole->m_unTouchedCells.fetch_add(static_cast<size_t>(Region.Right - Region.Left + 1) * (Region.Bottom - Region.Top + 1), std::memory_order_relaxed);
 
-		return true;
+		*lpWriteRegion = Region;
+
+		return TRUE;
 	}
 
-	bool SmartConsoleUtils::SetCursorColor(COLOR_PAIR ColorPair) {
-		WORD unAttributes = 0;
-		if (!GetAttributes(&unAttributes)) {
-			return false;
+	BOOL WINAPI EmulatedConsole::ApiReadConsoleOutputW(HANDLE hConsoleOutput, PCHAR_INFO lpBuffer, COORD dwBufferSize, COORD dwBufferCoord, PSMALL_RECT lpReadRegion) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_READ_CONSOLE_OUTPUT);
+		if (!pConsole || (hConsoleOutput != g_hEmulatedOut) || !lpBuffer || !lpReadRegion) {
+			return FALSE;
 		}
 
-		COLOR_PAIR CurrentColorPair(static_cast<COLOR>((unAttributes & 0xF0) >> 4), static_cast<COLOR>(unAttributes & 0x0F));
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-		if (ColorPair.ColorBackground != COLOR::COLOR_UNKNOWN) {
-			unAttributes = static_cast<unsigned char>((static_cast<unsigned char>(ColorPair.ColorBackground) & 0x0F) << 4);
-		} else {
-			unAttributes = static_cast<unsigned char>(CurrentColorPair.ColorBackground);
-		}
+		// Clip against both the screen buffer and the part of the target buffer the region maps to.
+		const SMALL_RECT Requested = *lpReadRegion;
+		SMALL_RECT Region = Requested;
 
-		if (ColorPair.ColorForeground != COLOR::COLOR_UNKNOWN) {
-			unAttributes |= static_cast<unsigned char>((static_cast<unsigned char>(ColorPair.ColorForeground) & 0x0F));
-		} else {
-			unAttributes |= static_cast<unsigned char>(CurrentColorPair.ColorForeground);
-		}
+		SMALL_RECT Bounds;
+		Bounds.Left = 0;
+		Bounds.Top = 0;
+		Bounds.Right = pConsole->m_Size.X - 1;
+		Bounds.Bottom = pConsole->m_Size.Y - 1;
 
-		m_PreviousCursorColorPair = CurrentColorPair;
+		SMALL_RECT Target;
+		Target.Left = Requested.Left - dwBufferCoord.X;
+		Target.Top = Requested.Top - dwBufferCoord.Y;
+		Target.Right = Target.Left + dwBufferSize.X - 1;
+		Target.Bottom = Target.Top + dwBufferSize.Y - 1;
 
-		if (!SetAttributes(unAttributes)) {
-			return false;
+		if (!IntersectRect(Region, Bounds) || !IntersectRect(Region, Target)) {
+			lpReadRegion->Right = lpReadRegion->Left - 1;
+			lpReadRegion->Bottom = lpReadRegion->Top - 1;
+			return TRUE;
+		}
+
+		for (SHORT nY = Region.Top; nY <= Region.Bottom; ++nY) {
+			const size_t unTargetRow = static_cast<size_t>(dwBufferCoord.Y + nY - Requested.Top) * dwBufferSize.X;
+			for (SHORT nX = Region.Left; nX <= Region.Right; ++nX) {
+				lpBuffer[unTargetRow + dwBufferCoord.X + nX - Requested.Left] = pConsole->m_Cells[static_cast<size_t>(nY) * pConsole->m_Size.X + nX];
+			}
 		}
 
-		return true;
-	}
+		*lpReadRegion = Region;
 
-	bool SmartConsoleUtils::RestoreCursorColor(bool bRestorePrevious) {
-		if (bRestorePrevious) {
-			return SetCursorColor(m_PreviousCursorColorPair);
-		}
-		return SetCursorColor(m_OriginalCursorColorPair);
+		return TRUE;
 	}
 
-	bool SmartConsoleUtils::Erase(COORD CursorPosition, unsigned int unLength) {
-		if (!GetWindow()) {
-			return false;
+	BOOL WINAPI EmulatedConsole::ApiWriteConsoleOutputAttribute(HANDLE hConsoleOutput, const WORD* lpAttribute, DWORD nLength, COORD dwWriteCoord, LPDWORD lpNumberOfAttrsWritten) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE_OUTPUT_ATTRIBUTE);
+		if (!pConsole || (hConsoleOutput != g_hEmulatedOut) || (!lpAttribute && nLength) || !lpNumberOfAttrsWritten) {
+			return FALSE;
 		}
 
-		HANDLE hOut = GetOut();
-		if (!hOut) {
-			return false;
-		}
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-		DWORD unWrittenAttributes = 0;
-		if (!FillConsoleOutputCharacter(hOut, _T(' '), unLength, CursorPosition, &unWrittenAttributes)) {
-			return false;
+		if ((dwWriteCoord.X < 0) || (dwWriteCoord.Y < 0) || (dwWriteCoord.X >= pConsole->m_Size.X) || (dwWriteCoord.Y >= pConsole->m_Size.Y)) {
+			return FALSE;
 		}
 
-		WORD unAttributes = 0;
-		if (!GetAttributes(&unAttributes)) {
-			return false;
-		}
+		const size_t unStart = static_cast<size_t>(dwWriteCoord.Y) * pConsole->m_Size.X + dwWriteCoord.X;
+		const size_t unCount = nLength < pConsole->m_Cells.size() - unStart ? nLength : pConsole->m_Cells.size() - unStart;
 
-		unWrittenAttributes = 0;
-		if (!FillConsoleOutputAttribute(hOut, unAttributes, unLength, CursorPosition, &unWrittenAttributes)) {
-			return false;
+		for (size_t i = 0; i < unCount; ++i) {
+			pConsole->m_Cells[unStart + i].Attributes = lpAttribute[i];
 		}
 
-		return true;
-	}
+		pConsole->m_unTouchedCells.fetch_add(unCount, std::memory_order_relaxed);
 
-	// ----------------------------------------------------------------
-	// print/scan with format and color support
-	// ----------------------------------------------------------------
+		*lpNumberOfAttrsWritten = static_cast<DWORD>(unCount);
 
-	int clrvprintf(COLOR_PAIR ColorPair, char const* const _Format, va_list vargs) {
-		char* szBuffer = new char[8192];
-		if (!szBuffer) {
-			return -1;
+		return TRUE;
+	}
+
+	BOOL WINAPI EmulatedConsole::ApiScrollConsoleScreenBufferW(HANDLE hConsoleOutput, const SMALL_RECT* lpScrollRectangle, const SMALL_RECT* lpClipRectangle, COORD dwDestinationOrigin, const CHAR_INFO* lpFill) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_SCROLL_CONSOLE_SCREEN_BUFFER);
+		if (!pConsole || (hConsoleOutput != g_hEmulatedOut) || !lpScrollRectangle || !lpFill) {
+			return FALSE;
 		}
 
-		memset(szBuffer, 0, sizeof(szBuffer));
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-		SmartConsoleUtils SCU;
-		
-		if (!SCU.SetCursorColor(ColorPair)) {
-			delete[] szBuffer;
-			return -1;
+		SMALL_RECT Bounds;
+		Bounds.Left = 0;
+		Bounds.Top = 0;
+		Bounds.Right = pConsole->m_Size.X - 1;
+		Bounds.Bottom = pConsole->m_Size.Y - 1;
+
+		SMALL_RECT Clip = lpClipRectangle ? *lpClipRectangle : Bounds;
+		if (!IntersectRect(Clip, Bounds)) {
+			return TRUE;
 		}
 
-		int nLength = vsprintf_s(szBuffer, 8192, _Format, vargs);
-		if (nLength == -1) {
-			delete[] szBuffer;
-			return -1;
+		SMALL_RECT Scroll = *lpScrollRectangle;
+		if (!IntersectRect(Scroll, Bounds)) {
+			return FALSE;
 		}
 
-		szBuffer[8191] = 0;
-		if (!SCU.WriteA(szBuffer)) {
-			SCU.RestoreCursorColor(true);
-			delete[] szBuffer;
-			return -1;
+		const SHORT nWidth = Scroll.Right - Scroll.Left + 1;
+		const SHORT nHeight = Scroll.Bottom - Scroll.Top + 1;
+		const size_t unStride = pConsole->m_Size.X;
+
+		std::vector<CHAR_INFO> Moved(static_cast<size_t>(nWidth) * nHeight);
+		for (SHORT nY = 0; nY < nHeight; ++nY) {
+			memcpy(Moved.data() + static_cast<size_t>(nY) * nWidth, pConsole->m_Cells.data() + static_cast<size_t>(Scroll.Top + nY) * unStride + Scroll.Left, sizeof(CHAR_INFO) * nWidth);
 		}
 
-		if (!SCU.RestoreCursorColor(true)) {
-			delete[] szBuffer;
-			return -1;
+		// Vacate the source first, the destination then overwrites whatever overlaps.
+		SMALL_RECT Vacated = Scroll;
+		if (IntersectRect(Vacated, Clip)) {
+			for (SHORT nY = Vacated.Top; nY <= Vacated.Bottom; ++nY) {
+				for (SHORT nX = Vacated.Left; nX <= Vacated.Right; ++nX) {
+					pConsole->m_Cells[static_cast<size_t>(nY) * unStride + nX] = *lpFill;
+				}
+			}
+
+			pConsole->m_unTouchedCells.fetch_add(static_cast<size_t>(Vacated.Right - Vacated.Left + 1) * (Vacated.Bottom - Vacated.Top + 1), std::memory_order_relaxed);
 		}
 
-		delete[] szBuffer;
-		return nLength;
-	}
+		SMALL_RECT Destination;
+		Destination.Left = dwDestinationOrigin.X;
+		Destination.Top = dwDestinationOrigin.Y;
+		Destination.Right = static_cast<SHORT>(dwDestinationOrigin.X + nWidth - 1);
+		Destination.Bottom = static_cast<SHORT>(dwDestinationOrigin.Y + nHeight - 1);
 
-	int clrvprintf(COLOR unForegroundColor, char const* const _Format, va_list vargs) {
-		return clrvprintf(COLOR_PAIR(unForegroundColor), _Format, vargs);
-	}
+		if (IntersectRect(Destination, Clip)) {
+			for (SHORT nY = Destination.Top; nY <= Destination.Bottom; ++nY) {
+				for (SHORT nX = Destination.Left; nX <= Destination.Right; ++nX) {
+					pConsole->m_Cells[static_cast<size_t>(nY) * unStride + nX] = Moved[static_cast<size_t>(nY - dwDestinationOrigin.Y) * nWidth + (nX - dwDestinationOrigin.X)];
+				}
+			}
 
-	int clrprintf(COLOR_PAIR ColorPair, char const* const _Format, ...) {
-		va_list vargs;
-		va_start(vargs, _Format);
-		int nLength = clrvprintf(ColorPair, _Format, vargs);
-		va_end(vargs);
-		return nLength;
-	}
+			pConsole->m_unTouchedCells.fetch_add(static_cast<size_t>(Destination.Right - Destination.Left + 1) * (Destination.Bottom - Destination.Top + 1), std::memory_order_relaxed);
+		}
 
-	int clrprintf(COLOR unForegroundColor, char const* const _Format, ...) {
-		va_list vargs;
-		va_start(vargs, _Format);
-		int nLength = clrvprintf(unForegroundColor, _Format, vargs);
-		va_end(vargs);
-		return nLength;
+		return TRUE;
 	}
 
-	int clrvwprintf(COLOR_PAIR ColorPair, wchar_t const* const _Format, va_list vargs) {
-		wchar_t* szBuffer = new wchar_t[8192];
-		if (!szBuffer) {
-			return -1;
+	// Hands out queued input up to and including the next line break (all of it without ENABLE_LINE_INPUT). No input reads as end of file.
+	BOOL WINAPI EmulatedConsole::ApiReadConsoleA(HANDLE hConsoleInput, LPVOID lpBuffer, DWORD nNumberOfCharsToRead, LPDWORD lpNumberOfCharsRead, PCONSOLE_READCONSOLE_CONTROL pInputControl) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_READ_CONSOLE);
+		if (!pConsole || (hConsoleInput != g_hEmulatedIn) || !lpBuffer || !lpNumberOfCharsRead) {
+			return FALSE;
 		}
 
-		memset(szBuffer, 0, sizeof(szBuffer));
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-		SmartConsoleUtils SCU;
-
-		if (!SCU.SetCursorColor(ColorPair)) {
-			delete[] szBuffer;
-			return -1;
+		size_t unTake = pConsole->m_Input.size();
+		if (pConsole->m_unInputMode & ENABLE_LINE_INPUT) {
+			const size_t unLineEnd = pConsole->m_Input.find(L'\n');
+			if (unLineEnd != std::wstring::npos) {
+				unTake = unLineEnd + 1;
+			}
 		}
 
-		int nLength = vswprintf_s(szBuffer, 8192, _Format, vargs);
-		if (nLength == -1) {
-			delete[] szBuffer;
-			return -1;
+		// Shrink until the UTF-8 form fits into the buffer.
+		int nBytes = 0;
+		while (unTake) {
+			nBytes = WideCharToMultiByte(CP_UTF8, 0, pConsole->m_Input.data(), static_cast<int>(unTake), nullptr, 0, nullptr, nullptr);
+			if ((nBytes > 0) && (static_cast<DWORD>(nBytes) <= nNumberOfCharsToRead)) {
+				break;
+			}
+			--unTake;
 		}
 
-		szBuffer[8191] = 0;
-		if (!SCU.WriteW(szBuffer)) {
-			SCU.RestoreCursorColor(true);
-			delete[] szBuffer;
-			return -1;
-		}
+		if (unTake) {
+			WideCharToMultiByte(CP_UTF8, 0, pConsole->m_Input.data(), static_cast<int>(unTake), reinterpret_cast<char*>(lpBuffer), nBytes, nullptr, nullptr);
 
-		if (!SCU.RestoreCursorColor(true)) {
-			delete[] szBuffer;
-			return -1;
+			if (pConsole->m_unInputMode & ENABLE_ECHO_INPUT) {
+				pConsole->WriteText(pConsole->m_Input.data(), unTake);
+			}
+
+			pConsole->m_Input.erase(0, unTake);
 		}
 
-		delete[] szBuffer;
-		return nLength;
-	}
+		*lpNumberOfCharsRead = unTake ? static_cast<DWORD>(nBytes) : 0;
 
-	int clrvwprintf(COLOR unForegroundColor, wchar_t const* const _Format, va_list vargs) {
-		return clrvwprintf(COLOR_PAIR(unForegroundColor), _Format, vargs);
+		return TRUE;
 	}
 
-	int clrwprintf(COLOR_PAIR ColorPair, wchar_t const* const _Format, ...) {
-		va_list vargs;
-		va_start(vargs, _Format);
-		int nLength = clrvwprintf(ColorPair, _Format, vargs);
-		va_end(vargs);
-		return nLength;
-	}
+	BOOL WINAPI EmulatedConsole::ApiReadConsoleW(HANDLE hConsoleInput, LPVOID lpBuffer, DWORD nNumberOfCharsToRead, LPDWORD lpNumberOfCharsRead, PCONSOLE_READCONSOLE_CONTROL pInputControl) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_READ_CONSOLE);
+		if (!pConsole || (hConsoleInput != g_hEmulatedIn) || !lpBuffer || !lpNumberOfCharsRead) {
+			return FALSE;
+		}
 
-	int clrwprintf(COLOR unForegroundColor, wchar_t const* const _Format, ...) {
-		va_list vargs;
-		va_start(vargs, _Format);
-		int nLength = clrvwprintf(unForegroundColor, _Format, vargs);
-		va_end(vargs);
-		return nLength;
-	}
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-#ifdef UNICODE
-	int tclrvprintf(COLOR_PAIR ColorPair, wchar_t const* const _Format, va_list vargs) {
-		return clrvwprintf(ColorPair, _Format, vargs);
-	}
+		size_t unTake = pConsole->m_Input.size();
+		if (pConsole->m_unInputMode & ENABLE_LINE_INPUT) {
+			const size_t unLineEnd = pConsole->m_Input.find(L'\n');
+			if (unLineEnd != std::wstring::npos) {
+				unTake = unLineEnd + 1;
+			}
+		}
 
-	int tclrvprintf(COLOR unForegroundColor, wchar_t const* const _Format, va_list vargs) {
-		return clrvwprintf(unForegroundColor, _Format, vargs);
-	}
+		if (unTake > nNumberOfCharsToRead) {
+			unTake = nNumberOfCharsToRead;
+		}
 
-	int tclrprintf(COLOR_PAIR ColorPair, wchar_t const* const _Format, ...) {
-		va_list vargs;
-		va_start(vargs, _Format);
-		int nLength = tclrvprintf(ColorPair, _Format, vargs);
-		va_end(vargs);
-		return nLength;
-	}
+		memcpy(lpBuffer, pConsole->m_Input.data(), sizeof(wchar_t) * unTake);
 
-	int tclrprintf(COLOR unForegroundColor, wchar_t const* const _Format, ...) {
-		va_list vargs;
-		va_start(vargs, _Format);
-		int nLength = tclrvprintf(unForegroundColor, _Format, vargs);
-		va_end(vargs);
-		return nLength;
-	}
-#else
-	int tclrvprintf(COLOR_PAIR ColorPair, char const* const _Format, va_list vargs) {
-		return clrvprintf(ColorPair, _Format, vargs);
-	}
+		if (pConsole->m_unInputMode & ENABLE_ECHO_INPUT) {
+			pConsole->WriteText(pConsole->m_Input.data(), unTake);
+		}
 
-	int tclrvprintf(COLOR unForegroundColor, char const* const _Format, va_list vargs) {
-		return clrvprintf(unForegroundColor, _Format, vargs);
-	}
+		pConsole->m_Input.erase(0, unTake);
 
-	int tclrprintf(COLOR_PAIR ColorPair, char const* const _Format, ...) {
-		va_list vargs;
-		va_start(vargs, _Format);
-		int nLength = tclrvprintf(ColorPair, _Format, vargs);
-		va_end(vargs);
-		return nLength;
-	}
+		*lpNumberOfCharsRead = static_cast<DWORD>(unTake);
 
-	int tclrprintf(COLOR unForegroundColor, char const* const _Format, ...) {
-		va_list vargs;
-		va_start(vargs, _Format);
-		int nLength = tclrvprintf(unForegroundColor, _Format, vargs);
-		va_end(vargs);
-		return nLength;
+		return TRUE;
 	}
-#endif
 
-	int clrvscanf(COLOR_PAIR ColorPair, char const* const _Format, va_list vargs) {
-		char* szBuffer = new char[8192];
-		if (!szBuffer) {
-			return -1;
+	// Blocks until there is at least one record, like the console does.
+	BOOL WINAPI EmulatedConsole::ApiReadConsoleInputW(HANDLE hConsoleInput, PINPUT_RECORD lpBuffer, DWORD nLength, LPDWORD lpNumberOfEventsRead) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_READ_CONSOLE_INPUT);
+		if (!pConsole || (hConsoleInput != g_hEmulatedIn) || !lpBuffer || !nLength || !lpNumberOfEventsRead) {
+			return FALSE;
 		}
 
-		memset(szBuffer, 0, sizeof(szBuffer));
+		std::unique_lock<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->m_InputReady.wait(Lock, [pConsole] { return !pConsole->m_InputRecords.empty(); });
+		pConsole->Simulate();
 
-		SmartConsoleUtils SCU;
-
-		if (!SCU.SetCursorColor(ColorPair)) {
-			delete[] szBuffer;
-			return -1;
+		DWORD unTake = static_cast<DWORD>(pConsole->m_InputRecords.size());
+		if (unTake > nLength) {
+			unTake = nLength;
 		}
 
-		if (!SCU.ReadA(szBuffer, 8191)) {
-			SCU.RestoreCursorColor(true);
-			delete[] szBuffer;
-			return -1;
-		}
+		std::copy(pConsole->m_InputRecords.begin(), pConsole->m_InputRecords.begin() + unTake, lpBuffer);
+		pConsole->m_InputRecords.erase(pConsole->m_InputRecords.begin(), pConsole->m_InputRecords.begin() + unTake);
 
-		int nLength = vsscanf_s(szBuffer, _Format, vargs);
-		if (nLength == -1) {
-			delete[] szBuffer;
-			return -1;
-		}
+		*lpNumberOfEventsRead = unTake;
 
-		if (!SCU.RestoreCursorColor(true)) {
-			delete[] szBuffer;
-			return -1;
+		return TRUE;
+	}
+
+	// Only the input handle can be waited on. It is signaled while input records are queued.
+	DWORD WINAPI EmulatedConsole::ApiWaitForSingleObject(HANDLE hHandle, DWORD dwMilliseconds) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_WAIT_FOR_SINGLE_OBJECT);
+		if (!pConsole || (hHandle != g_hEmulatedIn)) {
+			return WAIT_FAILED;
 		}
 
-		delete[] szBuffer;
-		return nLength;
-	}
+		std::unique_lock<std::mutex> Lock(pConsole->m_Lock);
 
-	int clrvscanf(COLOR unForegroundColor, char const* const _Format, va_list vargs) {
-		return clrvscanf(COLOR_PAIR(unForegroundColor), _Format, vargs);
-	}
+		const auto IsSignaled = [pConsole] { return !pConsole->m_InputRecords.empty(); };
 
-	int clrscanf(COLOR_PAIR ColorPair, char const* const _Format, ...) {
-		va_list vargs;
-		va_start(vargs, _Format);
-		int nLength = clrvscanf(ColorPair, _Format, vargs);
-		va_end(vargs);
-		return nLength;
-	}
+		if (dwMilliseconds == INFINITE) {
+			pConsole->m_InputReady.wait(Lock, IsSignaled);
+			return WAIT_OBJECT_0;
+		}
 
-	int clrscanf(COLOR unForegroundColor, char const* const _Format, ...) {
-		va_list vargs;
-		va_start(vargs, _Format);
-		int nLength = clrvscanf(COLOR_PAIR(unForegroundColor), _Format, vargs);
-		va_end(vargs);
-		return nLength;
+		if (!pConsole->m_InputReady.wait_for(Lock, std::chrono::milliseconds(dwMilliseconds), IsSignaled)) {
+			return WAIT_TIMEOUT;
+		}
+
+		return WAIT_OBJECT_0;
 	}
 
-	int clrvwscanf(COLOR_PAIR ColorPair, wchar_t const* const _Format, va_list vargs) {
-		wchar_t* szBuffer = new wchar_t[8192];
-		if (!szBuffer) {
-			return -1;
+	LONG WINAPI EmulatedConsole::ApiGetWindowLongW(HWND hWnd, int nIndex) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_GET_WINDOW_LONG);
+		if (!pConsole || (hWnd != g_hEmulatedWindow)) {
+			return 0;
 		}
 
-		memset(szBuffer, 0, sizeof(szBuffer));
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-		SmartConsoleUtils SCU;
-
-		if (!SCU.SetCursorColor(ColorPair)) {
-			delete[] szBuffer;
-			return -1;
+		if (nIndex == GWL_STYLE) {
+			return pConsole->m_nStyle;
 		}
 
-		if (!SCU.ReadW(szBuffer, 8191)) {
-			SCU.RestoreCursorColor(true);
-			delete[] szBuffer;
-			return -1;
+		if (nIndex == GWL_EXSTYLE) {
+			return pConsole->m_nStyleEx;
 		}
 
-		int nLength = vswscanf_s(szBuffer, _Format, vargs);
-		if (nLength == -1) {
-			delete[] szBuffer;
-			return -1;
+		return 0;
+	}
+
+	LONG WINAPI EmulatedConsole::ApiSetWindowLongW(HWND hWnd, int nIndex, LONG dwNewLong) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_SET_WINDOW_LONG);
+		if (!pConsole || (hWnd != g_hEmulatedWindow)) {
+			return 0;
 		}
 
-		if (!SCU.RestoreCursorColor(true)) {
-			delete[] szBuffer;
-			return -1;
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
+
+		LONG nPrevious = 0;
+		if (nIndex == GWL_STYLE) {
+			nPrevious = pConsole->m_nStyle;
+			pConsole->m_nStyle = dwNewLong;
+		} else if (nIndex == GWL_EXSTYLE) {
+			nPrevious = pConsole->m_nStyleEx;
+			pConsole->m_nStyleEx = dwNewLong;
 		}
 
-		delete[] szBuffer;
-		return nLength;
+		return nPrevious;
 	}
 
-	int clrvwscanf(COLOR unForegroundColor, wchar_t const* const _Format, va_list vargs) {
-		return clrvwscanf(COLOR_PAIR(unForegroundColor), _Format, vargs);
-	}
+	BOOL WINAPI EmulatedConsole::ApiSetWindowPos(HWND hWnd, HWND hWndInsertAfter, int X, int Y, int cx, int cy, UINT uFlags) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_SET_WINDOW_POS);
+		if (!pConsole || (hWnd != g_hEmulatedWindow)) {
+			return FALSE;
+		}
 
-	int clrwscanf(COLOR_PAIR ColorPair, wchar_t const* const _Format, ...) {
-		va_list vargs;
-		va_start(vargs, _Format);
-		int nLength = clrvwscanf(ColorPair, _Format, vargs);
-		va_end(vargs);
-		return nLength;
-	}
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-	int clrwscanf(COLOR unForegroundColor, wchar_t const* const _Format, ...) {
-		va_list vargs;
-		va_start(vargs, _Format);
-		int nLength = clrvwscanf(COLOR_PAIR(unForegroundColor), _Format, vargs);
-		va_end(vargs);
-		return nLength;
+		return TRUE;
 	}
 
-#ifdef UNICODE
-	int tclrvscanf(COLOR_PAIR ColorPair, wchar_t const* const _Format, va_list vargs) {
-		return clrvwscanf(ColorPair, _Format, vargs);
-	}
+	// Returns whether the window was visible before, like the real one.
+	BOOL WINAPI EmulatedConsole::ApiShowWindow(HWND hWnd, int nCmdShow) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_SHOW_WINDOW);
+		if (!pConsole || (hWnd != g_hEmulatedWindow)) {
+			return FALSE;
+		}
 
-	int tclrvscanf(COLOR unForegroundColor, wchar_t const* const _Format, va_list vargs) {
-		return clrvwscanf(unForegroundColor, _Format, vargs);
-	}
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-	int tclrscanf(COLOR_PAIR ColorPair, wchar_t const* const _Format, ...) {
-		va_list vargs;
-		va_start(vargs, _Format);
-		int nLength = tclrvscanf(ColorPair, _Format, vargs);
-		va_end(vargs);
-		return nLength;
-	}
+		const bool bWasVisible = pConsole->m_bVisible;
+		pConsole->m_bVisible = nCmdShow != SW_HIDE;
 
-	int tclrscanf(COLOR unForegroundColor, wchar_t const* const _Format, ...) {
-		va_list vargs;
-		va_start(vargs, _Format);
-		int nLength = tclrvscanf(unForegroundColor, _Format, vargs);
-		va_end(vargs);
-		return nLength;
-	}
-#else
-	int tclrvscanf(COLOR_PAIR ColorPair, char const* const _Format, va_list vargs) {
-		return clrvscanf(ColorPair, _Format, vargs);
+		return bWasVisible ? TRUE : FALSE;
 	}
 
-	int tclrvscanf(COLOR unForegroundColor, char const* const _Format, va_list vargs) {
-		return clrvscanf(unForegroundColor, _Format, vargs);
-	}
+	BOOL WINAPI EmulatedConsole::ApiDestroyWindow(HWND hWnd) {
+		EmulatedConsole* pConsole = Enter(EMULATED_CALL::EMULATED_CALL_DESTROY_WINDOW);
+		if (!pConsole || (hWnd != g_hEmulatedWindow)) {
+			return FALSE;
+		}
 
-	int tclrscanf(COLOR_PAIR ColorPair, char const* const _Format, ...) {
-		va_list vargs;
-		va_start(vargs, _Format);
-		int nLength = tclrvscanf(ColorPair, _Format, vargs);
-		va_end(vargs);
-		return nLength;
-	}
+		std::lock_guard<std::mutex> Lock(pConsole->m_Lock);
+		pConsole->Simulate();
 
-	int tclrscanf(COLOR unForegroundColor, char const* const _Format, ...) {
-		va_list vargs;
-		va_start(vargs, _Format);
-		int nLength = tclrvscanf(unForegroundColor, _Format, vargs);
-		va_end(vargs);
-		return nLength;
+		return TRUE;
 	}
-#endif
+
 }
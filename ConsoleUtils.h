@@ -11,19 +11,212 @@
 #include <io.h>
 #include <fcntl.h>
 
+// SIMD
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CONSOLEUTILS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
 // C++
 #include <clocale>
 #include <cstdio>
+#include <cstring>
+#include <cwctype>
+#include <cstdint>
 #include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 // ----------------------------------------------------------------
 // ConsoleUtils
 // ----------------------------------------------------------------
 namespace ConsoleUtils {
+	// ----------------------------------------------------------------
+	// Console API
+	// ----------------------------------------------------------------
+
+	// Console and console window entry points used by the library. Win32 unless another table is set.
+	typedef struct _CONSOLE_API {
+		HWND (WINAPI* GetConsoleWindow)();
+		BOOL (WINAPI* AllocConsole)();
+		BOOL (WINAPI* FreeConsole)();
+		HANDLE (WINAPI* GetStdHandle)(DWORD nStdHandle);
+		BOOL (WINAPI* GetConsoleMode)(HANDLE hConsoleHandle, LPDWORD lpMode);
+		BOOL (WINAPI* SetConsoleMode)(HANDLE hConsoleHandle, DWORD dwMode);
+		UINT (WINAPI* GetConsoleOutputCP)();
+		BOOL (WINAPI* GetConsoleScreenBufferInfoEx)(HANDLE hConsoleOutput, PCONSOLE_SCREEN_BUFFER_INFOEX lpConsoleScreenBufferInfoEx);
+		BOOL (WINAPI* SetConsoleScreenBufferInfoEx)(HANDLE hConsoleOutput, PCONSOLE_SCREEN_BUFFER_INFOEX lpConsoleScreenBufferInfoEx);
+		BOOL (WINAPI* SetConsoleTextAttribute)(HANDLE hConsoleOutput, WORD wAttributes);
+		BOOL (WINAPI* GetConsoleCursorInfo)(HANDLE hConsoleOutput, PCONSOLE_CURSOR_INFO lpConsoleCursorInfo);
+		BOOL (WINAPI* SetConsoleCursorInfo)(HANDLE hConsoleOutput, const CONSOLE_CURSOR_INFO* lpConsoleCursorInfo);
+		BOOL (WINAPI* SetConsoleCursorPosition)(HANDLE hConsoleOutput, COORD dwCursorPosition);
+		BOOL (WINAPI* FillConsoleOutputAttribute)(HANDLE hConsoleOutput, WORD wAttribute, DWORD nLength, COORD dwWriteCoord, LPDWORD lpNumberOfAttrsWritten);
+		BOOL (WINAPI* FillConsoleOutputCharacterW)(HANDLE hConsoleOutput, WCHAR cCharacter, DWORD nLength, COORD dwWriteCoord, LPDWORD lpNumberOfCharsWritten);
+		BOOL (WINAPI* WriteConsoleA)(HANDLE hConsoleOutput, const VOID* lpBuffer, DWORD nNumberOfCharsToWrite, LPDWORD lpNumberOfCharsWritten, LPVOID lpReserved);
+		BOOL (WINAPI* WriteConsoleW)(HANDLE hConsoleOutput, const VOID* lpBuffer, DWORD nNumberOfCharsToWrite, LPDWORD lpNumberOfCharsWritten, LPVOID lpReserved);
+		BOOL (WINAPI* WriteConsoleOutputW)(HANDLE hConsoleOutput, const CHAR_INFO* lpBuffer, COORD dwBufferSize, COORD dwBufferCoord, PSMALL_RECT lpWriteRegion);
+		BOOL (WINAPI* WriteConsoleOutputAttribute)(HANDLE hConsoleOutput, const WORD* lpAttribute, DWORD nLength, COORD dwWriteCoord, LPDWORD lpNumberOfAttrsWritten);
+		BOOL (WINAPI* ReadConsoleOutputW)(HANDLE hConsoleOutput, PCHAR_INFO lpBuffer, COORD dwBufferSize, COORD dwBufferCoord, PSMALL_RECT lpReadRegion);
+		BOOL (WINAPI* ScrollConsoleScreenBufferW)(HANDLE hConsoleOutput, const SMALL_RECT* lpScrollRectangle, const SMALL_RECT* lpClipRectangle, COORD dwDestinationOrigin, const CHAR_INFO* lpFill);
+		BOOL (WINAPI* ReadConsoleA)(HANDLE hConsoleInput, LPVOID lpBuffer, DWORD nNumberOfCharsToRead, LPDWORD lpNumberOfCharsRead, PCONSOLE_READCONSOLE_CONTROL pInputControl);
+		BOOL (WINAPI* ReadConsoleW)(HANDLE hConsoleInput, LPVOID lpBuffer, DWORD nNumberOfCharsToRead, LPDWORD lpNumberOfCharsRead, PCONSOLE_READCONSOLE_CONTROL pInputControl);
+		BOOL (WINAPI* ReadConsoleInputW)(HANDLE hConsoleInput, PINPUT_RECORD lpBuffer, DWORD nLength, LPDWORD lpNumberOfEventsRead);
+		DWORD (WINAPI* WaitForSingleObject)(HANDLE hHandle, DWORD dwMilliseconds);
+		LONG (WINAPI* GetWindowLongW)(HWND hWnd, int nIndex);
+		LONG (WINAPI* SetWindowLongW)(HWND hWnd, int nIndex, LONG dwNewLong);
+		BOOL (WINAPI* SetWindowPos)(HWND hWnd, HWND hWndInsertAfter, int X, int Y, int cx, int cy, UINT uFlags);
+		BOOL (WINAPI* ShowWindow)(HWND hWnd, int nCmdShow);
+		BOOL (WINAPI* DestroyWindow)(HWND hWnd);
+		// Handles don't belong to a real console, so console text goes through WriteConsole/ReadConsole instead of the CRT streams.
+		bool bEmulated;
+	} CONSOLE_API, *PCONSOLE_API;
+
+	const CONSOLE_API* GetConsoleApi();
+	// nullptr goes back to Win32. Consoles keep the handles they got when created, so switch before creating them.
+	void SetConsoleApi(const CONSOLE_API* pApi);
+
+	// ----------------------------------------------------------------
+	// UTF-8
+	// ----------------------------------------------------------------
+
+	// Instruction sets the transcoders can use. The best one the CPU supports is picked at startup.
+	typedef enum class _SIMD_LEVEL : unsigned char {
+		SIMD_LEVEL_SCALAR = 0,
+		SIMD_LEVEL_SSE2,
+		SIMD_LEVEL_AVX2
+	} SIMD_LEVEL, *PSIMD_LEVEL;
+
+	SIMD_LEVEL GetSimdLevel();
+	// Only lowers the level, or restores one the CPU supports.
+	bool SetSimdLevel(SIMD_LEVEL Level);
+
+	// Validating transcoders. Invalid UTF-8 becomes one U+FFFD per maximal invalid subpart, an unpaired surrogate becomes U+FFFD.
+	// The destination needs room for unLength UTF-16 units, or 3 * unLength bytes. Return the number of units written.
+	size_t ConvertUTF8ToUTF16(char const* const pSource, size_t unLength, wchar_t* const pDestination);
+	size_t ConvertUTF16ToUTF8(wchar_t const* const pSource, size_t unLength, char* const pDestination);
+
+	// ----------------------------------------------------------------
+	// InputReader
+	// ----------------------------------------------------------------
+
+	typedef enum class _INPUT_EVENT_TYPE : unsigned char {
+		INPUT_EVENT_TYPE_NONE = 0,
+		INPUT_EVENT_TYPE_KEY,
+		INPUT_EVENT_TYPE_RESIZE,
+		INPUT_EVENT_TYPE_FOCUS
+	} INPUT_EVENT_TYPE, *PINPUT_EVENT_TYPE;
+
+	typedef struct _INPUT_EVENT {
+		INPUT_EVENT_TYPE Type;
+		// Key
+		bool KeyDown;
+		WORD RepeatCount;
+		WORD VirtualKeyCode;
+		wchar_t Char;
+		DWORD ControlKeyState;
+		// Resize, the new buffer size
+		COORD Size;
+		// Focus
+		bool Focus;
+		// Steady clock microseconds at which the event was read from the console.
+		unsigned long long Timestamp;
+	} INPUT_EVENT, *PINPUT_EVENT;
+
+	// Reads console input events on its own thread into a single-producer single-consumer ring.
+	// Poll, Wait and Drain may only be called from one thread at a time. Events that find the ring full are dropped.
+	class InputReader {
+	public:
+		InputReader();
+		~InputReader();
+	public:
+		// Control
+		bool Start(HANDLE hIn, unsigned int unEvents = 256);
+		bool Stop();
+		bool IsRunning();
+	public:
+		// Consumer
+		bool Poll(PINPUT_EVENT pEvent);
+		bool Wait(PINPUT_EVENT pEvent, unsigned int unMilliseconds = INFINITE);
+		unsigned int Drain(PINPUT_EVENT pEvents, unsigned int unCount);
+		bool TakeResized();
+	public:
+		// Statistics
+		unsigned long long GetDropped();
+	private:
+		void Run();
+		bool Push(const INPUT_EVENT& Event);
+		void Wake();
+	private:
+		HANDLE m_hIn;
+		std::unique_ptr<INPUT_EVENT[]> m_pEvents;
+		size_t m_unCapacity;
+		size_t m_unMask;
+		// Written by the reader thread and the consumer respectively.
+		alignas(64) std::atomic<size_t> m_unHead;
+		alignas(64) std::atomic<size_t> m_unTail;
+		std::atomic<unsigned long long> m_unDropped;
+		std::atomic<bool> m_bResized;
+		std::atomic<bool> m_bWaiting;
+		std::atomic<bool> m_bStopping;
+		std::mutex m_WaitLock;
+		std::condition_variable m_WaitEvent;
+		std::thread m_Thread;
+	};
+
 	// ----------------------------------------------------------------
 	// SmartConsole
 	// ----------------------------------------------------------------
 
+	// When buffered output reaches the console. Color changes, cursor moves and reads always flush first.
+	typedef enum class _OUTPUT_POLICY : unsigned char {
+		OUTPUT_POLICY_UNBUFFERED = 0,
+		OUTPUT_POLICY_LINE,
+		OUTPUT_POLICY_SIZE,
+		OUTPUT_POLICY_TIME
+	} OUTPUT_POLICY, *POUTPUT_POLICY;
+
+	// What the CRT output stream leads to. Consoles and pipes are written through their handle, bypassing the stream.
+	typedef enum class _OUTPUT_TARGET : unsigned char {
+		OUTPUT_TARGET_STREAM = 0,
+		OUTPUT_TARGET_CONSOLE,
+		OUTPUT_TARGET_PIPE
+	} OUTPUT_TARGET, *POUTPUT_TARGET;
+
+	// Kinds of calls that reach the console (or the CRT stream in front of it).
+	typedef enum class _CONSOLE_CALL : unsigned char {
+		CONSOLE_CALL_WRITE = 0,
+		CONSOLE_CALL_READ,
+		CONSOLE_CALL_QUERY,
+		CONSOLE_CALL_UPDATE,
+		CONSOLE_CALL_FILL,
+		CONSOLE_CALL_COUNT
+	} CONSOLE_CALL, *PCONSOLE_CALL;
+
+	typedef struct _CONSOLE_STATISTICS {
+		unsigned long long Calls[static_cast<unsigned char>(CONSOLE_CALL::CONSOLE_CALL_COUNT)];
+		unsigned long long WrittenCharacters;
+	} CONSOLE_STATISTICS, *PCONSOLE_STATISTICS;
+
 	class SmartConsole {
 	public:
 		SmartConsole(bool bAutoClose = false);
@@ -34,6 +227,7 @@ namespace ConsoleUtils {
 		bool Close();
 		bool Show();
 		bool Hide();
+		bool RestoreWindowStyle();
 	public:
 		// IO
 		bool ReadA(char* const szBuffer, unsigned int unCount);
@@ -44,17 +238,63 @@ namespace ConsoleUtils {
 		bool Read(char* const szBuffer, unsigned int unCount);
 #endif
 		bool WriteA(char const* const szBuffer);
+		bool WriteA(std::string_view Text);
 		bool WriteW(wchar_t const* const szBuffer);
+		bool WriteW(std::wstring_view Text);
 #ifdef UNICODE
 		bool Write(wchar_t const* const szBuffer);
+		bool Write(std::wstring_view Text);
 #else
 		bool Write(char const* const szBuffer);
+		bool Write(std::string_view Text);
+#endif
+		// Gather, the segments reach the console in one write
+		bool WriteVA(const std::string_view* pSegments, unsigned int unSegments);
+		bool WriteVW(const std::wstring_view* pSegments, unsigned int unSegments);
+#ifdef UNICODE
+		bool WriteV(const std::wstring_view* pSegments, unsigned int unSegments);
+#else
+		bool WriteV(const std::string_view* pSegments, unsigned int unSegments);
 #endif
+		// UTF-8 whatever the code page is
+		bool WriteUTF8(std::string_view Text);
+	public:
+		// Raw input
+		bool EnableRawInput(unsigned int unEvents = 256);
+		bool DisableRawInput();
+		bool IsRawInput();
+		bool PollEvent(PINPUT_EVENT pEvent);
+		bool WaitEvent(PINPUT_EVENT pEvent, unsigned int unMilliseconds = INFINITE);
+		unsigned int DrainEvents(PINPUT_EVENT pEvents, unsigned int unCount);
+		bool CheckResized();
+		unsigned long long GetDroppedEvents();
+	public:
+		// Buffering
+		bool SetOutputPolicy(OUTPUT_POLICY Policy, unsigned int unThreshold = 4096, unsigned int unMilliseconds = 50);
+		OUTPUT_POLICY GetOutputPolicy();
+		bool FlushOutput();
+	public:
+		// Statistics
+		void CountCall(CONSOLE_CALL Call, unsigned long long unCount = 1);
+		void CountWrittenCharacters(unsigned long long unCount);
+		bool GetStatistics(PCONSOLE_STATISTICS pStatistics);
+		void ResetStatistics();
 	public:
 		// Properties
 		HWND GetWindow();
 		HANDLE GetIn();
 		HANDLE GetOut();
+		OUTPUT_TARGET GetOutputTarget();
+	private:
+		void UpdateOutputTarget();
+		bool WriteOutputA(char const* const szBuffer, size_t unLength);
+		bool WriteOutputW(wchar_t const* const szBuffer, size_t unLength);
+		bool WriteOutputHandle(char const* const pData, size_t unSize);
+		bool FlushOutputBuffer();
+		bool UpdateOutputBuffer(bool bNewLine);
+		void StartOutputTimer();
+		void StopOutputTimer();
+		void RunOutputTimer();
 	private:
 		bool m_bAutoClose;
 		HWND m_hWindow;
@@ -65,6 +305,25 @@ namespace ConsoleUtils {
 		DWORD m_unOriginalMode;
 		LONG m_nOriginalStyle;
 		LONG m_nOriginalStyleEx;
+		// Only one of the narrow and wide buffers holds text at a time.
+		OUTPUT_POLICY m_OutputPolicy;
+		unsigned int m_unOutputThreshold;
+		unsigned int m_unOutputMilliseconds;
+		std::mutex m_OutputBufferLock;
+		std::string m_OutputBufferA;
+		std::wstring m_OutputBufferW;
+		OUTPUT_TARGET m_OutputTarget;
+		// Wide text converted for a pipe.
+		std::string m_OutputBytes;
+		bool m_bOutputDeadline;
+		std::chrono::steady_clock::time_point m_OutputDeadline;
+		std::condition_variable m_OutputTimer;
+		std::thread m_OutputTimerThread;
+		bool m_bStopOutputTimer;
+		std::atomic<unsigned long long> m_unCalls[static_cast<unsigned char>(CONSOLE_CALL::CONSOLE_CALL_COUNT)];
+		std::atomic<unsigned long long> m_unWrittenCharacters;
+		DWORD m_unRawInputOriginalMode;
+		std::unique_ptr<InputReader> m_pInputReader;
 	};
 
 	// ----------------------------------------------------------------
@@ -93,17 +352,17 @@ namespace ConsoleUtils {
 
 	typedef struct _COLOR_PAIR {
 	public:
-		_COLOR_PAIR() {
+		constexpr _COLOR_PAIR() {
 			ColorBackground = COLOR::COLOR_UNKNOWN;
 			ColorForeground = COLOR::COLOR_UNKNOWN;
 		}
 
-		_COLOR_PAIR(COLOR unColorBackground, COLOR unColorForeground) {
+		constexpr _COLOR_PAIR(COLOR unColorBackground, COLOR unColorForeground) {
 			ColorBackground = unColorBackground;
 			ColorForeground = unColorForeground;
 		}
 
-		_COLOR_PAIR(COLOR unColorForeground) {
+		constexpr _COLOR_PAIR(COLOR unColorForeground) {
 			ColorBackground = COLOR::COLOR_UNKNOWN;
 			ColorForeground = unColorForeground;
 		}
@@ -113,10 +372,187 @@ namespace ConsoleUtils {
 		COLOR ColorForeground;
 	} COLOR_PAIR, *PCOLOR_PAIR;
 
+	// How many colors the output can show. Deeper colors are reduced to the nearest one the depth has.
+	typedef enum class _COLOR_DEPTH : unsigned char {
+		COLOR_DEPTH_16 = 0,
+		COLOR_DEPTH_256,
+		COLOR_DEPTH_TRUE
+	} COLOR_DEPTH, *PCOLOR_DEPTH;
+
+	typedef enum class _EXTENDED_COLOR_KIND : unsigned char {
+		EXTENDED_COLOR_KIND_UNKNOWN = 0,
+		EXTENDED_COLOR_KIND_LEGACY,
+		EXTENDED_COLOR_KIND_INDEXED,
+		EXTENDED_COLOR_KIND_RGB
+	} EXTENDED_COLOR_KIND, *PEXTENDED_COLOR_KIND;
+
+	// A legacy color, an index into the 256-color table or a 24-bit color.
+	typedef struct _EXTENDED_COLOR {
+	public:
+		constexpr _EXTENDED_COLOR() {
+			Kind = EXTENDED_COLOR_KIND::EXTENDED_COLOR_KIND_UNKNOWN;
+			Index = 0;
+			Red = 0;
+			Green = 0;
+			Blue = 0;
+		}
+
+		constexpr _EXTENDED_COLOR(COLOR Color) {
+			Kind = (static_cast<unsigned char>(Color) < 16) ? EXTENDED_COLOR_KIND::EXTENDED_COLOR_KIND_LEGACY : EXTENDED_COLOR_KIND::EXTENDED_COLOR_KIND_UNKNOWN;
+			Index = (static_cast<unsigned char>(Color) < 16) ? static_cast<unsigned char>(Color) : 0;
+			Red = 0;
+			Green = 0;
+			Blue = 0;
+		}
+
+		constexpr _EXTENDED_COLOR(unsigned char unR, unsigned char unG, unsigned char unB) {
+			Kind = EXTENDED_COLOR_KIND::EXTENDED_COLOR_KIND_RGB;
+			Index = 0;
+			Red = unR;
+			Green = unG;
+			Blue = unB;
+		}
+
+	public:
+		// 0xRRGGBB
+		static constexpr _EXTENDED_COLOR FromRGB(unsigned int unRGB) {
+			return _EXTENDED_COLOR((unRGB >> 16) & 0xFF, (unRGB >> 8) & 0xFF, unRGB & 0xFF);
+		}
+
+		static constexpr _EXTENDED_COLOR FromIndex(unsigned char unIndex) {
+			_EXTENDED_COLOR Color;
+			Color.Kind = EXTENDED_COLOR_KIND::EXTENDED_COLOR_KIND_INDEXED;
+			Color.Index = unIndex;
+			return Color;
+		}
+
+	public:
+		EXTENDED_COLOR_KIND Kind;
+		unsigned char Index;
+		unsigned char Red;
+		unsigned char Green;
+		unsigned char Blue;
+	} EXTENDED_COLOR, *PEXTENDED_COLOR;
+
+	typedef struct _EXTENDED_COLOR_PAIR {
+	public:
+		constexpr _EXTENDED_COLOR_PAIR() {}
+
+		constexpr _EXTENDED_COLOR_PAIR(EXTENDED_COLOR Background, EXTENDED_COLOR Foreground) {
+			ColorBackground = Background;
+			ColorForeground = Foreground;
+		}
+
+		constexpr _EXTENDED_COLOR_PAIR(EXTENDED_COLOR Foreground) {
+			ColorForeground = Foreground;
+		}
+
+		constexpr _EXTENDED_COLOR_PAIR(COLOR Foreground) {
+			ColorForeground = Foreground;
+		}
+
+		constexpr _EXTENDED_COLOR_PAIR(COLOR_PAIR ColorPair) {
+			ColorBackground = ColorPair.ColorBackground;
+			ColorForeground = ColorPair.ColorForeground;
+		}
+
+	public:
+		EXTENDED_COLOR ColorBackground;
+		EXTENDED_COLOR ColorForeground;
+	} EXTENDED_COLOR_PAIR, *PEXTENDED_COLOR_PAIR;
+
+	// ----------------------------------------------------------------
+	// Virtual terminal
+	// ----------------------------------------------------------------
+
+	// Returns the precomputed SGR sequence for a color pair. Unknown colors are left untouched by the sequence.
+	char const* GetColorSequence(COLOR_PAIR ColorPair, unsigned int* pLength = nullptr);
+
+	// Longest sequence GetExtendedColorSequence writes, without the terminator.
+	constexpr unsigned int MAX_EXTENDED_COLOR_SEQUENCE_LENGTH = 36;
+
+	// Writes the SGR sequence for an extended color pair as given: 38;2 and 48;2 for 24-bit colors, 38;5 and 48;5 for indexed ones. Returns the length.
+	unsigned int GetExtendedColorSequence(const EXTENDED_COLOR_PAIR& ColorPair, char* szBuffer);
+
+	// ----------------------------------------------------------------
+	// ColorQuantizer
+	// ----------------------------------------------------------------
+
+	// Maps colors to the nearest of 16 palette entries through a 32x32x32 lookup table that is built once per palette.
+	class ColorQuantizer {
+	public:
+		ColorQuantizer();
+		~ColorQuantizer();
+	public:
+		// Control
+		bool Build(const COLORREF* pColorTable);
+		bool IsBuilt();
+	public:
+		// Quantization
+		COLOR Quantize(unsigned char unR, unsigned char unG, unsigned char unB);
+		COLOR Quantize(const EXTENDED_COLOR& Color);
+		bool Quantize(const EXTENDED_COLOR* pColors, PCOLOR pResult, size_t unCount);
+		bool Quantize(const EXTENDED_COLOR_PAIR* pColorPairs, PWORD pAttributes, size_t unCount, WORD unDefaultAttributes);
+	public:
+		// 256-color table
+		static unsigned char GetNearestIndex(unsigned char unR, unsigned char unG, unsigned char unB);
+		static bool GetIndexColor(unsigned char unIndex, unsigned char* pR, unsigned char* pG, unsigned char* pB);
+	private:
+		COLORREF m_ColorTable[16];
+		bool m_bBuilt;
+		std::unique_ptr<unsigned char[]> m_pTable;
+	};
+
 	// ----------------------------------------------------------------
 	// SmartConsoleUtils
 	// ----------------------------------------------------------------
 
+	class ScreenBuffer;
+	class AsyncSink;
+	class LineEditor;
+	class ProgressGroup;
+
+	// What a producer does when the async ring is full.
+	typedef enum class _ASYNC_POLICY : unsigned char {
+		ASYNC_POLICY_BLOCK = 0,
+		ASYNC_POLICY_DROP,
+		ASYNC_POLICY_GROW
+	} ASYNC_POLICY, *PASYNC_POLICY;
+
+	typedef struct _ASYNC_SPAN {
+		COLOR_PAIR ColorPair;
+		void const* pText;
+		size_t unSize;
+		bool bWide;
+	} ASYNC_SPAN, *PASYNC_SPAN;
+
+	// Where a push sits in the sink's output, counted separately for the ring and the overflow queue. Zero parts are always written.
+	typedef struct _ASYNC_TICKET {
+		unsigned long long unRecords;
+		unsigned long long unSpans;
+	} ASYNC_TICKET, *PASYNC_TICKET;
+
+	// Rows a recolor touches. Clean rows are those below the cursor and the window that nothing reached since the last clear.
+	typedef enum class _COLOR_SCOPE : unsigned char {
+		COLOR_SCOPE_BUFFER = 0,
+		COLOR_SCOPE_CONTENT,
+		COLOR_SCOPE_WINDOW
+	} COLOR_SCOPE, *PCOLOR_SCOPE;
+
+	// What Clear() erases. Window and buffer clears home the cursor, the others leave it where it is.
+	typedef enum class _CLEAR_MODE : unsigned char {
+		CLEAR_MODE_WINDOW = 0,
+		CLEAR_MODE_TO_END,
+		CLEAR_MODE_LINE,
+		CLEAR_MODE_SCROLLBACK,
+		CLEAR_MODE_BUFFER
+	} CLEAR_MODE, *PCLEAR_MODE;
+
+	// The 16 console colors, indexed by COLOR.
+	typedef struct _PALETTE {
+		COLORREF ColorTable[16];
+	} PALETTE, *PPALETTE;
+
 	class SmartConsoleUtils : public SmartConsole {
 	public:
 		SmartConsoleUtils(bool bAutoClose = false, bool bAutoRestoreColors = false);
@@ -125,6 +561,39 @@ namespace ConsoleUtils {
 		// Control
 		bool Open(bool bUpdateIO = false);
 		bool Close();
+	public:
+		// IO
+		bool ReadA(char* const szBuffer, unsigned int unCount);
+		bool ReadW(wchar_t* const szBuffer, unsigned int unCount);
+#ifdef UNICODE
+		bool Read(wchar_t* const szBuffer, unsigned int unCount);
+#else
+		bool Read(char* const szBuffer, unsigned int unCount);
+#endif
+		bool WriteA(char const* const szBuffer);
+		bool WriteA(std::string_view Text);
+		bool WriteW(wchar_t const* const szBuffer);
+		bool WriteW(std::wstring_view Text);
+#ifdef UNICODE
+		bool Write(wchar_t const* const szBuffer);
+		bool Write(std::wstring_view Text);
+#else
+		bool Write(char const* const szBuffer);
+		bool Write(std::string_view Text);
+#endif
+		bool WriteVA(const std::string_view* pSegments, unsigned int unSegments);
+		bool WriteVW(const std::wstring_view* pSegments, unsigned int unSegments);
+#ifdef UNICODE
+		bool WriteV(const std::wstring_view* pSegments, unsigned int unSegments);
+#else
+		bool WriteV(const std::string_view* pSegments, unsigned int unSegments);
+#endif
+		bool WriteUTF8(std::string_view Text);
+	public:
+		// Cache
+		void InvalidateCache(bool bPositionOnly = false);
+		unsigned long long GetAvoidedCalls();
+		void ResetAvoidedCalls();
 	public:
 		// Buffer
 		bool GetBufferInfo(PCONSOLE_SCREEN_BUFFER_INFOEX pBufferInfoEx);
@@ -133,11 +602,26 @@ namespace ConsoleUtils {
 		bool SetAttributes(WORD unAttributes);
 		bool ChangeColorPalette(COLOR Color, unsigned int unRGB);
 		bool ChangeColorPalette(COLOR Color, unsigned char unR, unsigned char unG, unsigned char unB);
+		bool GetColorPalette(PPALETTE pPalette);
+		bool SetColorPalette(const PALETTE& Palette, unsigned short unMask = 0xFFFF);
+		bool FadeColorPalette(const PALETTE& Palette, unsigned int unMilliseconds, unsigned int unFramesPerSecond = 30);
+		bool AnimateColorPalette(const PALETTE* pPalettes, size_t unCount, unsigned int unStepMilliseconds, unsigned int unFramesPerSecond = 30);
+		// Extended colors
+		COLOR_DEPTH GetColorDepth();
+		bool SetColorDepth(COLOR_DEPTH Depth);
+		bool SetExtendedColor(const EXTENDED_COLOR_PAIR& ColorPair);
+		ColorQuantizer* GetColorQuantizer();
+		// Virtual terminal
+		bool EnableVirtualTerminal();
+		bool DisableVirtualTerminal();
+		bool IsVirtualTerminal();
 		// Screen
-		bool Flush(bool bClear = false, bool bUpdateOriginalColorPair = false, bool bResetPreviousColorPair = false);
+		bool Flush(bool bClear = false, bool bUpdateOriginalColorPair = false, bool bResetPreviousColorPair = false, COLOR_SCOPE Scope = COLOR_SCOPE::COLOR_SCOPE_BUFFER);
 		bool GetColor(PCOLOR_PAIR pColorPair);
-		bool SetColor(COLOR_PAIR ColorPair);
-		bool RestoreColor(bool bRestorePrevious = false);
+		bool SetColor(COLOR_PAIR ColorPair, COLOR_SCOPE Scope = COLOR_SCOPE::COLOR_SCOPE_BUFFER);
+		bool RestoreColor(bool bRestorePrevious = false, COLOR_SCOPE Scope = COLOR_SCOPE::COLOR_SCOPE_BUFFER);
+		bool RecolorRegion(SMALL_RECT Region, COLOR_PAIR ColorPair);
+		bool Clear(CLEAR_MODE Mode = CLEAR_MODE::CLEAR_MODE_WINDOW);
 		// Cursor
 		bool GetCursorInfo(PCONSOLE_CURSOR_INFO pCursorInfo);
 		bool SetCursorInfo(CONSOLE_CURSOR_INFO CursorInfo);
@@ -151,6 +635,33 @@ namespace ConsoleUtils {
 		bool RestoreCursorColor(bool bRestorePrevious = false);
 		// Advanced
 		bool Erase(COORD CursorPosition, unsigned int unLength);
+		bool FillRect(SMALL_RECT Region, wchar_t unChar, COLOR_PAIR ColorPair = COLOR_PAIR());
+		bool EraseRect(SMALL_RECT Region);
+		bool BlitCells(SMALL_RECT Region, const CHAR_INFO* pCells);
+		bool ReadCells(SMALL_RECT Region, PCHAR_INFO pCells);
+		ScreenBuffer* GetScreenBuffer();
+		// Line editing
+		bool EnableLineEditor();
+		bool DisableLineEditor();
+		LineEditor* GetLineEditor();
+		// Async
+		bool EnableAsync(unsigned int unRecords = 1024, ASYNC_POLICY Policy = ASYNC_POLICY::ASYNC_POLICY_BLOCK);
+		bool DisableAsync();
+		AsyncSink* GetAsyncSink();
+		// Progress
+		bool EnableProgress(unsigned int unFramesPerSecond = 15, unsigned int unBars = 1024);
+		bool DisableProgress();
+		ProgressGroup* GetProgressGroup();
+		// Threading
+		std::mutex& GetOutputLock();
+	private:
+		bool GetCachedBufferInfo(PCONSOLE_SCREEN_BUFFER_INFOEX pBufferInfoEx, bool bNeedPosition = false, bool bNeedWindow = false);
+		void UpdateContentRows(SHORT nRow, SHORT nBufferRows);
+		bool FillAttributes(HANDLE hOut, const CONSOLE_SCREEN_BUFFER_INFOEX& BufferInfoEx, WORD unAttributes, COLOR_SCOPE Scope);
+		bool ClearCells(HANDLE hOut, COORD Start, DWORD unLength, WORD unAttributes);
+		bool DropScrollback(HANDLE hOut, CONSOLE_SCREEN_BUFFER_INFOEX& BufferInfoEx);
+		bool WriteCells(HANDLE hOut, const CONSOLE_SCREEN_BUFFER_INFOEX& BufferInfoEx, SMALL_RECT Region, const CHAR_INFO* pCells, COORD CellsSize, COORD CellsCoord);
+		void HideProgress();
 	private:
 		bool m_bAutoRestoreColors;
 		COLOR_PAIR m_OriginalColorPair;
@@ -158,61 +669,1955 @@ namespace ConsoleUtils {
 		COLOR_PAIR m_PreviousColorPair;
 		COLOR_PAIR m_PreviousCursorColorPair;
 		COLORREF m_OriginalColorTable[16];
+		// Shadow copy of the screen buffer. The cursor position and window move with any output, so they are tracked separately.
+		// m_CacheLock guards it, the flags and m_bExtendedColor, so threads outside the output lock can use the cache too. Every invalidation
+		// bumps m_unCacheGeneration, a query that raced with one returns its result without storing it.
+		std::mutex m_CacheLock;
+		std::atomic<unsigned int> m_unCacheGeneration;
+		bool m_bCacheValid;
+		bool m_bCachedPositionValid;
+		CONSOLE_SCREEN_BUFFER_INFOEX m_CachedBufferInfo;
+		std::atomic<unsigned long long> m_unAvoidedCalls;
+		// Rows from m_nContentRows down are clean. Once a whole-buffer fill or a clear set them, their attributes are known.
+		SHORT m_nContentRows;
+		bool m_bCleanRowsKnown;
+		WORD m_unCleanAttributes;
+		bool m_bVirtualTerminal;
+		DWORD m_unOriginalOutputMode;
+		// Depth asked for. Without virtual terminal sequences only 16 colors are shown.
+		COLOR_DEPTH m_ColorDepth;
+		// The last text colors were written as a 256-color or 24-bit sequence, so the cached attributes only approximate them.
+		bool m_bExtendedColor;
+		ColorQuantizer m_ColorQuantizer;
+		// Scratch space of the rectangle calls, kept between calls.
+		std::vector<CHAR_INFO> m_RectCells;
+		std::vector<wchar_t> m_RectStream;
+		std::unique_ptr<ScreenBuffer> m_pScreenBuffer;
+		// The sink lives as long as the console, so printing threads can't see it freed. m_pActiveSink is only set while it runs.
+		std::unique_ptr<AsyncSink> m_pAsyncSink;
+		std::atomic<AsyncSink*> m_pActiveSink;
+		std::unique_ptr<LineEditor> m_pLineEditor;
+		std::unique_ptr<ProgressGroup> m_pProgressGroup;
+		bool m_bLineEditor;
+		// Held from the color switch to the color restore of a colored write, so concurrent writes can't mix their colors.
+		std::mutex m_OutputLock;
 	};
 
 	// ----------------------------------------------------------------
-	// Format and color supported print/scan
+	// PaletteTransaction
 	// ----------------------------------------------------------------
 
-
+	// Stages palette entries and applies all of them with a single buffer info update. Nothing is applied without Commit().
+	// Theme files hold one "name = #RRGGBB" line per entry, where name is a markup color name or an index. Lines starting with ';' are comments.
+	class PaletteTransaction {
+	public:
+		PaletteTransaction(SmartConsoleUtils* pConsole);
+		~PaletteTransaction();
+	public:
+		// Staging
+		bool Set(COLOR Color, unsigned int unRGB);
+		bool Set(COLOR Color, unsigned char unR, unsigned char unG, unsigned char unB);
+		bool Set(const PALETTE& Palette);
+		bool LoadA(char const* const szFile);
+		bool LoadW(wchar_t const* const szFile);
+#ifdef UNICODE
+		bool Load(wchar_t const* const szFile);
+#else
+		bool Load(char const* const szFile);
+#endif
+		bool Parse(char const* const szTheme);
+		void Discard();
+		unsigned short GetStaged();
+	public:
+		// Control
+		bool Commit();
+	private:
+		bool LoadFile(FILE* pFile);
+	private:
+		SmartConsoleUtils* m_pConsole;
+		PALETTE m_Palette;
+		unsigned short m_unStaged;
+	};
 
 	// ----------------------------------------------------------------
-	// print/scan with format and color support
+	// Console context
 	// ----------------------------------------------------------------
 
-	int clrvprintf(COLOR_PAIR ColorPair, char const* const _Format, va_list vargs);
-	int clrvprintf(COLOR unForegroundColor, char const* const _Format, va_list vargs);
-	int clrprintf(COLOR_PAIR ColorPair, char const* const _Format, ...);
-	int clrprintf(COLOR unForegroundColor, char const* const _Format, ...);
+	// Console used by the print/scan family. Either the bound one or a lazily created process-wide one.
+	// A process-wide console that gets replaced once a console window shows up stays allocated until exit, so pointers to it never dangle.
+	SmartConsoleUtils* GetConsole();
+	// Binding over another console and unbinding wait until no other thread holds a ConsoleReference, after that the old console can be destroyed.
+	bool BindConsole(SmartConsoleUtils* pConsole);
+	bool UnbindConsole(SmartConsoleUtils* pConsole = nullptr);
 
-	int clrvwprintf(COLOR_PAIR ColorPair, wchar_t const* const _Format, va_list vargs);
-	int clrvwprintf(COLOR unForegroundColor, wchar_t const* const _Format, va_list vargs);
-	int clrwprintf(COLOR_PAIR ColorPair, wchar_t const* const _Format, ...);
-	int clrwprintf(COLOR unForegroundColor, wchar_t const* const _Format, ...);
+	// Holds GetConsole() for the length of one call. The print/scan family and SpanWriter::Commit() take one.
+	// A thread blocked in clrscanf() holds its reference until input arrives, so unbinding waits for it. Pointers kept beyond one call,
+	// like the one of ConsoleExecutor, aren't covered and have to be dropped before their console is unbound.
+	class ConsoleReference {
+	public:
+		ConsoleReference();
+		~ConsoleReference();
+		ConsoleReference(const ConsoleReference&) = delete;
+		ConsoleReference& operator=(const ConsoleReference&) = delete;
+	public:
+		SmartConsoleUtils* Get();
+	private:
+		SmartConsoleUtils* m_pConsole;
+		unsigned int m_unSlot;
+	};
+
+	// ----------------------------------------------------------------
+	// SpanWriter
+	// ----------------------------------------------------------------
 
+	// Collects colored runs of text and writes them to the console at once. Buffers are kept between commits.
+	class SpanWriter {
+	public:
+		SpanWriter();
+		~SpanWriter();
+	public:
+		// Buffer
+		void Reserve(unsigned int unLength, unsigned int unSpans);
+		void Clear();
+		unsigned int GetLength();
+		unsigned int GetSpans();
+	public:
+		// Spans
+		bool AddA(COLOR_PAIR ColorPair, char const* const szText);
+		bool AddA(COLOR_PAIR ColorPair, char const* const szText, unsigned int unLength);
+		bool AddW(COLOR_PAIR ColorPair, wchar_t const* const szText);
+		bool AddW(COLOR_PAIR ColorPair, wchar_t const* const szText, unsigned int unLength);
 #ifdef UNICODE
-	int tclrvprintf(COLOR_PAIR ColorPair, wchar_t const* const _Format, va_list vargs);
-	int tclrvprintf(COLOR unForegroundColor, wchar_t const* const _Format, va_list vargs);
-	int tclrprintf(COLOR_PAIR ColorPair, wchar_t const* const _Format, ...);
-	int tclrprintf(COLOR unForegroundColor, wchar_t const* const _Format, ...);
+		bool Add(COLOR_PAIR ColorPair, wchar_t const* const szText);
+		bool Add(COLOR_PAIR ColorPair, wchar_t const* const szText, unsigned int unLength);
 #else
-	int tclrvprintf(COLOR_PAIR ColorPair, char const* const _Format, va_list vargs);
-	int tclrvprintf(COLOR unForegroundColor, char const* const _Format, va_list vargs);
-	int tclrprintf(COLOR_PAIR ColorPair, char const* const _Format, ...);
-	int tclrprintf(COLOR unForegroundColor, char const* const _Format, ...);
+		bool Add(COLOR_PAIR ColorPair, char const* const szText);
+		bool Add(COLOR_PAIR ColorPair, char const* const szText, unsigned int unLength);
 #endif
+	public:
+		// Output
+		// The ticket tells when text queued on an AsyncSink is written. It is zero when the commit wrote synchronously.
+		bool Commit(SmartConsoleUtils* pConsole = nullptr, PASYNC_TICKET pTicket = nullptr);
+	private:
+		bool CommitVirtualTerminal(SmartConsoleUtils* pConsole);
+		bool CommitAttributes(SmartConsoleUtils* pConsole);
+		bool CommitSpans(SmartConsoleUtils* pConsole);
+		bool CommitAsync(AsyncSink* pSink, PASYNC_TICKET pTicket);
+		bool WriteStream(SmartConsoleUtils* pConsole);
+	private:
+		typedef struct _SPAN {
+			COLOR_PAIR ColorPair;
+			unsigned int unOffset;
+			unsigned int unLength;
+		} SPAN;
+	private:
+		// Each span is stored NUL-terminated.
+		std::vector<wchar_t> m_Text;
+		std::vector<SPAN> m_Spans;
+		std::vector<wchar_t> m_Stream;
+		std::vector<WORD> m_Attributes;
+		std::vector<ASYNC_SPAN> m_AsyncSpans;
+		unsigned int m_unLength;
+		// Output code page of the narrow spans, asked once per batch.
+		UINT m_unCodePage;
+		bool m_bSimple;
+	};
 
-	int clrvscanf(COLOR_PAIR ColorPair, char const* const _Format, va_list vargs);
-	int clrvscanf(COLOR unForegroundColor, char const* const _Format, va_list vargs);
-	int clrscanf(COLOR_PAIR ColorPair, char const* const _Format, ...);
-	int clrscanf(COLOR unForegroundColor, char const* const _Format, ...);
+	// ----------------------------------------------------------------
+	// AsyncSink
+	// ----------------------------------------------------------------
 
-	int clrvwscanf(COLOR_PAIR ColorPair, wchar_t const* const _Format, va_list vargs);
-	int clrvwscanf(COLOR unForegroundColor, wchar_t const* const _Format, va_list vargs);
-	int clrwscanf(COLOR_PAIR ColorPair, wchar_t const* const _Format, ...);
-	int clrwscanf(COLOR unForegroundColor, wchar_t const* const _Format, ...);
+	// Background writer for the print family. Producers copy their text into a lock-free ring of records and a single thread writes them out in order.
+	// Memory stays bounded unless the policy is ASYNC_POLICY_GROW. A message bigger than the ring is dropped under ASYNC_POLICY_DROP, queued behind a lock
+	// under ASYNC_POLICY_GROW and streamed through the ring in ring-sized pieces under ASYNC_POLICY_BLOCK, where other messages may land between the pieces.
+	// Stop() waits for producers inside a push, a push that comes after it is written synchronously.
+	class AsyncSink {
+	public:
+		AsyncSink(SmartConsoleUtils* pConsole);
+		~AsyncSink();
+	public:
+		// Control
+		bool Start(unsigned int unRecords = 1024, ASYNC_POLICY Policy = ASYNC_POLICY::ASYNC_POLICY_BLOCK);
+		bool Stop();
+		bool Flush();
+		bool IsRunning();
+		bool IsWriterThread();
+		// Tickets. Everything pushed before GetTicket() is written once IsWritten() says so, tickets stay valid across restarts.
+		ASYNC_TICKET GetTicket();
+		bool IsWritten(const ASYNC_TICKET& Ticket);
+		bool WaitWritten(const ASYNC_TICKET& Ticket);
+	public:
+		// Producers. The ticket is the push's own, it is written once IsWritten() says so.
+		bool PushA(COLOR_PAIR ColorPair, char const* const szText, unsigned int unLength, PASYNC_TICKET pTicket = nullptr);
+		bool PushW(COLOR_PAIR ColorPair, wchar_t const* const szText, unsigned int unLength, PASYNC_TICKET pTicket = nullptr);
+		bool Push(const ASYNC_SPAN* pSpans, unsigned int unSpans, PASYNC_TICKET pTicket = nullptr);
+	public:
+		// Statistics
+		unsigned long long GetDropped();
+	private:
+		bool Enter();
+		void Leave();
+		bool PushRecords(const ASYNC_SPAN* pSpans, unsigned int unSpans, size_t unRecords, PASYNC_TICKET pTicket);
+		bool PushStream(const ASYNC_SPAN* pSpans, unsigned int unSpans, PASYNC_TICKET pTicket);
+		bool PushDirect(const ASYNC_SPAN* pSpans, unsigned int unSpans);
+		bool Enqueue(const ASYNC_SPAN* pSpans, unsigned int unSpans, size_t unRecords, PASYNC_TICKET pTicket);
+		bool EnqueueOverflow(const ASYNC_SPAN* pSpans, unsigned int unSpans, PASYNC_TICKET pTicket);
+		void Wake();
+		void Run();
+		bool IsEmpty();
+		unsigned int Drain();
+		unsigned int DrainOverflow();
+		bool AddText(COLOR_PAIR ColorPair, bool bWide, char const* pData, size_t unSize);
+	private:
+		static constexpr unsigned int RecordData = 240;
+		static constexpr unsigned char RecordWide = 1;
+		static constexpr unsigned char RecordContinued = 2;
+
+		// A record is free for position N when its sequence is N and holds data for position N when it is N + 1.
+		typedef struct alignas(64) _RECORD {
+			std::atomic<size_t> Sequence;
+			COLOR_PAIR ColorPair;
+			unsigned char Flags;
+			unsigned short unSize;
+			char Data[RecordData];
+		} RECORD;
 
+		typedef struct _OVERFLOW_SPAN {
+			COLOR_PAIR ColorPair;
+			bool bWide;
+			std::vector<char> Data;
+		} OVERFLOW_SPAN;
+	private:
+		SmartConsoleUtils* m_pConsole;
+		ASYNC_POLICY m_Policy;
+		std::unique_ptr<RECORD[]> m_pRecords;
+		size_t m_unCapacity;
+		size_t m_unMask;
+		alignas(64) std::atomic<size_t> m_unEnqueue;
+		alignas(64) size_t m_unDequeue;
+		// Ring records written over all runs. Ring tickets are m_unRecordBase plus the end of the push's claim, so they follow the ring's order.
+		unsigned long long m_unRecordBase;
+		std::atomic<unsigned long long> m_unCompleted;
+		std::atomic<unsigned long long> m_unOverflowSubmitted;
+		std::atomic<unsigned long long> m_unOverflowCompleted;
+		std::atomic<unsigned long long> m_unDropped;
+		std::atomic<unsigned int> m_unSignal;
+		std::atomic<bool> m_bSleeping;
+		// Producers inside a push. Once m_bStopping is set no new ones get in and Stop() waits for the rest before m_bExit lets the writer go.
+		std::atomic<unsigned int> m_unProducers;
+		std::atomic<bool> m_bStopping;
+		std::atomic<bool> m_bExit;
+		std::atomic<bool> m_bOverflow;
+		std::atomic<std::thread::id> m_WriterThreadId;
+		std::mutex m_OverflowLock;
+		std::vector<OVERFLOW_SPAN> m_Overflow;
+		std::vector<OVERFLOW_SPAN> m_OverflowBatch;
+		std::vector<char> m_Staging;
+		SpanWriter m_Writer;
+		std::thread m_Thread;
+	};
+
+	// ----------------------------------------------------------------
+	// ScreenBuffer
+	// ----------------------------------------------------------------
+
+	// Double-buffered cell grid of the console window. Present() only sends what changed since the last frame.
+	class ScreenBuffer {
+	public:
+		ScreenBuffer(SmartConsoleUtils* pConsole = nullptr);
+		~ScreenBuffer();
+	public:
+		// Buffer
+		bool Update();
+		bool Resize(COORD Size);
+		COORD GetSize();
+		PCHAR_INFO GetCells();
+		void Clear(COLOR_PAIR ColorPair = COLOR_PAIR());
+		void Invalidate();
+	public:
+		// Cells
+		bool GetCell(COORD Position, PCHAR_INFO pCell);
+		bool SetCell(COORD Position, wchar_t unChar, COLOR_PAIR ColorPair = COLOR_PAIR());
+		unsigned int WriteA(COORD Position, COLOR_PAIR ColorPair, char const* const szText);
+		unsigned int WriteW(COORD Position, COLOR_PAIR ColorPair, wchar_t const* const szText);
 #ifdef UNICODE
-	int tclrvscanf(COLOR_PAIR ColorPair, wchar_t const* const _Format, va_list vargs);
-	int tclrvscanf(COLOR unForegroundColor, wchar_t const* const _Format, va_list vargs);
-	int tclrscanf(COLOR_PAIR ColorPair, wchar_t const* const _Format, ...);
-	int tclrscanf(COLOR unForegroundColor, wchar_t const* const _Format, ...);
+		unsigned int Write(COORD Position, COLOR_PAIR ColorPair, wchar_t const* const szText);
 #else
-	int tclrvscanf(COLOR_PAIR ColorPair, char const* const _Format, va_list vargs);
-	int tclrvscanf(COLOR unForegroundColor, char const* const _Format, va_list vargs);
-	int tclrscanf(COLOR_PAIR ColorPair, char const* const _Format, ...);
-	int tclrscanf(COLOR unForegroundColor, char const* const _Format, ...);
+		unsigned int Write(COORD Position, COLOR_PAIR ColorPair, char const* const szText);
+#endif
+	public:
+		// Output
+		bool Present();
+		bool Present(PCHAR_INFO pTarget);
+	public:
+		// Statistics of the last frame
+		unsigned int GetPresentedCells();
+		unsigned int GetPresentedRows();
+		unsigned int GetPresentedBytes();
+	private:
+		bool Diff();
+		bool PresentAttributes();
+		bool PresentVirtualTerminal();
+		void Swap();
+		WORD GetDefaultAttributes();
+	private:
+		typedef struct _DIRTY_ROW {
+			SHORT Left;
+			SHORT Right;
+		} DIRTY_ROW;
+	private:
+		SmartConsoleUtils* m_pConsole;
+		COORD m_Size;
+		COORD m_Origin;
+		bool m_bInvalid;
+		std::vector<CHAR_INFO> m_Front;
+		std::vector<CHAR_INFO> m_Back;
+		std::vector<DIRTY_ROW> m_DirtyRows;
+		std::vector<wchar_t> m_Stream;
+		unsigned int m_unPresentedCells;
+		unsigned int m_unPresentedRows;
+		unsigned int m_unPresentedBytes;
+	};
+
+	// ----------------------------------------------------------------
+	// LineEditor
+	// ----------------------------------------------------------------
+
+	// Reads a line from raw key events with in-line editing and history. Each key redraws only the part of the line that changed.
+	// Left/Right and Home/End move, Ctrl moves by word. Backspace/Delete remove a character, with Ctrl a word. Ctrl+W, Ctrl+U and Ctrl+K
+	// cut the word before, everything before and everything after the cursor. Escape clears the line. Up/Down walk the history entries
+	// that start with the text typed before the cursor. Keys that are already queued, like a paste, are applied before the line is redrawn.
+	// History files hold one UTF-8 entry per line.
+	class LineEditor {
+	public:
+		LineEditor(SmartConsoleUtils* pConsole);
+		~LineEditor();
+	public:
+		// Prompt
+		bool SetPromptA(char const* const szPrompt, COLOR_PAIR ColorPair = COLOR_PAIR());
+		bool SetPromptW(wchar_t const* const szPrompt, COLOR_PAIR ColorPair = COLOR_PAIR());
+#ifdef UNICODE
+		bool SetPrompt(wchar_t const* const szPrompt, COLOR_PAIR ColorPair = COLOR_PAIR());
+#else
+		bool SetPrompt(char const* const szPrompt, COLOR_PAIR ColorPair = COLOR_PAIR());
+#endif
+	public:
+		// Input, like fgets the line ends with a newline when it fits
+		bool ReadLineA(char* const szBuffer, unsigned int unCount);
+		bool ReadLineW(wchar_t* const szBuffer, unsigned int unCount);
+#ifdef UNICODE
+		bool ReadLine(wchar_t* const szBuffer, unsigned int unCount);
+#else
+		bool ReadLine(char* const szBuffer, unsigned int unCount);
+#endif
+	public:
+		// Input driven by the caller's own event loop. Start shows the prompt, Feed applies events and Update redraws after a batch of them.
+		bool Start();
+		bool Feed(const INPUT_EVENT& Event, bool* pDone);
+		bool Update();
+		bool Finish(std::wstring* pLine);
+		bool Abort();
+	public:
+		// History
+		bool AddHistoryW(wchar_t const* const szLine);
+		void ClearHistory();
+		void SetHistoryLimit(unsigned int unLimit);
+		unsigned int GetHistorySize();
+		bool LoadHistoryA(char const* const szFile);
+		bool LoadHistoryW(wchar_t const* const szFile);
+		bool SaveHistoryA(char const* const szFile);
+		bool SaveHistoryW(wchar_t const* const szFile);
+#ifdef UNICODE
+		bool LoadHistory(wchar_t const* const szFile);
+		bool SaveHistory(wchar_t const* const szFile);
+#else
+		bool LoadHistory(char const* const szFile);
+		bool SaveHistory(char const* const szFile);
 #endif
+	private:
+		bool Edit(std::wstring& Line);
+		bool Begin();
+		void HandleKey(const INPUT_EVENT& Event, bool* pDone);
+		bool Redraw();
+		bool MoveCursor(size_t unOffset);
+		COORD GetPosition(size_t unOffset);
+		void UpdateOrigin(size_t unEnd);
+		size_t FindWordLeft();
+		size_t FindWordRight();
+		void SearchHistory(bool bBackward);
+		void StopHistorySearch();
+		bool LoadHistoryFile(FILE* pFile);
+		bool SaveHistoryFile(FILE* pFile);
+	private:
+		SmartConsoleUtils* m_pConsole;
+		std::wstring m_Prompt;
+		COLOR_PAIR m_PromptColorPair;
+		// What is being edited and what is on screen right now.
+		std::wstring m_Line;
+		size_t m_unCursor;
+		std::wstring m_Shown;
+		std::wstring m_Output;
+		// Where the line starts, and where the console cursor is within it. Unknown after text ends on a row boundary.
+		COORD m_Origin;
+		SHORT m_nWidth;
+		SHORT m_nHeight;
+		size_t m_unPhysicalCursor;
+		bool m_bPhysicalCursorKnown;
+		std::vector<std::wstring> m_History;
+		unsigned int m_unHistoryLimit;
+		// Entry shown by history search, the history size while editing the new line.
+		size_t m_unHistoryIndex;
+		std::wstring m_HistoryPrefix;
+		std::wstring m_Draft;
+	};
+
+	// ----------------------------------------------------------------
+	// Coroutines
+	// ----------------------------------------------------------------
+
+	template <typename T = void>
+	class ConsoleTask;
+
+	// Coroutines start suspended and resume whoever awaited them once they return. Exceptions are not supported.
+	class ConsoleTaskPromiseBase {
+	public:
+		class FinalAwaiter {
+		public:
+			bool await_ready() noexcept {
+				return false;
+			}
+
+			template <typename P>
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<P> hCoroutine) noexcept {
+				const std::coroutine_handle<> hContinuation = hCoroutine.promise().m_hContinuation;
+				return hContinuation ? hContinuation : std::noop_coroutine();
+			}
+
+			void await_resume() noexcept {}
+		};
+	public:
+		std::suspend_always initial_suspend() noexcept {
+			return {};
+		}
+
+		FinalAwaiter final_suspend() noexcept {
+			return {};
+		}
+
+		void unhandled_exception() noexcept {
+			std::terminate();
+		}
+	public:
+		std::coroutine_handle<> m_hContinuation;
+	};
+
+	template <typename T>
+	class ConsoleTaskPromise : public ConsoleTaskPromiseBase {
+	public:
+		ConsoleTask<T> get_return_object() noexcept;
+
+		template <typename U>
+		void return_value(U&& Value) {
+			m_Value.emplace(std::forward<U>(Value));
+		}
+	public:
+		std::optional<T> m_Value;
+	};
+
+	template <>
+	class ConsoleTaskPromise<void> : public ConsoleTaskPromiseBase {
+	public:
+		ConsoleTask<void> get_return_object() noexcept;
+
+		void return_void() noexcept {}
+	};
+
+	// Owns a coroutine that runs once it is awaited or spawned on a ConsoleExecutor.
+	template <typename T>
+	class ConsoleTask {
+	public:
+		using promise_type = ConsoleTaskPromise<T>;
+	public:
+		ConsoleTask() noexcept : m_hCoroutine(nullptr) {}
+
+		explicit ConsoleTask(std::coroutine_handle<promise_type> hCoroutine) noexcept : m_hCoroutine(hCoroutine) {}
+
+		ConsoleTask(ConsoleTask&& Other) noexcept : m_hCoroutine(std::exchange(Other.m_hCoroutine, nullptr)) {}
+
+		ConsoleTask(const ConsoleTask&) = delete;
+
+		~ConsoleTask() {
+			if (m_hCoroutine) {
+				m_hCoroutine.destroy();
+			}
+		}
+	public:
+		ConsoleTask& operator=(ConsoleTask&& Other) noexcept {
+			if (this != &Other) {
+				if (m_hCoroutine) {
+					m_hCoroutine.destroy();
+				}
+
+				m_hCoroutine = std::exchange(Other.m_hCoroutine, nullptr);
+			}
+
+			return *this;
+		}
+
+		ConsoleTask& operator=(const ConsoleTask&) = delete;
+	public:
+		bool IsValid() const {
+			return static_cast<bool>(m_hCoroutine);
+		}
+
+		bool IsDone() const {
+			return !m_hCoroutine || m_hCoroutine.done();
+		}
+
+		std::coroutine_handle<> GetHandle() const {
+			return m_hCoroutine;
+		}
+	public:
+		// Awaiting runs the coroutine right away and continues once it returns.
+		bool await_ready() const noexcept {
+			return IsDone();
+		}
+
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> hAwaiter) noexcept {
+			m_hCoroutine.promise().m_hContinuation = hAwaiter;
+			return m_hCoroutine;
+		}
+
+		T await_resume() {
+			if constexpr (!std::is_void_v<T>) {
+				return std::move(*m_hCoroutine.promise().m_Value);
+			}
+		}
+	private:
+		std::coroutine_handle<promise_type> m_hCoroutine;
+	};
+
+	template <typename T>
+	ConsoleTask<T> ConsoleTaskPromise<T>::get_return_object() noexcept {
+		return ConsoleTask<T>(std::coroutine_handle<ConsoleTaskPromise<T>>::from_promise(*this));
+	}
+
+	inline ConsoleTask<void> ConsoleTaskPromise<void>::get_return_object() noexcept {
+		return ConsoleTask<void>(std::coroutine_handle<ConsoleTaskPromise<void>>::from_promise(*this));
+	}
+
+	// Single-threaded loop for ConsoleTask coroutines. It waits on console input only while a read is pending and otherwise sleeps
+	// until the next timer, so an idle loop takes no CPU. Awaitables and Stop() may only be used from tasks running on the loop.
+	// Reads turn raw input on if it was off, and Run() turns it off again when it returns with no read pending.
+	class ConsoleExecutor {
+	public:
+		class SleepAwaiter {
+		public:
+			SleepAwaiter(ConsoleExecutor* pExecutor, unsigned int unMilliseconds);
+		public:
+			bool await_ready();
+			void await_suspend(std::coroutine_handle<> hCoroutine);
+			void await_resume();
+		private:
+			ConsoleExecutor* m_pExecutor;
+			std::chrono::steady_clock::time_point m_Deadline;
+		};
+
+		// Resolves with the next key press, or false once the read is cancelled.
+		class KeyAwaiter {
+		public:
+			KeyAwaiter(ConsoleExecutor* pExecutor, PINPUT_EVENT pEvent);
+		public:
+			bool await_ready();
+			void await_suspend(std::coroutine_handle<> hCoroutine);
+			bool await_resume();
+		private:
+			friend class ConsoleExecutor;
+			ConsoleExecutor* m_pExecutor;
+			PINPUT_EVENT m_pEvent;
+			std::coroutine_handle<> m_hCoroutine;
+			bool m_bResult;
+		};
+
+		// Resolves with a line from the console's LineEditor, or false once the read is cancelled. One line read at a time.
+		class LineAwaiter {
+		public:
+			LineAwaiter(ConsoleExecutor* pExecutor, std::wstring* pLine);
+		public:
+			bool await_ready();
+			void await_suspend(std::coroutine_handle<> hCoroutine);
+			bool await_resume();
+		private:
+			friend class ConsoleExecutor;
+			ConsoleExecutor* m_pExecutor;
+			std::wstring* m_pLine;
+			std::coroutine_handle<> m_hCoroutine;
+			bool m_bResult;
+		};
+
+		// Queues the writer's text on the console's AsyncSink and resumes once the sink wrote it out, other tasks run meanwhile.
+		// The executor starts the sink if none runs and stops it when Run() returns. Without one the text is written synchronously.
+		class WriteAwaiter {
+		public:
+			WriteAwaiter(ConsoleExecutor* pExecutor, SpanWriter* pWriter);
+		public:
+			bool await_ready();
+			bool await_suspend(std::coroutine_handle<> hCoroutine);
+			bool await_resume();
+		private:
+			friend class ConsoleExecutor;
+			ConsoleExecutor* m_pExecutor;
+			SpanWriter* m_pWriter;
+			std::coroutine_handle<> m_hCoroutine;
+			ASYNC_TICKET m_Ticket;
+			bool m_bResult;
+		};
+	public:
+		ConsoleExecutor(SmartConsoleUtils* pConsole = nullptr);
+		~ConsoleExecutor();
+	public:
+		// Control
+		bool Spawn(ConsoleTask<>&& Task);
+		bool Run();
+		void Stop();
+		bool IsRunning();
+	public:
+		// Awaitables
+		SleepAwaiter Sleep(unsigned int unMilliseconds);
+		KeyAwaiter NextKey(PINPUT_EVENT pEvent);
+		LineAwaiter ReadLineAsync(std::wstring* pLine);
+		WriteAwaiter WriteAsync(SpanWriter& Writer);
+		unsigned int CancelReads();
+	public:
+		// Properties
+		SmartConsoleUtils* GetConsole();
+	private:
+		bool EnableInput();
+		bool HasReaders();
+		bool WaitInput(unsigned int unMilliseconds);
+		AsyncSink* GetWriteSink();
+		void FinishWrites();
+		void Dispatch(const INPUT_EVENT& Event);
+		void FinishLine(bool bResult);
+		void AddTimer(std::chrono::steady_clock::time_point Deadline, std::coroutine_handle<> hCoroutine);
+		void FireTimers();
+		void RemoveDoneTasks();
+	private:
+		typedef struct _TIMER {
+			std::chrono::steady_clock::time_point Deadline;
+			unsigned long long Sequence;
+			std::coroutine_handle<> hCoroutine;
+		} TIMER;
+	private:
+		static bool IsLaterTimer(const TIMER& A, const TIMER& B);
+	private:
+		SmartConsoleUtils* m_pConsole;
+		bool m_bRunning;
+		bool m_bStopping;
+		// Raw input turned on by a read rather than by the application.
+		bool m_bRawInput;
+		std::vector<ConsoleTask<>> m_Tasks;
+		std::deque<std::coroutine_handle<>> m_Ready;
+		// Min-heap on the deadline, ties resumed in the order they were added.
+		std::vector<TIMER> m_Timers;
+		unsigned long long m_unTimerSequence;
+		std::deque<KeyAwaiter*> m_KeyWaiters;
+		LineAwaiter* m_pLineWaiter;
+		bool m_bLineChanged;
+		// Writes in the order they were queued, which is the order the sink completes them in.
+		std::deque<WriteAwaiter*> m_WriteWaiters;
+		// The sink was started by a write rather than by the application.
+		bool m_bAsyncSink;
+	};
+
+	// ----------------------------------------------------------------
+	// ProgressGroup
+	// ----------------------------------------------------------------
+
+	// Progress bars below the console output. Workers only touch the atomic counters of their own bar, and a renderer thread redraws
+	// the rows whose text changed at a capped frame rate. Text written through the console while the bars are shown takes their place,
+	// and they come back below it on the next frame. Other threads writing have to hold the output lock, like the print family does.
+	class ProgressGroup {
+	public:
+		ProgressGroup(SmartConsoleUtils* pConsole);
+		~ProgressGroup();
+	public:
+		// Control
+		bool Start(unsigned int unFramesPerSecond = 15, unsigned int unBars = 1024);
+		bool Stop();
+		bool IsRunning();
+		bool IsRendererThread();
+	public:
+		// Bars
+		bool AddBarA(char const* const szLabel, unsigned long long unTotal, COLOR_PAIR ColorPair, unsigned int* pBar);
+		bool AddBarW(wchar_t const* const szLabel, unsigned long long unTotal, COLOR_PAIR ColorPair, unsigned int* pBar);
+#ifdef UNICODE
+		bool AddBar(wchar_t const* const szLabel, unsigned long long unTotal, COLOR_PAIR ColorPair, unsigned int* pBar);
+#else
+		bool AddBar(char const* const szLabel, unsigned long long unTotal, COLOR_PAIR ColorPair, unsigned int* pBar);
+#endif
+		// Workers, lock-free
+		bool Advance(unsigned int unBar, unsigned long long unCount = 1);
+		bool SetProgress(unsigned int unBar, unsigned long long unValue);
+		bool SetTotal(unsigned int unBar, unsigned long long unTotal);
+		bool Finish(unsigned int unBar);
+		unsigned long long GetProgress(unsigned int unBar);
+	public:
+		// Display
+		bool SetMaxRows(unsigned int unRows);
+		bool Redraw();
+		void Hide();
+		bool IsShown();
+	public:
+		// Statistics
+		unsigned long long GetFrames();
+		unsigned long long GetDrawnCells();
+	private:
+		void Run();
+		bool Draw();
+		bool Place(SHORT nRows, COORD Cursor);
+		bool Grow(SHORT nRows);
+		void UpdateRates();
+		unsigned int SelectBars(unsigned int unMaxRows, unsigned int* pReady, unsigned int* pFinished);
+		void ComposeBar(CHAR_INFO* pRow, SHORT nWidth, SHORT nLabel, unsigned int unBar);
+		void ComposeSummary(CHAR_INFO* pRow, SHORT nWidth, unsigned int unHidden, unsigned int unReady, unsigned int unFinished);
+	private:
+		// Workers write Value and Total. The label and colors are fixed once Ready is set.
+		typedef struct alignas(64) _BAR {
+			std::atomic<unsigned long long> Value;
+			std::atomic<unsigned long long> Total;
+			std::atomic<bool> bFinished;
+			std::atomic<bool> bReady;
+			COLOR_PAIR ColorPair;
+			std::wstring Label;
+		} BAR;
+
+		// What the renderer saw of a bar on its last frame.
+		typedef struct _BAR_RATE {
+			bool bSeen;
+			unsigned long long unLastValue;
+			std::chrono::steady_clock::time_point LastTime;
+			double fRate;
+		} BAR_RATE;
+	private:
+		SmartConsoleUtils* m_pConsole;
+		std::unique_ptr<BAR[]> m_pBars;
+		unsigned int m_unCapacity;
+		std::atomic<unsigned int> m_unBars;
+		std::chrono::milliseconds m_FrameInterval;
+		std::atomic<unsigned int> m_unMaxRows;
+		// Everything below up to the statistics is only touched with m_DrawLock held.
+		std::mutex m_DrawLock;
+		std::atomic<bool> m_bShown;
+		// Where the output continues once the bars are hidden.
+		COORD m_Anchor;
+		SHORT m_nTop;
+		SHORT m_nRows;
+		SHORT m_nWidth;
+		WORD m_unAttributes;
+		std::vector<BAR_RATE> m_Rates;
+		std::vector<unsigned int> m_Visible;
+		std::vector<CHAR_INFO> m_Frame;
+		std::vector<CHAR_INFO> m_Drawn;
+		std::atomic<unsigned long long> m_unFrames;
+		std::atomic<unsigned long long> m_unDrawnCells;
+		std::mutex m_StopLock;
+		std::condition_variable m_StopSignal;
+		std::atomic<bool> m_bStopping;
+		std::thread m_Thread;
+	};
+
+	// ----------------------------------------------------------------
+	// Table
+	// ----------------------------------------------------------------
+
+	typedef enum class _TABLE_ALIGN : unsigned char {
+		TABLE_ALIGN_LEFT = 0,
+		TABLE_ALIGN_RIGHT,
+		TABLE_ALIGN_CENTER
+	} TABLE_ALIGN, *PTABLE_ALIGN;
+
+	// Streaming tables size their columns from a window of the latest rows and write rows as they come, in constant memory.
+	// Buffered tables keep their rows column by column until Flush() and size the columns exactly.
+	typedef enum class _TABLE_MODE : unsigned char {
+		TABLE_MODE_STREAMING = 0,
+		TABLE_MODE_BUFFERED
+	} TABLE_MODE, *PTABLE_MODE;
+
+	// Text table with a color, an alignment and a width limit per column. Cells wider than their column are cut and end in "...".
+	// Rows are written in batches, each of which reaches the console in a single write. Every character is taken as one cell wide.
+	class Table {
+	public:
+		Table(SmartConsoleUtils* pConsole = nullptr, TABLE_MODE Mode = TABLE_MODE::TABLE_MODE_STREAMING);
+		~Table();
+	public:
+		// Layout, fixed once the first row is added
+		bool AddColumnA(char const* const szTitle, TABLE_ALIGN Align = TABLE_ALIGN::TABLE_ALIGN_LEFT, COLOR_PAIR ColorPair = COLOR_PAIR(), unsigned int unMaxWidth = 0);
+		bool AddColumnW(wchar_t const* const szTitle, TABLE_ALIGN Align = TABLE_ALIGN::TABLE_ALIGN_LEFT, COLOR_PAIR ColorPair = COLOR_PAIR(), unsigned int unMaxWidth = 0);
+#ifdef UNICODE
+		bool AddColumn(wchar_t const* const szTitle, TABLE_ALIGN Align = TABLE_ALIGN::TABLE_ALIGN_LEFT, COLOR_PAIR ColorPair = COLOR_PAIR(), unsigned int unMaxWidth = 0);
+#else
+		bool AddColumn(char const* const szTitle, TABLE_ALIGN Align = TABLE_ALIGN::TABLE_ALIGN_LEFT, COLOR_PAIR ColorPair = COLOR_PAIR(), unsigned int unMaxWidth = 0);
+#endif
+		bool SetHeaderColor(COLOR_PAIR ColorPair);
+		bool SetSampleRows(unsigned int unRows);
+		bool SetBatchRows(unsigned int unRows);
+		unsigned int GetColumns();
+	public:
+		// Rows, one cell per column. Missing cells are empty and extra ones are ignored.
+		bool AddRowA(const std::string_view* pCells, unsigned int unCells);
+		bool AddRowW(const std::wstring_view* pCells, unsigned int unCells);
+#ifdef UNICODE
+		bool AddRow(const std::wstring_view* pCells, unsigned int unCells);
+#else
+		bool AddRow(const std::string_view* pCells, unsigned int unCells);
+#endif
+		bool Flush();
+	public:
+		// Statistics
+		unsigned long long GetRows();
+		size_t GetBufferedBytes();
+	private:
+		void AddToWindow(const std::wstring_view* pCells, unsigned int unCells);
+		void StoreRow(const std::wstring_view* pCells, unsigned int unCells);
+		bool WriteStored();
+		void WriteHeader();
+		void WriteRow(const std::wstring_view* pCells, unsigned int unCells);
+		void WriteCell(const std::wstring_view& Cell, unsigned int unColumn, COLOR_PAIR ColorPair);
+		void SetRunColor(COLOR_PAIR ColorPair);
+		void EndRun();
+		bool EndRow();
+	private:
+		typedef struct _COLUMN {
+			std::wstring Title;
+			TABLE_ALIGN Align;
+			COLOR_PAIR ColorPair;
+			unsigned int unMaxWidth;
+			unsigned int unWidth;
+			// Streaming: how many window rows have each cell length, the longest of them, and rows since it dropped below the width.
+			std::vector<unsigned int> Lengths;
+			unsigned int unWindowMax;
+			unsigned int unNarrowRows;
+			// Rows not written yet, back to back, and where each one ends.
+			std::wstring Text;
+			std::vector<size_t> Ends;
+		} COLUMN;
+	private:
+		SmartConsoleUtils* m_pConsole;
+		TABLE_MODE m_Mode;
+		std::vector<COLUMN> m_Columns;
+		COLOR_PAIR m_HeaderColor;
+		unsigned int m_unSampleRows;
+		unsigned int m_unBatchRows;
+		bool m_bHeader;
+		unsigned long long m_unRows;
+		size_t m_unStoredRows;
+		// Cell lengths of the window rows, a row of columns at a time, reused as a ring.
+		std::vector<unsigned int> m_Window;
+		unsigned int m_unBatchedRows;
+		SpanWriter m_Writer;
+		COLOR_PAIR m_RunColor;
+		std::wstring m_Run;
+		std::vector<std::wstring_view> m_Cells;
+		// Narrow rows converted to wide text.
+		std::wstring m_Convert;
+		std::vector<size_t> m_ConvertEnds;
+		std::vector<std::wstring_view> m_ConvertCells;
+	};
+
+	// ----------------------------------------------------------------
+	// Format and color supported print/scan
+	// ----------------------------------------------------------------
+
+
+
+	// ----------------------------------------------------------------
+	// print/scan with format and color support
+	// ----------------------------------------------------------------
+
+	int clrvprintf(COLOR_PAIR ColorPair, char const* const _Format, va_list vargs);
+	int clrvprintf(COLOR unForegroundColor, char const* const _Format, va_list vargs);
+	int clrprintf(COLOR_PAIR ColorPair, char const* const _Format, ...);
+	int clrprintf(COLOR unForegroundColor, char const* const _Format, ...);
+
+	int clrvwprintf(COLOR_PAIR ColorPair, wchar_t const* const _Format, va_list vargs);
+	int clrvwprintf(COLOR unForegroundColor, wchar_t const* const _Format, va_list vargs);
+	int clrwprintf(COLOR_PAIR ColorPair, wchar_t const* const _Format, ...);
+	int clrwprintf(COLOR unForegroundColor, wchar_t const* const _Format, ...);
+
+#ifdef UNICODE
+	int tclrvprintf(COLOR_PAIR ColorPair, wchar_t const* const _Format, va_list vargs);
+	int tclrvprintf(COLOR unForegroundColor, wchar_t const* const _Format, va_list vargs);
+	int tclrprintf(COLOR_PAIR ColorPair, wchar_t const* const _Format, ...);
+	int tclrprintf(COLOR unForegroundColor, wchar_t const* const _Format, ...);
+#else
+	int tclrvprintf(COLOR_PAIR ColorPair, char const* const _Format, va_list vargs);
+	int tclrvprintf(COLOR unForegroundColor, char const* const _Format, va_list vargs);
+	int tclrprintf(COLOR_PAIR ColorPair, char const* const _Format, ...);
+	int tclrprintf(COLOR unForegroundColor, char const* const _Format, ...);
+#endif
+
+	int clrputs(COLOR_PAIR ColorPair, char const* const szText);
+	int clrputs(COLOR unForegroundColor, char const* const szText);
+	int clrwputs(COLOR_PAIR ColorPair, wchar_t const* const szText);
+	int clrwputs(COLOR unForegroundColor, wchar_t const* const szText);
+
+#ifdef UNICODE
+	int tclrputs(COLOR_PAIR ColorPair, wchar_t const* const szText);
+	int tclrputs(COLOR unForegroundColor, wchar_t const* const szText);
+#else
+	int tclrputs(COLOR_PAIR ColorPair, char const* const szText);
+	int tclrputs(COLOR unForegroundColor, char const* const szText);
+#endif
+
+	int clrvscanf(COLOR_PAIR ColorPair, char const* const _Format, va_list vargs);
+	int clrvscanf(COLOR unForegroundColor, char const* const _Format, va_list vargs);
+	int clrscanf(COLOR_PAIR ColorPair, char const* const _Format, ...);
+	int clrscanf(COLOR unForegroundColor, char const* const _Format, ...);
+
+	int clrvwscanf(COLOR_PAIR ColorPair, wchar_t const* const _Format, va_list vargs);
+	int clrvwscanf(COLOR unForegroundColor, wchar_t const* const _Format, va_list vargs);
+	int clrwscanf(COLOR_PAIR ColorPair, wchar_t const* const _Format, ...);
+	int clrwscanf(COLOR unForegroundColor, wchar_t const* const _Format, ...);
+
+#ifdef UNICODE
+	int tclrvscanf(COLOR_PAIR ColorPair, wchar_t const* const _Format, va_list vargs);
+	int tclrvscanf(COLOR unForegroundColor, wchar_t const* const _Format, va_list vargs);
+	int tclrscanf(COLOR_PAIR ColorPair, wchar_t const* const _Format, ...);
+	int tclrscanf(COLOR unForegroundColor, wchar_t const* const _Format, ...);
+#else
+	int tclrvscanf(COLOR_PAIR ColorPair, char const* const _Format, va_list vargs);
+	int tclrvscanf(COLOR unForegroundColor, char const* const _Format, va_list vargs);
+	int tclrscanf(COLOR_PAIR ColorPair, char const* const _Format, ...);
+	int tclrscanf(COLOR unForegroundColor, char const* const _Format, ...);
+#endif
+
+	// ----------------------------------------------------------------
+	// Type-safe print
+	// ----------------------------------------------------------------
+
+	typedef enum class _FORMAT_ARGUMENT : unsigned char {
+		FORMAT_ARGUMENT_UNSUPPORTED = 0,
+		FORMAT_ARGUMENT_BOOL,
+		FORMAT_ARGUMENT_CHAR,
+		FORMAT_ARGUMENT_SIGNED,
+		FORMAT_ARGUMENT_UNSIGNED,
+		FORMAT_ARGUMENT_FLOAT,
+		FORMAT_ARGUMENT_STRING,
+		FORMAT_ARGUMENT_POINTER
+	} FORMAT_ARGUMENT, *PFORMAT_ARGUMENT;
+
+	// Parsed replacement field: {[:[[fill]align][sign][#][0][width][.precision][type]]}
+	typedef struct _FORMAT_SPEC {
+		unsigned int Fill;
+		char Align;
+		// '+' or ' ' for non-negative numbers, 0 for none.
+		char Sign;
+		// Base prefix for integers.
+		bool bAlternate;
+		bool bZero;
+		unsigned short Width;
+		short Precision;
+		char Type;
+	} FORMAT_SPEC, *PFORMAT_SPEC;
+
+	// Literal text followed by the replacement field of the next argument.
+	typedef struct _FORMAT_PIECE {
+		unsigned int LiteralOffset;
+		unsigned int LiteralLength;
+		bool bEscaped;
+		FORMAT_SPEC Spec;
+	} FORMAT_PIECE, *PFORMAT_PIECE;
+
+	template <typename T, typename U>
+	constexpr FORMAT_ARGUMENT GetFormatArgument() {
+		using V = std::remove_cvref_t<U>;
+		using P = std::remove_cv_t<std::remove_pointer_t<std::decay_t<V>>>;
+
+		constexpr bool bCharacter = std::is_same_v<V, char> || std::is_same_v<V, wchar_t> || std::is_same_v<V, char8_t> || std::is_same_v<V, char16_t> || std::is_same_v<V, char32_t>;
+		constexpr bool bCharacterPointer = std::is_pointer_v<std::decay_t<V>> && (std::is_same_v<P, char> || std::is_same_v<P, wchar_t> || std::is_same_v<P, char8_t> || std::is_same_v<P, char16_t> || std::is_same_v<P, char32_t>);
+
+		if constexpr (std::is_same_v<V, bool>) {
+			return FORMAT_ARGUMENT::FORMAT_ARGUMENT_BOOL;
+		} else if constexpr (std::is_same_v<V, T> || (std::is_same_v<V, char> && std::is_same_v<T, wchar_t>)) {
+			return FORMAT_ARGUMENT::FORMAT_ARGUMENT_CHAR;
+		} else if constexpr (bCharacter) {
+			return FORMAT_ARGUMENT::FORMAT_ARGUMENT_UNSUPPORTED;
+		} else if constexpr (std::is_integral_v<V>) {
+			return std::is_signed_v<V> ? FORMAT_ARGUMENT::FORMAT_ARGUMENT_SIGNED : FORMAT_ARGUMENT::FORMAT_ARGUMENT_UNSIGNED;
+		} else if constexpr (std::is_floating_point_v<V>) {
+			return FORMAT_ARGUMENT::FORMAT_ARGUMENT_FLOAT;
+		} else if constexpr (std::is_convertible_v<const V&, std::basic_string_view<T>>) {
+			return FORMAT_ARGUMENT::FORMAT_ARGUMENT_STRING;
+		} else if constexpr (bCharacterPointer) {
+			// Strings of the other character width.
+			return FORMAT_ARGUMENT::FORMAT_ARGUMENT_UNSUPPORTED;
+		} else if constexpr (std::is_pointer_v<V> || std::is_null_pointer_v<V>) {
+			return FORMAT_ARGUMENT::FORMAT_ARGUMENT_POINTER;
+		} else {
+			return FORMAT_ARGUMENT::FORMAT_ARGUMENT_UNSUPPORTED;
+		}
+	}
+
+	// Not constexpr, so reaching it while parsing a format string fails the build.
+	inline void FormatError(char const* const szMessage) {
+		(void)szMessage;
+	}
+
+	template <typename T, typename... Args>
+	class BasicFormatString {
+	public:
+		template <typename S> requires std::is_convertible_v<const S&, std::basic_string_view<T>>
+		consteval BasicFormatString(const S& Format) : m_Format(Format), m_Pieces() {
+			Parse();
+		}
+	public:
+		constexpr std::basic_string_view<T> GetFormat() const {
+			return m_Format;
+		}
+
+		constexpr const FORMAT_PIECE& GetPiece(size_t unIndex) const {
+			return m_Pieces[unIndex];
+		}
+	private:
+		consteval void Parse() {
+			constexpr FORMAT_ARGUMENT Arguments[] = { GetFormatArgument<T, Args>()..., FORMAT_ARGUMENT::FORMAT_ARGUMENT_UNSUPPORTED };
+
+			const size_t unLength = m_Format.size();
+			size_t unPiece = 0;
+			size_t unStart = 0;
+			bool bEscaped = false;
+
+			size_t i = 0;
+			while (i < unLength) {
+				const T unChar = m_Format[i];
+
+				if (unChar == T('}')) {
+					if (((i + 1) < unLength) && (m_Format[i + 1] == T('}'))) {
+						bEscaped = true;
+						i += 2;
+						continue;
+					}
+
+					FormatError("Unmatched '}' in format string");
+				}
+
+				if (unChar != T('{')) {
+					++i;
+					continue;
+				}
+
+				if (((i + 1) < unLength) && (m_Format[i + 1] == T('{'))) {
+					bEscaped = true;
+					i += 2;
+					continue;
+				}
+
+				if (unPiece >= sizeof...(Args)) {
+					FormatError("More replacement fields than arguments");
+				}
+
+				FORMAT_PIECE& Piece = m_Pieces[unPiece];
+				Piece.LiteralOffset = static_cast<unsigned int>(unStart);
+				Piece.LiteralLength = static_cast<unsigned int>(i - unStart);
+				Piece.bEscaped = bEscaped;
+
+				i = ParseSpec(i + 1, &Piece.Spec);
+				CheckSpec(Piece.Spec, Arguments[unPiece]);
+
+				++unPiece;
+				unStart = i;
+				bEscaped = false;
+			}
+
+			if (unPiece != sizeof...(Args)) {
+				FormatError("Fewer replacement fields than arguments");
+			}
+
+			FORMAT_PIECE& Piece = m_Pieces[unPiece];
+			Piece.LiteralOffset = static_cast<unsigned int>(unStart);
+			Piece.LiteralLength = static_cast<unsigned int>(unLength - unStart);
+			Piece.bEscaped = bEscaped;
+			ResetSpec(&Piece.Spec);
+		}
+
+		static consteval void ResetSpec(PFORMAT_SPEC pSpec) {
+			pSpec->Fill = ' ';
+			pSpec->Align = 0;
+			pSpec->Sign = 0;
+			pSpec->bAlternate = false;
+			pSpec->bZero = false;
+			pSpec->Width = 0;
+			pSpec->Precision = -1;
+			pSpec->Type = 0;
+		}
+
+		consteval size_t ParseSpec(size_t i, PFORMAT_SPEC pSpec) {
+			const size_t unLength = m_Format.size();
+
+			ResetSpec(pSpec);
+
+			if (i >= unLength) {
+				FormatError("Unterminated replacement field");
+			}
+
+			if (m_Format[i] == T('}')) {
+				return i + 1;
+			}
+
+			if (m_Format[i] != T(':')) {
+				FormatError("Only automatic argument indexing is supported");
+			}
+
+			++i;
+
+			auto IsAlign = [](T unChar) {
+				return (unChar == T('<')) || (unChar == T('>')) || (unChar == T('^'));
+			};
+
+			if (((i + 1) < unLength) && IsAlign(m_Format[i + 1]) && (m_Format[i] != T('}'))) {
+				pSpec->Fill = static_cast<unsigned int>(m_Format[i]);
+				pSpec->Align = static_cast<char>(m_Format[i + 1]);
+				i += 2;
+			} else if ((i < unLength) && IsAlign(m_Format[i])) {
+				pSpec->Align = static_cast<char>(m_Format[i]);
+				++i;
+			}
+
+			if ((i < unLength) && ((m_Format[i] == T('+')) || (m_Format[i] == T('-')) || (m_Format[i] == T(' ')))) {
+				pSpec->Sign = (m_Format[i] == T('-')) ? 0 : static_cast<char>(m_Format[i]);
+				++i;
+			}
+
+			if ((i < unLength) && (m_Format[i] == T('#'))) {
+				pSpec->bAlternate = true;
+				++i;
+			}
+
+			if ((i < unLength) && (m_Format[i] == T('0'))) {
+				pSpec->bZero = true;
+				++i;
+			}
+
+			unsigned int unWidth = 0;
+			while ((i < unLength) && (m_Format[i] >= T('0')) && (m_Format[i] <= T('9'))) {
+				unWidth = unWidth * 10 + static_cast<unsigned int>(m_Format[i] - T('0'));
+				if (unWidth > 1024) {
+					FormatError("Width is too large");
+				}
+				++i;
+			}
+
+			pSpec->Width = static_cast<unsigned short>(unWidth);
+
+			if ((i < unLength) && (m_Format[i] == T('.'))) {
+				++i;
+
+				if ((i >= unLength) || (m_Format[i] < T('0')) || (m_Format[i] > T('9'))) {
+					FormatError("Missing precision");
+				}
+
+				unsigned int unPrecision = 0;
+				while ((i < unLength) && (m_Format[i] >= T('0')) && (m_Format[i] <= T('9'))) {
+					unPrecision = unPrecision * 10 + static_cast<unsigned int>(m_Format[i] - T('0'));
+					if (unPrecision > 300) {
+						FormatError("Precision is too large");
+					}
+					++i;
+				}
+
+				pSpec->Precision = static_cast<short>(unPrecision);
+			}
+
+			if ((i < unLength) && (m_Format[i] != T('}'))) {
+				const T unType = m_Format[i];
+				if ((unType != T('b')) && (unType != T('c')) && (unType != T('d')) && (unType != T('o')) && (unType != T('x')) && (unType != T('X')) && (unType != T('f')) && (unType != T('e')) && (unType != T('g')) && (unType != T('s')) && (unType != T('p'))) {
+					FormatError("Unknown presentation type");
+				}
+
+				pSpec->Type = static_cast<char>(unType);
+				++i;
+			}
+
+			if ((i >= unLength) || (m_Format[i] != T('}'))) {
+				FormatError("Unterminated replacement field");
+			}
+
+			return i + 1;
+		}
+
+		static consteval void CheckSpec(const FORMAT_SPEC& Spec, FORMAT_ARGUMENT Argument) {
+			const char unType = Spec.Type;
+			const bool bInteger = (unType == 'b') || (unType == 'd') || (unType == 'o') || (unType == 'x') || (unType == 'X');
+
+			switch (Argument) {
+				case FORMAT_ARGUMENT::FORMAT_ARGUMENT_BOOL:
+					if (!(!unType || (unType == 's') || bInteger)) {
+						FormatError("Invalid presentation type for bool");
+					}
+					if (Spec.bZero && !bInteger) {
+						FormatError("Zero padding requires a numeric presentation");
+					}
+					break;
+				case FORMAT_ARGUMENT::FORMAT_ARGUMENT_CHAR:
+					if (!(!unType || (unType == 'c') || bInteger)) {
+						FormatError("Invalid presentation type for a character");
+					}
+					if (Spec.bZero && !bInteger) {
+						FormatError("Zero padding requires a numeric presentation");
+					}
+					break;
+				case FORMAT_ARGUMENT::FORMAT_ARGUMENT_SIGNED:
+				case FORMAT_ARGUMENT::FORMAT_ARGUMENT_UNSIGNED:
+					if (!(!unType || (unType == 'c') || bInteger)) {
+						FormatError("Invalid presentation type for an integer");
+					}
+					if (Spec.bZero && (unType == 'c')) {
+						FormatError("Zero padding requires a numeric presentation");
+					}
+					break;
+				case FORMAT_ARGUMENT::FORMAT_ARGUMENT_FLOAT:
+					if (!(!unType || (unType == 'f') || (unType == 'e') || (unType == 'g'))) {
+						FormatError("Invalid presentation type for a floating-point value");
+					}
+					break;
+				case FORMAT_ARGUMENT::FORMAT_ARGUMENT_STRING:
+					if (!(!unType || (unType == 's'))) {
+						FormatError("Invalid presentation type for a string");
+					}
+					if (Spec.bZero) {
+						FormatError("Zero padding requires a numeric presentation");
+					}
+					break;
+				case FORMAT_ARGUMENT::FORMAT_ARGUMENT_POINTER:
+					if (!(!unType || (unType == 'p'))) {
+						FormatError("Invalid presentation type for a pointer");
+					}
+					break;
+				default:
+					FormatError("Unsupported argument type");
+					break;
+			}
+
+			if ((Spec.Precision >= 0) && (Argument != FORMAT_ARGUMENT::FORMAT_ARGUMENT_FLOAT) && (Argument != FORMAT_ARGUMENT::FORMAT_ARGUMENT_STRING)) {
+				FormatError("Precision is only allowed for floating-point values and strings");
+			}
+
+			const bool bNumber = bInteger || (!unType && ((Argument == FORMAT_ARGUMENT::FORMAT_ARGUMENT_SIGNED) || (Argument == FORMAT_ARGUMENT::FORMAT_ARGUMENT_UNSIGNED)));
+
+			if (Spec.Sign && !bNumber && (Argument != FORMAT_ARGUMENT::FORMAT_ARGUMENT_FLOAT)) {
+				FormatError("Sign requires a numeric presentation");
+			}
+
+			if (Spec.bAlternate && !bNumber) {
+				FormatError("Alternate form is only supported for integers");
+			}
+		}
+	private:
+		std::basic_string_view<T> m_Format;
+		FORMAT_PIECE m_Pieces[sizeof...(Args) + 1];
+	};
+
+	template <typename... Args>
+	using FormatString = BasicFormatString<char, std::type_identity_t<Args>...>;
+
+	template <typename... Args>
+	using WFormatString = BasicFormatString<wchar_t, std::type_identity_t<Args>...>;
+
+	// Thread-local buffers used once output outgrows the stack.
+	std::vector<char>& GetPrintBuffer(char);
+	std::vector<wchar_t>& GetPrintBuffer(wchar_t);
+
+	template <typename T>
+	class FormatWriter {
+	public:
+		FormatWriter() {
+			m_pBuffer = m_StackBuffer;
+			m_unCapacity = sizeof(m_StackBuffer) / sizeof(T);
+			m_unLength = 0;
+		}
+	public:
+		T* Reserve(size_t unLength) {
+			if (m_unLength + unLength + 1 > m_unCapacity) {
+				size_t unCapacity = m_unCapacity * 2;
+				if (unCapacity < m_unLength + unLength + 1) {
+					unCapacity = m_unLength + unLength + 1;
+				}
+
+				std::vector<T>& Heap = GetPrintBuffer(T());
+				if (Heap.size() < unCapacity) {
+					Heap.resize(unCapacity);
+				}
+
+				if (m_pBuffer == m_StackBuffer) {
+					memcpy(Heap.data(), m_StackBuffer, m_unLength * sizeof(T));
+				}
+
+				m_pBuffer = Heap.data();
+				m_unCapacity = Heap.size();
+			}
+
+			return m_pBuffer + m_unLength;
+		}
+
+		void Commit(size_t unLength) {
+			m_unLength += unLength;
+		}
+
+		void Append(T const* pData, size_t unLength) {
+			memcpy(Reserve(unLength), pData, unLength * sizeof(T));
+			m_unLength += unLength;
+		}
+
+		// Widens ASCII produced by the numeric conversions.
+		void AppendNarrow(char const* pData, size_t unLength) {
+			T* pBuffer = Reserve(unLength);
+			for (size_t i = 0; i < unLength; ++i) {
+				pBuffer[i] = static_cast<T>(pData[i]);
+			}
+			m_unLength += unLength;
+		}
+
+		void Fill(T unChar, size_t unCount) {
+			T* pBuffer = Reserve(unCount);
+			for (size_t i = 0; i < unCount; ++i) {
+				pBuffer[i] = unChar;
+			}
+			m_unLength += unCount;
+		}
+
+		T const* Terminate() {
+			*Reserve(0) = 0;
+			return m_pBuffer;
+		}
+
+		size_t GetLength() const {
+			return m_unLength;
+		}
+	private:
+		T m_StackBuffer[1024];
+		T* m_pBuffer;
+		size_t m_unCapacity;
+		size_t m_unLength;
+	};
+
+	// Writes text padded to the field width. unPrefix leading characters (sign, base prefix) stay in front of zero padding.
+	template <typename T, typename S>
+	void FormatPadded(FormatWriter<T>& Writer, const FORMAT_SPEC& Spec, S const* pText, size_t unLength, char DefaultAlign, size_t unPrefix = 0) {
+		auto AppendText = [&](S const* pData, size_t unCount) {
+			if constexpr (std::is_same_v<S, T>) {
+				Writer.Append(pData, unCount);
+			} else {
+				Writer.AppendNarrow(pData, unCount);
+			}
+		};
+
+		if (Spec.Width <= unLength) {
+			AppendText(pText, unLength);
+			return;
+		}
+
+		const size_t unPadding = Spec.Width - unLength;
+
+		if (Spec.bZero && !Spec.Align) {
+			AppendText(pText, unPrefix);
+			Writer.Fill(T('0'), unPadding);
+			AppendText(pText + unPrefix, unLength - unPrefix);
+			return;
+		}
+
+		const char Align = Spec.Align ? Spec.Align : DefaultAlign;
+		const T unFill = static_cast<T>(Spec.Fill);
+
+		size_t unLeft = 0;
+		if (Align == '>') {
+			unLeft = unPadding;
+		} else if (Align == '^') {
+			unLeft = unPadding / 2;
+		}
+
+		Writer.Fill(unFill, unLeft);
+		AppendText(pText, unLength);
+		Writer.Fill(unFill, unPadding - unLeft);
+	}
+
+	template <typename T, typename U>
+	void FormatInteger(FormatWriter<T>& Writer, const FORMAT_SPEC& Spec, U Value) {
+		if (Spec.Type == 'c') {
+			const T unChar = static_cast<T>(Value);
+			FormatPadded(Writer, Spec, &unChar, 1, '<');
+			return;
+		}
+
+		int nBase = 10;
+		if ((Spec.Type == 'x') || (Spec.Type == 'X')) {
+			nBase = 16;
+		} else if (Spec.Type == 'o') {
+			nBase = 8;
+		} else if (Spec.Type == 'b') {
+			nBase = 2;
+		}
+
+		// Sign and base prefix go in front of the digits, to_chars leaves room for them.
+		char szBuffer[72];
+		char* const pDigits = szBuffer + 3;
+		const std::to_chars_result Result = std::to_chars(pDigits, szBuffer + sizeof(szBuffer), Value, nBase);
+
+		char* pStart = pDigits;
+		const bool bNegative = *pDigits == '-';
+		if (bNegative) {
+			++pStart;
+		}
+
+		if (Spec.Type == 'X') {
+			for (char* pDigit = pStart; pDigit < Result.ptr; ++pDigit) {
+				if ((*pDigit >= 'a') && (*pDigit <= 'f')) {
+					*pDigit = static_cast<char>(*pDigit - 'a' + 'A');
+				}
+			}
+		}
+
+		if (Spec.bAlternate && (nBase != 10)) {
+			if (nBase == 8) {
+				// Zero already starts with one.
+				if (*pStart != '0') {
+					*--pStart = '0';
+				}
+			} else {
+				*--pStart = (nBase == 16) ? Spec.Type : 'b';
+				*--pStart = '0';
+			}
+		}
+
+		if (bNegative) {
+			*--pStart = '-';
+		} else if (Spec.Sign) {
+			*--pStart = Spec.Sign;
+		}
+
+		FormatPadded(Writer, Spec, pStart, static_cast<size_t>(Result.ptr - pStart), '>', static_cast<size_t>(pDigits - pStart) + (bNegative ? 1 : 0));
+	}
+
+	template <typename T, typename U>
+	void FormatFloat(FormatWriter<T>& Writer, const FORMAT_SPEC& Spec, U Value) {
+		// Enough for the widest fixed notation of U at the largest allowed precision, after room for the sign.
+		char szBuffer[std::numeric_limits<U>::max_exponent10 + 310];
+		char* const pDigits = szBuffer + 1;
+		std::to_chars_result Result;
+
+		if (!Spec.Type && (Spec.Precision < 0)) {
+			Result = std::to_chars(pDigits, szBuffer + sizeof(szBuffer), Value);
+		} else {
+			std::chars_format Format = std::chars_format::general;
+			if (Spec.Type == 'f') {
+				Format = std::chars_format::fixed;
+			} else if (Spec.Type == 'e') {
+				Format = std::chars_format::scientific;
+			}
+
+			Result = std::to_chars(pDigits, szBuffer + sizeof(szBuffer), Value, Format, (Spec.Precision < 0) ? 6 : Spec.Precision);
+		}
+
+		// Result.ptr is the end of the buffer on failure, nothing before it was written.
+		if (Result.ec != std::errc()) {
+			return;
+		}
+
+		char* pStart = pDigits;
+		if ((*pDigits != '-') && Spec.Sign) {
+			*--pStart = Spec.Sign;
+		}
+
+		FormatPadded(Writer, Spec, pStart, static_cast<size_t>(Result.ptr - pStart), '>', ((*pStart == '-') || (*pStart == '+') || (*pStart == ' ')) ? 1 : 0);
+	}
+
+	template <typename T, typename U>
+	void FormatArgument(FormatWriter<T>& Writer, const FORMAT_SPEC& Spec, const U& Value) {
+		constexpr FORMAT_ARGUMENT Argument = GetFormatArgument<T, U>();
+
+		if constexpr (Argument == FORMAT_ARGUMENT::FORMAT_ARGUMENT_BOOL) {
+			if (!Spec.Type || (Spec.Type == 's')) {
+				FormatPadded(Writer, Spec, Value ? "true" : "false", Value ? 4 : 5, '<');
+			} else {
+				FormatInteger(Writer, Spec, static_cast<unsigned int>(Value));
+			}
+		} else if constexpr (Argument == FORMAT_ARGUMENT::FORMAT_ARGUMENT_CHAR) {
+			if (!Spec.Type || (Spec.Type == 'c')) {
+				const T unChar = static_cast<T>(Value);
+				FormatPadded(Writer, Spec, &unChar, 1, '<');
+			} else {
+				FormatInteger(Writer, Spec, static_cast<std::make_unsigned_t<std::remove_cvref_t<U>>>(Value));
+			}
+		} else if constexpr ((Argument == FORMAT_ARGUMENT::FORMAT_ARGUMENT_SIGNED) || (Argument == FORMAT_ARGUMENT::FORMAT_ARGUMENT_UNSIGNED)) {
+			FormatInteger(Writer, Spec, Value);
+		} else if constexpr (Argument == FORMAT_ARGUMENT::FORMAT_ARGUMENT_FLOAT) {
+			FormatFloat(Writer, Spec, Value);
+		} else if constexpr (Argument == FORMAT_ARGUMENT::FORMAT_ARGUMENT_STRING) {
+			std::basic_string_view<T> Text(Value);
+			if ((Spec.Precision >= 0) && (static_cast<size_t>(Spec.Precision) < Text.size())) {
+				Text = Text.substr(0, Spec.Precision);
+			}
+			FormatPadded(Writer, Spec, Text.data(), Text.size(), '<');
+		} else if constexpr (Argument == FORMAT_ARGUMENT::FORMAT_ARGUMENT_POINTER) {
+			char szBuffer[2 + sizeof(void*) * 2];
+			szBuffer[0] = '0';
+			szBuffer[1] = 'x';
+			const std::to_chars_result Result = std::to_chars(szBuffer + 2, szBuffer + sizeof(szBuffer), reinterpret_cast<uintptr_t>(static_cast<const void*>(Value)), 16);
+			FormatPadded(Writer, Spec, szBuffer, static_cast<size_t>(Result.ptr - szBuffer), '>', 2);
+		}
+	}
+
+	template <typename T>
+	void FormatLiteral(FormatWriter<T>& Writer, std::basic_string_view<T> Format, const FORMAT_PIECE& Piece) {
+		T const* pText = Format.data() + Piece.LiteralOffset;
+		if (!Piece.bEscaped) {
+			Writer.Append(pText, Piece.LiteralLength);
+			return;
+		}
+
+		// Escaped braces were validated in pairs while parsing.
+		for (unsigned int i = 0; i < Piece.LiteralLength; ++i) {
+			Writer.Append(pText + i, 1);
+			if ((pText[i] == T('{')) || (pText[i] == T('}'))) {
+				++i;
+			}
+		}
+	}
+
+	template <typename T, typename... Args, size_t... Indices>
+	void FormatTo(FormatWriter<T>& Writer, const BasicFormatString<T, Args...>& Format, std::index_sequence<Indices...>, const Args&... args) {
+		FormatLiteral(Writer, Format.GetFormat(), Format.GetPiece(0));
+		((FormatArgument(Writer, Format.GetPiece(Indices).Spec, args), FormatLiteral(Writer, Format.GetFormat(), Format.GetPiece(Indices + 1))), ...);
+	}
+
+	template <typename... Args>
+	int print(COLOR_PAIR ColorPair, FormatString<Args...> Format, const Args&... args) {
+		FormatWriter<char> Writer;
+		FormatTo(Writer, Format, std::index_sequence_for<Args...>(), args...);
+
+		if (clrputs(ColorPair, Writer.Terminate()) < 0) {
+			return -1;
+		}
+
+		return static_cast<int>(Writer.GetLength());
+	}
+
+	template <typename... Args>
+	int print(COLOR_PAIR ColorPair, WFormatString<Args...> Format, const Args&... args) {
+		FormatWriter<wchar_t> Writer;
+		FormatTo(Writer, Format, std::index_sequence_for<Args...>(), args...);
+
+		if (clrwputs(ColorPair, Writer.Terminate()) < 0) {
+			return -1;
+		}
+
+		return static_cast<int>(Writer.GetLength());
+	}
+
+	// ----------------------------------------------------------------
+	// Markup
+	// ----------------------------------------------------------------
+
+	// Tags are {color}, {color on color} and {on color}. {/} returns to the enclosing colors, {{ and }} are literal braces.
+
+	typedef enum class _MARKUP_TAG : unsigned char {
+		MARKUP_TAG_UNKNOWN = 0,
+		MARKUP_TAG_COLOR,
+		MARKUP_TAG_CLOSE
+	} MARKUP_TAG, *PMARKUP_TAG;
+
+	typedef struct _MARKUP_SPAN {
+		unsigned int Offset;
+		unsigned int Length;
+		bool bEscaped;
+		COLOR_PAIR ColorPair;
+	} MARKUP_SPAN, *PMARKUP_SPAN;
+
+	template <typename T>
+	constexpr bool GetMarkupColor(T const* pName, size_t unLength, PCOLOR pColor) {
+		struct {
+			char const* szName;
+			COLOR Color;
+		} const Names[] = {
+			{ "black", COLOR::COLOR_BLACK },
+			{ "dark_blue", COLOR::COLOR_DARK_BLUE },
+			{ "dark_green", COLOR::COLOR_DARK_GREEN },
+			{ "dark_cyan", COLOR::COLOR_DARK_CYAN },
+			{ "dark_red", COLOR::COLOR_DARK_RED },
+			{ "dark_magenta", COLOR::COLOR_DARK_MAGENTA },
+			{ "dark_yellow", COLOR::COLOR_DARK_YELLOW },
+			{ "dark_gray", COLOR::COLOR_DARK_GRAY },
+			{ "gray", COLOR::COLOR_GRAY },
+			{ "blue", COLOR::COLOR_BLUE },
+			{ "green", COLOR::COLOR_GREEN },
+			{ "cyan", COLOR::COLOR_CYAN },
+			{ "red", COLOR::COLOR_RED },
+			{ "magenta", COLOR::COLOR_MAGENTA },
+			{ "yellow", COLOR::COLOR_YELLOW },
+			{ "white", COLOR::COLOR_WHITE },
+			{ "default", COLOR::COLOR_UNKNOWN }
+		};
+
+		for (const auto& Name : Names) {
+			size_t i = 0;
+			while ((i < unLength) && Name.szName[i] && (pName[i] == static_cast<T>(Name.szName[i]))) {
+				++i;
+			}
+
+			if ((i == unLength) && !Name.szName[i]) {
+				*pColor = Name.Color;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Parses the text between the braces of a tag. Colors that the tag doesn't mention are inherited from Current.
+	template <typename T>
+	constexpr MARKUP_TAG ParseMarkupTag(T const* pTag, size_t unLength, COLOR_PAIR Current, PCOLOR_PAIR pColorPair) {
+		if ((unLength == 1) && (pTag[0] == T('/'))) {
+			return MARKUP_TAG::MARKUP_TAG_CLOSE;
+		}
+
+		COLOR_PAIR Result = Current;
+
+		if ((unLength > 3) && (pTag[0] == T('o')) && (pTag[1] == T('n')) && (pTag[2] == T(' '))) {
+			if (!GetMarkupColor(pTag + 3, unLength - 3, &Result.ColorBackground)) {
+				return MARKUP_TAG::MARKUP_TAG_UNKNOWN;
+			}
+
+			*pColorPair = Result;
+			return MARKUP_TAG::MARKUP_TAG_COLOR;
+		}
+
+		size_t unSplit = unLength;
+		for (size_t i = 0; (i + 4) <= unLength; ++i) {
+			if ((pTag[i] == T(' ')) && (pTag[i + 1] == T('o')) && (pTag[i + 2] == T('n')) && (pTag[i + 3] == T(' '))) {
+				unSplit = i;
+				break;
+			}
+		}
+
+		if (!GetMarkupColor(pTag, unSplit, &Result.ColorForeground)) {
+			return MARKUP_TAG::MARKUP_TAG_UNKNOWN;
+		}
+
+		if ((unSplit != unLength) && !GetMarkupColor(pTag + unSplit + 4, unLength - unSplit - 4, &Result.ColorBackground)) {
+			return MARKUP_TAG::MARKUP_TAG_UNKNOWN;
+		}
+
+		*pColorPair = Result;
+		return MARKUP_TAG::MARKUP_TAG_COLOR;
+	}
+
+	// Not constexpr, so reaching it while parsing markup fails the build.
+	inline void MarkupError(char const* const szMessage) {
+		(void)szMessage;
+	}
+
+	// Markup literal resolved at compile time into text spans with their final colors.
+	// The whole literal is always checked. One with more spans or deeper nesting than the table holds is printed through the runtime parser instead.
+	template <typename T>
+	class BasicMarkupString {
+	public:
+		static constexpr size_t MaxSpans = 32;
+		static constexpr size_t MaxDepth = 16;
+	public:
+		template <typename S> requires std::is_convertible_v<const S&, std::basic_string_view<T>>
+		consteval BasicMarkupString(const S& Markup) : m_Markup(Markup), m_Spans(), m_unSpans(0), m_bRuntime(false) {
+			Parse();
+		}
+	public:
+		constexpr std::basic_string_view<T> GetMarkup() const {
+			return m_Markup;
+		}
+
+		constexpr bool IsRuntime() const {
+			return m_bRuntime;
+		}
+
+		constexpr size_t GetSpans() const {
+			return m_unSpans;
+		}
+
+		constexpr const MARKUP_SPAN& GetSpan(size_t unIndex) const {
+			return m_Spans[unIndex];
+		}
+	private:
+		consteval void Parse() {
+			for (MARKUP_SPAN& Span : m_Spans) {
+				Span.Offset = 0;
+				Span.Length = 0;
+				Span.bEscaped = false;
+				Span.ColorPair = COLOR_PAIR();
+			}
+
+			COLOR_PAIR Stack[MaxDepth];
+			size_t unDepth = 0;
+			COLOR_PAIR Current;
+
+			const size_t unLength = m_Markup.size();
+			size_t unStart = 0;
+			bool bEscaped = false;
+
+			size_t i = 0;
+			while (i < unLength) {
+				const T unChar = m_Markup[i];
+
+				if (unChar == T('}')) {
+					if (((i + 1) < unLength) && (m_Markup[i + 1] == T('}'))) {
+						bEscaped = true;
+						i += 2;
+						continue;
+					}
+
+					MarkupError("Unmatched '}' in markup");
+				}
+
+				if (unChar != T('{')) {
+					++i;
+					continue;
+				}
+
+				if (((i + 1) < unLength) && (m_Markup[i + 1] == T('{'))) {
+					bEscaped = true;
+					i += 2;
+					continue;
+				}
+
+				size_t unEnd = i + 1;
+				while ((unEnd < unLength) && (m_Markup[unEnd] != T('}'))) {
+					++unEnd;
+				}
+
+				if (unEnd >= unLength) {
+					MarkupError("Unterminated markup tag");
+				}
+
+				COLOR_PAIR Next;
+				const MARKUP_TAG Tag = ParseMarkupTag(m_Markup.data() + i + 1, unEnd - i - 1, Current, &Next);
+				if (Tag == MARKUP_TAG::MARKUP_TAG_UNKNOWN) {
+					MarkupError("Unknown markup tag");
+				}
+
+				AddSpan(unStart, i - unStart, bEscaped, Current);
+
+				if (Tag == MARKUP_TAG::MARKUP_TAG_CLOSE) {
+					if (!unDepth) {
+						MarkupError("Unbalanced {/} in markup");
+					}
+
+					--unDepth;
+					if (unDepth < MaxDepth) {
+						Current = Stack[unDepth];
+					}
+				} else {
+					// Colors past the stack are lost, the spans are left to the runtime parser from here on.
+					if (unDepth < MaxDepth) {
+						Stack[unDepth] = Current;
+					} else {
+						m_bRuntime = true;
+					}
+
+					++unDepth;
+					Current = Next;
+				}
+
+				i = unEnd + 1;
+				unStart = i;
+				bEscaped = false;
+			}
+
+			AddSpan(unStart, unLength - unStart, bEscaped, Current);
+		}
+
+		consteval void AddSpan(size_t unOffset, size_t unLength, bool bEscaped, COLOR_PAIR ColorPair) {
+			if (!unLength || m_bRuntime) {
+				return;
+			}
+
+			if (m_unSpans >= MaxSpans) {
+				m_bRuntime = true;
+				return;
+			}
+
+			MARKUP_SPAN& Span = m_Spans[m_unSpans++];
+			Span.Offset = static_cast<unsigned int>(unOffset);
+			Span.Length = static_cast<unsigned int>(unLength);
+			Span.bEscaped = bEscaped;
+			Span.ColorPair = ColorPair;
+		}
+	private:
+		std::basic_string_view<T> m_Markup;
+		MARKUP_SPAN m_Spans[MaxSpans];
+		size_t m_unSpans;
+		bool m_bRuntime;
+	};
+
+	typedef BasicMarkupString<char> MarkupString;
+	typedef BasicMarkupString<wchar_t> WMarkupString;
+
+	// Markup only known at runtime. Unknown tags are printed as text.
+	template <typename T>
+	struct BasicRuntimeMarkup {
+		std::basic_string_view<T> Markup;
+	};
+
+	inline BasicRuntimeMarkup<char> RuntimeMarkup(std::string_view Markup) {
+		return BasicRuntimeMarkup<char> { Markup };
+	}
+
+	inline BasicRuntimeMarkup<wchar_t> RuntimeMarkup(std::wstring_view Markup) {
+		return BasicRuntimeMarkup<wchar_t> { Markup };
+	}
+
+	int mprint(const MarkupString& Markup);
+	int mprint(const WMarkupString& Markup);
+	int mprint(BasicRuntimeMarkup<char> Markup);
+	int mprint(BasicRuntimeMarkup<wchar_t> Markup);
+
+	// ----------------------------------------------------------------
+	// EmulatedConsole
+	// ----------------------------------------------------------------
+
+	// Console API entry points of the emulated host. The A and W variants share a counter.
+	typedef enum class _EMULATED_CALL : unsigned char {
+		EMULATED_CALL_GET_CONSOLE_WINDOW = 0,
+		EMULATED_CALL_ALLOC_CONSOLE,
+		EMULATED_CALL_FREE_CONSOLE,
+		EMULATED_CALL_GET_STD_HANDLE,
+		EMULATED_CALL_GET_CONSOLE_MODE,
+		EMULATED_CALL_SET_CONSOLE_MODE,
+		EMULATED_CALL_GET_CONSOLE_OUTPUT_CP,
+		EMULATED_CALL_GET_CONSOLE_SCREEN_BUFFER_INFO,
+		EMULATED_CALL_SET_CONSOLE_SCREEN_BUFFER_INFO,
+		EMULATED_CALL_SET_CONSOLE_TEXT_ATTRIBUTE,
+		EMULATED_CALL_GET_CONSOLE_CURSOR_INFO,
+		EMULATED_CALL_SET_CONSOLE_CURSOR_INFO,
+		EMULATED_CALL_SET_CONSOLE_CURSOR_POSITION,
+		EMULATED_CALL_FILL_CONSOLE_OUTPUT_ATTRIBUTE,
+		EMULATED_CALL_FILL_CONSOLE_OUTPUT_CHARACTER,
+		EMULATED_CALL_WRITE_CONSOLE,
+		EMULATED_CALL_WRITE_CONSOLE_OUTPUT,
+		EMULATED_CALL_WRITE_CONSOLE_OUTPUT_ATTRIBUTE,
+		EMULATED_CALL_READ_CONSOLE_OUTPUT,
+		EMULATED_CALL_SCROLL_CONSOLE_SCREEN_BUFFER,
+		EMULATED_CALL_READ_CONSOLE,
+		EMULATED_CALL_READ_CONSOLE_INPUT,
+		EMULATED_CALL_WAIT_FOR_SINGLE_OBJECT,
+		EMULATED_CALL_GET_WINDOW_LONG,
+		EMULATED_CALL_SET_WINDOW_LONG,
+		EMULATED_CALL_SET_WINDOW_POS,
+		EMULATED_CALL_SHOW_WINDOW,
+		EMULATED_CALL_DESTROY_WINDOW,
+		EMULATED_CALL_COUNT
+	} EMULATED_CALL, *PEMULATED_CALL;
+
+	// In-process console host over an in-memory cell grid, for running the library without a Win32 console.
+	// Installing it swaps the console API table, so install it before creating any console.
+	// Writes understand \r, \n, \b, \t, wrapping and scrolling, and with virtual terminal processing SGR colors, cursor moves and ED/EL erases.
+	class EmulatedConsole {
+	public:
+		EmulatedConsole(SHORT nWidth = 120, SHORT nHeight = 30, SHORT nBufferHeight = 300);
+		~EmulatedConsole();
+	public:
+		// Control
+		bool Install();
+		bool Uninstall();
+		bool IsInstalled();
+	public:
+		// Simulation
+		void SetCallCost(unsigned int unMicroseconds);
+		bool PushInputA(char const* const szInput);
+		bool PushInputW(wchar_t const* const szInput);
+#ifdef UNICODE
+		bool PushInput(wchar_t const* const szInput);
+#else
+		bool PushInput(char const* const szInput);
+#endif
+		bool PushInputRecords(const INPUT_RECORD* pRecords, unsigned int unCount);
+		bool ResizeWindow(SHORT nWidth, SHORT nHeight);
+	public:
+		// Inspection
+		bool GetCell(COORD Position, PCHAR_INFO pCell);
+		bool GetLine(SHORT nY, wchar_t* const szBuffer, unsigned int unCount);
+		bool GetCursorPosition(PCOORD pCursorPosition);
+		unsigned long long GetCalls(EMULATED_CALL Call);
+		unsigned long long GetTotalCalls();
+		// Cells written, filled, erased or moved, a measure of the work behind the calls.
+		unsigned long long GetTouchedCells();
+		void ResetCalls();
+	private:
+		static EmulatedConsole* Enter(EMULATED_CALL Call);
+		void Simulate();
+		void Resize(COORD Size);
+		void FollowCursor();
+		void NewLine();
+		void EraseCells(size_t unStart, size_t unCount);
+		void WriteText(wchar_t const* const szText, size_t unLength);
+		void ApplyControlSequence();
+	private:
+		static HWND WINAPI ApiGetConsoleWindow();
+		static BOOL WINAPI ApiAllocConsole();
+		static BOOL WINAPI ApiFreeConsole();
+		static HANDLE WINAPI ApiGetStdHandle(DWORD nStdHandle);
+		static BOOL WINAPI ApiGetConsoleMode(HANDLE hConsoleHandle, LPDWORD lpMode);
+		static BOOL WINAPI ApiSetConsoleMode(HANDLE hConsoleHandle, DWORD dwMode);
+		static UINT WINAPI ApiGetConsoleOutputCP();
+		static BOOL WINAPI ApiGetConsoleScreenBufferInfoEx(HANDLE hConsoleOutput, PCONSOLE_SCREEN_BUFFER_INFOEX lpConsoleScreenBufferInfoEx);
+		static BOOL WINAPI ApiSetConsoleScreenBufferInfoEx(HANDLE hConsoleOutput, PCONSOLE_SCREEN_BUFFER_INFOEX lpConsoleScreenBufferInfoEx);
+		static BOOL WINAPI ApiSetConsoleTextAttribute(HANDLE hConsoleOutput, WORD wAttributes);
+		static BOOL WINAPI ApiGetConsoleCursorInfo(HANDLE hConsoleOutput, PCONSOLE_CURSOR_INFO lpConsoleCursorInfo);
+		static BOOL WINAPI ApiSetConsoleCursorInfo(HANDLE hConsoleOutput, const CONSOLE_CURSOR_INFO* lpConsoleCursorInfo);
+		static BOOL WINAPI ApiSetConsoleCursorPosition(HANDLE hConsoleOutput, COORD dwCursorPosition);
+		static BOOL WINAPI ApiFillConsoleOutputAttribute(HANDLE hConsoleOutput, WORD wAttribute, DWORD nLength, COORD dwWriteCoord, LPDWORD lpNumberOfAttrsWritten);
+		static BOOL WINAPI ApiFillConsoleOutputCharacterW(HANDLE hConsoleOutput, WCHAR cCharacter, DWORD nLength, COORD dwWriteCoord, LPDWORD lpNumberOfCharsWritten);
+		static BOOL WINAPI ApiWriteConsoleA(HANDLE hConsoleOutput, const VOID* lpBuffer, DWORD nNumberOfCharsToWrite, LPDWORD lpNumberOfCharsWritten, LPVOID lpReserved);
+		static BOOL WINAPI ApiWriteConsoleW(HANDLE hConsoleOutput, const VOID* lpBuffer, DWORD nNumberOfCharsToWrite, LPDWORD lpNumberOfCharsWritten, LPVOID lpReserved);
+		static BOOL WINAPI ApiWriteConsoleOutputW(HANDLE hConsoleOutput, const CHAR_INFO* lpBuffer, COORD dwBufferSize, COORD dwBufferCoord, PSMALL_RECT lpWriteRegion);
+		static BOOL WINAPI ApiWriteConsoleOutputAttribute(HANDLE hConsoleOutput, const WORD* lpAttribute, DWORD nLength, COORD dwWriteCoord, LPDWORD lpNumberOfAttrsWritten);
+		static BOOL WINAPI ApiReadConsoleOutputW(HANDLE hConsoleOutput, PCHAR_INFO lpBuffer, COORD dwBufferSize, COORD dwBufferCoord, PSMALL_RECT lpReadRegion);
+		static BOOL WINAPI ApiScrollConsoleScreenBufferW(HANDLE hConsoleOutput, const SMALL_RECT* lpScrollRectangle, const SMALL_RECT* lpClipRectangle, COORD dwDestinationOrigin, const CHAR_INFO* lpFill);
+		static BOOL WINAPI ApiReadConsoleA(HANDLE hConsoleInput, LPVOID lpBuffer, DWORD nNumberOfCharsToRead, LPDWORD lpNumberOfCharsRead, PCONSOLE_READCONSOLE_CONTROL pInputControl);
+		static BOOL WINAPI ApiReadConsoleW(HANDLE hConsoleInput, LPVOID lpBuffer, DWORD nNumberOfCharsToRead, LPDWORD lpNumberOfCharsRead, PCONSOLE_READCONSOLE_CONTROL pInputControl);
+		static BOOL WINAPI ApiReadConsoleInputW(HANDLE hConsoleInput, PINPUT_RECORD lpBuffer, DWORD nLength, LPDWORD lpNumberOfEventsRead);
+		static DWORD WINAPI ApiWaitForSingleObject(HANDLE hHandle, DWORD dwMilliseconds);
+		static LONG WINAPI ApiGetWindowLongW(HWND hWnd, int nIndex);
+		static LONG WINAPI ApiSetWindowLongW(HWND hWnd, int nIndex, LONG dwNewLong);
+		static BOOL WINAPI ApiSetWindowPos(HWND hWnd, HWND hWndInsertAfter, int X, int Y, int cx, int cy, UINT uFlags);
+		static BOOL WINAPI ApiShowWindow(HWND hWnd, int nCmdShow);
+		static BOOL WINAPI ApiDestroyWindow(HWND hWnd);
+	private:
+		static const CONSOLE_API m_EmulatedApi;
+		const CONSOLE_API* m_pPreviousApi;
+		std::mutex m_Lock;
+		bool m_bAttached;
+		bool m_bVisible;
+		LONG m_nStyle;
+		LONG m_nStyleEx;
+		COORD m_Size;
+		SMALL_RECT m_Window;
+		COORD m_CursorPosition;
+		COORD m_SavedCursorPosition;
+		WORD m_unAttributes;
+		CONSOLE_CURSOR_INFO m_CursorInfo;
+		COLORREF m_ColorTable[16];
+		ColorQuantizer m_ColorQuantizer;
+		DWORD m_unInputMode;
+		DWORD m_unOutputMode;
+		std::vector<CHAR_INFO> m_Cells;
+		// Escape sequence split across writes.
+		std::wstring m_Sequence;
+		// Narrow writes converted, kept so the host doesn't show up in allocation counts.
+		std::wstring m_Converted;
+		std::wstring m_Input;
+		std::deque<INPUT_RECORD> m_InputRecords;
+		std::condition_variable m_InputReady;
+		std::atomic<unsigned int> m_unCallCost;
+		std::atomic<unsigned long long> m_unCalls[static_cast<unsigned char>(EMULATED_CALL::EMULATED_CALL_COUNT)];
+		std::atomic<unsigned long long> m_unTouchedCells;
+	};
 }
 
 #endif // !_CONSOLEUTILS_H_
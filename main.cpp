@@ -12,7 +12,9 @@ int _tmain() {
 	SmartConsoleUtils SCU;
 
 	if (SCU.Open()) {
-		tclrprintf(COLOR::COLOR_CYAN, _T("Hello, ")); tclrprintf(COLOR_PAIR(COLOR::COLOR_GREEN, COLOR::COLOR_RED), _T("World!\n"));
+		BindConsole(&SCU);
+
+		mprint(_T("{cyan}Hello, {/}{red on green}World!\n{/}"));
 
 		TCHAR szName[32];
 		memset(szName, 0, sizeof(szName));
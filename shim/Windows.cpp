@@ -0,0 +1,508 @@
+// Default
+#include "Windows.h"
+#include "tchar.h"
+#include "io.h"
+
+// C++
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ----------------------------------------------------------------
+// Console
+// ----------------------------------------------------------------
+
+// There is no console, so everything fails like it does for a process without one.
+
+HWND GetConsoleWindow() {
+	return nullptr;
+}
+
+BOOL AllocConsole() {
+	return FALSE;
+}
+
+BOOL FreeConsole() {
+	return FALSE;
+}
+
+HANDLE GetStdHandle(DWORD nStdHandle) {
+	return INVALID_HANDLE_VALUE;
+}
+
+BOOL GetConsoleMode(HANDLE hConsoleHandle, LPDWORD lpMode) {
+	return FALSE;
+}
+
+BOOL SetConsoleMode(HANDLE hConsoleHandle, DWORD dwMode) {
+	return FALSE;
+}
+
+UINT GetConsoleOutputCP() {
+	return CP_UTF8;
+}
+
+BOOL SetConsoleOutputCP(UINT wCodePageID) {
+	return wCodePageID == CP_UTF8;
+}
+
+BOOL GetConsoleScreenBufferInfo(HANDLE hConsoleOutput, PCONSOLE_SCREEN_BUFFER_INFO lpConsoleScreenBufferInfo) {
+	return FALSE;
+}
+
+BOOL GetConsoleScreenBufferInfoEx(HANDLE hConsoleOutput, PCONSOLE_SCREEN_BUFFER_INFOEX lpConsoleScreenBufferInfoEx) {
+	return FALSE;
+}
+
+BOOL SetConsoleScreenBufferInfoEx(HANDLE hConsoleOutput, PCONSOLE_SCREEN_BUFFER_INFOEX lpConsoleScreenBufferInfoEx) {
+	return FALSE;
+}
+
+BOOL SetConsoleTextAttribute(HANDLE hConsoleOutput, WORD wAttributes) {
+	return FALSE;
+}
+
+BOOL GetConsoleCursorInfo(HANDLE hConsoleOutput, PCONSOLE_CURSOR_INFO lpConsoleCursorInfo) {
+	return FALSE;
+}
+
+BOOL SetConsoleCursorInfo(HANDLE hConsoleOutput, const CONSOLE_CURSOR_INFO* lpConsoleCursorInfo) {
+	return FALSE;
+}
+
+BOOL SetConsoleCursorPosition(HANDLE hConsoleOutput, COORD dwCursorPosition) {
+	return FALSE;
+}
+
+BOOL FillConsoleOutputAttribute(HANDLE hConsoleOutput, WORD wAttribute, DWORD nLength, COORD dwWriteCoord, LPDWORD lpNumberOfAttrsWritten) {
+	return FALSE;
+}
+
+BOOL FillConsoleOutputCharacterA(HANDLE hConsoleOutput, CHAR cCharacter, DWORD nLength, COORD dwWriteCoord, LPDWORD lpNumberOfCharsWritten) {
+	return FALSE;
+}
+
+BOOL FillConsoleOutputCharacterW(HANDLE hConsoleOutput, WCHAR cCharacter, DWORD nLength, COORD dwWriteCoord, LPDWORD lpNumberOfCharsWritten) {
+	return FALSE;
+}
+
+BOOL WriteConsoleA(HANDLE hConsoleOutput, const VOID* lpBuffer, DWORD nNumberOfCharsToWrite, LPDWORD lpNumberOfCharsWritten, LPVOID lpReserved) {
+	return FALSE;
+}
+
+BOOL WriteConsoleW(HANDLE hConsoleOutput, const VOID* lpBuffer, DWORD nNumberOfCharsToWrite, LPDWORD lpNumberOfCharsWritten, LPVOID lpReserved) {
+	return FALSE;
+}
+
+BOOL WriteConsoleOutputA(HANDLE hConsoleOutput, const CHAR_INFO* lpBuffer, COORD dwBufferSize, COORD dwBufferCoord, PSMALL_RECT lpWriteRegion) {
+	return FALSE;
+}
+
+BOOL WriteConsoleOutputW(HANDLE hConsoleOutput, const CHAR_INFO* lpBuffer, COORD dwBufferSize, COORD dwBufferCoord, PSMALL_RECT lpWriteRegion) {
+	return FALSE;
+}
+
+BOOL WriteConsoleOutputAttribute(HANDLE hConsoleOutput, const WORD* lpAttribute, DWORD nLength, COORD dwWriteCoord, LPDWORD lpNumberOfAttrsWritten) {
+	return FALSE;
+}
+
+BOOL WriteConsoleOutputCharacterW(HANDLE hConsoleOutput, const WCHAR* lpCharacter, DWORD nLength, COORD dwWriteCoord, LPDWORD lpNumberOfCharsWritten) {
+	return FALSE;
+}
+
+BOOL ReadConsoleOutputA(HANDLE hConsoleOutput, PCHAR_INFO lpBuffer, COORD dwBufferSize, COORD dwBufferCoord, PSMALL_RECT lpReadRegion) {
+	return FALSE;
+}
+
+BOOL ReadConsoleOutputW(HANDLE hConsoleOutput, PCHAR_INFO lpBuffer, COORD dwBufferSize, COORD dwBufferCoord, PSMALL_RECT lpReadRegion) {
+	return FALSE;
+}
+
+BOOL ScrollConsoleScreenBufferA(HANDLE hConsoleOutput, const SMALL_RECT* lpScrollRectangle, const SMALL_RECT* lpClipRectangle, COORD dwDestinationOrigin, const CHAR_INFO* lpFill) {
+	return FALSE;
+}
+
+BOOL ScrollConsoleScreenBufferW(HANDLE hConsoleOutput, const SMALL_RECT* lpScrollRectangle, const SMALL_RECT* lpClipRectangle, COORD dwDestinationOrigin, const CHAR_INFO* lpFill) {
+	return FALSE;
+}
+
+BOOL ReadConsoleA(HANDLE hConsoleInput, LPVOID lpBuffer, DWORD nNumberOfCharsToRead, LPDWORD lpNumberOfCharsRead, PCONSOLE_READCONSOLE_CONTROL pInputControl) {
+	return FALSE;
+}
+
+BOOL ReadConsoleW(HANDLE hConsoleInput, LPVOID lpBuffer, DWORD nNumberOfCharsToRead, LPDWORD lpNumberOfCharsRead, PCONSOLE_READCONSOLE_CONTROL pInputControl) {
+	return FALSE;
+}
+
+BOOL ReadConsoleInputA(HANDLE hConsoleInput, PINPUT_RECORD lpBuffer, DWORD nLength, LPDWORD lpNumberOfEventsRead) {
+	return FALSE;
+}
+
+BOOL ReadConsoleInputW(HANDLE hConsoleInput, PINPUT_RECORD lpBuffer, DWORD nLength, LPDWORD lpNumberOfEventsRead) {
+	return FALSE;
+}
+
+BOOL PeekConsoleInputW(HANDLE hConsoleInput, PINPUT_RECORD lpBuffer, DWORD nLength, LPDWORD lpNumberOfEventsRead) {
+	return FALSE;
+}
+
+BOOL GetNumberOfConsoleInputEvents(HANDLE hConsoleInput, LPDWORD lpNumberOfEvents) {
+	return FALSE;
+}
+
+BOOL FlushConsoleInputBuffer(HANDLE hConsoleInput) {
+	return FALSE;
+}
+
+// ----------------------------------------------------------------
+// Window
+// ----------------------------------------------------------------
+
+LONG GetWindowLongW(HWND hWnd, int nIndex) {
+	return 0;
+}
+
+LONG SetWindowLongW(HWND hWnd, int nIndex, LONG dwNewLong) {
+	return 0;
+}
+
+BOOL SetWindowPos(HWND hWnd, HWND hWndInsertAfter, int X, int Y, int cx, int cy, UINT uFlags) {
+	return FALSE;
+}
+
+BOOL ShowWindow(HWND hWnd, int nCmdShow) {
+	return FALSE;
+}
+
+BOOL DestroyWindow(HWND hWnd) {
+	return FALSE;
+}
+
+// ----------------------------------------------------------------
+// Files and synchronization
+// ----------------------------------------------------------------
+
+BOOL WriteFile(HANDLE hFile, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite, LPDWORD lpNumberOfBytesWritten, LPVOID lpOverlapped) {
+	return FALSE;
+}
+
+BOOL ReadFile(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPDWORD lpNumberOfBytesRead, LPVOID lpOverlapped) {
+	return FALSE;
+}
+
+DWORD GetFileType(HANDLE hFile) {
+	return FILE_TYPE_UNKNOWN;
+}
+
+BOOL CloseHandle(HANDLE hObject) {
+	return FALSE;
+}
+
+BOOL CancelIoEx(HANDLE hFile, LPVOID lpOverlapped) {
+	return FALSE;
+}
+
+BOOL CancelSynchronousIo(HANDLE hThread) {
+	return FALSE;
+}
+
+HANDLE CreateEventW(LPVOID lpEventAttributes, BOOL bManualReset, BOOL bInitialState, const WCHAR* lpName) {
+	return nullptr;
+}
+
+BOOL SetEvent(HANDLE hEvent) {
+	return FALSE;
+}
+
+BOOL ResetEvent(HANDLE hEvent) {
+	return FALSE;
+}
+
+DWORD WaitForSingleObject(HANDLE hHandle, DWORD dwMilliseconds) {
+	return WAIT_FAILED;
+}
+
+DWORD WaitForMultipleObjects(DWORD nCount, const HANDLE* lpHandles, BOOL bWaitAll, DWORD dwMilliseconds) {
+	return WAIT_FAILED;
+}
+
+// ----------------------------------------------------------------
+// Text
+// ----------------------------------------------------------------
+
+// Wide text is UTF-16 like on Windows, whatever the size of wchar_t. Invalid input becomes U+FFFD.
+
+int MultiByteToWideChar(UINT CodePage, DWORD dwFlags, const CHAR* lpMultiByteStr, int cbMultiByte, WCHAR* lpWideCharStr, int cchWideChar) {
+	if (!lpMultiByteStr || !cbMultiByte || (cchWideChar < 0) || (cchWideChar && !lpWideCharStr)) {
+		return 0;
+	}
+
+	const unsigned char* pSource = reinterpret_cast<const unsigned char*>(lpMultiByteStr);
+	const size_t unLength = (cbMultiByte < 0) ? (strlen(lpMultiByteStr) + 1) : static_cast<size_t>(cbMultiByte);
+
+	int nWritten = 0;
+	auto Put = [&](unsigned int unUnit) {
+		if (cchWideChar) {
+			if (nWritten >= cchWideChar) {
+				return false;
+			}
+
+			lpWideCharStr[nWritten] = static_cast<WCHAR>(unUnit);
+		}
+
+		++nWritten;
+		return true;
+	};
+
+	size_t i = 0;
+	while (i < unLength) {
+		const unsigned int unLead = pSource[i];
+
+		unsigned int unCodePoint = 0xFFFD;
+		size_t unUnits = 1;
+
+		if (unLead < 0x80) {
+			unCodePoint = unLead;
+		} else if ((unLead >= 0xC2) && (unLead <= 0xF4)) {
+			const size_t unNeeded = (unLead < 0xE0) ? 2 : ((unLead < 0xF0) ? 3 : 4);
+			unsigned int unValue = unLead & ((unNeeded == 2) ? 0x1F : ((unNeeded == 3) ? 0x0F : 0x07));
+
+			size_t j = 1;
+			for (; (j < unNeeded) && ((i + j) < unLength) && ((pSource[i + j] & 0xC0) == 0x80); ++j) {
+				unValue = (unValue << 6) | (pSource[i + j] & 0x3F);
+			}
+
+			const unsigned int unMinimum = (unNeeded == 2) ? 0x80 : ((unNeeded == 3) ? 0x800 : 0x10000);
+			if ((j == unNeeded) && (unValue >= unMinimum) && (unValue <= 0x10FFFF) && ((unValue < 0xD800) || (unValue > 0xDFFF))) {
+				unCodePoint = unValue;
+				unUnits = unNeeded;
+			} else {
+				unUnits = std::max<size_t>(j, 1);
+			}
+		}
+
+		if (unCodePoint >= 0x10000) {
+			unCodePoint -= 0x10000;
+			if (!Put(0xD800 + (unCodePoint >> 10)) || !Put(0xDC00 + (unCodePoint & 0x3FF))) {
+				return 0;
+			}
+		} else if (!Put(unCodePoint)) {
+			return 0;
+		}
+
+		i += unUnits;
+	}
+
+	return nWritten;
+}
+
+int WideCharToMultiByte(UINT CodePage, DWORD dwFlags, const WCHAR* lpWideCharStr, int cchWideChar, CHAR* lpMultiByteStr, int cbMultiByte, const CHAR* lpDefaultChar, BOOL* lpUsedDefaultChar) {
+	if (!lpWideCharStr || !cchWideChar || (cbMultiByte < 0) || (cbMultiByte && !lpMultiByteStr)) {
+		return 0;
+	}
+
+	const size_t unLength = (cchWideChar < 0) ? (wcslen(lpWideCharStr) + 1) : static_cast<size_t>(cchWideChar);
+
+	int nWritten = 0;
+	auto Put = [&](unsigned int unByte) {
+		if (cbMultiByte) {
+			if (nWritten >= cbMultiByte) {
+				return false;
+			}
+
+			lpMultiByteStr[nWritten] = static_cast<CHAR>(unByte);
+		}
+
+		++nWritten;
+		return true;
+	};
+
+	for (size_t i = 0; i < unLength; ++i) {
+		unsigned int unCodePoint = static_cast<unsigned int>(lpWideCharStr[i]);
+
+		if ((unCodePoint >= 0xD800) && (unCodePoint <= 0xDBFF) && ((i + 1) < unLength) && (static_cast<unsigned int>(lpWideCharStr[i + 1]) >= 0xDC00) && (static_cast<unsigned int>(lpWideCharStr[i + 1]) <= 0xDFFF)) {
+			unCodePoint = 0x10000 + ((unCodePoint - 0xD800) << 10) + (static_cast<unsigned int>(lpWideCharStr[i + 1]) - 0xDC00);
+			++i;
+		} else if (((unCodePoint >= 0xD800) && (unCodePoint <= 0xDFFF)) || (unCodePoint > 0x10FFFF)) {
+			unCodePoint = 0xFFFD;
+		}
+
+		bool bPut = true;
+		if (unCodePoint < 0x80) {
+			bPut = Put(unCodePoint);
+		} else if (unCodePoint < 0x800) {
+			bPut = Put(0xC0 | (unCodePoint >> 6)) && Put(0x80 | (unCodePoint & 0x3F));
+		} else if (unCodePoint < 0x10000) {
+			bPut = Put(0xE0 | (unCodePoint >> 12)) && Put(0x80 | ((unCodePoint >> 6) & 0x3F)) && Put(0x80 | (unCodePoint & 0x3F));
+		} else {
+			bPut = Put(0xF0 | (unCodePoint >> 18)) && Put(0x80 | ((unCodePoint >> 12) & 0x3F)) && Put(0x80 | ((unCodePoint >> 6) & 0x3F)) && Put(0x80 | (unCodePoint & 0x3F));
+		}
+
+		if (!bPut) {
+			return 0;
+		}
+	}
+
+	return nWritten;
+}
+
+// ----------------------------------------------------------------
+// System
+// ----------------------------------------------------------------
+
+DWORD GetLastError() {
+	return 0;
+}
+
+void Sleep(DWORD dwMilliseconds) {
+	std::this_thread::sleep_for(std::chrono::milliseconds(dwMilliseconds));
+}
+
+ULONGLONG GetTickCount64() {
+	return static_cast<ULONGLONG>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+BOOL QueryPerformanceCounter(PLARGE_INTEGER lpPerformanceCount) {
+	lpPerformanceCount->QuadPart = static_cast<LONGLONG>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(PLARGE_INTEGER lpFrequency) {
+	lpFrequency->QuadPart = 1000000000;
+	return TRUE;
+}
+
+// ----------------------------------------------------------------
+// CRT
+// ----------------------------------------------------------------
+
+static std::string ToNarrowPath(const wchar_t* szText) {
+	std::string Result;
+
+	const int nLength = WideCharToMultiByte(CP_UTF8, 0, szText, -1, nullptr, 0, nullptr, nullptr);
+	if (nLength > 0) {
+		Result.resize(static_cast<size_t>(nLength));
+		WideCharToMultiByte(CP_UTF8, 0, szText, -1, Result.data(), nLength, nullptr, nullptr);
+		Result.resize(static_cast<size_t>(nLength - 1));
+	}
+
+	return Result;
+}
+
+int fopen_s(FILE** pFile, const char* szFileName, const char* szMode) {
+	*pFile = fopen(szFileName, szMode);
+	return *pFile ? 0 : 1;
+}
+
+int _wfopen_s(FILE** pFile, const wchar_t* szFileName, const wchar_t* szMode) {
+	return fopen_s(pFile, ToNarrowPath(szFileName).c_str(), ToNarrowPath(szMode).c_str());
+}
+
+int sprintf_s(char* szBuffer, size_t unSize, const char* szFormat, ...) {
+	va_list vargs;
+	va_start(vargs, szFormat);
+	const int nLength = vsprintf_s(szBuffer, unSize, szFormat, vargs);
+	va_end(vargs);
+	return nLength;
+}
+
+int swprintf_s(wchar_t* szBuffer, size_t unSize, const wchar_t* szFormat, ...) {
+	va_list vargs;
+	va_start(vargs, szFormat);
+	const int nLength = vswprintf_s(szBuffer, unSize, szFormat, vargs);
+	va_end(vargs);
+	return nLength;
+}
+
+int vsprintf_s(char* szBuffer, size_t unSize, const char* szFormat, va_list vargs) {
+	return vsnprintf(szBuffer, unSize, szFormat, vargs);
+}
+
+int vswprintf_s(wchar_t* szBuffer, size_t unSize, const wchar_t* szFormat, va_list vargs) {
+	return vswprintf(szBuffer, unSize, szFormat, vargs);
+}
+
+int _vscprintf(const char* szFormat, va_list vargs) {
+	return vsnprintf(nullptr, 0, szFormat, vargs);
+}
+
+// vswprintf has no counting mode, so the text is formatted into a growing buffer until it fits.
+// The buffer is kept per thread, the CRT function doesn't allocate either. A call that fails doesn't leave it grown.
+int _vscwprintf(const wchar_t* szFormat, va_list vargs) {
+	static thread_local std::vector<wchar_t> Buffer(1024);
+
+	for (;;) {
+		va_list vargsCopy;
+		va_copy(vargsCopy, vargs);
+		errno = 0;
+		const int nLength = vswprintf(Buffer.data(), Buffer.size(), szFormat, vargsCopy);
+		va_end(vargsCopy);
+
+		if (nLength >= 0) {
+			return nLength;
+		}
+
+		// An argument that doesn't convert fails at any size.
+		if ((errno == EILSEQ) || (Buffer.size() >= (1u << 26))) {
+			if (Buffer.size() > 1024) {
+				std::vector<wchar_t>(1024).swap(Buffer);
+			}
+
+			return -1;
+		}
+
+		Buffer.resize(Buffer.size() * 2);
+	}
+}
+
+int vsscanf_s(const char* szBuffer, const char* szFormat, va_list vargs) {
+	return vsscanf(szBuffer, szFormat, vargs);
+}
+
+int vswscanf_s(const wchar_t* szBuffer, const wchar_t* szFormat, va_list vargs) {
+	return vswscanf(szBuffer, szFormat, vargs);
+}
+
+int _tfreopen_s(FILE** pFile, const char* szFileName, const char* szMode, FILE* pStream) {
+	*pFile = freopen(strcmp(szFileName, "nul") ? szFileName : "/dev/null", szMode, pStream);
+	return *pFile ? 0 : 1;
+}
+
+int _tfreopen_s(FILE** pFile, const wchar_t* szFileName, const wchar_t* szMode, FILE* pStream) {
+	return _tfreopen_s(pFile, ToNarrowPath(szFileName).c_str(), ToNarrowPath(szMode).c_str(), pStream);
+}
+
+FILE* _tfdopen(int nDescriptor, const char* szMode) {
+	return nullptr;
+}
+
+FILE* _tfdopen(int nDescriptor, const wchar_t* szMode) {
+	return nullptr;
+}
+
+// ----------------------------------------------------------------
+// Low-level I/O
+// ----------------------------------------------------------------
+
+int _open_osfhandle(intptr_t nHandle, int nFlags) {
+	return -1;
+}
+
+intptr_t _get_osfhandle(int nDescriptor) {
+	return -1;
+}
+
+int _dup2(int nDescriptor1, int nDescriptor2) {
+	return -1;
+}
+
+int _fileno(FILE* pStream) {
+	return fileno(pStream);
+}
+
+int _isatty(int nDescriptor) {
+	return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef _SHIM_IO_H_
+#define _SHIM_IO_H_
+
+// Low-level I/O ConsoleUtils uses, for building it on other platforms. Handles and descriptors are never related.
+
+// C
+#include <cstdio>
+#include <cstdint>
+
+#define _O_TEXT 0x4000
+#define _O_BINARY 0x8000
+#define _O_U16TEXT 0x20000
+#define _O_U8TEXT 0x40000
+
+int _open_osfhandle(intptr_t nHandle, int nFlags);
+intptr_t _get_osfhandle(int nDescriptor);
+int _dup2(int nDescriptor1, int nDescriptor2);
+int _fileno(FILE* pStream);
+int _isatty(int nDescriptor);
+
+#endif // !_SHIM_IO_H_
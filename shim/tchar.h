@@ -0,0 +1,31 @@
+#ifndef _SHIM_TCHAR_H_
+#define _SHIM_TCHAR_H_
+
+// Generic-text mappings ConsoleUtils uses, for building it on other platforms.
+
+// C
+#include <cstdio>
+#include <cwchar>
+
+#ifdef UNICODE
+typedef wchar_t TCHAR;
+#define _T(x) L##x
+#define _tcslen wcslen
+#else
+typedef char TCHAR;
+#define _T(x) x
+#define _tcslen strlen
+#endif
+
+#define _TEXT(x) _T(x)
+
+// The entry point is main either way.
+#define _tmain main
+
+// "nul" opens the null device.
+int _tfreopen_s(FILE** pFile, const char* szFileName, const char* szMode, FILE* pStream);
+int _tfreopen_s(FILE** pFile, const wchar_t* szFileName, const wchar_t* szMode, FILE* pStream);
+FILE* _tfdopen(int nDescriptor, const char* szMode);
+FILE* _tfdopen(int nDescriptor, const wchar_t* szMode);
+
+#endif // !_SHIM_TCHAR_H_
@@ -0,0 +1,52 @@
+// Default
+#include "Test.h"
+
+// C
+#include <cstdlib>
+
+// C++
+#include <atomic>
+#include <new>
+
+// ----------------------------------------------------------------
+// Allocations
+// ----------------------------------------------------------------
+
+static std::atomic<unsigned long long> g_unAllocations = 0;
+
+void* operator new(size_t unSize) {
+	g_unAllocations.fetch_add(1, std::memory_order_relaxed);
+
+	void* pMemory = malloc(unSize ? unSize : 1);
+	if (!pMemory) {
+		throw std::bad_alloc();
+	}
+
+	return pMemory;
+}
+
+void* operator new[](size_t unSize) {
+	return operator new(unSize);
+}
+
+void operator delete(void* pMemory) noexcept {
+	free(pMemory);
+}
+
+void operator delete[](void* pMemory) noexcept {
+	free(pMemory);
+}
+
+void operator delete(void* pMemory, size_t) noexcept {
+	free(pMemory);
+}
+
+void operator delete[](void* pMemory, size_t) noexcept {
+	free(pMemory);
+}
+
+namespace ConsoleUtilsTest {
+	unsigned long long GetAllocations() {
+		return g_unAllocations.load(std::memory_order_relaxed);
+	}
+}
@@ -0,0 +1,296 @@
+// Default
+#include "Test.h"
+
+// C++
+#include <atomic>
+#include <string>
+#include <thread>
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// AsyncSink
+// ----------------------------------------------------------------
+
+static void TestOrder() {
+	EmulatedConsole Console(40, 10, 2000);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		BindConsole(&SCU);
+		TEST_CHECK(SCU.EnableAsync(64));
+
+		// A ring of 64 records keeps the producers blocking on the writer.
+		const unsigned int unThreads = 4;
+		const unsigned int unLines = 300;
+
+		std::vector<std::thread> Threads;
+		for (unsigned int i = 0; i < unThreads; ++i) {
+			Threads.emplace_back([i]() {
+				for (unsigned int j = 0; j < unLines; ++j) {
+					clrprintf(static_cast<COLOR>(i + 1), "t%u %04u\n", i, j);
+				}
+			});
+		}
+
+		for (std::thread& Thread : Threads) {
+			Thread.join();
+		}
+
+		TEST_CHECK(SCU.GetAsyncSink()->Flush());
+
+		// Lines are whole, in the right color and in order per thread.
+		unsigned int unNext[unThreads] = {};
+		for (SHORT nY = 0; nY < static_cast<SHORT>(unThreads * unLines); ++nY) {
+			const std::wstring Line = GetLine(Console, nY);
+			TEST_CHECK(Line.size() == 7);
+
+			const unsigned int unThread = Line[1] - L'0';
+			TEST_CHECK(unThread < unThreads);
+			TEST_CHECK(static_cast<unsigned int>(std::stoul(Line.substr(3))) == unNext[unThread]);
+			TEST_CHECK((GetAttributes(Console, 0, nY) & 0x0F) == unThread + 1);
+
+			++unNext[unThread];
+		}
+
+		TEST_CHECK(SCU.DisableAsync());
+		UnbindConsole(&SCU);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// Searches back from the cursor row, where a line just written sits.
+static bool HasLine(EmulatedConsole& Console, const std::wstring& Line) {
+	COORD Cursor;
+	if (!Console.GetCursorPosition(&Cursor)) {
+		return false;
+	}
+
+	for (SHORT nY = Cursor.Y; nY >= 0; --nY) {
+		if (GetLine(Console, nY) == Line) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Each thread's own text is on the console once its Flush() or its push's ticket says so, whatever the other producers still hold.
+static void TestFlush() {
+	EmulatedConsole Console(40, 10, 2000);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		TEST_CHECK(SCU.EnableAsync(16));
+		AsyncSink* pSink = SCU.GetAsyncSink();
+
+		const unsigned int unThreads = 4;
+		const unsigned int unLines = 150;
+
+		std::vector<std::thread> Threads;
+		for (unsigned int i = 0; i < unThreads; ++i) {
+			Threads.emplace_back([&, i]() {
+				char szLine[32];
+				wchar_t szExpected[32];
+				for (unsigned int j = 0; j < unLines; ++j) {
+					const int nLength = snprintf(szLine, sizeof(szLine), "t%u %04u\n", i, j);
+					swprintf(szExpected, 32, L"t%u %04u", i, j);
+
+					ASYNC_TICKET Ticket;
+					TEST_CHECK(pSink->PushA(COLOR::COLOR_CYAN, szLine, static_cast<unsigned int>(nLength), &Ticket));
+					TEST_CHECK(Ticket.unRecords != 0);
+
+					if (j & 1) {
+						TEST_CHECK(pSink->Flush());
+					} else {
+						TEST_CHECK(pSink->WaitWritten(Ticket));
+					}
+
+					TEST_CHECK(pSink->IsWritten(Ticket));
+					TEST_CHECK(HasLine(Console, szExpected));
+				}
+			});
+		}
+
+		for (std::thread& Thread : Threads) {
+			Thread.join();
+		}
+
+		// Everything pushed so far is covered by the sink's ticket.
+		const ASYNC_TICKET Ticket = pSink->GetTicket();
+		TEST_CHECK(pSink->WaitWritten(Ticket));
+
+		COORD Cursor;
+		TEST_CHECK(Console.GetCursorPosition(&Cursor));
+		TEST_CHECK(Cursor.Y == static_cast<SHORT>(unThreads * unLines));
+
+		TEST_CHECK(SCU.DisableAsync());
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+static void TestOversized() {
+	EmulatedConsole Console(100, 10, 500);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+
+		// Four records hold 960 bytes, the message is more than ten times that.
+		std::string Message;
+		for (unsigned int i = 0; i < 100; ++i) {
+			Message += std::string(99, static_cast<char>('a' + (i % 26)));
+			Message += '\n';
+		}
+
+		// Blocking streams it through the ring.
+		TEST_CHECK(SCU.EnableAsync(4, ASYNC_POLICY::ASYNC_POLICY_BLOCK));
+		AsyncSink* pSink = SCU.GetAsyncSink();
+		TEST_CHECK(pSink->PushA(COLOR::COLOR_GREEN, Message.c_str(), static_cast<unsigned int>(Message.size())));
+		TEST_CHECK(pSink->Flush());
+		TEST_CHECK(pSink->GetDropped() == 0);
+
+		for (SHORT nY = 0; nY < 100; ++nY) {
+			TEST_CHECK(GetLine(Console, nY) == std::wstring(99, static_cast<wchar_t>(L'a' + (nY % 26))));
+		}
+
+		TEST_CHECK(SCU.DisableAsync());
+
+		// Dropping counts it and writes nothing.
+		TEST_CHECK(SCU.EnableAsync(4, ASYNC_POLICY::ASYNC_POLICY_DROP));
+		pSink = SCU.GetAsyncSink();
+		TEST_CHECK(!pSink->PushA(COLOR::COLOR_GREEN, Message.c_str(), static_cast<unsigned int>(Message.size())));
+		TEST_CHECK(pSink->Flush());
+		TEST_CHECK(pSink->GetDropped() == 1);
+		TEST_CHECK(GetLine(Console, 100).empty());
+		TEST_CHECK(SCU.DisableAsync());
+
+		// Growing queues it.
+		TEST_CHECK(SCU.EnableAsync(4, ASYNC_POLICY::ASYNC_POLICY_GROW));
+		pSink = SCU.GetAsyncSink();
+		ASYNC_TICKET Ticket;
+		TEST_CHECK(pSink->PushA(COLOR::COLOR_GREEN, Message.c_str(), static_cast<unsigned int>(Message.size()), &Ticket));
+		TEST_CHECK(Ticket.unSpans == 1);
+		TEST_CHECK(pSink->WaitWritten(Ticket));
+		TEST_CHECK(GetLine(Console, 199) == std::wstring(99, static_cast<wchar_t>(L'a' + (99 % 26))));
+		TEST_CHECK(SCU.DisableAsync());
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+static void TestStop() {
+	EmulatedConsole Console(40, 10, 8000);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		BindConsole(&SCU);
+		Console.SetCallCost(5);
+		TEST_CHECK(SCU.EnableAsync(32));
+
+		// Producers keep printing while the sink is stopped and started under them. No line may get lost.
+		const unsigned int unThreads = 4;
+		const unsigned int unLines = 1500;
+
+		std::atomic<unsigned int> unRunning = unThreads;
+		std::vector<std::thread> Threads;
+		for (unsigned int i = 0; i < unThreads; ++i) {
+			Threads.emplace_back([i, &unRunning]() {
+				for (unsigned int j = 0; j < unLines; ++j) {
+					TEST_CHECK(clrprintf(COLOR::COLOR_CYAN, "%u\n", i) == 2);
+				}
+
+				--unRunning;
+			});
+		}
+
+		unsigned int unToggles = 0;
+		while (unRunning.load()) {
+			TEST_CHECK(SCU.DisableAsync());
+			TEST_CHECK(SCU.EnableAsync(32));
+			++unToggles;
+
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+
+		for (std::thread& Thread : Threads) {
+			Thread.join();
+		}
+
+		TEST_CHECK(SCU.DisableAsync());
+		Console.SetCallCost(0);
+
+		COORD Cursor;
+		TEST_CHECK(Console.GetCursorPosition(&Cursor));
+		TEST_CHECK(Cursor.Y == static_cast<SHORT>(unThreads * unLines));
+		printf("%u lines from %u threads over %u restarts\n", unThreads * unLines, unThreads, unToggles);
+
+		UnbindConsole(&SCU);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// Time a producer spends in clrprintf, synchronous and through the sink, while the host takes 20 us per call.
+static void TestLatency() {
+	EmulatedConsole Console(40, 10, 3000);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		BindConsole(&SCU);
+		Console.SetCallCost(20);
+
+		// Fewer messages than records, so the producer never waits on the writer.
+		const unsigned int unMessages = 500;
+
+		std::vector<double> Sync;
+		for (unsigned int i = 0; i < unMessages; ++i) {
+			const double fStart = GetSeconds();
+			clrprintf(COLOR::COLOR_YELLOW, "sync %u\n", i);
+			Sync.push_back(GetSeconds() - fStart);
+		}
+
+		TEST_CHECK(SCU.EnableAsync(1024));
+
+		std::vector<double> Async;
+		for (unsigned int i = 0; i < unMessages; ++i) {
+			const double fStart = GetSeconds();
+			clrprintf(COLOR::COLOR_YELLOW, "async %u\n", i);
+			Async.push_back(GetSeconds() - fStart);
+		}
+
+		TEST_CHECK(SCU.GetAsyncSink()->Flush());
+		TEST_CHECK(SCU.DisableAsync());
+		Console.SetCallCost(0);
+
+		const double fSyncMedian = GetPercentile(Sync, 50);
+		const double fAsyncMedian = GetPercentile(Async, 50);
+		printf("producer latency sync p50 %.2f us p99 %.2f us, async p50 %.2f us p99 %.2f us\n", fSyncMedian * 1e6, GetPercentile(Sync, 99) * 1e6, fAsyncMedian * 1e6, GetPercentile(Async, 99) * 1e6);
+
+		TEST_CHECK(fAsyncMedian < fSyncMedian);
+		TEST_CHECK(GetLine(Console, 2 * unMessages - 1) == L"async 499");
+
+		UnbindConsole(&SCU);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+int main() {
+	TestOrder();
+	TestFlush();
+	TestOversized();
+	TestStop();
+	TestLatency();
+
+	puts("AsyncSinkTest passed");
+
+	return EXIT_SUCCESS;
+}
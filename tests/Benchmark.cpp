@@ -0,0 +1,383 @@
+// Default
+#include "Test.h"
+
+// C
+#include <cstring>
+
+// C++
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// Metrics
+// ----------------------------------------------------------------
+
+typedef enum class _METRIC : unsigned char {
+	METRIC_OPS_PER_SEC = 0,
+	METRIC_LATENCY_P50,
+	METRIC_LATENCY_P90,
+	METRIC_LATENCY_P99,
+	METRIC_ALLOCS_PER_OP,
+	METRIC_CALLS_PER_OP,
+	METRIC_COUNT
+} METRIC, *PMETRIC;
+
+typedef struct _METRIC_INFO {
+	char const* szName;
+	bool bHigherIsBetter;
+	// Timings depend on the machine, counts don't.
+	bool bTiming;
+} METRIC_INFO, *PMETRIC_INFO;
+
+static const METRIC_INFO g_Metrics[static_cast<unsigned int>(METRIC::METRIC_COUNT)] = {
+	{ "ops_per_sec", true, true },
+	{ "latency_p50_ns", false, true },
+	{ "latency_p90_ns", false, true },
+	{ "latency_p99_ns", false, true },
+	{ "allocs_per_op", false, false },
+	{ "console_calls_per_op", false, false }
+};
+
+typedef struct _BENCHMARK_RESULT {
+	std::string Name;
+	unsigned int unOperations;
+	double Values[static_cast<unsigned int>(METRIC::METRIC_COUNT)];
+} BENCHMARK_RESULT, *PBENCHMARK_RESULT;
+
+static int FindMetric(const std::string& Name) {
+	for (unsigned int i = 0; i < static_cast<unsigned int>(METRIC::METRIC_COUNT); ++i) {
+		if (Name == g_Metrics[i].szName) {
+			return static_cast<int>(i);
+		}
+	}
+
+	return -1;
+}
+
+// ----------------------------------------------------------------
+// Runner
+// ----------------------------------------------------------------
+
+// Runs Operation unOperations times after a short warm-up. Calls and allocations are counted over the timed runs only.
+template <typename Operation>
+static BENCHMARK_RESULT Measure(EmulatedConsole& Console, char const* const szName, unsigned int unOperations, Operation&& Function) {
+	for (unsigned int i = 0; i < 100; ++i) {
+		TEST_CHECK(Function(i));
+	}
+
+	std::vector<double> Samples;
+	Samples.reserve(unOperations);
+
+	Console.ResetCalls();
+	const unsigned long long unAllocations = GetAllocations();
+
+	const double fStart = GetSeconds();
+	for (unsigned int i = 0; i < unOperations; ++i) {
+		const double fOperationStart = GetSeconds();
+		TEST_CHECK(Function(i));
+		Samples.push_back(GetSeconds() - fOperationStart);
+	}
+	const double fElapsed = GetSeconds() - fStart;
+
+	const double fAllocations = static_cast<double>(GetAllocations() - unAllocations);
+	const double fCalls = static_cast<double>(Console.GetTotalCalls());
+
+	BENCHMARK_RESULT Result;
+	Result.Name = szName;
+	Result.unOperations = unOperations;
+	Result.Values[static_cast<unsigned int>(METRIC::METRIC_OPS_PER_SEC)] = unOperations / fElapsed;
+	Result.Values[static_cast<unsigned int>(METRIC::METRIC_LATENCY_P50)] = GetPercentile(Samples, 50) * 1e9;
+	Result.Values[static_cast<unsigned int>(METRIC::METRIC_LATENCY_P90)] = GetPercentile(Samples, 90) * 1e9;
+	Result.Values[static_cast<unsigned int>(METRIC::METRIC_LATENCY_P99)] = GetPercentile(Samples, 99) * 1e9;
+	Result.Values[static_cast<unsigned int>(METRIC::METRIC_ALLOCS_PER_OP)] = fAllocations / unOperations;
+	Result.Values[static_cast<unsigned int>(METRIC::METRIC_CALLS_PER_OP)] = fCalls / unOperations;
+
+	return Result;
+}
+
+static void RunBenchmarks(unsigned int unOperations, std::vector<BENCHMARK_RESULT>& Results) {
+	EmulatedConsole Console(120, 30, 300);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		TEST_CHECK(BindConsole(&SCU));
+
+		Results.push_back(Measure(Console, "clrprintf", unOperations, [](unsigned int i) {
+			return clrprintf(COLOR::COLOR_GREEN, "line %u of the benchmark\n", i) > 0;
+		}));
+
+		Results.push_back(Measure(Console, "clrwprintf", unOperations, [](unsigned int i) {
+			return clrwprintf(COLOR::COLOR_CYAN, L"line %u of the benchmark\n", i) > 0;
+		}));
+
+		// Recolors the whole buffer, alternating so no call is a no-op.
+		Results.push_back(Measure(Console, "SetColor", unOperations / 10, [&SCU](unsigned int i) {
+			return SCU.SetColor(COLOR_PAIR((i % 2) ? COLOR::COLOR_BLUE : COLOR::COLOR_BLACK, COLOR::COLOR_WHITE));
+		}));
+
+		Results.push_back(Measure(Console, "SetCursorColor", unOperations, [&SCU](unsigned int i) {
+			return SCU.SetCursorColor(COLOR_PAIR(static_cast<COLOR>(1 + (i % 15))));
+		}));
+
+		Results.push_back(Measure(Console, "Flush(true)", unOperations / 10, [&SCU](unsigned int) {
+			return SCU.Flush(true);
+		}));
+
+		Results.push_back(Measure(Console, "Erase", unOperations, [&SCU](unsigned int i) {
+			COORD Position;
+			Position.X = 0;
+			Position.Y = static_cast<SHORT>(i % 30);
+			return SCU.Erase(Position, 120);
+		}));
+
+		Results.push_back(Measure(Console, "ChangeColorPalette", unOperations, [&SCU](unsigned int i) {
+			return SCU.ChangeColorPalette(COLOR::COLOR_DARK_BLUE, (i % 2) ? 0x000080 : 0x102080);
+		}));
+
+		// The input queue stands in for the pipe, filled up front so its allocations don't count.
+		std::string Input;
+		for (unsigned int i = 0; i < unOperations + 100; ++i) {
+			Input += "input line\n";
+		}
+
+		TEST_CHECK(Console.PushInputA(Input.c_str()));
+
+		Results.push_back(Measure(Console, "ReadA", unOperations, [&SCU](unsigned int) {
+			char szBuffer[64];
+			return SCU.ReadA(szBuffer, sizeof(szBuffer)) && !strcmp(szBuffer, "input line\n");
+		}));
+
+		TEST_CHECK(UnbindConsole(&SCU));
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// ----------------------------------------------------------------
+// Report
+// ----------------------------------------------------------------
+
+static std::string FormatReport(const std::vector<BENCHMARK_RESULT>& Results) {
+	std::string Report = "{\n\t\"benchmarks\": [\n";
+
+	for (size_t i = 0; i < Results.size(); ++i) {
+		const BENCHMARK_RESULT& Result = Results[i];
+
+		char szField[128];
+		snprintf(szField, sizeof(szField), "\t\t{ \"name\": \"%s\", \"operations\": %u", Result.Name.c_str(), Result.unOperations);
+		Report += szField;
+
+		for (unsigned int j = 0; j < static_cast<unsigned int>(METRIC::METRIC_COUNT); ++j) {
+			snprintf(szField, sizeof(szField), ", \"%s\": %.2f", g_Metrics[j].szName, Result.Values[j]);
+			Report += szField;
+		}
+
+		Report += (i + 1 < Results.size()) ? " },\n" : " }\n";
+	}
+
+	Report += "\t]\n}\n";
+
+	return Report;
+}
+
+// Reads the reports written above: nested objects and arrays holding string and number members.
+// Every "name" starts a benchmark, the known metrics after it belong to it.
+static bool ParseReport(const std::string& Text, std::vector<BENCHMARK_RESULT>& Results) {
+	std::string Key;
+	bool bHaveKey = false;
+
+	size_t unPosition = 0;
+	while (unPosition < Text.size()) {
+		const char Character = Text[unPosition];
+
+		if (strchr(" \t\r\n,:", Character)) {
+			++unPosition;
+			continue;
+		}
+
+		if (strchr("{}[]", Character)) {
+			bHaveKey = false;
+			++unPosition;
+			continue;
+		}
+
+		if (Character == '"') {
+			const size_t unEnd = Text.find('"', unPosition + 1);
+			if (unEnd == std::string::npos) {
+				return false;
+			}
+
+			const std::string String = Text.substr(unPosition + 1, unEnd - unPosition - 1);
+			unPosition = unEnd + 1;
+
+			if (!bHaveKey) {
+				Key = String;
+				bHaveKey = true;
+				continue;
+			}
+
+			if (Key == "name") {
+				BENCHMARK_RESULT Result = {};
+				Result.Name = String;
+				for (double& fValue : Result.Values) {
+					fValue = -1.0;
+				}
+
+				Results.push_back(Result);
+			}
+
+			bHaveKey = false;
+			continue;
+		}
+
+		char* pEnd = nullptr;
+		const double fValue = strtod(Text.c_str() + unPosition, &pEnd);
+		if (pEnd == Text.c_str() + unPosition) {
+			return false;
+		}
+
+		unPosition = static_cast<size_t>(pEnd - Text.c_str());
+
+		if (bHaveKey && !Results.empty()) {
+			const int nMetric = FindMetric(Key);
+			if (nMetric >= 0) {
+				Results.back().Values[nMetric] = fValue;
+			}
+		}
+
+		bHaveKey = false;
+	}
+
+	return !Results.empty();
+}
+
+// Prints every metric that got worse than the baseline by more than fThreshold, a fraction. Counts get 0.01 of slack for rounding.
+static unsigned int CompareReports(const std::vector<BENCHMARK_RESULT>& Results, const std::vector<BENCHMARK_RESULT>& Baseline, double fThreshold, bool bCountsOnly) {
+	unsigned int unRegressions = 0;
+
+	for (const BENCHMARK_RESULT& Base : Baseline) {
+		const BENCHMARK_RESULT* pResult = nullptr;
+		for (const BENCHMARK_RESULT& Result : Results) {
+			if (Result.Name == Base.Name) {
+				pResult = &Result;
+				break;
+			}
+		}
+
+		if (!pResult) {
+			fprintf(stderr, "%s: missing from this run\n", Base.Name.c_str());
+			++unRegressions;
+			continue;
+		}
+
+		for (unsigned int i = 0; i < static_cast<unsigned int>(METRIC::METRIC_COUNT); ++i) {
+			const METRIC_INFO& Info = g_Metrics[i];
+			if ((bCountsOnly && Info.bTiming) || (Base.Values[i] < 0.0)) {
+				continue;
+			}
+
+			const double fBase = Base.Values[i];
+			const double fValue = pResult->Values[i];
+
+			bool bRegressed = false;
+			if (Info.bHigherIsBetter) {
+				bRegressed = fValue * (1.0 + fThreshold) < fBase;
+			} else {
+				bRegressed = fValue > fBase * (1.0 + fThreshold) + (Info.bTiming ? 0.0 : 0.01);
+			}
+
+			if (bRegressed) {
+				fprintf(stderr, "%s: %s regressed from %g to %g\n", Base.Name.c_str(), Info.szName, fBase, fValue);
+				++unRegressions;
+			}
+		}
+	}
+
+	return unRegressions;
+}
+
+// ----------------------------------------------------------------
+// Main
+// ----------------------------------------------------------------
+
+static void PrintUsage() {
+	fputs("usage: ConsoleUtilsBenchmark [--quick] [--output FILE] [--baseline FILE] [--threshold PERCENT] [--counts-only]\n"
+	      "  --quick        a tenth of the operations\n"
+	      "  --output       write the JSON report to FILE instead of stdout\n"
+	      "  --baseline     fail when a metric is worse than in FILE, a report written earlier\n"
+	      "  --threshold    how much worse, in percent (default 10)\n"
+	      "  --counts-only  compare allocations and console calls, not timings\n",
+	      stderr);
+}
+
+int main(int nArguments, char* pArguments[]) {
+	unsigned int unOperations = 20000;
+	char const* szOutput = nullptr;
+	char const* szBaseline = nullptr;
+	double fThreshold = 0.10;
+	bool bCountsOnly = false;
+
+	for (int i = 1; i < nArguments; ++i) {
+		char const* const szArgument = pArguments[i];
+		const bool bHaveValue = i + 1 < nArguments;
+
+		if (!strcmp(szArgument, "--quick")) {
+			unOperations = 2000;
+		} else if (!strcmp(szArgument, "--counts-only")) {
+			bCountsOnly = true;
+		} else if (!strcmp(szArgument, "--output") && bHaveValue) {
+			szOutput = pArguments[++i];
+		} else if (!strcmp(szArgument, "--baseline") && bHaveValue) {
+			szBaseline = pArguments[++i];
+		} else if (!strcmp(szArgument, "--threshold") && bHaveValue) {
+			fThreshold = atof(pArguments[++i]) / 100.0;
+		} else {
+			PrintUsage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::vector<BENCHMARK_RESULT> Results;
+	RunBenchmarks(unOperations, Results);
+
+	const std::string Report = FormatReport(Results);
+	if (szOutput) {
+		std::ofstream Output(szOutput);
+		Output << Report;
+		if (!Output) {
+			fprintf(stderr, "can't write %s\n", szOutput);
+			return EXIT_FAILURE;
+		}
+	} else {
+		fputs(Report.c_str(), stdout);
+	}
+
+	if (!szBaseline) {
+		return EXIT_SUCCESS;
+	}
+
+	std::ifstream Input(szBaseline);
+	std::ostringstream Text;
+	Text << Input.rdbuf();
+
+	std::vector<BENCHMARK_RESULT> Baseline;
+	if (!Input || !ParseReport(Text.str(), Baseline)) {
+		fprintf(stderr, "can't read the baseline %s\n", szBaseline);
+		return EXIT_FAILURE;
+	}
+
+	const unsigned int unRegressions = CompareReports(Results, Baseline, fThreshold, bCountsOnly);
+	if (unRegressions) {
+		fprintf(stderr, "%u regressions against %s\n", unRegressions, szBaseline);
+		return EXIT_FAILURE;
+	}
+
+	fprintf(stderr, "no regressions against %s\n", szBaseline);
+
+	return EXIT_SUCCESS;
+}
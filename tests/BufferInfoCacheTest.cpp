@@ -0,0 +1,182 @@
+// Default
+#include "Test.h"
+
+// C++
+#include <thread>
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// Buffer info cache
+// ----------------------------------------------------------------
+
+static void TestAvoided() {
+	EmulatedConsole Console(40, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+
+		const unsigned int unRounds = 1000;
+
+		Console.ResetCalls();
+		SCU.ResetAvoidedCalls();
+
+		// Same text color every round, only the first one reaches the console.
+		for (unsigned int i = 0; i < unRounds; ++i) {
+			COLOR_PAIR ColorPair;
+			TEST_CHECK(SCU.SetCursorColor(COLOR_PAIR(COLOR::COLOR_BLACK, COLOR::COLOR_CYAN)));
+			TEST_CHECK(SCU.GetCursorColor(&ColorPair));
+			TEST_CHECK(ColorPair.ColorForeground == COLOR::COLOR_CYAN);
+		}
+
+		const unsigned long long unQueries = Console.GetCalls(EMULATED_CALL::EMULATED_CALL_GET_CONSOLE_SCREEN_BUFFER_INFO);
+		const unsigned long long unUpdates = Console.GetCalls(EMULATED_CALL::EMULATED_CALL_SET_CONSOLE_TEXT_ATTRIBUTE);
+		printf("%u SetCursorColor/GetCursorColor rounds: %llu queries, %llu attribute updates, %llu calls avoided\n", unRounds, unQueries, unUpdates, SCU.GetAvoidedCalls());
+
+		TEST_CHECK(unQueries <= 1);
+		TEST_CHECK(unUpdates <= 1);
+		TEST_CHECK(SCU.GetAvoidedCalls() >= 2 * unRounds - 2);
+
+		// Writing drops the cached cursor position.
+		COORD Before;
+		TEST_CHECK(SCU.GetCursorPosition(&Before));
+		TEST_CHECK(SCU.WriteA("abc"));
+
+		COORD After;
+		TEST_CHECK(SCU.GetCursorPosition(&After));
+		TEST_CHECK(After.X == Before.X + 3);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// Without raw input nothing tells us about a resize. Window-relative calls query it anyway, the rest notice when the console clips them.
+static void TestResize() {
+	EmulatedConsole Console(40, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		const WORD unDefault = GetAttributes(Console, 0, 0);
+		const COLOR_PAIR ColorPair(COLOR::COLOR_BLUE, COLOR::COLOR_YELLOW);
+
+		for (unsigned int i = 0; i < 15; ++i) {
+			TEST_CHECK(SCU.WriteA("line\n"));
+		}
+
+		// The cache holds the 40x10 window over rows 6 to 15.
+		COORD Cursor;
+		TEST_CHECK(SCU.GetCursorPosition(&Cursor));
+		TEST_CHECK(Cursor.Y == 15);
+
+		// Narrower and shorter, the window follows the cursor to rows 10 to 15.
+		TEST_CHECK(Console.ResizeWindow(30, 6));
+
+		TEST_CHECK(SCU.SetColor(ColorPair, COLOR_SCOPE::COLOR_SCOPE_WINDOW));
+		TEST_CHECK(GetAttributes(Console, 0, 10) == MakeAttributes(ColorPair));
+		TEST_CHECK(GetAttributes(Console, 29, 15) == MakeAttributes(ColorPair));
+		TEST_CHECK(GetAttributes(Console, 0, 9) == unDefault);
+		TEST_CHECK(GetAttributes(Console, 0, 16) == unDefault);
+
+		TEST_CHECK(SCU.Clear(CLEAR_MODE::CLEAR_MODE_WINDOW));
+		TEST_CHECK(GetLine(Console, 9) == L"line");
+		TEST_CHECK(GetLine(Console, 10).empty());
+		TEST_CHECK(Console.GetCursorPosition(&Cursor));
+		TEST_CHECK((Cursor.X == 0) && (Cursor.Y == 10));
+
+		// Back to a wider buffer, then a clear to the end of the window from the middle of a line.
+		TEST_CHECK(SCU.WriteA("ab\ncd\nef"));
+		TEST_CHECK(SCU.GetCursorPosition(&Cursor));
+		TEST_CHECK(Console.ResizeWindow(40, 4));
+		TEST_CHECK(SCU.SetCursorPosition(COORD { 1, 11 }));
+		TEST_CHECK(SCU.Clear(CLEAR_MODE::CLEAR_MODE_TO_END));
+		TEST_CHECK(GetLine(Console, 10) == L"ab");
+		TEST_CHECK(GetLine(Console, 11) == L"c");
+		TEST_CHECK(GetLine(Console, 12).empty());
+
+		// Buffer-wide fills still use the cached size, cut short by the smaller buffer they fail once and the next one is right.
+		TEST_CHECK(SCU.GetCursorPosition(&Cursor));
+		TEST_CHECK(Console.ResizeWindow(20, 4));
+		TEST_CHECK(!SCU.SetColor(ColorPair, COLOR_SCOPE::COLOR_SCOPE_BUFFER));
+		TEST_CHECK(SCU.SetColor(ColorPair, COLOR_SCOPE::COLOR_SCOPE_BUFFER));
+		TEST_CHECK(GetAttributes(Console, 0, 0) == MakeAttributes(ColorPair));
+		TEST_CHECK(GetAttributes(Console, 19, 49) == MakeAttributes(ColorPair));
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// Threads share one console and only color changes take the output lock. The cache must stay consistent and end up matching the host.
+static void TestThreads() {
+	EmulatedConsole Console(80, 25, 2000);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+
+		const unsigned int unThreads = 4;
+		const unsigned int unRounds = 2000;
+
+		std::vector<std::thread> Threads;
+		for (unsigned int i = 0; i < unThreads; ++i) {
+			Threads.emplace_back([&SCU, i]() {
+				for (unsigned int j = 0; j < unRounds; ++j) {
+					COLOR_PAIR ColorPair;
+					COORD Position;
+					PALETTE Palette;
+
+					switch ((i + j) % 4) {
+						case 0: {
+							// The color to restore belongs to whoever holds the output lock.
+							std::lock_guard<std::mutex> Lock(SCU.GetOutputLock());
+							TEST_CHECK(SCU.SetCursorColor(COLOR_PAIR(static_cast<COLOR>(j % 16))));
+							break;
+						}
+						case 1:
+							TEST_CHECK(SCU.GetCursorColor(&ColorPair));
+							break;
+						case 2:
+							TEST_CHECK(SCU.GetCursorPosition(&Position));
+							TEST_CHECK(SCU.GetColorPalette(&Palette));
+							break;
+						default:
+							TEST_CHECK(SCU.WriteA((j % 40) ? "x" : "\n"));
+							break;
+					}
+				}
+			});
+		}
+
+		for (std::thread& Thread : Threads) {
+			Thread.join();
+		}
+
+		COORD Cached;
+		COORD Host;
+		TEST_CHECK(SCU.GetCursorPosition(&Cached));
+		TEST_CHECK(Console.GetCursorPosition(&Host));
+		TEST_CHECK((Cached.X == Host.X) && (Cached.Y == Host.Y));
+
+		WORD unAttributes = 0;
+		TEST_CHECK(SCU.GetAttributes(&unAttributes));
+		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+		TEST_CHECK(SCU.GetBufferInfo(&csbi));
+		TEST_CHECK(unAttributes == csbi.wAttributes);
+
+		printf("%u threads, %u calls each, %llu calls avoided\n", unThreads, unRounds, SCU.GetAvoidedCalls());
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+int main() {
+	TestAvoided();
+	TestResize();
+	TestThreads();
+
+	puts("BufferInfoCacheTest passed");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,200 @@
+// Default
+#include "Test.h"
+
+// C++
+#include <string>
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// Clear
+// ----------------------------------------------------------------
+
+// Numbered lines from the top of the buffer. Filling a buffer of nRows rows takes nRows - 1, more scrolls the whole buffer for every extra line.
+static void FillRows(SmartConsoleUtils& SCU, unsigned int unRows) {
+	COORD Home;
+	Home.X = 0;
+	Home.Y = 0;
+	TEST_CHECK(SCU.SetCursorPosition(Home));
+
+	std::string Text;
+	for (unsigned int i = 0; i < unRows; ++i) {
+		Text += "row " + std::to_string(i) + "\n";
+	}
+
+	TEST_CHECK(SCU.WriteA(Text.c_str()));
+}
+
+static void TestModes(bool bVirtualTerminal) {
+	const SHORT nRows = 300;
+
+	EmulatedConsole Console(120, 30, nRows);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		if (bVirtualTerminal) {
+			TEST_CHECK(SCU.EnableVirtualTerminal());
+		}
+
+		FillRows(SCU, nRows - 1);
+
+		COORD Cursor;
+		TEST_CHECK(Console.GetCursorPosition(&Cursor));
+		TEST_CHECK(Cursor.Y == nRows - 1);
+
+		// Line: the cursor row only.
+		TEST_CHECK(SCU.WriteA("partial"));
+		TEST_CHECK(SCU.Clear(CLEAR_MODE::CLEAR_MODE_LINE));
+		TEST_CHECK(GetLine(Console, nRows - 1).empty());
+		TEST_CHECK(GetLine(Console, nRows - 2) == L"row 298");
+
+		// To end: from the cursor down, the rows above stay.
+		COORD Position;
+		Position.X = 0;
+		Position.Y = nRows - 5;
+		TEST_CHECK(SCU.SetCursorPosition(Position));
+		TEST_CHECK(SCU.Clear(CLEAR_MODE::CLEAR_MODE_TO_END));
+		TEST_CHECK(GetLine(Console, nRows - 6) == L"row 294");
+		TEST_CHECK(GetLine(Console, nRows - 5).empty());
+		TEST_CHECK(GetLine(Console, nRows - 2).empty());
+
+		// Scrollback: the rows above the window go.
+		const std::wstring Top = GetLine(Console, nRows - 30);
+		TEST_CHECK(SCU.Clear(CLEAR_MODE::CLEAR_MODE_SCROLLBACK));
+		if (bVirtualTerminal) {
+			TEST_CHECK(GetLine(Console, 0).empty());
+			TEST_CHECK(GetLine(Console, nRows - 31).empty());
+			TEST_CHECK(GetLine(Console, nRows - 30) == Top);
+		} else {
+			// The window moves up to the top of the buffer.
+			TEST_CHECK(GetLine(Console, 0) == Top);
+			TEST_CHECK(GetLine(Console, 30).empty());
+			TEST_CHECK(GetLine(Console, nRows - 30).empty());
+		}
+
+		// Window: the visible rows, the cursor goes home.
+		FillRows(SCU, nRows - 1);
+		TEST_CHECK(SCU.Clear(CLEAR_MODE::CLEAR_MODE_WINDOW));
+		TEST_CHECK(GetLine(Console, nRows - 30).empty());
+		TEST_CHECK(GetLine(Console, nRows - 1).empty());
+		TEST_CHECK(GetLine(Console, nRows - 31) == L"row 269");
+		TEST_CHECK(Console.GetCursorPosition(&Cursor));
+		TEST_CHECK((Cursor.X == 0) && (Cursor.Y == nRows - 30));
+
+		// Flush(true) still empties the whole buffer.
+		FillRows(SCU, nRows - 1);
+		TEST_CHECK(SCU.Flush(true));
+		TEST_CHECK(GetLine(Console, 0).empty());
+		TEST_CHECK(GetLine(Console, 29).empty());
+		TEST_CHECK(GetLine(Console, nRows - 1).empty());
+		TEST_CHECK(Console.GetCursorPosition(&Cursor));
+		TEST_CHECK((Cursor.X == 0) && (Cursor.Y == 0));
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// pCells receives the cells touched per call, if given.
+template <typename Operation>
+static double GetMedian(EmulatedConsole& Console, unsigned int unSamples, unsigned long long* pCells, Operation&& Function) {
+	Console.ResetCalls();
+
+	std::vector<double> Samples;
+	for (unsigned int i = 0; i < unSamples; ++i) {
+		const double fStart = GetSeconds();
+		Function();
+		Samples.push_back(GetSeconds() - fStart);
+	}
+
+	if (pCells) {
+		*pCells = Console.GetTouchedCells() / unSamples;
+	}
+
+	return GetPercentile(Samples, 50);
+}
+
+// What clearing cost before the modes, blanking every cell of the buffer.
+static void ClearWholeBuffer() {
+	const CONSOLE_API* pApi = GetConsoleApi();
+	HANDLE hOut = pApi->GetStdHandle(STD_OUTPUT_HANDLE);
+
+	CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+	memset(&csbi, 0, sizeof(csbi));
+	csbi.cbSize = sizeof(csbi);
+	TEST_CHECK(pApi->GetConsoleScreenBufferInfoEx(hOut, &csbi));
+
+	COORD Start;
+	Start.X = 0;
+	Start.Y = 0;
+
+	const DWORD unLength = static_cast<DWORD>(csbi.dwSize.X) * static_cast<DWORD>(csbi.dwSize.Y);
+	DWORD unWritten = 0;
+	TEST_CHECK(pApi->FillConsoleOutputCharacterW(hOut, L' ', unLength, Start, &unWritten));
+	TEST_CHECK(pApi->FillConsoleOutputAttribute(hOut, csbi.wAttributes, unLength, Start, &unWritten));
+}
+
+// Full buffers from 300 to 32000 rows. Window, to end and line clears touch the window at most, so they may not grow with the buffer.
+static void TestScaling(bool bVirtualTerminal) {
+	static const SHORT Heights[] = { 300, 2000, 8000, 32000 };
+
+	unsigned long long Window[4] = {};
+	unsigned long long ToEnd[4] = {};
+	unsigned long long Line[4] = {};
+	unsigned long long Whole[4] = {};
+
+	for (unsigned int i = 0; i < 4; ++i) {
+		EmulatedConsole Console(120, 30, Heights[i]);
+		TEST_CHECK(Console.Install());
+
+		{
+			SmartConsoleUtils SCU;
+			if (bVirtualTerminal) {
+				TEST_CHECK(SCU.EnableVirtualTerminal());
+			}
+
+			FillRows(SCU, static_cast<unsigned int>(Heights[i]) - 1);
+
+			const double fWindow = GetMedian(Console, 100, &Window[i], [&SCU]() { TEST_CHECK(SCU.Clear(CLEAR_MODE::CLEAR_MODE_WINDOW)); });
+			const double fToEnd = GetMedian(Console, 100, &ToEnd[i], [&SCU]() { TEST_CHECK(SCU.Clear(CLEAR_MODE::CLEAR_MODE_TO_END)); });
+			const double fLine = GetMedian(Console, 100, &Line[i], [&SCU]() { TEST_CHECK(SCU.Clear(CLEAR_MODE::CLEAR_MODE_LINE)); });
+			const double fWhole = GetMedian(Console, 20, &Whole[i], ClearWholeBuffer);
+
+			// Scrollback and buffer clears depend on what was written, so each sample starts from a full buffer.
+			FillRows(SCU, static_cast<unsigned int>(Heights[i]) - 1);
+			const double fScrollback = GetMedian(Console, 1, nullptr, [&SCU]() { TEST_CHECK(SCU.Clear(CLEAR_MODE::CLEAR_MODE_SCROLLBACK)); });
+			FillRows(SCU, static_cast<unsigned int>(Heights[i]) - 1);
+			const double fFlush = GetMedian(Console, 1, nullptr, [&SCU]() { TEST_CHECK(SCU.Flush(true)); });
+
+			printf("%s %5d rows: window %6.2f us (%llu cells), to end %6.2f us (%llu cells), line %6.2f us (%llu cells), scrollback %8.2f us, flush(true) %8.2f us, whole buffer %8.2f us (%llu cells)\n", bVirtualTerminal ? "vt " : "api", Heights[i], fWindow * 1e6, Window[i], fToEnd * 1e6, ToEnd[i], fLine * 1e6, Line[i], fScrollback * 1e6, fFlush * 1e6, fWhole * 1e6, Whole[i]);
+		}
+
+		TEST_CHECK(Console.Uninstall());
+	}
+
+	// The same cells at a hundred times the rows, each one blanked once or, through the API, once for the text and once for the attributes.
+	const unsigned long long unPasses = bVirtualTerminal ? 1 : 2;
+	TEST_CHECK(Window[0] == unPasses * 120 * 30);
+	TEST_CHECK(ToEnd[0] <= Window[0]);
+	TEST_CHECK(Line[0] == unPasses * 120);
+	for (unsigned int i = 1; i < 4; ++i) {
+		TEST_CHECK(Window[i] == Window[0]);
+		TEST_CHECK(ToEnd[i] == ToEnd[0]);
+		TEST_CHECK(Line[i] == Line[0]);
+	}
+
+	// While blanking the whole buffer touches all of it.
+	TEST_CHECK(Whole[3] == 2ull * 120 * 32000);
+}
+
+int main() {
+	TestModes(false);
+	TestModes(true);
+	TestScaling(false);
+	TestScaling(true);
+
+	puts("ClearTest passed");
+
+	return EXIT_SUCCESS;
+}
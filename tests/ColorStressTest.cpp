@@ -0,0 +1,120 @@
+// Default
+#include "Test.h"
+
+// C++
+#include <string>
+#include <thread>
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// Color stress
+// ----------------------------------------------------------------
+
+static const unsigned int g_unThreads = 32;
+static const unsigned int g_unLines = 300;
+
+static COLOR GetFirstColor(unsigned int unThread) {
+	return static_cast<COLOR>(1 + unThread % 15);
+}
+
+static COLOR GetSecondColor(unsigned int unThread) {
+	return static_cast<COLOR>(1 + (unThread + 7) % 15);
+}
+
+// Every third line is two spans through a SpanWriter, the others one clrprintf.
+static void PrintLines(unsigned int unThread) {
+	SpanWriter Writer;
+
+	for (unsigned int i = 0; i < g_unLines; ++i) {
+		if (i % 3) {
+			TEST_CHECK(clrprintf(GetFirstColor(unThread), "t%02u %05u\n", unThread, i) == 10);
+			continue;
+		}
+
+		char szThread[8];
+		char szLine[8];
+		snprintf(szThread, sizeof(szThread), "t%02u ", unThread);
+		snprintf(szLine, sizeof(szLine), "%05u\n", i);
+
+		TEST_CHECK(Writer.AddA(GetFirstColor(unThread), szThread));
+		TEST_CHECK(Writer.AddA(GetSecondColor(unThread), szLine));
+		TEST_CHECK(Writer.Commit());
+	}
+}
+
+// Each row has to be one whole line, in its thread's colors, and each thread's lines in order.
+static void CheckRows(EmulatedConsole& Console, WORD unDefault) {
+	unsigned int unNext[g_unThreads] = {};
+
+	for (SHORT nY = 0; nY < static_cast<SHORT>(g_unThreads * g_unLines); ++nY) {
+		const std::wstring Line = GetLine(Console, nY);
+		TEST_CHECK(Line.size() == 9);
+		TEST_CHECK(Line[0] == L't');
+
+		const unsigned int unThread = static_cast<unsigned int>(std::stoul(Line.substr(1, 2)));
+		TEST_CHECK(unThread < g_unThreads);
+
+		const unsigned int unLine = static_cast<unsigned int>(std::stoul(Line.substr(4)));
+		TEST_CHECK(unLine == unNext[unThread]);
+		++unNext[unThread];
+
+		const WORD unSecond = static_cast<WORD>((unLine % 3) ? GetFirstColor(unThread) : GetSecondColor(unThread));
+		for (SHORT nX = 0; nX < 9; ++nX) {
+			TEST_CHECK((GetAttributes(Console, nX, nY) & 0x0F) == ((nX < 4) ? static_cast<WORD>(GetFirstColor(unThread)) : unSecond));
+		}
+
+		// Past the text the row keeps the colors the console had.
+		TEST_CHECK(GetAttributes(Console, 9, nY) == unDefault);
+	}
+}
+
+static void TestStress(bool bVirtualTerminal) {
+	EmulatedConsole Console(40, 10, static_cast<SHORT>(g_unThreads * g_unLines + 1));
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		BindConsole(&SCU);
+
+		if (bVirtualTerminal) {
+			TEST_CHECK(SCU.EnableVirtualTerminal());
+		}
+
+		const WORD unDefault = GetAttributes(Console, 0, 0);
+
+		std::vector<std::thread> Threads;
+		const double fStart = GetSeconds();
+		for (unsigned int i = 0; i < g_unThreads; ++i) {
+			Threads.emplace_back(PrintLines, i);
+		}
+
+		for (std::thread& Thread : Threads) {
+			Thread.join();
+		}
+		const double fElapsed = GetSeconds() - fStart;
+
+		printf("%s: %u threads, %u lines, %.0f lines/s\n", bVirtualTerminal ? "virtual terminal" : "attributes", g_unThreads, g_unThreads * g_unLines, g_unThreads * g_unLines / fElapsed);
+
+		CheckRows(Console, unDefault);
+
+		// Every restore put back the same colors.
+		WORD unAttributes = 0;
+		TEST_CHECK(SCU.GetAttributes(&unAttributes));
+		TEST_CHECK(unAttributes == unDefault);
+
+		UnbindConsole(&SCU);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+int main() {
+	TestStress(false);
+	TestStress(true);
+
+	puts("ColorStressTest passed");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,217 @@
+// Default
+#include "Test.h"
+
+// C++
+#include <atomic>
+#include <thread>
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// Console context
+// ----------------------------------------------------------------
+
+// Has to run first, while the process-wide console doesn't exist yet.
+static void TestRetire() {
+	// Without a console the default has no window.
+	SmartConsoleUtils* pWindowless = GetConsole();
+	TEST_CHECK(pWindowless);
+	TEST_CHECK(!pWindowless->GetWindow());
+	TEST_CHECK(GetConsole() == pWindowless);
+
+	EmulatedConsole Console(40, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	const HWND hWindow = GetConsoleApi()->GetConsoleWindow();
+	const LONG nStyle = GetConsoleApi()->GetWindowLongW(hWindow, GWL_STYLE);
+	const LONG nStyleEx = GetConsoleApi()->GetWindowLongW(hWindow, GWL_EXSTYLE);
+
+	// Once a console shows up the default is replaced, but the old one stays valid for whoever still holds it.
+	SmartConsoleUtils* pConsole = GetConsole();
+	TEST_CHECK(pConsole != pWindowless);
+	TEST_CHECK(pConsole->GetWindow());
+	TEST_CHECK(!pWindowless->GetWindow());
+	TEST_CHECK(GetConsole() == pConsole);
+
+	// The window keeps its styles while the default lives on.
+	TEST_CHECK(clrprintf(COLOR::COLOR_GREEN, "x\n") == 2);
+	TEST_CHECK(GetConsoleApi()->GetWindowLongW(hWindow, GWL_STYLE) == nStyle);
+	TEST_CHECK(GetConsoleApi()->GetWindowLongW(hWindow, GWL_EXSTYLE) == nStyleEx);
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+static void TestBind() {
+	EmulatedConsole Console(40, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		TEST_CHECK(BindConsole(&SCU));
+		TEST_CHECK(GetConsole() == &SCU);
+
+		{
+			ConsoleReference Reference;
+			TEST_CHECK(Reference.Get() == &SCU);
+
+			// References of the unbinding thread itself don't hold it up.
+			TEST_CHECK(UnbindConsole(&SCU));
+			TEST_CHECK(GetConsole() != &SCU);
+		}
+
+		TEST_CHECK(!UnbindConsole(&SCU));
+
+		// Destruction unbinds.
+		TEST_CHECK(BindConsole(&SCU));
+	}
+
+	TEST_CHECK(!UnbindConsole());
+	TEST_CHECK(Console.Uninstall());
+}
+
+// Consoles are bound, unbound and destroyed while other threads print through them.
+static void TestUnbindUnderLoad() {
+	EmulatedConsole Console(40, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	{
+		std::atomic<bool> bStop = false;
+		std::atomic<unsigned long long> unPrinted = 0;
+
+		std::vector<std::thread> Threads;
+		for (unsigned int i = 0; i < 4; ++i) {
+			Threads.emplace_back([&bStop, &unPrinted]() {
+				while (!bStop.load()) {
+					TEST_CHECK(clrprintf(COLOR::COLOR_GREEN, "x\n") == 2);
+					++unPrinted;
+				}
+			});
+		}
+
+		const unsigned int unRounds = 200;
+		for (unsigned int i = 0; i < unRounds; ++i) {
+			std::unique_ptr<SmartConsoleUtils> pSCU(new SmartConsoleUtils());
+			TEST_CHECK(BindConsole(pSCU.get()));
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+			TEST_CHECK(UnbindConsole(pSCU.get()));
+		}
+
+		bStop = true;
+		for (std::thread& Thread : Threads) {
+			Thread.join();
+		}
+
+		printf("%u consoles bound and destroyed under %llu prints\n", unRounds, unPrinted.load());
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// A print while clrscanf waits for input leaves the color clrscanf has to go back to alone.
+static void TestScanColor() {
+	EmulatedConsole Console(40, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		TEST_CHECK(BindConsole(&SCU));
+
+		COLOR_PAIR Original;
+		TEST_CHECK(SCU.GetCursorColor(&Original));
+
+		// Slow calls keep the read going long enough for the print to start meanwhile.
+		TEST_CHECK(Console.PushInputA("42\n"));
+		Console.ResetCalls();
+		Console.SetCallCost(50000);
+
+		int nValue = 0;
+		std::thread Scanner([&nValue]() {
+			TEST_CHECK(clrscanf(COLOR::COLOR_RED, "%d", &nValue) == 1);
+		});
+
+		while (!Console.GetCalls(EMULATED_CALL::EMULATED_CALL_READ_CONSOLE)) {
+			std::this_thread::yield();
+		}
+
+		TEST_CHECK(clrprintf(COLOR::COLOR_GREEN, "x\n") == 2);
+
+		Scanner.join();
+		Console.SetCallCost(0);
+
+		TEST_CHECK(nValue == 42);
+
+		COLOR_PAIR ColorPair;
+		TEST_CHECK(SCU.GetCursorColor(&ColorPair));
+		TEST_CHECK((ColorPair.ColorBackground == Original.ColorBackground) && (ColorPair.ColorForeground == Original.ColorForeground));
+		TEST_CHECK(UnbindConsole(&SCU));
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// What the print family did before the shared context, a fresh console per call.
+static int PrintWithOwnConsole(COLOR_PAIR ColorPair, char const* const szText) {
+	SmartConsoleUtils SCU;
+
+	std::lock_guard<std::mutex> Lock(SCU.GetOutputLock());
+
+	if (!SCU.SetCursorColor(ColorPair)) {
+		return -1;
+	}
+
+	if (!SCU.WriteA(szText)) {
+		SCU.RestoreCursorColor(true);
+		return -1;
+	}
+
+	if (!SCU.RestoreCursorColor(true)) {
+		return -1;
+	}
+
+	return static_cast<int>(strlen(szText));
+}
+
+static void TestThroughput() {
+	EmulatedConsole Console(40, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	{
+		const unsigned int unCalls = 20000;
+
+		Console.ResetCalls();
+		double fStart = GetSeconds();
+		for (unsigned int i = 0; i < unCalls; ++i) {
+			TEST_CHECK(PrintWithOwnConsole(COLOR::COLOR_CYAN, "line\n") == 5);
+		}
+		const double fOwnElapsed = GetSeconds() - fStart;
+		const double fOwnCalls = static_cast<double>(Console.GetTotalCalls()) / unCalls;
+
+		Console.ResetCalls();
+		fStart = GetSeconds();
+		for (unsigned int i = 0; i < unCalls; ++i) {
+			TEST_CHECK(clrprintf(COLOR::COLOR_CYAN, "line\n") == 5);
+		}
+		const double fSharedElapsed = GetSeconds() - fStart;
+		const double fSharedCalls = static_cast<double>(Console.GetTotalCalls()) / unCalls;
+
+		printf("console per call: %.0f calls/s, %.1f console calls each\n", unCalls / fOwnElapsed, fOwnCalls);
+		printf("shared console:   %.0f calls/s, %.1f console calls each\n", unCalls / fSharedElapsed, fSharedCalls);
+
+		TEST_CHECK(fSharedCalls < fOwnCalls);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+int main() {
+	TestRetire();
+	TestBind();
+	TestUnbindUnderLoad();
+	TestScanColor();
+	TestThroughput();
+
+	puts("ConsoleContextTest passed");
+
+	return EXIT_SUCCESS;
+}
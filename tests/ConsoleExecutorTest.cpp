@@ -0,0 +1,275 @@
+// Default
+#include "Test.h"
+
+// C++
+#include <atomic>
+#include <thread>
+
+// POSIX
+#include <sys/resource.h>
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// ConsoleExecutor
+// ----------------------------------------------------------------
+
+static INPUT_RECORD MakeKey(wchar_t unChar) {
+	INPUT_RECORD Record = {};
+	Record.EventType = KEY_EVENT;
+	Record.Event.KeyEvent.bKeyDown = TRUE;
+	Record.Event.KeyEvent.wRepeatCount = 1;
+	Record.Event.KeyEvent.uChar.UnicodeChar = unChar;
+	return Record;
+}
+
+// CPU time of the calling thread, the emulated host spins on its own threads.
+static double GetThreadSeconds() {
+	rusage Usage;
+	getrusage(RUSAGE_THREAD, &Usage);
+	return static_cast<double>(Usage.ru_utime.tv_sec + Usage.ru_stime.tv_sec) + static_cast<double>(Usage.ru_utime.tv_usec + Usage.ru_stime.tv_usec) / 1e6;
+}
+
+static ConsoleTask<> Writer(ConsoleExecutor& Executor, EmulatedConsole& Console, std::string& Log) {
+	SpanWriter Writer;
+	Writer.AddA(COLOR::COLOR_RED, "written\n");
+
+	Log += 'a';
+	TEST_CHECK(co_await Executor.WriteAsync(Writer));
+	Log += 'A';
+
+	// Resumed only once the text is out.
+	TEST_CHECK(GetLine(Console, 0) == L"written");
+	TEST_CHECK((GetAttributes(Console, 0, 0) & 0x0F) == static_cast<WORD>(COLOR::COLOR_RED));
+}
+
+static ConsoleTask<> Other(std::string& Log) {
+	Log += 'b';
+	co_return;
+}
+
+static void TestSuspend() {
+	EmulatedConsole Console(40, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		Console.SetCallCost(2000);
+
+		std::string Log;
+		ConsoleExecutor Executor(&SCU);
+		TEST_CHECK(Executor.Spawn(Writer(Executor, Console, Log)));
+		TEST_CHECK(Executor.Spawn(Other(Log)));
+		TEST_CHECK(Executor.Run());
+
+		// The writer suspended and the other task ran while the sink wrote.
+		TEST_CHECK(Log == "abA");
+
+		// The sink the executor started is gone with Run().
+		TEST_CHECK(!SCU.GetAsyncSink());
+
+		Console.SetCallCost(0);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+static ConsoleTask<> WriteLatency(ConsoleExecutor& Executor, std::vector<double>& Samples, unsigned int unWrites) {
+	for (unsigned int i = 0; i < unWrites; ++i) {
+		SpanWriter Writer;
+		Writer.AddA(COLOR::COLOR_GREEN, "line\n");
+
+		const double fStart = GetSeconds();
+		TEST_CHECK(co_await Executor.WriteAsync(Writer));
+		Samples.push_back(GetSeconds() - fStart);
+	}
+}
+
+static std::atomic<double> g_fPushed = 0.0;
+
+static ConsoleTask<> KeyLatency(ConsoleExecutor& Executor, std::vector<double>& Samples, unsigned int unKeys) {
+	for (unsigned int i = 0; i < unKeys; ++i) {
+		INPUT_EVENT Event;
+		TEST_CHECK(co_await Executor.NextKey(&Event));
+		Samples.push_back(GetSeconds() - g_fPushed.load());
+		TEST_CHECK(Event.Char == L'z');
+	}
+}
+
+static void TestLatency() {
+	EmulatedConsole Console(40, 10, 2000);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+
+		// Time from queuing a write to the task running again.
+		const unsigned int unWrites = 500;
+
+		std::vector<double> Writes;
+		ConsoleExecutor Executor(&SCU);
+		TEST_CHECK(Executor.Spawn(WriteLatency(Executor, Writes, unWrites)));
+		TEST_CHECK(Executor.Run());
+		TEST_CHECK(GetLine(Console, unWrites - 1) == L"line");
+
+		// Time from a key arriving to the task waiting on it running.
+		const unsigned int unKeys = 500;
+
+		std::vector<double> Keys;
+		TEST_CHECK(Executor.Spawn(KeyLatency(Executor, Keys, unKeys)));
+		std::thread Feeder([&Console]() {
+			for (unsigned int i = 0; i < unKeys; ++i) {
+				std::this_thread::sleep_for(std::chrono::microseconds(500));
+				const INPUT_RECORD Record = MakeKey(L'z');
+				g_fPushed = GetSeconds();
+				Console.PushInputRecords(&Record, 1);
+			}
+		});
+
+		TEST_CHECK(Executor.Run());
+		Feeder.join();
+
+		const double fWriteMedian = GetPercentile(Writes, 50);
+		const double fKeyMedian = GetPercentile(Keys, 50);
+		printf("write resume p50 %.1f us p99 %.1f us, key wakeup p50 %.1f us p99 %.1f us\n", fWriteMedian * 1e6, GetPercentile(Writes, 99) * 1e6, fKeyMedian * 1e6, GetPercentile(Keys, 99) * 1e6);
+
+		// Generous bounds, both sides are woken, not polled.
+		TEST_CHECK(fWriteMedian < 0.005);
+		TEST_CHECK(fKeyMedian < 0.005);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+static ConsoleTask<> WaitKey(ConsoleExecutor& Executor) {
+	INPUT_EVENT Event;
+	TEST_CHECK(co_await Executor.NextKey(&Event));
+}
+
+static ConsoleTask<> SharedWrites(ConsoleExecutor& Executor, EmulatedConsole& Console, unsigned int unWrites) {
+	wchar_t szLine[32];
+	for (unsigned int i = 0; i < unWrites; ++i) {
+		swprintf(szLine, 32, L"task %u", i);
+
+		SpanWriter Writer;
+		Writer.AddW(COLOR::COLOR_GREEN, szLine);
+		Writer.AddW(COLOR::COLOR_GREEN, L"\n");
+		TEST_CHECK(co_await Executor.WriteAsync(Writer));
+
+		// Resumed with the task's own text out, whatever the other producers still hold in the ring.
+		COORD Cursor;
+		TEST_CHECK(Console.GetCursorPosition(&Cursor));
+
+		bool bFound = false;
+		for (SHORT nY = Cursor.Y; (nY >= 0) && !bFound; --nY) {
+			bFound = GetLine(Console, nY) == szLine;
+		}
+		TEST_CHECK(bFound);
+	}
+}
+
+// Other threads share the sink with the executor.
+static void TestSharedSink() {
+	EmulatedConsole Console(40, 10, 4000);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		TEST_CHECK(SCU.EnableAsync(16));
+		AsyncSink* pSink = SCU.GetAsyncSink();
+
+		std::atomic<bool> bStop(false);
+		std::vector<std::thread> Threads;
+		for (unsigned int i = 0; i < 3; ++i) {
+			Threads.emplace_back([&]() {
+				for (unsigned int j = 0; (j < 1000) && !bStop.load(); ++j) {
+					TEST_CHECK(pSink->PushA(COLOR::COLOR_GRAY, "noise\n", 6));
+				}
+			});
+		}
+
+		ConsoleExecutor Executor(&SCU);
+		TEST_CHECK(Executor.Spawn(SharedWrites(Executor, Console, 300)));
+		TEST_CHECK(Executor.Run());
+
+		bStop = true;
+		for (std::thread& Thread : Threads) {
+			Thread.join();
+		}
+
+		TEST_CHECK(SCU.DisableAsync());
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+static ConsoleTask<> WaitSleep(ConsoleExecutor& Executor) {
+	co_await Executor.Sleep(500);
+}
+
+static ConsoleTask<> WaitWrite(ConsoleExecutor& Executor) {
+	SpanWriter Writer;
+	// Wide text, converting narrow text asks the host for the code page.
+	Writer.AddW(COLOR::COLOR_GREEN, L"slow\n");
+	TEST_CHECK(co_await Executor.WriteAsync(Writer));
+}
+
+// The executor thread may not spin while it waits on input, a timer or the sink.
+static void TestIdle() {
+	EmulatedConsole Console(40, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		ConsoleExecutor Executor(&SCU);
+
+		TEST_CHECK(Executor.Spawn(WaitKey(Executor)));
+		TEST_CHECK(Executor.Spawn(WaitSleep(Executor)));
+		std::thread Feeder([&Console]() {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+			const INPUT_RECORD Record = MakeKey(L'z');
+			Console.PushInputRecords(&Record, 1);
+		});
+
+		double fWall = GetSeconds();
+		double fCpu = GetThreadSeconds();
+		TEST_CHECK(Executor.Run());
+		fCpu = GetThreadSeconds() - fCpu;
+		fWall = GetSeconds() - fWall;
+		Feeder.join();
+
+		printf("waiting on input and a timer: %.0f ms wall, %.2f ms cpu\n", fWall * 1e3, fCpu * 1e3);
+		TEST_CHECK(fWall >= 0.9);
+		TEST_CHECK(fCpu < 0.05 * fWall);
+
+		// A host slow enough that the write takes a while. The sink runs already, so the executor thread makes no console calls of its own.
+		TEST_CHECK(SCU.EnableAsync());
+		Console.SetCallCost(50000);
+		TEST_CHECK(Executor.Spawn(WaitWrite(Executor)));
+
+		fWall = GetSeconds();
+		fCpu = GetThreadSeconds();
+		TEST_CHECK(Executor.Run());
+		fCpu = GetThreadSeconds() - fCpu;
+		fWall = GetSeconds() - fWall;
+		Console.SetCallCost(0);
+		TEST_CHECK(SCU.DisableAsync());
+
+		printf("waiting on the sink: %.0f ms wall, %.2f ms cpu\n", fWall * 1e3, fCpu * 1e3);
+		TEST_CHECK(fCpu < 0.05 * fWall);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+int main() {
+	TestSuspend();
+	TestLatency();
+	TestSharedSink();
+	TestIdle();
+
+	puts("ConsoleExecutorTest passed");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,145 @@
+// Default
+#include "Test.h"
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// EmulatedConsole
+// ----------------------------------------------------------------
+
+static void TestInstall() {
+	EmulatedConsole Console(40, 10, 50);
+
+	TEST_CHECK(!GetConsoleApi()->bEmulated);
+	TEST_CHECK(Console.Install());
+	TEST_CHECK(Console.IsInstalled());
+	TEST_CHECK(GetConsoleApi()->bEmulated);
+
+	// A second host can't take over while one is installed.
+	EmulatedConsole Other(40, 10, 50);
+	TEST_CHECK(!Other.Install());
+
+	TEST_CHECK(Console.Uninstall());
+	TEST_CHECK(!GetConsoleApi()->bEmulated);
+}
+
+static void TestText() {
+	EmulatedConsole Console(10, 4, 6);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		TEST_CHECK(SCU.GetWindow());
+
+		TEST_CHECK(SCU.WriteA("Hello\n"));
+		TEST_CHECK(GetLine(Console, 0) == L"Hello");
+
+		// Wrapping, carriage return, backspace and tabs.
+		TEST_CHECK(SCU.WriteA("0123456789AB\n"));
+		TEST_CHECK(GetLine(Console, 1) == L"0123456789");
+		TEST_CHECK(GetLine(Console, 2) == L"AB");
+		TEST_CHECK(SCU.WriteA("abc\rX\bY\tZ\n"));
+		TEST_CHECK(GetLine(Console, 3) == L"Ybc     Z");
+
+		// The buffer scrolls once the cursor passes its last row.
+		TEST_CHECK(SCU.WriteA("4\n5\n"));
+		TEST_CHECK(GetLine(Console, 0) == L"0123456789");
+		TEST_CHECK(GetLine(Console, 4) == L"5");
+
+		COORD Cursor;
+		TEST_CHECK(Console.GetCursorPosition(&Cursor));
+		TEST_CHECK((Cursor.X == 0) && (Cursor.Y == 5));
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+static void TestColors() {
+	EmulatedConsole Console(40, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		BindConsole(&SCU);
+
+		TEST_CHECK(clrprintf(COLOR::COLOR_RED, "red %d\n", 5) > 0);
+		TEST_CHECK(GetLine(Console, 0) == L"red 5");
+		TEST_CHECK((GetAttributes(Console, 0, 0) & 0x0F) == static_cast<WORD>(COLOR::COLOR_RED));
+
+		// SGR sequences are applied with virtual terminal processing on.
+		TEST_CHECK(SCU.EnableVirtualTerminal());
+		TEST_CHECK(clrprintf(COLOR_PAIR(COLOR::COLOR_GREEN, COLOR::COLOR_BLUE), "vt\n") > 0);
+		TEST_CHECK(GetLine(Console, 1) == L"vt");
+		TEST_CHECK(GetAttributes(Console, 0, 1) == MakeAttributes(COLOR_PAIR(COLOR::COLOR_GREEN, COLOR::COLOR_BLUE)));
+
+		// Cursor moves and erases.
+		TEST_CHECK(SCU.WriteA("abcdef\x1B[3D\x1B[K!\n"));
+		TEST_CHECK(GetLine(Console, 2) == L"abc!");
+		TEST_CHECK(SCU.DisableVirtualTerminal());
+
+		UnbindConsole(&SCU);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+static void TestInput() {
+	EmulatedConsole Console(40, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+
+		TEST_CHECK(Console.PushInputA("typed\n"));
+
+		char szBuffer[32];
+		TEST_CHECK(SCU.ReadA(szBuffer, sizeof(szBuffer)));
+		TEST_CHECK(!strcmp(szBuffer, "typed\n"));
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+static void TestCalls() {
+	EmulatedConsole Console(40, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+
+		Console.ResetCalls();
+		TEST_CHECK(SCU.WriteA("x"));
+		TEST_CHECK(Console.GetCalls(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE) == 1);
+		TEST_CHECK(Console.GetTotalCalls() >= 1);
+
+		// Every call costs at least the simulated time.
+		const unsigned int unWrites = 20;
+		Console.SetCallCost(200);
+
+		const double fStart = GetSeconds();
+		for (unsigned int i = 0; i < unWrites; ++i) {
+			TEST_CHECK(SCU.WriteA("x"));
+		}
+		const double fElapsed = GetSeconds() - fStart;
+
+		Console.SetCallCost(0);
+
+		TEST_CHECK(fElapsed >= unWrites * 200e-6);
+		printf("%u writes at 200 us per call: %.0f us\n", unWrites, fElapsed * 1e6);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+int main() {
+	TestInstall();
+	TestText();
+	TestColors();
+	TestInput();
+	TestCalls();
+
+	puts("EmulatedConsoleTest passed");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,200 @@
+// Default
+#include "Test.h"
+
+// C++
+#include <string>
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// Extended colors
+// ----------------------------------------------------------------
+
+// The emulated console's palette.
+static const COLORREF g_ColorTable[16] = {
+	RGB(12, 12, 12), RGB(0, 55, 218), RGB(19, 161, 14), RGB(58, 150, 221),
+	RGB(197, 15, 31), RGB(136, 23, 152), RGB(193, 156, 0), RGB(204, 204, 204),
+	RGB(118, 118, 118), RGB(59, 120, 255), RGB(22, 198, 12), RGB(97, 214, 214),
+	RGB(231, 72, 86), RGB(180, 0, 158), RGB(249, 241, 165), RGB(242, 242, 242)
+};
+
+static std::string GetSequence(const EXTENDED_COLOR_PAIR& ColorPair) {
+	char szSequence[MAX_EXTENDED_COLOR_SEQUENCE_LENGTH + 1];
+	const unsigned int unLength = GetExtendedColorSequence(ColorPair, szSequence);
+	TEST_CHECK(unLength <= MAX_EXTENDED_COLOR_SEQUENCE_LENGTH);
+	TEST_CHECK(strlen(szSequence) == unLength);
+	return szSequence;
+}
+
+static void TestQuantizer() {
+	ColorQuantizer Quantizer;
+	TEST_CHECK(!Quantizer.IsBuilt());
+	TEST_CHECK(Quantizer.Quantize(EXTENDED_COLOR(0, 0, 0)) == COLOR::COLOR_UNKNOWN);
+	TEST_CHECK(Quantizer.Build(g_ColorTable));
+	TEST_CHECK(Quantizer.IsBuilt());
+
+	// Palette entries map to themselves, the rest to their nearest entry.
+	for (unsigned char i = 0; i < 16; ++i) {
+		TEST_CHECK(Quantizer.Quantize(EXTENDED_COLOR(GetRValue(g_ColorTable[i]), GetGValue(g_ColorTable[i]), GetBValue(g_ColorTable[i]))) == static_cast<COLOR>(i));
+	}
+
+	TEST_CHECK(Quantizer.Quantize(EXTENDED_COLOR(0, 0, 0)) == COLOR::COLOR_BLACK);
+	TEST_CHECK(Quantizer.Quantize(EXTENDED_COLOR(255, 255, 255)) == COLOR::COLOR_WHITE);
+	TEST_CHECK(Quantizer.Quantize(EXTENDED_COLOR(255, 0, 0)) == COLOR::COLOR_DARK_RED);
+	TEST_CHECK(Quantizer.Quantize(EXTENDED_COLOR(255, 255, 0)) == COLOR::COLOR_DARK_YELLOW);
+	TEST_CHECK(Quantizer.Quantize(EXTENDED_COLOR(0, 0, 128)) == COLOR::COLOR_DARK_BLUE);
+	TEST_CHECK(Quantizer.Quantize(EXTENDED_COLOR(128, 128, 128)) == COLOR::COLOR_GRAY);
+
+	// Legacy colors pass through, indices below 16 are in SGR order and the rest go through their RGB value.
+	TEST_CHECK(Quantizer.Quantize(EXTENDED_COLOR(COLOR::COLOR_MAGENTA)) == COLOR::COLOR_MAGENTA);
+	TEST_CHECK(Quantizer.Quantize(EXTENDED_COLOR::FromIndex(1)) == COLOR::COLOR_DARK_RED);
+	TEST_CHECK(Quantizer.Quantize(EXTENDED_COLOR::FromIndex(12)) == COLOR::COLOR_BLUE);
+	TEST_CHECK(Quantizer.Quantize(EXTENDED_COLOR::FromIndex(196)) == COLOR::COLOR_DARK_RED);
+	TEST_CHECK(Quantizer.Quantize(EXTENDED_COLOR::FromRGB(0x3B78FF)) == COLOR::COLOR_BLUE);
+	TEST_CHECK(Quantizer.Quantize(EXTENDED_COLOR()) == COLOR::COLOR_UNKNOWN);
+
+	// Unknown halves of a pair keep the default attributes.
+	const EXTENDED_COLOR_PAIR Pairs[] = { EXTENDED_COLOR_PAIR(EXTENDED_COLOR::FromRGB(0x13A10E)), EXTENDED_COLOR_PAIR(EXTENDED_COLOR::FromIndex(16), EXTENDED_COLOR(COLOR::COLOR_WHITE)) };
+	WORD Attributes[2] = {};
+	TEST_CHECK(Quantizer.Quantize(Pairs, Attributes, 2, 0x17));
+	TEST_CHECK(Attributes[0] == 0x12);
+	TEST_CHECK(Attributes[1] == 0x0F);
+
+	// The 256-color table.
+	TEST_CHECK(ColorQuantizer::GetNearestIndex(255, 0, 0) == 196);
+	TEST_CHECK(ColorQuantizer::GetNearestIndex(0, 0, 0) == 16);
+	TEST_CHECK(ColorQuantizer::GetNearestIndex(128, 128, 128) == 244);
+	TEST_CHECK(ColorQuantizer::GetNearestIndex(95, 135, 175) == 67);
+
+	unsigned char unR = 0, unG = 0, unB = 0;
+	TEST_CHECK(ColorQuantizer::GetIndexColor(67, &unR, &unG, &unB));
+	TEST_CHECK((unR == 95) && (unG == 135) && (unB == 175));
+	TEST_CHECK(ColorQuantizer::GetIndexColor(244, &unR, &unG, &unB));
+	TEST_CHECK((unR == 128) && (unG == 128) && (unB == 128));
+	TEST_CHECK(!ColorQuantizer::GetIndexColor(15, &unR, &unG, &unB));
+
+	// A different palette rebuilds the table.
+	COLORREF ColorTable[16];
+	memcpy(ColorTable, g_ColorTable, sizeof(ColorTable));
+	ColorTable[static_cast<unsigned char>(COLOR::COLOR_DARK_RED)] = RGB(0, 0, 0);
+	TEST_CHECK(Quantizer.Build(ColorTable));
+	TEST_CHECK(Quantizer.Quantize(EXTENDED_COLOR(255, 0, 0)) == COLOR::COLOR_RED);
+}
+
+static void TestSequences() {
+	TEST_CHECK(GetSequence(EXTENDED_COLOR_PAIR(EXTENDED_COLOR(1, 2, 3), EXTENDED_COLOR(255, 128, 0))) == "\x1B[38;2;255;128;0;48;2;1;2;3m");
+	TEST_CHECK(GetSequence(EXTENDED_COLOR_PAIR(EXTENDED_COLOR::FromIndex(196))) == "\x1B[38;5;196m");
+	TEST_CHECK(GetSequence(EXTENDED_COLOR_PAIR(EXTENDED_COLOR::FromIndex(0), EXTENDED_COLOR())) == "\x1B[48;5;0m");
+	TEST_CHECK(GetSequence(EXTENDED_COLOR_PAIR(COLOR_PAIR(COLOR::COLOR_BLUE, COLOR::COLOR_RED))) == "\x1B[91;104m");
+	TEST_CHECK(GetSequence(EXTENDED_COLOR_PAIR(COLOR_PAIR(COLOR::COLOR_DARK_BLUE, COLOR::COLOR_BLACK))) == "\x1B[30;44m");
+	TEST_CHECK(GetSequence(EXTENDED_COLOR_PAIR()).empty());
+
+	// The longest one fits.
+	TEST_CHECK(GetSequence(EXTENDED_COLOR_PAIR(EXTENDED_COLOR(255, 255, 255), EXTENDED_COLOR(255, 255, 255))).size() == MAX_EXTENDED_COLOR_SEQUENCE_LENGTH);
+}
+
+static unsigned long long GetWrittenCharacters(SmartConsoleUtils& SCU) {
+	CONSOLE_STATISTICS Statistics;
+	TEST_CHECK(SCU.GetStatistics(&Statistics));
+	return Statistics.WrittenCharacters;
+}
+
+// What SetExtendedColor sends at each depth, and the attributes the cells end up with.
+static void TestConsole() {
+	EmulatedConsole Console(40, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		const WORD unDefault = GetAttributes(Console, 0, 0);
+
+		// Without virtual terminal sequences the nearest attributes are set, nothing is written.
+		unsigned long long unWritten = GetWrittenCharacters(SCU);
+		Console.ResetCalls();
+		TEST_CHECK(SCU.SetExtendedColor(EXTENDED_COLOR_PAIR(EXTENDED_COLOR(255, 0, 0))));
+		TEST_CHECK(GetWrittenCharacters(SCU) == unWritten);
+		TEST_CHECK(Console.GetCalls(EMULATED_CALL::EMULATED_CALL_SET_CONSOLE_TEXT_ATTRIBUTE) == 1);
+		TEST_CHECK(SCU.WriteA("a"));
+		TEST_CHECK(GetAttributes(Console, 0, 0) == ((unDefault & 0xF0) | static_cast<WORD>(COLOR::COLOR_DARK_RED)));
+
+		TEST_CHECK(SCU.EnableVirtualTerminal());
+
+		// True color goes out as given.
+		TEST_CHECK(SCU.SetColorDepth(COLOR_DEPTH::COLOR_DEPTH_TRUE));
+		unWritten = GetWrittenCharacters(SCU);
+		TEST_CHECK(SCU.SetExtendedColor(EXTENDED_COLOR_PAIR(EXTENDED_COLOR::FromRGB(0x3B78FF))));
+		TEST_CHECK(GetWrittenCharacters(SCU) - unWritten == strlen("\x1B[38;2;59;120;255m"));
+		TEST_CHECK(SCU.WriteA("b"));
+		TEST_CHECK((GetAttributes(Console, 1, 0) & 0x0F) == static_cast<WORD>(COLOR::COLOR_BLUE));
+
+		// 256 colors get the nearest index.
+		TEST_CHECK(SCU.SetColorDepth(COLOR_DEPTH::COLOR_DEPTH_256));
+		unWritten = GetWrittenCharacters(SCU);
+		TEST_CHECK(SCU.SetExtendedColor(EXTENDED_COLOR_PAIR(EXTENDED_COLOR(250, 5, 5), EXTENDED_COLOR(255, 255, 255))));
+		TEST_CHECK(GetWrittenCharacters(SCU) - unWritten == strlen("\x1B[38;5;231;48;5;196m"));
+		TEST_CHECK(SCU.WriteA("c"));
+		TEST_CHECK(GetAttributes(Console, 2, 0) == MakeAttributes(COLOR_PAIR(COLOR::COLOR_DARK_RED, COLOR::COLOR_WHITE)));
+
+		// 16 colors fall back to attributes even with sequences on.
+		TEST_CHECK(SCU.SetColorDepth(COLOR_DEPTH::COLOR_DEPTH_16));
+		unWritten = GetWrittenCharacters(SCU);
+		TEST_CHECK(SCU.SetExtendedColor(EXTENDED_COLOR_PAIR(EXTENDED_COLOR(255, 255, 0))));
+		TEST_CHECK(SCU.WriteA("d"));
+		TEST_CHECK(GetWrittenCharacters(SCU) - unWritten == 1 + strlen(GetColorSequence(COLOR_PAIR(COLOR::COLOR_DARK_RED, COLOR::COLOR_DARK_YELLOW))));
+		TEST_CHECK(GetAttributes(Console, 3, 0) == MakeAttributes(COLOR_PAIR(COLOR::COLOR_DARK_RED, COLOR::COLOR_DARK_YELLOW)));
+
+		// The quantized attributes are cached, so going back to the default isn't skipped.
+		TEST_CHECK(SCU.SetAttributes(unDefault));
+		TEST_CHECK(SCU.WriteA("e"));
+		TEST_CHECK(GetAttributes(Console, 4, 0) == unDefault);
+		TEST_CHECK(GetLine(Console, 0) == L"abcde");
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// A 120x30 screen of pairs, half of them 24-bit. Pass the round count for a longer run.
+static void TestThroughput(unsigned int unRounds) {
+	ColorQuantizer Quantizer;
+
+	double fStart = GetSeconds();
+	TEST_CHECK(Quantizer.Build(g_ColorTable));
+	const double fBuild = GetSeconds() - fStart;
+
+	std::vector<EXTENDED_COLOR_PAIR> Pairs(120 * 30);
+	for (size_t i = 0; i < Pairs.size(); ++i) {
+		const unsigned int unValue = static_cast<unsigned int>(i * 2654435761u);
+		if (i & 1) {
+			Pairs[i] = EXTENDED_COLOR_PAIR(EXTENDED_COLOR::FromRGB(unValue >> 8), EXTENDED_COLOR::FromRGB(unValue));
+		} else {
+			Pairs[i] = EXTENDED_COLOR_PAIR(EXTENDED_COLOR::FromIndex(static_cast<unsigned char>(unValue)));
+		}
+	}
+
+	std::vector<WORD> Attributes(Pairs.size());
+	std::vector<double> Samples;
+	for (unsigned int i = 0; i < unRounds; ++i) {
+		fStart = GetSeconds();
+		TEST_CHECK(Quantizer.Quantize(Pairs.data(), Attributes.data(), Pairs.size(), 0x07));
+		Samples.push_back(GetSeconds() - fStart);
+	}
+
+	// The same answers as one color at a time.
+	for (size_t i = 0; i < Pairs.size(); ++i) {
+		TEST_CHECK((Attributes[i] & 0x0F) == static_cast<WORD>(Quantizer.Quantize(Pairs[i].ColorForeground)));
+	}
+
+	printf("table build %.0f us, 120x30 screen of pairs p50 %.1f us (%.1f ns per pair)\n", fBuild * 1e6, GetPercentile(Samples, 50) * 1e6, GetPercentile(Samples, 50) * 1e9 / Pairs.size());
+}
+
+int main(int nArguments, char* pArguments[]) {
+	TestQuantizer();
+	TestSequences();
+	TestConsole();
+	TestThroughput((nArguments > 1) ? static_cast<unsigned int>(atoi(pArguments[1])) : 200);
+
+	puts("ExtendedColorTest passed");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,222 @@
+// Default
+#include "Test.h"
+
+// C++
+#include <string>
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// Line editor
+// ----------------------------------------------------------------
+
+static INPUT_RECORD MakeKey(WORD unVirtualKey, wchar_t unChar = 0, DWORD unControlKeyState = 0) {
+	INPUT_RECORD Record;
+	memset(&Record, 0, sizeof(Record));
+	Record.EventType = KEY_EVENT;
+	Record.Event.KeyEvent.bKeyDown = TRUE;
+	Record.Event.KeyEvent.wRepeatCount = 1;
+	Record.Event.KeyEvent.wVirtualKeyCode = unVirtualKey;
+	Record.Event.KeyEvent.uChar.UnicodeChar = unChar;
+	Record.Event.KeyEvent.dwControlKeyState = unControlKeyState;
+	return Record;
+}
+
+// Typed text followed by the given keys, then Enter.
+static void PushLine(EmulatedConsole& Console, wchar_t const* const szText, std::vector<INPUT_RECORD> Keys = {}) {
+	std::vector<INPUT_RECORD> Records;
+	for (wchar_t const* pChar = szText; *pChar; ++pChar) {
+		Records.push_back(MakeKey(0, *pChar));
+	}
+
+	Records.insert(Records.end(), Keys.begin(), Keys.end());
+	Records.push_back(MakeKey(VK_RETURN, L'\r'));
+
+	TEST_CHECK(Console.PushInputRecords(Records.data(), static_cast<DWORD>(Records.size())));
+}
+
+static void TestEditing() {
+	EmulatedConsole Console(40, 10, 10);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		LineEditor* pEditor = SCU.GetLineEditor();
+		TEST_CHECK(pEditor);
+		TEST_CHECK(pEditor->SetPromptW(L"> ", COLOR_PAIR(COLOR::COLOR_GREEN)));
+
+		wchar_t szLine[256];
+
+		// Insert in the middle.
+		PushLine(Console, L"hello wrld", { MakeKey(VK_LEFT), MakeKey(VK_LEFT), MakeKey(VK_LEFT), MakeKey(0, L'o'), MakeKey(VK_END) });
+		TEST_CHECK(pEditor->ReadLineW(szLine, 256));
+		TEST_CHECK(wcscmp(szLine, L"hello world\n") == 0);
+		TEST_CHECK(GetLine(Console, 0) == L"> hello world");
+		TEST_CHECK((GetAttributes(Console, 0, 0) & 0x0F) == static_cast<WORD>(COLOR::COLOR_GREEN));
+		TEST_CHECK((GetAttributes(Console, 2, 0) & 0x0F) != static_cast<WORD>(COLOR::COLOR_GREEN));
+
+		// Ctrl+W and Ctrl+Backspace delete words, Delete the character under the cursor.
+		PushLine(Console, L"one two three", { MakeKey(0, 0x17), MakeKey(VK_BACK, 0, LEFT_CTRL_PRESSED), MakeKey(VK_HOME), MakeKey(VK_DELETE) });
+		TEST_CHECK(pEditor->ReadLineW(szLine, 256));
+		TEST_CHECK(wcscmp(szLine, L"ne \n") == 0);
+		TEST_CHECK(GetLine(Console, 1) == L"> ne");
+
+		// Word motion, Ctrl+K kills to the end and Ctrl+U to the start.
+		PushLine(Console, L"abc def", { MakeKey(VK_LEFT, 0, LEFT_CTRL_PRESSED), MakeKey(0, 0x0B), MakeKey(0, L'X'), MakeKey(VK_HOME), MakeKey(VK_RIGHT, 0, RIGHT_CTRL_PRESSED), MakeKey(0, 0x15) });
+		TEST_CHECK(pEditor->ReadLineW(szLine, 256));
+		TEST_CHECK(wcscmp(szLine, L" X\n") == 0);
+
+		// Up searches the history for entries starting with what was typed.
+		PushLine(Console, L"h", { MakeKey(VK_UP) });
+		TEST_CHECK(pEditor->ReadLineW(szLine, 256));
+		TEST_CHECK(wcscmp(szLine, L"hello world\n") == 0);
+
+		PushLine(Console, L"", { MakeKey(VK_UP), MakeKey(VK_UP), MakeKey(VK_DOWN) });
+		TEST_CHECK(pEditor->ReadLineW(szLine, 256));
+		TEST_CHECK(wcscmp(szLine, L"hello world\n") == 0);
+
+		// A line repeating the previous entry isn't added again.
+		TEST_CHECK(pEditor->GetHistorySize() == 4);
+
+		// Lines longer than the row wrap, and the window scrolls under them.
+		const std::wstring Long(100, L'x');
+		PushLine(Console, Long.c_str(), { MakeKey(VK_HOME), MakeKey(0, L'A') });
+		TEST_CHECK(pEditor->ReadLineW(szLine, 256));
+		TEST_CHECK((szLine[0] == L'A') && (wcslen(szLine) == 102));
+
+		COORD Cursor;
+		TEST_CHECK(Console.GetCursorPosition(&Cursor));
+		TEST_CHECK(Cursor.X == 0);
+		TEST_CHECK(GetLine(Console, Cursor.Y - 3) == L"> A" + std::wstring(37, L'x'));
+		TEST_CHECK(GetLine(Console, Cursor.Y - 1) == std::wstring(23, L'x'));
+
+		// Ending exactly on the row boundary.
+		const std::wstring Boundary(38, L'y');
+		PushLine(Console, Boundary.c_str(), { MakeKey(VK_BACK), MakeKey(0, L'z'), MakeKey(VK_LEFT), MakeKey(0, L'Q') });
+		TEST_CHECK(pEditor->ReadLineW(szLine, 256));
+		TEST_CHECK(wcscmp(szLine, (std::wstring(37, L'y') + L"Qz\n").c_str()) == 0);
+		TEST_CHECK(GetLine(Console, 7) == L"> " + std::wstring(37, L'y') + L"Q");
+		TEST_CHECK(GetLine(Console, 8) == L"z");
+
+		// Read goes through the editor once it is on.
+		TEST_CHECK(SCU.EnableLineEditor());
+		PushLine(Console, L"42 abc");
+
+		char szNarrow[64];
+		TEST_CHECK(SCU.ReadA(szNarrow, 64));
+		TEST_CHECK(strcmp(szNarrow, "42 abc\n") == 0);
+		TEST_CHECK(SCU.DisableLineEditor());
+
+		// History survives a round trip through a file.
+		const unsigned int unHistory = pEditor->GetHistorySize();
+		TEST_CHECK(pEditor->SaveHistoryA("LineEditorTest.history"));
+		pEditor->ClearHistory();
+		TEST_CHECK(pEditor->GetHistorySize() == 0);
+		TEST_CHECK(pEditor->LoadHistoryA("LineEditorTest.history"));
+		remove("LineEditorTest.history");
+		TEST_CHECK(pEditor->GetHistorySize() == unHistory);
+
+		PushLine(Console, L"4", { MakeKey(VK_UP) });
+		TEST_CHECK(pEditor->ReadLineW(szLine, 256));
+		TEST_CHECK(wcscmp(szLine, L"42 abc\n") == 0);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+static INPUT_EVENT MakeEvent(WORD unVirtualKey, wchar_t unChar = 0) {
+	INPUT_EVENT Event;
+	memset(&Event, 0, sizeof(Event));
+	Event.Type = INPUT_EVENT_TYPE::INPUT_EVENT_TYPE_KEY;
+	Event.KeyDown = true;
+	Event.RepeatCount = 1;
+	Event.VirtualKeyCode = unVirtualKey;
+	Event.Char = unChar;
+	return Event;
+}
+
+// Characters written for each of unKeys presses of a key, each one redrawn on its own like a typist would.
+static double GetCharactersPerKey(SmartConsoleUtils& SCU, LineEditor* pEditor, const INPUT_EVENT& Event, unsigned int unKeys, double* pSeconds) {
+	CONSOLE_STATISTICS Before;
+	TEST_CHECK(SCU.GetStatistics(&Before));
+
+	std::vector<double> Samples;
+	for (unsigned int i = 0; i < unKeys; ++i) {
+		bool bDone = false;
+
+		const double fStart = GetSeconds();
+		TEST_CHECK(pEditor->Feed(Event, &bDone));
+		TEST_CHECK(pEditor->Update());
+		Samples.push_back(GetSeconds() - fStart);
+
+		TEST_CHECK(!bDone);
+	}
+
+	CONSOLE_STATISTICS After;
+	TEST_CHECK(SCU.GetStatistics(&After));
+
+	*pSeconds = GetPercentile(Samples, 50);
+
+	return static_cast<double>(After.WrittenCharacters - Before.WrittenCharacters) / unKeys;
+}
+
+// Editing a 4000 character pasted command. Only the changed tail is written, so keys near the end cost a handful of characters.
+static void TestRedraw() {
+	EmulatedConsole Console(200, 50, 300);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		LineEditor* pEditor = SCU.GetLineEditor();
+		TEST_CHECK(pEditor->SetPromptW(L"$ ", COLOR_PAIR(COLOR::COLOR_GREEN)));
+
+		TEST_CHECK(pEditor->Start());
+
+		// The paste is one batch, one redraw.
+		bool bDone = false;
+		for (unsigned int i = 0; i < 4000; ++i) {
+			TEST_CHECK(pEditor->Feed(MakeEvent(0, L'k'), &bDone));
+		}
+		TEST_CHECK(pEditor->Update());
+
+		static const struct {
+			char const* szName;
+			WORD unVirtualKey;
+			wchar_t unChar;
+			unsigned int unKeys;
+			double fLimit;
+		} Keys[] = {
+			{ "append", 0, L'e', 100, 4.0 },
+			{ "left", VK_LEFT, 0, 100, 1.0 },
+			{ "insert 100 from the end", 0, L'm', 100, 210.0 },
+			{ "backspace", VK_BACK, 0, 50, 210.0 },
+			{ "home", VK_HOME, 0, 1, 1.0 },
+			{ "insert at the start", 0, L'h', 20, 4200.0 }
+		};
+
+		for (const auto& Key : Keys) {
+			double fSeconds = 0.0;
+			const double fCharacters = GetCharactersPerKey(SCU, pEditor, MakeEvent(Key.unVirtualKey, Key.unChar), Key.unKeys, &fSeconds);
+			printf("%-24s %7.1f chars/key, %6.1f us/key\n", Key.szName, fCharacters, fSeconds * 1e6);
+
+			TEST_CHECK(fCharacters <= Key.fLimit);
+			TEST_CHECK(fSeconds < 0.001);
+		}
+
+		std::wstring Line;
+		TEST_CHECK(pEditor->Finish(&Line));
+		TEST_CHECK(Line == std::wstring(20, L'h') + std::wstring(4000, L'k') + std::wstring(50, L'm') + std::wstring(100, L'e'));
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+int main() {
+	TestEditing();
+	TestRedraw();
+
+	puts("LineEditorTest passed");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,143 @@
+// Default
+#include "Test.h"
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// Markup
+// ----------------------------------------------------------------
+
+#define MARKUP_REPEAT_4(Text) Text Text Text Text
+#define MARKUP_REPEAT_20(Text) MARKUP_REPEAT_4(Text) MARKUP_REPEAT_4(Text) MARKUP_REPEAT_4(Text) MARKUP_REPEAT_4(Text) MARKUP_REPEAT_4(Text)
+
+// 40 spans, more than the compile-time table holds.
+#define MARKUP_LONG MARKUP_REPEAT_20("{red}r{/}{green}g{/}")
+
+// 20 levels, deeper than the compile-time stack.
+#define MARKUP_DEEP MARKUP_REPEAT_20("{blue}b") "x" MARKUP_REPEAT_20("{/}") "y"
+
+static_assert(MarkupString("{red}a{/}b").GetSpans() == 2);
+static_assert(!MarkupString("{red}a{/}b").IsRuntime());
+static_assert(MarkupString(MARKUP_LONG).IsRuntime());
+static_assert(MarkupString(MARKUP_DEEP).IsRuntime());
+static_assert(WMarkupString(L"{{x}} {white on blue}y").GetSpans() == 2);
+
+static WORD GetForeground(EmulatedConsole& Console, SHORT nX, SHORT nY) {
+	return GetAttributes(Console, nX, nY) & 0x0F;
+}
+
+static WORD GetBackground(EmulatedConsole& Console, SHORT nX, SHORT nY) {
+	return (GetAttributes(Console, nX, nY) >> 4) & 0x0F;
+}
+
+static void TestNested() {
+	EmulatedConsole Console(80, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		BindConsole(&SCU);
+
+		const WORD unDefault = GetForeground(Console, 0, 0);
+
+		TEST_CHECK(mprint("{red}a{blue on white}b{/}c{/}d\n") == 5);
+		TEST_CHECK(GetLine(Console, 0) == L"abcd");
+		TEST_CHECK(GetForeground(Console, 0, 0) == static_cast<WORD>(COLOR::COLOR_RED));
+		TEST_CHECK(GetForeground(Console, 1, 0) == static_cast<WORD>(COLOR::COLOR_BLUE));
+		TEST_CHECK(GetBackground(Console, 1, 0) == static_cast<WORD>(COLOR::COLOR_WHITE));
+		TEST_CHECK(GetForeground(Console, 2, 0) == static_cast<WORD>(COLOR::COLOR_RED));
+		TEST_CHECK(GetForeground(Console, 3, 0) == unDefault);
+
+		// {on color} keeps the foreground.
+		TEST_CHECK(mprint(L"{green}x{on blue}y{/}{/}\n") == 3);
+		TEST_CHECK(GetForeground(Console, 1, 1) == static_cast<WORD>(COLOR::COLOR_GREEN));
+		TEST_CHECK(GetBackground(Console, 1, 1) == static_cast<WORD>(COLOR::COLOR_BLUE));
+
+		// Escaped braces.
+		TEST_CHECK(mprint("{{literal}} {yellow}}}{/}\n") > 0);
+		TEST_CHECK(GetLine(Console, 2) == L"{literal} }");
+		TEST_CHECK(GetForeground(Console, 10, 2) == static_cast<WORD>(COLOR::COLOR_YELLOW));
+
+		UnbindConsole(&SCU);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+static void TestUnknown() {
+	EmulatedConsole Console(80, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		BindConsole(&SCU);
+
+		// Runtime markup keeps unknown tags, stray braces and unbalanced closes as text.
+		TEST_CHECK(mprint(RuntimeMarkup("a{bogus}b{/}c{red\n")) > 0);
+		TEST_CHECK(GetLine(Console, 0) == L"a{bogus}b{/}c{red");
+
+		TEST_CHECK(mprint(RuntimeMarkup(L"{cyan}x{/}{/}y\n")) > 0);
+		TEST_CHECK(GetLine(Console, 1) == L"x{/}y");
+		TEST_CHECK(GetForeground(Console, 0, 1) == static_cast<WORD>(COLOR::COLOR_CYAN));
+
+		UnbindConsole(&SCU);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+static void TestLong() {
+	EmulatedConsole Console(120, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		BindConsole(&SCU);
+
+		const WORD unDefault = GetForeground(Console, 0, 0);
+
+		// More spans than the table holds.
+		TEST_CHECK(mprint(MARKUP_LONG "\n") == 41);
+		for (SHORT nX = 0; nX < 40; ++nX) {
+			TEST_CHECK(GetForeground(Console, nX, 0) == static_cast<WORD>((nX % 2) ? COLOR::COLOR_GREEN : COLOR::COLOR_RED));
+		}
+
+		// Deeper nesting than the stack holds unwinds to the right colors.
+		TEST_CHECK(mprint(MARKUP_DEEP "\n") == 23);
+		TEST_CHECK(GetLine(Console, 1) == std::wstring(20, L'b') + L"xy");
+		TEST_CHECK(GetForeground(Console, 20, 1) == static_cast<WORD>(COLOR::COLOR_BLUE));
+		TEST_CHECK(GetForeground(Console, 21, 1) == unDefault);
+
+		// Same at runtime, 100 levels deep.
+		std::string Deep;
+		for (unsigned int i = 0; i < 100; ++i) {
+			Deep += (i % 2) ? "{red}" : "{green}";
+		}
+		Deep += "z";
+		for (unsigned int i = 0; i < 99; ++i) {
+			Deep += "{/}";
+		}
+		Deep += "w{/}v\n";
+
+		TEST_CHECK(mprint(RuntimeMarkup(Deep)) == 4);
+		TEST_CHECK(GetLine(Console, 2) == L"zwv");
+		TEST_CHECK(GetForeground(Console, 0, 2) == static_cast<WORD>(COLOR::COLOR_RED));
+		TEST_CHECK(GetForeground(Console, 1, 2) == static_cast<WORD>(COLOR::COLOR_GREEN));
+		TEST_CHECK(GetForeground(Console, 2, 2) == unDefault);
+
+		UnbindConsole(&SCU);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+int main() {
+	TestNested();
+	TestUnknown();
+	TestLong();
+
+	puts("MarkupTest passed");
+
+	return EXIT_SUCCESS;
+}
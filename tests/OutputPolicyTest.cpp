@@ -0,0 +1,143 @@
+// Default
+#include "Test.h"
+
+// C++
+#include <thread>
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// Output policy
+// ----------------------------------------------------------------
+
+static void TestFlushes() {
+	EmulatedConsole Console(80, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+
+		// Line: held until the line break.
+		TEST_CHECK(SCU.SetOutputPolicy(OUTPUT_POLICY::OUTPUT_POLICY_LINE));
+		TEST_CHECK(SCU.WriteA("line"));
+		TEST_CHECK(GetLine(Console, 0).empty());
+		TEST_CHECK(SCU.WriteA(" done\n"));
+		TEST_CHECK(GetLine(Console, 0) == L"line done");
+
+		// Size: held until the threshold.
+		TEST_CHECK(SCU.SetOutputPolicy(OUTPUT_POLICY::OUTPUT_POLICY_SIZE, 16));
+		TEST_CHECK(SCU.WriteA("size\n"));
+		TEST_CHECK(GetLine(Console, 1).empty());
+		TEST_CHECK(SCU.WriteA("0123456789\n"));
+		TEST_CHECK(GetLine(Console, 1) == L"size");
+		TEST_CHECK(GetLine(Console, 2) == L"0123456789");
+
+		// A color change flushes first, so the text keeps its colors.
+		TEST_CHECK(SCU.WriteA("colored"));
+		TEST_CHECK(GetLine(Console, 3).empty());
+		TEST_CHECK(SCU.SetCursorColor(COLOR::COLOR_RED));
+		TEST_CHECK(GetLine(Console, 3) == L"colored");
+		TEST_CHECK(SCU.RestoreCursorColor());
+
+		// So does a read, the prompt is on screen before input is taken.
+		TEST_CHECK(SCU.WriteA("\nname? "));
+		TEST_CHECK(Console.PushInputA("typed\n"));
+
+		char szBuffer[32];
+		TEST_CHECK(SCU.ReadA(szBuffer, sizeof(szBuffer)));
+		TEST_CHECK(GetLine(Console, 4).rfind(L"name? ", 0) == 0);
+
+		// Time: written within the interval even without a line break.
+		TEST_CHECK(SCU.SetOutputPolicy(OUTPUT_POLICY::OUTPUT_POLICY_TIME, 4096, 20));
+		TEST_CHECK(SCU.WriteA("\nlater"));
+
+		COORD Cursor;
+		TEST_CHECK(Console.GetCursorPosition(&Cursor));
+		const SHORT nRow = Cursor.Y + 1;
+		TEST_CHECK(GetLine(Console, nRow).empty());
+
+		const double fStart = GetSeconds();
+		while (GetLine(Console, nRow).empty() && (GetSeconds() - fStart < 2.0)) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		const double fDelay = GetSeconds() - fStart;
+
+		printf("time policy wrote after %.1f ms\n", fDelay * 1e3);
+		TEST_CHECK(GetLine(Console, nRow) == L"later");
+		TEST_CHECK(fDelay < 1.0);
+
+		TEST_CHECK(SCU.SetOutputPolicy(OUTPUT_POLICY::OUTPUT_POLICY_UNBUFFERED));
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// Log lines under every policy, with the host charging unCallCost us per call. The volume is in MB, 100 for the full run.
+static void TestThroughput(unsigned int unMegabytes, unsigned int unCallCost) {
+	static const struct {
+		char const* szName;
+		OUTPUT_POLICY Policy;
+	} Policies[] = {
+		{ "unbuffered", OUTPUT_POLICY::OUTPUT_POLICY_UNBUFFERED },
+		{ "line", OUTPUT_POLICY::OUTPUT_POLICY_LINE },
+		{ "size", OUTPUT_POLICY::OUTPUT_POLICY_SIZE },
+		{ "time", OUTPUT_POLICY::OUTPUT_POLICY_TIME }
+	};
+
+	char const* const szLine = "2026-10-17 12:00:00.000 INFO worker-07 processed request 123456 in 1.234 ms\n";
+	const size_t unLineLength = strlen(szLine);
+	const size_t unLines = static_cast<size_t>(unMegabytes) * 1000000 / unLineLength;
+
+	EmulatedConsole Console(120, 30, 300);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		Console.SetCallCost(unCallCost);
+
+		double fUnbuffered = 0.0;
+		double fSize = 0.0;
+
+		for (const auto& Entry : Policies) {
+			TEST_CHECK(SCU.SetOutputPolicy(Entry.Policy, 64 * 1024, 50));
+
+			Console.ResetCalls();
+			const double fStart = GetSeconds();
+			for (size_t i = 0; i < unLines; ++i) {
+				TEST_CHECK(SCU.WriteA(szLine));
+			}
+			TEST_CHECK(SCU.FlushOutput());
+			const double fElapsed = GetSeconds() - fStart;
+
+			const double fBytesPerSecond = unLines * unLineLength / fElapsed;
+			printf("%-10s %7.1f MB/s, %llu writes for %zu lines\n", Entry.szName, fBytesPerSecond / 1e6, Console.GetCalls(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE), unLines);
+
+			if (Entry.Policy == OUTPUT_POLICY::OUTPUT_POLICY_UNBUFFERED) {
+				fUnbuffered = fBytesPerSecond;
+				TEST_CHECK(Console.GetCalls(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE) == unLines);
+			} else if (Entry.Policy == OUTPUT_POLICY::OUTPUT_POLICY_SIZE) {
+				fSize = fBytesPerSecond;
+				TEST_CHECK(Console.GetCalls(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE) <= unLines * unLineLength / (64 * 1024) + 1);
+			}
+		}
+
+		TEST_CHECK(fSize > fUnbuffered);
+
+		TEST_CHECK(SCU.SetOutputPolicy(OUTPUT_POLICY::OUTPUT_POLICY_UNBUFFERED));
+		Console.SetCallCost(0);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+int main(int nArguments, char* pArguments[]) {
+	TestFlushes();
+
+	// Pass the volume in MB for a longer run, 100 matches the original figures.
+	TestThroughput((nArguments > 1) ? static_cast<unsigned int>(atoi(pArguments[1])) : 2, 5);
+
+	puts("OutputPolicyTest passed");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,196 @@
+// Default
+#include "Test.h"
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// Palette
+// ----------------------------------------------------------------
+
+static void TestTransaction() {
+	EmulatedConsole Console(80, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		TEST_CHECK(SCU.WriteA("cells keep their text and colors\n"));
+		const WORD unAttributes = GetAttributes(Console, 0, 0);
+
+		PaletteTransaction Transaction(&SCU);
+		TEST_CHECK(Transaction.Parse("; theme\n red = #FF0000\r\n3=#00ff00\n\nwhite=#FFFFFF\n"));
+		TEST_CHECK(Transaction.GetStaged() == ((1 << 12) | (1 << 3) | (1 << 15)));
+
+		// Bad lines are rejected.
+		TEST_CHECK(!Transaction.Parse("red = #FF00"));
+		TEST_CHECK(!Transaction.Parse("default = #FF0000"));
+		TEST_CHECK(!Transaction.Parse("16 = #FF0000"));
+
+		// Nothing is applied before the commit, then all of it with one update.
+		PALETTE Palette;
+		TEST_CHECK(SCU.GetColorPalette(&Palette));
+		TEST_CHECK(Palette.ColorTable[12] != RGB(255, 0, 0));
+
+		Console.ResetCalls();
+		TEST_CHECK(Transaction.Commit());
+		TEST_CHECK(Console.GetCalls(EMULATED_CALL::EMULATED_CALL_SET_CONSOLE_SCREEN_BUFFER_INFO) == 1);
+		TEST_CHECK(Console.GetCalls(EMULATED_CALL::EMULATED_CALL_FILL_CONSOLE_OUTPUT_ATTRIBUTE) == 0);
+		TEST_CHECK(Console.GetCalls(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE_OUTPUT_ATTRIBUTE) == 0);
+		TEST_CHECK(Transaction.GetStaged() == 0);
+
+		TEST_CHECK(SCU.GetColorPalette(&Palette));
+		TEST_CHECK(Palette.ColorTable[12] == RGB(255, 0, 0));
+		TEST_CHECK(Palette.ColorTable[3] == RGB(0, 255, 0));
+		TEST_CHECK(Palette.ColorTable[15] == RGB(255, 255, 255));
+		TEST_CHECK(GetLine(Console, 0) == L"cells keep their text and colors");
+		TEST_CHECK(GetAttributes(Console, 0, 0) == unAttributes);
+
+		// Discarded entries never reach the console.
+		TEST_CHECK(Transaction.Set(COLOR::COLOR_RED, 0x010203u));
+		Transaction.Discard();
+		Console.ResetCalls();
+		TEST_CHECK(Transaction.Commit());
+		TEST_CHECK(Console.GetCalls(EMULATED_CALL::EMULATED_CALL_SET_CONSOLE_SCREEN_BUFFER_INFO) == 0);
+
+		// Single entries still work and take the same path.
+		TEST_CHECK(SCU.ChangeColorPalette(COLOR::COLOR_RED, 0x123456u));
+		TEST_CHECK(SCU.GetColorPalette(&Palette));
+		TEST_CHECK(Palette.ColorTable[12] == RGB(0x12, 0x34, 0x56));
+
+		// Themes from a file.
+		FILE* pFile = fopen("PaletteTest.ini", "w");
+		TEST_CHECK(pFile);
+		fputs("; blue theme\nblue = #0000FF\n1 = #000080\n", pFile);
+		fclose(pFile);
+
+		TEST_CHECK(Transaction.LoadA("PaletteTest.ini"));
+		TEST_CHECK(Transaction.Commit());
+		remove("PaletteTest.ini");
+
+		TEST_CHECK(SCU.GetColorPalette(&Palette));
+		TEST_CHECK(Palette.ColorTable[9] == RGB(0, 0, 255));
+		TEST_CHECK(Palette.ColorTable[1] == RGB(0, 0, 128));
+		TEST_CHECK(!Transaction.LoadA("PaletteTest.missing"));
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// A full retheme, entry by entry against one transaction, with the host charging 5us per call.
+static void TestRetheme() {
+	EmulatedConsole Console(120, 30, 9000);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		Console.SetCallCost(5);
+
+		const unsigned int unRounds = 200;
+
+		Console.ResetCalls();
+		double fStart = GetSeconds();
+		for (unsigned int i = 0; i < unRounds; ++i) {
+			for (unsigned char j = 0; j < 16; ++j) {
+				TEST_CHECK(SCU.ChangeColorPalette(static_cast<COLOR>(j), static_cast<unsigned char>(i), j, 0));
+			}
+		}
+		const double fSingle = (GetSeconds() - fStart) / unRounds;
+		const unsigned long long unSingleCalls = Console.GetTotalCalls() / unRounds;
+
+		PaletteTransaction Transaction(&SCU);
+
+		Console.ResetCalls();
+		fStart = GetSeconds();
+		for (unsigned int i = 0; i < unRounds; ++i) {
+			for (unsigned char j = 0; j < 16; ++j) {
+				TEST_CHECK(Transaction.Set(static_cast<COLOR>(j), static_cast<unsigned char>(i), j, 1));
+			}
+			TEST_CHECK(Transaction.Commit());
+		}
+		const double fTransaction = (GetSeconds() - fStart) / unRounds;
+		const unsigned long long unTransactionCalls = Console.GetTotalCalls() / unRounds;
+
+		printf("16 entries: one by one %.1f us in %llu calls, transaction %.1f us in %llu calls\n", fSingle * 1e6, unSingleCalls, fTransaction * 1e6, unTransactionCalls);
+
+		TEST_CHECK(unTransactionCalls <= 2);
+		TEST_CHECK(fTransaction < fSingle);
+
+		Console.SetCallCost(0);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+static void TestFade() {
+	EmulatedConsole Console(80, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		TEST_CHECK(SCU.WriteA("faded\n"));
+		const WORD unAttributes = GetAttributes(Console, 0, 0);
+
+		PALETTE Target;
+		for (COLORREF& Color : Target.ColorTable) {
+			Color = RGB(10, 20, 30);
+		}
+
+		// 200ms at 30 frames per second is six frames, and only palette updates.
+		Console.ResetCalls();
+		double fStart = GetSeconds();
+		TEST_CHECK(SCU.FadeColorPalette(Target, 200, 30));
+		double fElapsed = GetSeconds() - fStart;
+
+		const unsigned long long unFrames = Console.GetCalls(EMULATED_CALL::EMULATED_CALL_SET_CONSOLE_SCREEN_BUFFER_INFO);
+		printf("fade: %llu frames in %.1f ms\n", unFrames, fElapsed * 1e3);
+
+		TEST_CHECK((unFrames >= 1) && (unFrames <= 6));
+		TEST_CHECK((fElapsed >= 0.19) && (fElapsed < 0.5));
+		TEST_CHECK(Console.GetCalls(EMULATED_CALL::EMULATED_CALL_FILL_CONSOLE_OUTPUT_ATTRIBUTE) == 0);
+		TEST_CHECK(Console.GetCalls(EMULATED_CALL::EMULATED_CALL_FILL_CONSOLE_OUTPUT_CHARACTER) == 0);
+		TEST_CHECK(Console.GetCalls(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE) == 0);
+		TEST_CHECK(Console.GetCalls(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE_OUTPUT_ATTRIBUTE) == 0);
+
+		PALETTE Palette;
+		TEST_CHECK(SCU.GetColorPalette(&Palette));
+		for (COLORREF Color : Palette.ColorTable) {
+			TEST_CHECK(Color == RGB(10, 20, 30));
+		}
+		TEST_CHECK(GetLine(Console, 0) == L"faded");
+		TEST_CHECK(GetAttributes(Console, 0, 0) == unAttributes);
+
+		// Animations fade through each palette in turn and end on the last.
+		PALETTE Palettes[3];
+		for (unsigned int i = 0; i < 3; ++i) {
+			for (COLORREF& Color : Palettes[i].ColorTable) {
+				Color = RGB(i * 100, 0, 255 - i * 100);
+			}
+		}
+
+		Console.ResetCalls();
+		fStart = GetSeconds();
+		TEST_CHECK(SCU.AnimateColorPalette(Palettes, 3, 100, 20));
+		fElapsed = GetSeconds() - fStart;
+
+		TEST_CHECK(Console.GetCalls(EMULATED_CALL::EMULATED_CALL_SET_CONSOLE_SCREEN_BUFFER_INFO) <= 1 + 2 * 2);
+		TEST_CHECK((fElapsed >= 0.19) && (fElapsed < 0.5));
+		TEST_CHECK(SCU.GetColorPalette(&Palette));
+		TEST_CHECK(Palette.ColorTable[0] == RGB(200, 0, 55));
+		TEST_CHECK(GetAttributes(Console, 0, 0) == unAttributes);
+
+		TEST_CHECK(!SCU.FadeColorPalette(Target, 100, 0));
+		TEST_CHECK(!SCU.AnimateColorPalette(nullptr, 0, 100));
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+int main() {
+	TestTransaction();
+	TestRetheme();
+	TestFade();
+
+	puts("PaletteTest passed");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,125 @@
+// Default
+#include "Test.h"
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// Print format
+// ----------------------------------------------------------------
+
+// Rows of 99 letters and a line break, the last row cut to fit unSize.
+template <typename Char>
+static std::basic_string<Char> MakePayload(size_t unSize) {
+	std::basic_string<Char> Payload(unSize, static_cast<Char>('\n'));
+	for (size_t i = 0; i + 1 < unSize; ++i) {
+		if ((i % 100) != 99) {
+			Payload[i] = static_cast<Char>('a' + (i / 100) % 26);
+		}
+	}
+
+	return Payload;
+}
+
+template <typename Char>
+static std::wstring GetLastRow(const std::basic_string<Char>& Payload) {
+	const size_t unStart = Payload.rfind(static_cast<Char>('\n'), Payload.size() - 2);
+	const size_t unFirst = (unStart == std::basic_string<Char>::npos) ? 0 : unStart + 1;
+	return std::wstring(Payload.begin() + unFirst, Payload.end() - 1);
+}
+
+static int Print(const std::string& Payload) {
+	return clrprintf(COLOR::COLOR_GREEN, "%s", Payload.c_str());
+}
+
+static int Print(const std::wstring& Payload) {
+	return clrwprintf(COLOR::COLOR_GREEN, L"%ls", Payload.c_str());
+}
+
+// The first call grows the thread-local buffer. After that no size may allocate and none may be cut.
+template <typename Char>
+static void TestSizes(EmulatedConsole& Console, char const* const szName) {
+	static const size_t Sizes[] = { 16, 1024, 64 * 1024, 4 * 1024 * 1024 };
+	static const unsigned int Calls[] = { 20000, 5000, 100, 2 };
+
+	for (unsigned int i = 0; i < sizeof(Sizes) / sizeof(Sizes[0]); ++i) {
+		const std::basic_string<Char> Payload = MakePayload<Char>(Sizes[i]);
+
+		TEST_CHECK(Print(Payload) == static_cast<int>(Sizes[i]));
+
+		const unsigned long long unAllocations = GetAllocations();
+		const double fStart = GetSeconds();
+		for (unsigned int j = 0; j < Calls[i]; ++j) {
+			TEST_CHECK(Print(Payload) == static_cast<int>(Sizes[i]));
+		}
+		const double fElapsed = GetSeconds() - fStart;
+		const unsigned long long unCallAllocations = GetAllocations() - unAllocations;
+
+		COORD Cursor;
+		TEST_CHECK(Console.GetCursorPosition(&Cursor));
+		TEST_CHECK(Cursor.X == 0);
+		TEST_CHECK(GetLine(Console, Cursor.Y - 1) == GetLastRow(Payload));
+
+		printf("%s %8zu B: %10.0f calls/s, %8.1f MB/s, %llu allocations over %u calls\n", szName, Sizes[i], Calls[i] / fElapsed, Calls[i] * Sizes[i] / fElapsed / 1e6, unCallAllocations, Calls[i]);
+		TEST_CHECK(unCallAllocations == 0);
+	}
+}
+
+static void TestPrint() {
+	EmulatedConsole Console(120, 30, 300);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		BindConsole(&SCU);
+
+		TestSizes<char>(Console, "clrprintf ");
+		TestSizes<wchar_t>(Console, "clrwprintf");
+
+		// Virtual terminal output wraps the text in color sequences inside the same buffer.
+		TEST_CHECK(SCU.EnableVirtualTerminal());
+		TestSizes<char>(Console, "clrprintf  VT");
+		TestSizes<wchar_t>(Console, "clrwprintf VT");
+		TEST_CHECK(SCU.DisableVirtualTerminal());
+
+		UnbindConsole(&SCU);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// A narrow argument that doesn't convert in the C locale fails the call at once, it doesn't grow the buffers looking for room.
+static void TestEncodingError() {
+	EmulatedConsole Console(120, 30, 300);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		BindConsole(&SCU);
+
+		TEST_CHECK(clrwprintf(COLOR::COLOR_RED, L"%s\n", "cafe") == 5);
+
+		// At most the thread's counting buffer gets set up.
+		const unsigned long long unAllocations = GetAllocations();
+		TEST_CHECK(clrwprintf(COLOR::COLOR_RED, L"%s\n", "caf\xE9") == -1);
+		TEST_CHECK(GetAllocations() - unAllocations <= 1);
+
+		COORD Cursor;
+		TEST_CHECK(Console.GetCursorPosition(&Cursor));
+		TEST_CHECK((Cursor.X == 0) && (Cursor.Y == 1));
+		TEST_CHECK(GetLine(Console, 0) == L"cafe");
+
+		UnbindConsole(&SCU);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+int main() {
+	TestEncodingError();
+	TestPrint();
+
+	puts("PrintFormatTest passed");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,35 @@
+// Default
+#include "Test.h"
+
+using namespace ConsoleUtils;
+
+// ----------------------------------------------------------------
+// print mismatches
+// ----------------------------------------------------------------
+
+// Built once per PRINT_MISMATCH case, each build has to fail.
+int main() {
+#if PRINT_MISMATCH == 1
+	// Fewer arguments than fields.
+	print(COLOR::COLOR_RED, "{} {}\n", 1);
+#elif PRINT_MISMATCH == 2
+	// More arguments than fields.
+	print(COLOR::COLOR_RED, "{}\n", 1, 2);
+#elif PRINT_MISMATCH == 3
+	// Presentation type that doesn't fit the argument.
+	print(COLOR::COLOR_RED, "{:d}\n", "text");
+#elif PRINT_MISMATCH == 4
+	// Wide string in a narrow format.
+	print(COLOR::COLOR_RED, "{}\n", L"wide");
+#elif PRINT_MISMATCH == 5
+	// Unterminated field.
+	print(COLOR::COLOR_RED, "{:>8\n", 1);
+#elif PRINT_MISMATCH == 6
+	// Sign on a string.
+	print(COLOR::COLOR_RED, "{:+}\n", "text");
+#else
+	print(COLOR::COLOR_RED, "{:+#x}\n", 1);
+#endif
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,146 @@
+// Default
+#include "Test.h"
+
+// C
+#include <cfloat>
+#include <cstdarg>
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// print
+// ----------------------------------------------------------------
+
+static void TestOutput() {
+	EmulatedConsole Console(80, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		BindConsole(&SCU);
+
+		// Same text as the printf family for the same values.
+		TEST_CHECK(print(COLOR::COLOR_GREEN, "{} {:.3f} {:>8} {:#x} {:08.2f} {{}}\n", 42, 3.14159, "right", 255, -2.5) == 35);
+		TEST_CHECK(clrprintf(COLOR::COLOR_GREEN, "%d %.3f %8s %#x %08.2f {}\n", 42, 3.14159, "right", 255, -2.5) == 35);
+		TEST_CHECK(GetLine(Console, 0) == L"42 3.142    right 0xff -0002.50 {}");
+		TEST_CHECK(GetLine(Console, 1) == GetLine(Console, 0));
+		TEST_CHECK((GetAttributes(Console, 0, 0) & 0x0F) == static_cast<WORD>(COLOR::COLOR_GREEN));
+
+		TEST_CHECK(print(COLOR::COLOR_CYAN, L"{:<6}|{:^7}|{:+}\n", L"left", 'c', 7) == 18);
+		TEST_CHECK(GetLine(Console, 2) == L"left  |   c   |+7");
+
+		// Sign and base prefix stay in front of zero padding.
+		TEST_CHECK(print(COLOR::COLOR_CYAN, "{:+08.2f} {:#010x} {:#o} {:#b} {: d} {:#X}\n", 2.5, -255, 8, 5u, 3, 0xABu) > 0);
+		TEST_CHECK(clrprintf(COLOR::COLOR_CYAN, "%+08.2f %#010x %#o %s % d %#X\n", 2.5, 255, 8, "0b101", 3, 0xABu) > 0);
+		TEST_CHECK(GetLine(Console, 3) == L"+0002.50 -0x00000ff 010 0b101  3 0XAB");
+		TEST_CHECK(GetLine(Console, 4) == L"+0002.50 0x000000ff 010 0b101  3 0XAB");
+
+		// Longer than the stack buffer.
+		const std::string Long(3000, 'x');
+		TEST_CHECK(print(COLOR::COLOR_RED, "{}{}\n", Long.c_str(), 1) == 3002);
+		TEST_CHECK(GetLine(Console, 5) == std::wstring(80, L'x'));
+
+		UnbindConsole(&SCU);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+static int FormatVarargs(char* szBuffer, size_t unSize, char const* const szFormat, ...) {
+	va_list vargs;
+	va_start(vargs, szFormat);
+	const int nLength = vsnprintf(szBuffer, unSize, szFormat, vargs);
+	va_end(vargs);
+	return nLength;
+}
+
+template <typename... Args>
+static std::string Format(FormatString<Args...> Text, const Args&... args) {
+	FormatWriter<char> Writer;
+	FormatTo(Writer, Text, std::index_sequence_for<Args...>(), args...);
+	return std::string(Writer.Terminate(), Writer.GetLength());
+}
+
+// The widest values in fixed notation come out whole, as printf has them.
+static void TestWide() {
+	char szExpected[6000];
+
+	TEST_CHECK(FormatVarargs(szExpected, sizeof(szExpected), "%.300f", -DBL_MAX) > 600);
+	TEST_CHECK(Format("{:.300f}", -DBL_MAX) == szExpected);
+
+	TEST_CHECK(FormatVarargs(szExpected, sizeof(szExpected), "%Lf", 1e4000L) > 4000);
+	TEST_CHECK(Format("{:f}", 1e4000L) == szExpected);
+
+	TEST_CHECK(FormatVarargs(szExpected, sizeof(szExpected), "%+.300Lf", LDBL_MAX) > 5000);
+	TEST_CHECK(Format("{:+.300f}", LDBL_MAX) == szExpected);
+
+	TEST_CHECK(Format("[{:8.2f}]", 1.5L) == "[    1.50]");
+}
+
+// Formatting alone first, then through the console. The status stays nonzero, printf's %#x has no prefix for zero.
+static void TestSpeed() {
+	const unsigned int unCalls = 500000;
+	char const* const szHost = "10.0.0.1";
+
+	size_t unTotal = 0;
+	double fStart = GetSeconds();
+	for (unsigned int i = 0; i < unCalls; ++i) {
+		char szBuffer[256];
+		unTotal += static_cast<size_t>(FormatVarargs(szBuffer, sizeof(szBuffer), "request %u took %.3f ms from %s status %#x\n", i, i * 0.001, szHost, 0x100u + (i & 0xFFu)));
+	}
+	const double fVarargs = GetSeconds() - fStart;
+
+	size_t unPrintTotal = 0;
+	fStart = GetSeconds();
+	for (unsigned int i = 0; i < unCalls; ++i) {
+		FormatWriter<char> Writer;
+		FormatTo(Writer, FormatString<unsigned int, double, char const*, unsigned int>("request {} took {:.3f} ms from {} status {:#x}\n"), std::index_sequence_for<unsigned int, double, char const*, unsigned int>(), i, i * 0.001, szHost, 0x100u + (i & 0xFFu));
+		unPrintTotal += Writer.GetLength();
+	}
+	const double fPrint = GetSeconds() - fStart;
+
+	printf("formatting: varargs %.1f ns/call, print %.1f ns/call\n", fVarargs / unCalls * 1e9, fPrint / unCalls * 1e9);
+
+	TEST_CHECK(unPrintTotal == unTotal);
+	TEST_CHECK(fPrint < fVarargs);
+
+	// Through the console as well, where the write costs the same for both.
+	EmulatedConsole Console(80, 25, 300);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		BindConsole(&SCU);
+
+		const unsigned int unLines = 20000;
+
+		fStart = GetSeconds();
+		for (unsigned int i = 0; i < unLines; ++i) {
+			TEST_CHECK(clrprintf(COLOR::COLOR_GREEN, "request %u took %.3f ms from %s status %#x\n", i, i * 0.001, "10.0.0.1", 0x100u + (i & 0xFFu)) > 0);
+		}
+		const double fClrprintf = GetSeconds() - fStart;
+
+		fStart = GetSeconds();
+		for (unsigned int i = 0; i < unLines; ++i) {
+			TEST_CHECK(print(COLOR::COLOR_GREEN, "request {} took {:.3f} ms from {} status {:#x}\n", i, i * 0.001, "10.0.0.1", 0x100u + (i & 0xFFu)) > 0);
+		}
+		const double fPrintLines = GetSeconds() - fStart;
+
+		printf("console: clrprintf %.0f lines/s, print %.0f lines/s\n", unLines / fClrprintf, unLines / fPrintLines);
+
+		UnbindConsole(&SCU);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+int main() {
+	TestOutput();
+	TestWide();
+	TestSpeed();
+
+	puts("PrintTest passed");
+
+	return EXIT_SUCCESS;
+}
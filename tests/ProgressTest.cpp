@@ -0,0 +1,225 @@
+// Default
+#include "Test.h"
+
+// C++
+#include <atomic>
+#include <thread>
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// Progress
+// ----------------------------------------------------------------
+
+// Waits for the renderer to finish unFrames more frames.
+static void WaitFrames(ProgressGroup* pGroup, unsigned long long unFrames) {
+	const unsigned long long unTarget = pGroup->GetFrames() + unFrames;
+
+	const double fStart = GetSeconds();
+	while ((pGroup->GetFrames() < unTarget) && (GetSeconds() - fStart < 2.0)) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	TEST_CHECK(pGroup->GetFrames() >= unTarget);
+}
+
+static bool StartsWith(const std::wstring& Line, wchar_t const* const szPrefix) {
+	return Line.rfind(szPrefix, 0) == 0;
+}
+
+static bool Contains(const std::wstring& Line, wchar_t const* const szText) {
+	return Line.find(szText) != std::wstring::npos;
+}
+
+static void TestLayout(bool bVirtualTerminal) {
+	EmulatedConsole Console(100, 12, 40);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		if (bVirtualTerminal) {
+			TEST_CHECK(SCU.EnableVirtualTerminal());
+		}
+
+		BindConsole(&SCU);
+
+		TEST_CHECK(clrprintf(COLOR::COLOR_GREEN, "first log line\n") > 0);
+
+		TEST_CHECK(SCU.EnableProgress(1000, 64));
+		ProgressGroup* pGroup = SCU.GetProgressGroup();
+		TEST_CHECK(pGroup);
+		TEST_CHECK(pGroup->SetMaxRows(4));
+
+		unsigned int unDownload = 0;
+		unsigned int unUnpack = 0;
+		unsigned int unDone = 0;
+		TEST_CHECK(pGroup->AddBarA("download", 1000, COLOR_PAIR(COLOR::COLOR_CYAN), &unDownload));
+		TEST_CHECK(pGroup->AddBarW(L"unpack", 0, COLOR_PAIR(COLOR::COLOR_YELLOW), &unUnpack));
+		TEST_CHECK(pGroup->AddBarW(L"x", 50, COLOR_PAIR(COLOR::COLOR_RED), &unDone));
+
+		TEST_CHECK(pGroup->Advance(unDownload, 250));
+		TEST_CHECK(pGroup->Advance(unUnpack, 7));
+		TEST_CHECK(pGroup->SetProgress(unDone, 50));
+		TEST_CHECK(pGroup->Finish(unDone));
+		TEST_CHECK(pGroup->GetProgress(unDownload) == 250);
+
+		WaitFrames(pGroup, 2);
+		TEST_CHECK(pGroup->IsShown());
+
+		// Bars sit below the log, with the fraction, the count and the bar's colors.
+		TEST_CHECK(GetLine(Console, 0) == L"first log line");
+		TEST_CHECK(StartsWith(GetLine(Console, 1), L"download "));
+		TEST_CHECK(Contains(GetLine(Console, 1), L"25%"));
+		TEST_CHECK(Contains(GetLine(Console, 1), L"250/1.00k"));
+		TEST_CHECK((GetAttributes(Console, 9, 1) & 0x0F) == static_cast<WORD>(COLOR::COLOR_CYAN));
+		TEST_CHECK(StartsWith(GetLine(Console, 2), L"unpack "));
+		TEST_CHECK(Contains(GetLine(Console, 2), L"7/?"));
+		TEST_CHECK(StartsWith(GetLine(Console, 3), L"x "));
+		TEST_CHECK(Contains(GetLine(Console, 3), L"100%"));
+		TEST_CHECK(Contains(GetLine(Console, 3), L"done"));
+
+		// Log lines, even an unfinished one, go above the bars and never into them.
+		for (unsigned int i = 0; i < 3; ++i) {
+			TEST_CHECK(clrprintf(COLOR::COLOR_WHITE, "log %u\n", i) > 0);
+		}
+		TEST_CHECK(SCU.WriteA("partial"));
+		WaitFrames(pGroup, 2);
+
+		for (SHORT nY = 1; nY <= 3; ++nY) {
+			TEST_CHECK(GetLine(Console, nY) == L"log " + std::to_wstring(nY - 1));
+		}
+		TEST_CHECK(GetLine(Console, 4) == L"partial");
+		TEST_CHECK(StartsWith(GetLine(Console, 5), L"download "));
+		TEST_CHECK(StartsWith(GetLine(Console, 7), L"x "));
+
+		// Past the window the log scrolls, and bars beyond the row limit are summed up on the last row.
+		for (unsigned int i = 0; i < 50; ++i) {
+			TEST_CHECK(clrprintf(COLOR::COLOR_WHITE, "\nscroll %u", i) > 0);
+		}
+
+		unsigned int unMore = 0;
+		for (unsigned int i = 0; i < 5; ++i) {
+			TEST_CHECK(pGroup->AddBarW(L"more", 10, COLOR_PAIR(COLOR::COLOR_BLUE), &unMore));
+		}
+		WaitFrames(pGroup, 2);
+
+		TEST_CHECK(GetLine(Console, 35) == L"scroll 49");
+		TEST_CHECK(StartsWith(GetLine(Console, 36), L"download "));
+		TEST_CHECK(StartsWith(GetLine(Console, 38), L"more "));
+		TEST_CHECK(StartsWith(GetLine(Console, 39), L"... 5 more, 1 of 8 done"));
+
+		// Output after the group stops continues below the last frame.
+		TEST_CHECK(SCU.DisableProgress());
+		TEST_CHECK(SCU.WriteA("after\n"));
+		TEST_CHECK(StartsWith(GetLine(Console, 37), L"... 5 more"));
+		TEST_CHECK(GetLine(Console, 38) == L"after");
+
+		UnbindConsole(&SCU);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// 500 bars advanced by four workers for a second, with the host charging 20us per call.
+static void TestWorkers(bool bVirtualTerminal) {
+	EmulatedConsole Console(160, 50, 300);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		if (bVirtualTerminal) {
+			TEST_CHECK(SCU.EnableVirtualTerminal());
+		}
+
+		const unsigned int unFramesPerSecond = 15;
+		TEST_CHECK(SCU.EnableProgress(unFramesPerSecond, 1024));
+		ProgressGroup* pGroup = SCU.GetProgressGroup();
+
+		const unsigned int unBarCount = 500;
+		std::vector<unsigned int> Bars(unBarCount);
+		for (unsigned int i = 0; i < unBarCount; ++i) {
+			TEST_CHECK(pGroup->AddBarA(("job " + std::to_string(i)).c_str(), 100000000ull, COLOR_PAIR(COLOR::COLOR_GREEN), &Bars[i]));
+		}
+
+		Console.SetCallCost(20);
+
+		const unsigned int unThreads = 4;
+		std::atomic<bool> bStop(false);
+		std::atomic<unsigned long long> unAdvances(0);
+
+		CONSOLE_STATISTICS Before;
+		TEST_CHECK(SCU.GetStatistics(&Before));
+		const unsigned long long unFrames = pGroup->GetFrames();
+		const unsigned long long unCells = pGroup->GetDrawnCells();
+
+		std::vector<std::thread> Threads;
+		const double fStart = GetSeconds();
+		for (unsigned int i = 0; i < unThreads; ++i) {
+			Threads.emplace_back([&, i]() {
+				unsigned long long unCount = 0;
+				unsigned int unBar = i;
+				while (!bStop.load(std::memory_order_relaxed)) {
+					for (unsigned int j = 0; j < 1000; ++j) {
+						pGroup->Advance(Bars[unBar]);
+						unBar += unThreads;
+						if (unBar >= unBarCount) {
+							unBar = i;
+						}
+					}
+					unCount += 1000;
+				}
+
+				unAdvances += unCount;
+			});
+		}
+
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+		bStop = true;
+		for (std::thread& Thread : Threads) {
+			Thread.join();
+		}
+		const double fElapsed = GetSeconds() - fStart;
+
+		CONSOLE_STATISTICS After;
+		TEST_CHECK(SCU.GetStatistics(&After));
+
+		const double fFrames = (pGroup->GetFrames() - unFrames) / fElapsed;
+		printf("%s: Advance %.1f ns per call on %u threads, %.1f frames/s, %.0f cells/s, %.0f chars/s written\n", bVirtualTerminal ? "vt " : "api", fElapsed * 1e9 * unThreads / unAdvances.load(), unThreads, fFrames, (pGroup->GetDrawnCells() - unCells) / fElapsed, (After.WrittenCharacters - Before.WrittenCharacters) / fElapsed);
+
+		// Nothing lost between the workers, and the renderer kept to its cap.
+		unsigned long long unTotal = 0;
+		for (unsigned int unBar : Bars) {
+			unTotal += pGroup->GetProgress(unBar);
+		}
+		TEST_CHECK(unTotal == unAdvances.load());
+		TEST_CHECK(fFrames <= unFramesPerSecond * 1.5);
+
+		// Uncontended, one worker.
+		const unsigned int unCalls = 10000000;
+		const double fSingleStart = GetSeconds();
+		for (unsigned int i = 0; i < unCalls; ++i) {
+			pGroup->Advance(Bars[i & 7]);
+		}
+		const double fSingle = (GetSeconds() - fSingleStart) / unCalls;
+		printf("%s: Advance %.1f ns per call on one thread\n", bVirtualTerminal ? "vt " : "api", fSingle * 1e9);
+
+		TEST_CHECK(fSingle < 1e-6);
+
+		Console.SetCallCost(0);
+		TEST_CHECK(SCU.DisableProgress());
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+int main() {
+	TestLayout(false);
+	TestLayout(true);
+	TestWorkers(false);
+	TestWorkers(true);
+
+	puts("ProgressTest passed");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,226 @@
+// Default
+#include "Test.h"
+
+// C++
+#include <atomic>
+#include <thread>
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// Raw input
+// ----------------------------------------------------------------
+
+static INPUT_RECORD MakeKey(wchar_t unChar) {
+	INPUT_RECORD Record;
+	memset(&Record, 0, sizeof(Record));
+	Record.EventType = KEY_EVENT;
+	Record.Event.KeyEvent.bKeyDown = TRUE;
+	Record.Event.KeyEvent.wRepeatCount = 1;
+	Record.Event.KeyEvent.uChar.UnicodeChar = unChar;
+	return Record;
+}
+
+static unsigned long long GetMicroseconds() {
+	return static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static void TestEvents() {
+	EmulatedConsole Console(120, 30, 300);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+
+		INPUT_EVENT Event;
+		TEST_CHECK(!SCU.PollEvent(&Event));
+		TEST_CHECK(!SCU.IsRawInput());
+
+		TEST_CHECK(SCU.EnableRawInput(64));
+		TEST_CHECK(SCU.IsRawInput());
+
+		// Nothing typed, the wait times out.
+		const double fStart = GetSeconds();
+		TEST_CHECK(!SCU.WaitEvent(&Event, 20));
+		TEST_CHECK(GetSeconds() - fStart >= 0.015);
+		TEST_CHECK(!SCU.PollEvent(&Event));
+
+		INPUT_RECORD Records[3];
+		Records[0] = MakeKey(L'q');
+		Records[1] = MakeKey(L'w');
+		Records[1].Event.KeyEvent.bKeyDown = FALSE;
+		memset(&Records[2], 0, sizeof(Records[2]));
+		Records[2].EventType = FOCUS_EVENT;
+		Records[2].Event.FocusEvent.bSetFocus = TRUE;
+		TEST_CHECK(Console.PushInputRecords(Records, 3));
+
+		TEST_CHECK(SCU.WaitEvent(&Event, 1000));
+		TEST_CHECK(Event.Type == INPUT_EVENT_TYPE::INPUT_EVENT_TYPE_KEY);
+		TEST_CHECK(Event.KeyDown && (Event.Char == L'q') && (Event.RepeatCount == 1));
+		TEST_CHECK(Event.Timestamp <= GetMicroseconds());
+
+		// The rest of the batch, in order.
+		INPUT_EVENT Events[8];
+		unsigned int unEvents = 0;
+		while ((unEvents < 2) && SCU.WaitEvent(&Events[unEvents], 1000)) {
+			++unEvents;
+			unEvents += SCU.DrainEvents(&Events[unEvents], 8 - unEvents);
+		}
+		TEST_CHECK(unEvents == 2);
+		TEST_CHECK((Events[0].Type == INPUT_EVENT_TYPE::INPUT_EVENT_TYPE_KEY) && !Events[0].KeyDown && (Events[0].Char == L'w'));
+		TEST_CHECK((Events[1].Type == INPUT_EVENT_TYPE::INPUT_EVENT_TYPE_FOCUS) && Events[1].Focus);
+
+		// Resizes come as events and drop what the buffer info cache held.
+		CONSOLE_SCREEN_BUFFER_INFOEX csbi;
+		TEST_CHECK(SCU.GetBufferInfo(&csbi));
+		TEST_CHECK(csbi.dwSize.X == 120);
+
+		TEST_CHECK(Console.ResizeWindow(80, 25));
+		TEST_CHECK(SCU.WaitEvent(&Event, 1000));
+		TEST_CHECK(Event.Type == INPUT_EVENT_TYPE::INPUT_EVENT_TYPE_RESIZE);
+		TEST_CHECK(Event.Size.X == 80);
+		TEST_CHECK(SCU.CheckResized());
+		TEST_CHECK(!SCU.CheckResized());
+
+		TEST_CHECK(SCU.GetBufferInfo(&csbi));
+		TEST_CHECK(csbi.dwSize.X == 80);
+
+		TEST_CHECK(SCU.DisableRawInput());
+		TEST_CHECK(!SCU.IsRawInput());
+		TEST_CHECK(!SCU.PollEvent(&Event));
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// Events that find the ring full are counted and dropped, the ones already queued stay.
+static void TestOverflow() {
+	EmulatedConsole Console(120, 30, 300);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		TEST_CHECK(SCU.EnableRawInput(16));
+
+		std::vector<INPUT_RECORD> Records;
+		for (unsigned int i = 0; i < 40; ++i) {
+			Records.push_back(MakeKey(static_cast<wchar_t>(L'A' + i)));
+		}
+		TEST_CHECK(Console.PushInputRecords(Records.data(), static_cast<DWORD>(Records.size())));
+
+		const double fStart = GetSeconds();
+		while ((SCU.GetDroppedEvents() < 24) && (GetSeconds() - fStart < 2.0)) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		TEST_CHECK(SCU.GetDroppedEvents() == 24);
+
+		INPUT_EVENT Events[64];
+		TEST_CHECK(SCU.DrainEvents(Events, 64) == 16);
+		for (unsigned int i = 0; i < 16; ++i) {
+			TEST_CHECK(Events[i].Char == static_cast<wchar_t>(L'A' + i));
+		}
+
+		TEST_CHECK(SCU.DisableRawInput());
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// One key at a time, from the push into the console to the application holding the event.
+static void TestLatency() {
+	EmulatedConsole Console(120, 30, 300);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		TEST_CHECK(SCU.EnableRawInput(1024));
+
+		std::vector<double> Samples;
+		std::vector<double> Decoded;
+		for (unsigned int i = 0; i < 2000; ++i) {
+			const INPUT_RECORD Record = MakeKey(L'a');
+
+			INPUT_EVENT Event;
+			const unsigned long long unStart = GetMicroseconds();
+			TEST_CHECK(Console.PushInputRecords(&Record, 1));
+			TEST_CHECK(SCU.WaitEvent(&Event, 1000));
+			const unsigned long long unEnd = GetMicroseconds();
+
+			Samples.push_back(static_cast<double>(unEnd - unStart));
+			Decoded.push_back(static_cast<double>(unEnd - Event.Timestamp));
+		}
+
+		const double fP50 = GetPercentile(Samples, 50);
+		printf("key to application: p50 %.1f us, p99 %.1f us, from the read p50 %.1f us\n", fP50, GetPercentile(Samples, 99), GetPercentile(Decoded, 50));
+
+		TEST_CHECK(fP50 < 1000.0);
+
+		TEST_CHECK(SCU.DisableRawInput());
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// A producer pushes batches of keys, never more than half the ring ahead of the application, which waits and drains.
+static void TestThroughput() {
+	EmulatedConsole Console(120, 30, 300);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		TEST_CHECK(SCU.EnableRawInput(1024));
+
+		const unsigned int unBatch = 64;
+		const unsigned int unBatches = 4000;
+		const unsigned int unTotal = unBatch * unBatches;
+
+		std::vector<INPUT_RECORD> Records(unBatch, MakeKey(L'x'));
+		std::atomic<unsigned int> unReceived(0);
+
+		const double fStart = GetSeconds();
+		std::thread Producer([&]() {
+			for (unsigned int i = 0; i < unBatches; ++i) {
+				while (i * unBatch - unReceived.load() > 512) {
+					std::this_thread::yield();
+				}
+
+				TEST_CHECK(Console.PushInputRecords(Records.data(), unBatch));
+			}
+		});
+
+		std::vector<INPUT_EVENT> Events(256);
+		unsigned int unCount = 0;
+		while (unCount < unTotal) {
+			if (!SCU.WaitEvent(&Events[0], 2000)) {
+				break;
+			}
+
+			unCount += 1 + SCU.DrainEvents(Events.data(), static_cast<unsigned int>(Events.size()));
+			unReceived.store(unCount);
+		}
+
+		Producer.join();
+		const double fElapsed = GetSeconds() - fStart;
+
+		printf("%u events in %.3f s: %.0f events/s, %llu dropped\n", unCount, fElapsed, unCount / fElapsed, SCU.GetDroppedEvents());
+
+		TEST_CHECK(unCount == unTotal);
+		TEST_CHECK(SCU.GetDroppedEvents() == 0);
+
+		TEST_CHECK(SCU.DisableRawInput());
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+int main() {
+	TestEvents();
+	TestOverflow();
+	TestLatency();
+	TestThroughput();
+
+	puts("RawInputTest passed");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,127 @@
+// Default
+#include "Test.h"
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// Recolor
+// ----------------------------------------------------------------
+
+static void TestScopes() {
+	EmulatedConsole Console(40, 10, 100);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		const WORD unDefault = GetAttributes(Console, 0, 99);
+
+		TEST_CHECK(SCU.WriteA("first\nsecond\n"));
+
+		// Content: the rows written so far, the rest of the buffer stays.
+		TEST_CHECK(SCU.SetColor(COLOR_PAIR(COLOR::COLOR_BLUE, COLOR::COLOR_WHITE), COLOR_SCOPE::COLOR_SCOPE_CONTENT));
+		TEST_CHECK(GetAttributes(Console, 39, 1) == MakeAttributes(COLOR_PAIR(COLOR::COLOR_BLUE, COLOR::COLOR_WHITE)));
+		TEST_CHECK(GetAttributes(Console, 0, 99) == unDefault);
+
+		// Window: the visible rows.
+		TEST_CHECK(SCU.SetColor(COLOR_PAIR(COLOR::COLOR_RED, COLOR::COLOR_YELLOW), COLOR_SCOPE::COLOR_SCOPE_WINDOW));
+		TEST_CHECK(GetAttributes(Console, 39, 9) == MakeAttributes(COLOR_PAIR(COLOR::COLOR_RED, COLOR::COLOR_YELLOW)));
+		TEST_CHECK(GetAttributes(Console, 0, 10) == unDefault);
+
+		// A rectangle, clipped to the buffer.
+		SMALL_RECT Region;
+		Region.Left = 2;
+		Region.Top = 3;
+		Region.Right = 60;
+		Region.Bottom = 4;
+		TEST_CHECK(SCU.RecolorRegion(Region, COLOR_PAIR(COLOR::COLOR_GREEN, COLOR::COLOR_BLACK)));
+		TEST_CHECK(GetAttributes(Console, 1, 3) == MakeAttributes(COLOR_PAIR(COLOR::COLOR_RED, COLOR::COLOR_YELLOW)));
+		TEST_CHECK(GetAttributes(Console, 2, 3) == MakeAttributes(COLOR_PAIR(COLOR::COLOR_GREEN, COLOR::COLOR_BLACK)));
+		TEST_CHECK(GetAttributes(Console, 39, 4) == MakeAttributes(COLOR_PAIR(COLOR::COLOR_GREEN, COLOR::COLOR_BLACK)));
+		TEST_CHECK(GetAttributes(Console, 2, 5) == MakeAttributes(COLOR_PAIR(COLOR::COLOR_RED, COLOR::COLOR_YELLOW)));
+
+		// The whole buffer.
+		TEST_CHECK(SCU.SetColor(COLOR_PAIR(COLOR::COLOR_BLACK, COLOR::COLOR_CYAN)));
+		TEST_CHECK(GetAttributes(Console, 0, 99) == MakeAttributes(COLOR_PAIR(COLOR::COLOR_BLACK, COLOR::COLOR_CYAN)));
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// Median time of a recolor, alternating colors so none is a no-op. pCells receives the cells touched per recolor.
+template <typename Operation>
+static double GetMedian(EmulatedConsole& Console, unsigned long long* pCells, Operation&& Function) {
+	const unsigned int unSamples = 200;
+
+	Console.ResetCalls();
+
+	std::vector<double> Samples;
+	for (unsigned int i = 0; i < unSamples; ++i) {
+		const double fStart = GetSeconds();
+		TEST_CHECK(Function(COLOR_PAIR((i % 2) ? COLOR::COLOR_BLUE : COLOR::COLOR_BLACK, COLOR::COLOR_WHITE)));
+		Samples.push_back(GetSeconds() - fStart);
+	}
+
+	*pCells = Console.GetTouchedCells() / unSamples;
+
+	return GetPercentile(Samples, 50);
+}
+
+// A screenful of text in buffers from 300 to 32000 rows. Content, window and rectangle recolors may not grow with the buffer.
+static void TestScaling() {
+	static const SHORT Heights[] = { 300, 2000, 8000, 32000 };
+
+	unsigned long long Content[4] = {};
+	unsigned long long Window[4] = {};
+	unsigned long long Region[4] = {};
+	unsigned long long Buffer[4] = {};
+
+	for (unsigned int i = 0; i < 4; ++i) {
+		EmulatedConsole Console(120, 30, Heights[i]);
+		TEST_CHECK(Console.Install());
+
+		{
+			SmartConsoleUtils SCU;
+			for (unsigned int j = 0; j < 20; ++j) {
+				TEST_CHECK(SCU.WriteA("a line of log output\n"));
+			}
+
+			SMALL_RECT Rect;
+			Rect.Left = 0;
+			Rect.Top = 0;
+			Rect.Right = 119;
+			Rect.Bottom = 19;
+
+			const double fContent = GetMedian(Console, &Content[i], [&SCU](COLOR_PAIR ColorPair) { return SCU.SetColor(ColorPair, COLOR_SCOPE::COLOR_SCOPE_CONTENT); });
+			const double fWindow = GetMedian(Console, &Window[i], [&SCU](COLOR_PAIR ColorPair) { return SCU.SetColor(ColorPair, COLOR_SCOPE::COLOR_SCOPE_WINDOW); });
+			const double fRegion = GetMedian(Console, &Region[i], [&SCU, Rect](COLOR_PAIR ColorPair) { return SCU.RecolorRegion(Rect, ColorPair); });
+			const double fBuffer = GetMedian(Console, &Buffer[i], [&SCU](COLOR_PAIR ColorPair) { return SCU.SetColor(ColorPair); });
+
+			printf("%5d rows: content %7.2f us (%llu cells), window %7.2f us (%llu cells), region %7.2f us (%llu cells), buffer %8.2f us (%llu cells)\n", Heights[i], fContent * 1e6, Content[i], fWindow * 1e6, Window[i], fRegion * 1e6, Region[i], fBuffer * 1e6, Buffer[i]);
+		}
+
+		TEST_CHECK(Console.Uninstall());
+	}
+
+	// The same cells at a hundred times the rows. Content reaches down to the window, which shows the first rows.
+	TEST_CHECK(Content[0] == 120 * 30);
+	TEST_CHECK(Window[0] == 120 * 30);
+	TEST_CHECK(Region[0] == 120 * 20);
+	for (unsigned int i = 1; i < 4; ++i) {
+		TEST_CHECK(Content[i] == Content[0]);
+		TEST_CHECK(Window[i] == Window[0]);
+		TEST_CHECK(Region[i] == Region[0]);
+	}
+
+	// Only the whole buffer grows with it.
+	TEST_CHECK(Buffer[3] == 120ull * 32000);
+}
+
+int main() {
+	TestScopes();
+	TestScaling();
+
+	puts("RecolorTest passed");
+
+	return EXIT_SUCCESS;
+}
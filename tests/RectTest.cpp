@@ -0,0 +1,151 @@
+// Default
+#include "Test.h"
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// Rectangles
+// ----------------------------------------------------------------
+
+static CHAR_INFO GetCell(EmulatedConsole& Console, SHORT nX, SHORT nY) {
+	COORD Position;
+	Position.X = nX;
+	Position.Y = nY;
+
+	CHAR_INFO Cell;
+	memset(&Cell, 0, sizeof(Cell));
+	TEST_CHECK(Console.GetCell(Position, &Cell));
+
+	return Cell;
+}
+
+static SMALL_RECT MakeRect(SHORT nLeft, SHORT nTop, SHORT nRight, SHORT nBottom) {
+	SMALL_RECT Region;
+	Region.Left = nLeft;
+	Region.Top = nTop;
+	Region.Right = nRight;
+	Region.Bottom = nBottom;
+	return Region;
+}
+
+static void TestCells(bool bVirtualTerminal) {
+	EmulatedConsole Console(120, 30, 300);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		if (bVirtualTerminal) {
+			TEST_CHECK(SCU.EnableVirtualTerminal());
+		}
+
+		// A 40x20 panel is one write, whatever the mode.
+		const SMALL_RECT Region = MakeRect(10, 5, 49, 24);
+
+		Console.ResetCalls();
+		TEST_CHECK(SCU.FillRect(Region, L'#', COLOR_PAIR(COLOR::COLOR_DARK_BLUE, COLOR::COLOR_YELLOW)));
+		TEST_CHECK(Console.GetCalls(bVirtualTerminal ? EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE : EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE_OUTPUT) == 1);
+		TEST_CHECK(Console.GetTotalCalls() <= 2);
+
+		TEST_CHECK(GetCell(Console, 10, 5).Char.UnicodeChar == L'#');
+		TEST_CHECK(GetCell(Console, 10, 5).Attributes == MakeAttributes(COLOR_PAIR(COLOR::COLOR_DARK_BLUE, COLOR::COLOR_YELLOW)));
+		TEST_CHECK(GetCell(Console, 49, 24).Char.UnicodeChar == L'#');
+		TEST_CHECK(GetCell(Console, 9, 5).Char.UnicodeChar != L'#');
+		TEST_CHECK(GetCell(Console, 50, 24).Char.UnicodeChar != L'#');
+		TEST_CHECK(GetCell(Console, 10, 25).Char.UnicodeChar != L'#');
+
+		// Read back in one call.
+		std::vector<CHAR_INFO> Cells(40 * 20);
+		Console.ResetCalls();
+		TEST_CHECK(SCU.ReadCells(Region, Cells.data()));
+		TEST_CHECK(Console.GetCalls(EMULATED_CALL::EMULATED_CALL_READ_CONSOLE_OUTPUT) == 1);
+		TEST_CHECK(Cells.front().Char.UnicodeChar == L'#');
+		TEST_CHECK(Cells.back().Attributes == MakeAttributes(COLOR_PAIR(COLOR::COLOR_DARK_BLUE, COLOR::COLOR_YELLOW)));
+
+		// Blits are clipped against the buffer, rows keep the source stride.
+		for (size_t i = 0; i < Cells.size(); ++i) {
+			Cells[i].Char.UnicodeChar = static_cast<wchar_t>(L'a' + i % 26);
+			Cells[i].Attributes = static_cast<WORD>(1 + i % 15);
+		}
+
+		TEST_CHECK(SCU.BlitCells(MakeRect(100, 20, 139, 39), Cells.data()));
+		TEST_CHECK(GetCell(Console, 100, 20).Char.UnicodeChar == L'a');
+		TEST_CHECK(GetCell(Console, 119, 21).Char.UnicodeChar == Cells[40 + 19].Char.UnicodeChar);
+		TEST_CHECK(GetCell(Console, 119, 29).Char.UnicodeChar == Cells[9 * 40 + 19].Char.UnicodeChar);
+		TEST_CHECK(GetCell(Console, 119, 29).Attributes == Cells[9 * 40 + 19].Attributes);
+
+		// Nothing left after clipping.
+		TEST_CHECK(!SCU.FillRect(MakeRect(200, 5, 210, 6), L'#'));
+		TEST_CHECK(!SCU.EraseRect(MakeRect(10, 5, 5, 6)));
+
+		TEST_CHECK(SCU.EraseRect(Region));
+		TEST_CHECK(GetCell(Console, 10, 5).Char.UnicodeChar == L' ');
+		TEST_CHECK(GetCell(Console, 49, 24).Char.UnicodeChar == L' ');
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// Erasing a 40x20 panel in one go against a per-row Erase loop, with the host charging unCallCost us per call.
+static void TestThroughput(bool bVirtualTerminal, unsigned int unCallCost) {
+	EmulatedConsole Console(120, 30, 300);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		if (bVirtualTerminal) {
+			TEST_CHECK(SCU.EnableVirtualTerminal());
+		}
+
+		const SMALL_RECT Region = MakeRect(10, 5, 49, 24);
+		const double fCells = 40.0 * 20.0;
+		const unsigned int unRounds = 50;
+
+		TEST_CHECK(SCU.EraseRect(Region));
+		Console.SetCallCost(unCallCost);
+
+		const unsigned long long unAllocations = GetAllocations();
+		double fStart = GetSeconds();
+		for (unsigned int i = 0; i < unRounds; ++i) {
+			TEST_CHECK(SCU.EraseRect(Region));
+		}
+		const double fRect = (GetSeconds() - fStart) / unRounds;
+		const unsigned long long unRectAllocations = GetAllocations() - unAllocations;
+
+		fStart = GetSeconds();
+		for (unsigned int i = 0; i < unRounds; ++i) {
+			for (SHORT nY = Region.Top; nY <= Region.Bottom; ++nY) {
+				COORD Position;
+				Position.X = Region.Left;
+				Position.Y = nY;
+				TEST_CHECK(SCU.Erase(Position, 40));
+			}
+		}
+		const double fRows = (GetSeconds() - fStart) / unRounds;
+
+		printf("%s at %u us per call: EraseRect %.2f Mcells/s, per-row Erase %.2f Mcells/s\n", bVirtualTerminal ? "vt " : "api", unCallCost, fCells / fRect / 1e6, fCells / fRows / 1e6);
+
+		TEST_CHECK(unRectAllocations == 0);
+		if (unCallCost) {
+			TEST_CHECK(fRect * 4 < fRows);
+		}
+
+		Console.SetCallCost(0);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+int main() {
+	TestCells(false);
+	TestCells(true);
+
+	TestThroughput(false, 0);
+	TestThroughput(false, 20);
+	TestThroughput(true, 0);
+	TestThroughput(true, 20);
+
+	puts("RectTest passed");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,217 @@
+// Default
+#include "Test.h"
+
+// C++
+#include <string>
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// ScreenBuffer
+// ----------------------------------------------------------------
+
+static COORD MakePosition(SHORT nX, SHORT nY) {
+	COORD Position;
+	Position.X = nX;
+	Position.Y = nY;
+	return Position;
+}
+
+static unsigned long long GetWrites(EmulatedConsole& Console) {
+	return Console.GetCalls(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE) + Console.GetCalls(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE_OUTPUT);
+}
+
+static void TestFrames(bool bVirtualTerminal) {
+	EmulatedConsole Console(40, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		if (bVirtualTerminal) {
+			TEST_CHECK(SCU.EnableVirtualTerminal());
+		}
+
+		const WORD unDefault = GetAttributes(Console, 0, 0);
+
+		ScreenBuffer Screen(&SCU);
+		TEST_CHECK(Screen.Update());
+		TEST_CHECK((Screen.GetSize().X == 40) && (Screen.GetSize().Y == 10));
+
+		// Text is clipped against the grid and doesn't wrap.
+		Screen.Clear();
+		TEST_CHECK(Screen.WriteA(MakePosition(2, 1), COLOR_PAIR(COLOR::COLOR_BLUE, COLOR::COLOR_YELLOW), "hello") == 5);
+		TEST_CHECK(Screen.WriteW(MakePosition(35, 3), COLOR_PAIR(COLOR::COLOR_RED), L"clipped text") == 5);
+		TEST_CHECK(Screen.WriteW(MakePosition(-3, 5), COLOR_PAIR(), L"abcdef") == 3);
+		TEST_CHECK(Screen.SetCell(MakePosition(39, 9), L'#', COLOR_PAIR(COLOR::COLOR_GREEN)));
+		TEST_CHECK(!Screen.SetCell(MakePosition(40, 9), L'#'));
+
+		// The first frame sends everything.
+		Console.ResetCalls();
+		TEST_CHECK(Screen.Present());
+		TEST_CHECK(Screen.GetPresentedRows() == 10);
+		TEST_CHECK(Screen.GetPresentedCells() == 400);
+		TEST_CHECK(GetWrites(Console) == 1);
+
+		TEST_CHECK(GetLine(Console, 1) == L"  hello");
+		TEST_CHECK(GetLine(Console, 3) == std::wstring(35, L' ') + L"clipp");
+		TEST_CHECK(GetLine(Console, 5) == L"def");
+		TEST_CHECK(GetLine(Console, 9) == std::wstring(39, L' ') + L"#");
+		TEST_CHECK(GetAttributes(Console, 2, 1) == MakeAttributes(COLOR_PAIR(COLOR::COLOR_BLUE, COLOR::COLOR_YELLOW)));
+		TEST_CHECK(GetAttributes(Console, 35, 3) == ((unDefault & 0xF0) | static_cast<WORD>(COLOR::COLOR_RED)));
+		TEST_CHECK(GetAttributes(Console, 39, 9) == ((unDefault & 0xF0) | static_cast<WORD>(COLOR::COLOR_GREEN)));
+		TEST_CHECK(GetAttributes(Console, 0, 0) == unDefault);
+
+		// Nothing changed, nothing is sent.
+		Console.ResetCalls();
+		TEST_CHECK(Screen.Present());
+		TEST_CHECK(Screen.GetPresentedRows() == 0);
+		TEST_CHECK(Screen.GetPresentedCells() == 0);
+		TEST_CHECK(Screen.GetPresentedBytes() == 0);
+		TEST_CHECK(Console.GetTotalCalls() == 0);
+
+		// Only the changed span of a row, "hello" to "help!" is the last two cells.
+		TEST_CHECK(Screen.WriteA(MakePosition(2, 1), COLOR_PAIR(COLOR::COLOR_BLUE, COLOR::COLOR_YELLOW), "help!") == 5);
+		Console.ResetCalls();
+		TEST_CHECK(Screen.Present());
+		TEST_CHECK(Screen.GetPresentedRows() == 1);
+		TEST_CHECK(Screen.GetPresentedCells() == 2);
+		TEST_CHECK(GetWrites(Console) == 1);
+		TEST_CHECK(GetLine(Console, 1) == L"  help!");
+
+		// A color change alone is a change too.
+		TEST_CHECK(Screen.SetCell(MakePosition(39, 9), L'#', COLOR_PAIR(COLOR::COLOR_MAGENTA)));
+		TEST_CHECK(Screen.SetCell(MakePosition(0, 7), L'x'));
+		TEST_CHECK(Screen.Present());
+		TEST_CHECK(Screen.GetPresentedRows() == 2);
+		TEST_CHECK(Screen.GetPresentedCells() == 2);
+		TEST_CHECK(GetLine(Console, 7) == L"x");
+		TEST_CHECK((GetAttributes(Console, 39, 9) & 0x0F) == static_cast<WORD>(COLOR::COLOR_MAGENTA));
+
+		// Writing the same text again isn't.
+		TEST_CHECK(Screen.WriteA(MakePosition(2, 1), COLOR_PAIR(COLOR::COLOR_BLUE, COLOR::COLOR_YELLOW), "help!") == 5);
+		TEST_CHECK(Screen.Present());
+		TEST_CHECK(Screen.GetPresentedCells() == 0);
+
+		// After Invalidate() the next frame is full again.
+		Screen.Invalidate();
+		TEST_CHECK(Screen.Present());
+		TEST_CHECK(Screen.GetPresentedCells() == 400);
+
+		// The cursor is where it was.
+		COORD Cursor;
+		TEST_CHECK(Console.GetCursorPosition(&Cursor));
+		TEST_CHECK((Cursor.X == 0) && (Cursor.Y == 0));
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// Presenting into memory, no console needed.
+static void TestHeadless() {
+	ScreenBuffer Screen;
+	TEST_CHECK(!Screen.Update());
+	TEST_CHECK(Screen.Resize(MakePosition(20, 5)));
+	Screen.Clear();
+
+	std::vector<CHAR_INFO> Target(100);
+	memset(Target.data(), 0, Target.size() * sizeof(CHAR_INFO));
+
+	TEST_CHECK(Screen.WriteW(MakePosition(1, 2), COLOR_PAIR(COLOR::COLOR_CYAN, COLOR::COLOR_BLACK), L"abc") == 3);
+	TEST_CHECK(Screen.Present(Target.data()));
+	TEST_CHECK(Screen.GetPresentedCells() == 100);
+	TEST_CHECK(Screen.GetPresentedBytes() == 100 * sizeof(CHAR_INFO));
+	TEST_CHECK(memcmp(Target.data(), Screen.GetCells(), Target.size() * sizeof(CHAR_INFO)) == 0);
+
+	// Cells outside the changed span are left alone.
+	Target[0].Char.UnicodeChar = L'?';
+	TEST_CHECK(Screen.SetCell(MakePosition(3, 2), L'Z'));
+	TEST_CHECK(Screen.Present(Target.data()));
+	TEST_CHECK(Screen.GetPresentedCells() == 1);
+	TEST_CHECK(Target[2 * 20 + 3].Char.UnicodeChar == L'Z');
+	TEST_CHECK(Target[2 * 20 + 3].Attributes == MakeAttributes(COLOR_PAIR(COLOR::COLOR_CYAN, COLOR::COLOR_BLACK)));
+	TEST_CHECK(Target[0].Char.UnicodeChar == L'?');
+
+	// Growing keeps what fits.
+	TEST_CHECK(Screen.Resize(MakePosition(30, 6)));
+	CHAR_INFO Cell;
+	TEST_CHECK(Screen.GetCell(MakePosition(3, 2), &Cell));
+	TEST_CHECK(Cell.Char.UnicodeChar == L'Z');
+	TEST_CHECK(Screen.GetCell(MakePosition(29, 5), &Cell));
+	TEST_CHECK(Cell.Char.UnicodeChar == L' ');
+	TEST_CHECK(!Screen.GetCell(MakePosition(30, 5), &Cell));
+}
+
+// A dashboard redrawn every frame: fully repainted, with only its status line ticking, and with nothing changed. Pass the frame count for a longer run.
+static void TestThroughput(bool bVirtualTerminal, unsigned int unFrames) {
+	EmulatedConsole Console(120, 40, 40);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		if (bVirtualTerminal) {
+			TEST_CHECK(SCU.EnableVirtualTerminal());
+		}
+
+		ScreenBuffer Screen(&SCU);
+		TEST_CHECK(Screen.Update());
+
+		static char const* const Names[] = { "full", "partial", "unchanged" };
+		double Bytes[3] = {};
+
+		char szLine[128];
+		for (unsigned int unKind = 0; unKind < 3; ++unKind) {
+			unsigned long long unBytes = 0;
+			unsigned long long unCells = 0;
+
+			Console.ResetCalls();
+			const double fStart = GetSeconds();
+			for (unsigned int i = 0; i < unFrames; ++i) {
+				if (!unKind) {
+					// Every row moves, as if the whole view scrolled.
+					for (SHORT nY = 0; nY < 40; ++nY) {
+						snprintf(szLine, sizeof(szLine), "%6u  process-%04u  %5.1f%%  %-80s", i + nY, (i * 7 + nY) % 10000, ((i + nY) % 1000) / 10.0, "running");
+						Screen.WriteA(MakePosition(0, nY), static_cast<COLOR>(1 + ((i + nY) % 15)), szLine);
+					}
+				} else if (unKind == 1) {
+					snprintf(szLine, sizeof(szLine), "frame %8u", i);
+					Screen.WriteA(MakePosition(0, 39), COLOR::COLOR_YELLOW, szLine);
+				}
+
+				TEST_CHECK(Screen.Present());
+				unBytes += Screen.GetPresentedBytes();
+				unCells += Screen.GetPresentedCells();
+			}
+			const double fElapsed = GetSeconds() - fStart;
+
+			Bytes[unKind] = static_cast<double>(unBytes) / unFrames;
+			printf("%s %-9s %8.0f frames/s, %9.1f bytes/frame, %7.1f cells/frame, %.2f writes/frame\n", bVirtualTerminal ? "vt " : "api", Names[unKind], unFrames / fElapsed, Bytes[unKind], static_cast<double>(unCells) / unFrames, static_cast<double>(GetWrites(Console)) / unFrames);
+
+			if (unKind == 2) {
+				TEST_CHECK(unBytes == 0);
+				TEST_CHECK(GetWrites(Console) == 0);
+			} else {
+				TEST_CHECK(GetWrites(Console) == unFrames);
+			}
+		}
+
+		// A ticking counter changes a few cells of one row.
+		TEST_CHECK(Bytes[1] * 100 < Bytes[0]);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+int main(int nArguments, char* pArguments[]) {
+	TestFrames(false);
+	TestFrames(true);
+	TestHeadless();
+
+	const unsigned int unFrames = (nArguments > 1) ? static_cast<unsigned int>(atoi(pArguments[1])) : 500;
+	TestThroughput(false, unFrames);
+	TestThroughput(true, unFrames);
+
+	puts("ScreenBufferTest passed");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,128 @@
+// Default
+#include "Test.h"
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// SpanWriter
+// ----------------------------------------------------------------
+
+static const COLOR g_Colors[5] = { COLOR::COLOR_RED, COLOR::COLOR_GREEN, COLOR::COLOR_BLUE, COLOR::COLOR_YELLOW, COLOR::COLOR_CYAN };
+static char const* const g_szFields[5] = { "time ", "level ", "thread ", "module ", "message\n" };
+
+// One log line of five colored fields.
+static void AddLine(SpanWriter& Writer) {
+	for (unsigned int i = 0; i < 5; ++i) {
+		TEST_CHECK(Writer.AddA(g_Colors[i], g_szFields[i]));
+	}
+}
+
+static void CheckLine(EmulatedConsole& Console, SHORT nY) {
+	TEST_CHECK(GetLine(Console, nY) == L"time level thread module message");
+
+	SHORT nX = 0;
+	for (unsigned int i = 0; i < 5; ++i) {
+		const SHORT nLength = static_cast<SHORT>(strlen(g_szFields[i]) - ((i == 4) ? 1 : 0));
+		for (SHORT j = 0; j < nLength; ++j, ++nX) {
+			TEST_CHECK((GetAttributes(Console, nX, nY) & 0x0F) == static_cast<WORD>(g_Colors[i]));
+		}
+	}
+}
+
+static void TestCommit() {
+	EmulatedConsole Console(80, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		SpanWriter Writer;
+
+		// Attributes: one write for the text, one for the colors.
+		AddLine(Writer);
+		TEST_CHECK(Writer.GetSpans() == 5);
+
+		Console.ResetCalls();
+		TEST_CHECK(Writer.Commit(&SCU));
+		TEST_CHECK(Console.GetCalls(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE_OUTPUT_ATTRIBUTE) == 1);
+		TEST_CHECK(Writer.GetSpans() == 0);
+		CheckLine(Console, 0);
+
+		// Virtual terminal: one stream.
+		TEST_CHECK(SCU.EnableVirtualTerminal());
+		AddLine(Writer);
+
+		Console.ResetCalls();
+		TEST_CHECK(Writer.Commit(&SCU));
+		TEST_CHECK(Console.GetCalls(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE) == 1);
+		CheckLine(Console, 1);
+
+		TEST_CHECK(SCU.DisableVirtualTerminal());
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// Five fields per line through one SpanWriter, against five clrprintf calls. Every console call costs the host 5 us.
+static void TestThroughput() {
+	EmulatedConsole Console(80, 25, 1000);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		BindConsole(&SCU);
+		Console.SetCallCost(5);
+
+		const unsigned int unLines = 4000;
+
+		Console.ResetCalls();
+		double fStart = GetSeconds();
+		for (unsigned int i = 0; i < unLines; ++i) {
+			for (unsigned int j = 0; j < 5; ++j) {
+				TEST_CHECK(clrprintf(g_Colors[j], "%s", g_szFields[j]) > 0);
+			}
+		}
+		const double fPerCallElapsed = GetSeconds() - fStart;
+		const double fPerCallCalls = static_cast<double>(Console.GetTotalCalls()) / unLines;
+
+		SpanWriter Writer;
+		Writer.Reserve(64, 8);
+
+		// The first commit sizes the internal buffers.
+		AddLine(Writer);
+		TEST_CHECK(Writer.Commit(&SCU));
+
+		Console.ResetCalls();
+		const unsigned long long unAllocations = GetAllocations();
+		fStart = GetSeconds();
+		for (unsigned int i = 0; i < unLines; ++i) {
+			AddLine(Writer);
+			TEST_CHECK(Writer.Commit(&SCU));
+		}
+		const double fWriterElapsed = GetSeconds() - fStart;
+		const double fWriterCalls = static_cast<double>(Console.GetTotalCalls()) / unLines;
+		const unsigned long long unWriterAllocations = GetAllocations() - unAllocations;
+
+		printf("per call:   %.0f spans/s, %.1f console calls per line\n", 5 * unLines / fPerCallElapsed, fPerCallCalls);
+		printf("SpanWriter: %.0f spans/s, %.1f console calls per line, %llu allocations\n", 5 * unLines / fWriterElapsed, fWriterCalls, unWriterAllocations);
+
+		TEST_CHECK(fWriterCalls < fPerCallCalls);
+		TEST_CHECK(fWriterElapsed < fPerCallElapsed);
+		TEST_CHECK(unWriterAllocations == 0);
+
+		Console.SetCallCost(0);
+
+		UnbindConsole(&SCU);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+int main() {
+	TestCommit();
+	TestThroughput();
+
+	puts("SpanWriterTest passed");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,208 @@
+// Default
+#include "Test.h"
+
+// C++
+#include <string>
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// Table
+// ----------------------------------------------------------------
+
+static void TestBuffered(bool bVirtualTerminal) {
+	EmulatedConsole Console(80, 30, 100);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		if (bVirtualTerminal) {
+			TEST_CHECK(SCU.EnableVirtualTerminal());
+		}
+
+		const WORD unDefault = GetAttributes(Console, 0, 0);
+
+		{
+			Table Rows(&SCU, TABLE_MODE::TABLE_MODE_BUFFERED);
+			TEST_CHECK(Rows.AddColumnA("name"));
+			TEST_CHECK(Rows.AddColumnW(L"size", TABLE_ALIGN::TABLE_ALIGN_RIGHT, COLOR_PAIR(COLOR::COLOR_CYAN)));
+			TEST_CHECK(Rows.AddColumnW(L"state", TABLE_ALIGN::TABLE_ALIGN_CENTER, COLOR_PAIR(COLOR::COLOR_GREEN), 6));
+			TEST_CHECK(Rows.AddColumnW(L"note", TABLE_ALIGN::TABLE_ALIGN_LEFT, COLOR_PAIR(COLOR::COLOR_BLUE, COLOR::COLOR_WHITE)));
+			TEST_CHECK(Rows.GetColumns() == 4);
+
+			const std::string_view First[] = { "alpha", "12", "ok", "x" };
+			const std::string_view Second[] = { "b", "123456", "failed badly", "tab\there" };
+			const std::string_view Third[] = { "gamma-long-name" };
+			TEST_CHECK(Rows.AddRowA(First, 4));
+			TEST_CHECK(Rows.AddRowA(Second, 4));
+			TEST_CHECK(Rows.AddRowA(Third, 1));
+
+			// The layout is fixed now.
+			TEST_CHECK(!Rows.AddColumnA("late"));
+
+			// Nothing is written before the flush.
+			TEST_CHECK(GetLine(Console, 0).empty());
+			TEST_CHECK(Rows.Flush());
+			TEST_CHECK(Rows.GetRows() == 3);
+		}
+
+		// Exact widths, cut cells end in "...", control characters become spaces.
+		TEST_CHECK(GetLine(Console, 0) == L"name               size  state   note");
+		TEST_CHECK(GetLine(Console, 1) == L"---------------  ------  ------  --------");
+		TEST_CHECK(GetLine(Console, 2) == L"alpha                12    ok    x");
+		TEST_CHECK(GetLine(Console, 3) == L"b                123456  fai...  tab here");
+		TEST_CHECK(GetLine(Console, 4) == L"gamma-long-name");
+
+		// Cells, padding included, take their column's colors. Separators and the rest of the row keep the console's.
+		TEST_CHECK(GetAttributes(Console, 17, 2) == ((unDefault & 0xF0) | static_cast<WORD>(COLOR::COLOR_CYAN)));
+		TEST_CHECK(GetAttributes(Console, 22, 3) == ((unDefault & 0xF0) | static_cast<WORD>(COLOR::COLOR_CYAN)));
+		TEST_CHECK(GetAttributes(Console, 33, 3) == MakeAttributes(COLOR_PAIR(COLOR::COLOR_BLUE, COLOR::COLOR_WHITE)));
+		TEST_CHECK(GetAttributes(Console, 15, 2) == unDefault);
+		TEST_CHECK(GetAttributes(Console, 79, 2) == unDefault);
+
+		COORD Cursor;
+		TEST_CHECK(Console.GetCursorPosition(&Cursor));
+		TEST_CHECK((Cursor.X == 0) && (Cursor.Y == 5));
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// Streaming tables widen a column as soon as a wider cell arrives, and narrow it again once the sample window has moved past it.
+static void TestStreaming() {
+	EmulatedConsole Console(80, 30, 100);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+
+		{
+			Table Rows(&SCU);
+			TEST_CHECK(Rows.SetSampleRows(3));
+			TEST_CHECK(Rows.SetBatchRows(2));
+			TEST_CHECK(Rows.AddColumnW(L"k"));
+			TEST_CHECK(Rows.AddColumnW(L"v", TABLE_ALIGN::TABLE_ALIGN_RIGHT));
+
+			static wchar_t const* const Keys[] = { L"a", L"bb", L"c", L"wideeeee", L"d", L"e", L"f", L"g", L"h" };
+			for (unsigned int i = 0; i < 9; ++i) {
+				const std::wstring Value = std::to_wstring(i * i * i);
+				const std::wstring_view Cells[] = { Keys[i], Value };
+				TEST_CHECK(Rows.AddRowW(Cells, 2));
+			}
+
+			TEST_CHECK(Rows.Flush());
+			TEST_CHECK(Rows.GetRows() == 9);
+		}
+
+		TEST_CHECK(GetLine(Console, 2) == L"a   0");
+		TEST_CHECK(GetLine(Console, 3) == L"bb  1");
+		TEST_CHECK(GetLine(Console, 5) == L"wideeeee  27");
+		TEST_CHECK(GetLine(Console, 9) == L"g         343");
+		TEST_CHECK(GetLine(Console, 10) == L"h  512");
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// Rows for a listing of unRows files, the way a caller would produce them.
+template <typename Function>
+static void MakeRows(unsigned int unRows, Function&& Callback) {
+	char szId[16];
+	char szName[32];
+	char szSize[16];
+
+	for (unsigned int i = 0; i < unRows; ++i) {
+		const int nId = snprintf(szId, sizeof(szId), "%u", i);
+		const int nName = snprintf(szName, sizeof(szName), "file-%u.dat", (i * 7919u) % 100000u);
+		const int nSize = snprintf(szSize, sizeof(szSize), "%u", (i * 31337u) % 1000000u);
+
+		const std::string_view Cells[] = { std::string_view(szId, static_cast<size_t>(nId)), std::string_view(szName, static_cast<size_t>(nName)), std::string_view(szSize, static_cast<size_t>(nSize)), (i % 3) ? "ok" : "pending" };
+		Callback(i, Cells);
+	}
+}
+
+// A streamed listing against one clrprintf per cell, with the host charging 5us per call. Pass the row count for a longer run.
+static void TestThroughput(bool bVirtualTerminal, unsigned int unRows) {
+	EmulatedConsole Console(120, 40, 300);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		if (bVirtualTerminal) {
+			TEST_CHECK(SCU.EnableVirtualTerminal());
+		}
+
+		BindConsole(&SCU);
+		Console.SetCallCost(5);
+
+		size_t unHalfBytes = 0;
+		size_t unFullBytes = 0;
+		unsigned long long unHalfAllocations = 0;
+		unsigned long long unLaterAllocations = 0;
+
+		Console.ResetCalls();
+		double fStart = GetSeconds();
+		{
+			Table Rows(&SCU);
+			TEST_CHECK(Rows.AddColumnA("id", TABLE_ALIGN::TABLE_ALIGN_RIGHT, COLOR_PAIR(COLOR::COLOR_YELLOW)));
+			TEST_CHECK(Rows.AddColumnA("name"));
+			TEST_CHECK(Rows.AddColumnA("size", TABLE_ALIGN::TABLE_ALIGN_RIGHT, COLOR_PAIR(COLOR::COLOR_CYAN)));
+			TEST_CHECK(Rows.AddColumnA("state", TABLE_ALIGN::TABLE_ALIGN_LEFT, COLOR_PAIR(COLOR::COLOR_GREEN)));
+
+			MakeRows(unRows, [&](unsigned int i, const std::string_view* pCells) {
+				TEST_CHECK(Rows.AddRowA(pCells, 4));
+
+				if (i == unRows / 2) {
+					unHalfBytes = Rows.GetBufferedBytes();
+					unHalfAllocations = GetAllocations();
+				}
+			});
+
+			unFullBytes = Rows.GetBufferedBytes();
+			unLaterAllocations = GetAllocations() - unHalfAllocations;
+			TEST_CHECK(Rows.Flush());
+		}
+		const double fTable = GetSeconds() - fStart;
+		const unsigned long long unTableWrites = Console.GetCalls(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE);
+
+		const unsigned int unPrintRows = unRows / 10;
+
+		Console.ResetCalls();
+		fStart = GetSeconds();
+		MakeRows(unPrintRows, [](unsigned int, const std::string_view* pCells) {
+			TEST_CHECK(clrprintf(COLOR::COLOR_YELLOW, "%8.*s  ", static_cast<int>(pCells[0].size()), pCells[0].data()) > 0);
+			TEST_CHECK(clrprintf(COLOR::COLOR_WHITE, "%-16.*s  ", static_cast<int>(pCells[1].size()), pCells[1].data()) > 0);
+			TEST_CHECK(clrprintf(COLOR::COLOR_CYAN, "%8.*s  ", static_cast<int>(pCells[2].size()), pCells[2].data()) > 0);
+			TEST_CHECK(clrprintf(COLOR::COLOR_GREEN, "%.*s\n", static_cast<int>(pCells[3].size()), pCells[3].data()) > 0);
+		});
+		const double fPrint = GetSeconds() - fStart;
+		const unsigned long long unPrintWrites = Console.GetCalls(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE);
+
+		printf("%s: table %.0f rows/s in %.3f writes/row, clrprintf per cell %.0f rows/s in %.3f writes/row, %zu bytes held at %u rows and %zu at %u\n", bVirtualTerminal ? "vt " : "api", unRows / fTable, static_cast<double>(unTableWrites) / unRows, unPrintRows / fPrint, static_cast<double>(unPrintWrites) / unPrintRows, unHalfBytes, unRows / 2, unFullBytes, unRows);
+
+		// Constant memory once streaming.
+		TEST_CHECK(unFullBytes == unHalfBytes);
+		TEST_CHECK(unLaterAllocations == 0);
+		TEST_CHECK(unRows / fTable > unPrintRows / fPrint);
+
+		Console.SetCallCost(0);
+		UnbindConsole(&SCU);
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+int main(int nArguments, char* pArguments[]) {
+	TestBuffered(false);
+	TestBuffered(true);
+	TestStreaming();
+
+	const unsigned int unRows = (nArguments > 1) ? static_cast<unsigned int>(atoi(pArguments[1])) : 20000;
+	TestThroughput(false, unRows);
+	TestThroughput(true, unRows);
+
+	puts("TableTest passed");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+#ifndef _CONSOLEUTILS_TEST_H_
+#define _CONSOLEUTILS_TEST_H_
+
+// ConsoleUtils
+#include "ConsoleUtils.h"
+
+// C
+#include <cstdio>
+#include <cstdlib>
+
+// C++
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// ----------------------------------------------------------------
+// Checks
+// ----------------------------------------------------------------
+
+// Unlike assert, checks stay on in release builds.
+#define TEST_CHECK(Expression)                                                              \
+	do {                                                                                    \
+		if (!(Expression)) {                                                                \
+			fprintf(stderr, "%s(%d): check failed: %s\n", __FILE__, __LINE__, #Expression); \
+			exit(EXIT_FAILURE);                                                             \
+		}                                                                                   \
+	} while (false)
+
+namespace ConsoleUtilsTest {
+	// ----------------------------------------------------------------
+	// Screen
+	// ----------------------------------------------------------------
+
+	// Text of a buffer row without trailing spaces.
+	inline std::wstring GetLine(ConsoleUtils::EmulatedConsole& Console, SHORT nY) {
+		wchar_t szLine[1024];
+		if (!Console.GetLine(nY, szLine, sizeof(szLine) / sizeof(wchar_t))) {
+			return std::wstring();
+		}
+
+		return szLine;
+	}
+
+	inline WORD GetAttributes(ConsoleUtils::EmulatedConsole& Console, SHORT nX, SHORT nY) {
+		CHAR_INFO Cell;
+		COORD Position;
+		Position.X = nX;
+		Position.Y = nY;
+
+		if (!Console.GetCell(Position, &Cell)) {
+			return 0xFFFF;
+		}
+
+		return Cell.Attributes;
+	}
+
+	inline WORD MakeAttributes(ConsoleUtils::COLOR_PAIR ColorPair) {
+		return static_cast<WORD>((static_cast<unsigned char>(ColorPair.ColorBackground) << 4) | static_cast<unsigned char>(ColorPair.ColorForeground));
+	}
+
+	// ----------------------------------------------------------------
+	// Timing
+	// ----------------------------------------------------------------
+
+	inline double GetSeconds() {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Value below which unPercent percent of the samples lie. Sorts the samples.
+	inline double GetPercentile(std::vector<double>& Samples, unsigned int unPercent) {
+		if (Samples.empty()) {
+			return 0.0;
+		}
+
+		std::sort(Samples.begin(), Samples.end());
+
+		const size_t unIndex = std::min(Samples.size() - 1, (Samples.size() * unPercent) / 100);
+		return Samples[unIndex];
+	}
+
+	// ----------------------------------------------------------------
+	// Allocations
+	// ----------------------------------------------------------------
+
+	// Heap allocations made through operator new since the start of the process, by all threads.
+	unsigned long long GetAllocations();
+}
+
+#endif // !_CONSOLEUTILS_TEST_H_
@@ -0,0 +1,246 @@
+// Default
+#include "Test.h"
+
+// C++
+#include <random>
+#include <string>
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// UTF-8
+// ----------------------------------------------------------------
+
+static char const* const g_szLevels[] = { "scalar", "SSE2", "AVX2" };
+
+static std::vector<unsigned int> ToUTF16(const std::string& Text, SIMD_LEVEL Level) {
+	TEST_CHECK(SetSimdLevel(Level));
+
+	// Room for one unit per byte, as documented, and a poisoned one past it that nothing may write.
+	std::vector<wchar_t> Units(Text.size() + 1, static_cast<wchar_t>(0x5555));
+	const size_t unUnits = ConvertUTF8ToUTF16(Text.data(), Text.size(), Units.data());
+	TEST_CHECK(unUnits <= Text.size());
+	TEST_CHECK(Units[Text.size()] == static_cast<wchar_t>(0x5555));
+
+	return std::vector<unsigned int>(Units.begin(), Units.begin() + unUnits);
+}
+
+static std::string ToUTF8(const std::vector<unsigned int>& Units, SIMD_LEVEL Level) {
+	TEST_CHECK(SetSimdLevel(Level));
+
+	const std::vector<wchar_t> Source(Units.begin(), Units.end());
+	std::string Text(Units.size() * 3, '\0');
+	Text.resize(ConvertUTF16ToUTF8(Source.data(), Source.size(), &Text[0]));
+
+	return Text;
+}
+
+static void Append(std::string& Text, char32_t unCodePoint) {
+	if (unCodePoint < 0x80) {
+		Text += static_cast<char>(unCodePoint);
+	} else if (unCodePoint < 0x800) {
+		Text += static_cast<char>(0xC0 | (unCodePoint >> 6));
+		Text += static_cast<char>(0x80 | (unCodePoint & 0x3F));
+	} else if (unCodePoint < 0x10000) {
+		Text += static_cast<char>(0xE0 | (unCodePoint >> 12));
+		Text += static_cast<char>(0x80 | ((unCodePoint >> 6) & 0x3F));
+		Text += static_cast<char>(0x80 | (unCodePoint & 0x3F));
+	} else {
+		Text += static_cast<char>(0xF0 | (unCodePoint >> 18));
+		Text += static_cast<char>(0x80 | ((unCodePoint >> 12) & 0x3F));
+		Text += static_cast<char>(0x80 | ((unCodePoint >> 6) & 0x3F));
+		Text += static_cast<char>(0x80 | (unCodePoint & 0x3F));
+	}
+}
+
+static void TestCases(SIMD_LEVEL Best) {
+	static const struct {
+		char const* szInput;
+		std::vector<unsigned int> Output;
+	} Cases[] = {
+		{ "caf\xC3\xA9", { 'c', 'a', 'f', 0xE9 } },
+		{ "\xF0\x9F\x98\x80", { 0xD83D, 0xDE00 } },
+		{ "\x80", { 0xFFFD } },
+		{ "\xFF", { 0xFFFD } },
+		// Overlong, surrogate and out of range encodings are one replacement per byte.
+		{ "\xC0\x80", { 0xFFFD, 0xFFFD } },
+		{ "\xE0\x80\x80", { 0xFFFD, 0xFFFD, 0xFFFD } },
+		{ "\xED\xA0\x80", { 0xFFFD, 0xFFFD, 0xFFFD } },
+		{ "\xF4\x90\x80\x80", { 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD } },
+		// A truncated sequence is one replacement.
+		{ "\xE2\x82", { 0xFFFD } },
+		{ "\xE2\x82" "A", { 0xFFFD, 'A' } },
+		{ "\xF0\x9F\x98", { 0xFFFD } }
+	};
+
+	for (const auto& Case : Cases) {
+		for (unsigned char i = 0; i <= static_cast<unsigned char>(Best); ++i) {
+			TEST_CHECK(ToUTF16(Case.szInput, static_cast<SIMD_LEVEL>(i)) == Case.Output);
+		}
+	}
+
+	// Unpaired surrogates.
+	for (unsigned char i = 0; i <= static_cast<unsigned char>(Best); ++i) {
+		TEST_CHECK(ToUTF8({ 0xD800, 'a', 0xDC00 }, static_cast<SIMD_LEVEL>(i)) == "\xEF\xBF\xBD" "a" "\xEF\xBF\xBD");
+	}
+}
+
+// Random mixes of ASCII runs, stray bytes and every sequence length. Each level has to agree with the scalar code.
+static void TestRandom(SIMD_LEVEL Best) {
+	std::mt19937 Random(1);
+
+	for (unsigned int i = 0; i < 5000; ++i) {
+		std::string Text;
+		const unsigned int unPieces = Random() % 200;
+		for (unsigned int j = 0; j < unPieces; ++j) {
+			switch (Random() % 10) {
+				case 0:
+					Text += static_cast<char>(Random() % 256);
+					break;
+
+				case 1:
+					Append(Text, 0x80 + Random() % 0x780);
+					break;
+
+				case 2: {
+					const char32_t unCodePoint = 0x800 + Random() % 0xF800;
+					Append(Text, ((unCodePoint >= 0xD800) && (unCodePoint < 0xE000)) ? 0x4E00 : unCodePoint);
+					break;
+				}
+
+				case 3:
+					Append(Text, 0x10000 + Random() % 0x100000);
+					break;
+
+				case 4:
+					Text.append(40, ' ');
+					break;
+
+				default:
+					Text += static_cast<char>('a' + Random() % 26);
+					break;
+			}
+		}
+
+		const std::vector<unsigned int> Units = ToUTF16(Text, SIMD_LEVEL::SIMD_LEVEL_SCALAR);
+		const std::string Back = ToUTF8(Units, SIMD_LEVEL::SIMD_LEVEL_SCALAR);
+
+		for (unsigned char j = 1; j <= static_cast<unsigned char>(Best); ++j) {
+			TEST_CHECK(ToUTF16(Text, static_cast<SIMD_LEVEL>(j)) == Units);
+			TEST_CHECK(ToUTF8(Units, static_cast<SIMD_LEVEL>(j)) == Back);
+		}
+
+		// What comes back is valid and decodes the same.
+		TEST_CHECK(ToUTF16(Back, SIMD_LEVEL::SIMD_LEVEL_SCALAR) == Units);
+	}
+
+	TEST_CHECK(SetSimdLevel(Best));
+}
+
+static void TestConsole() {
+	EmulatedConsole Console(120, 30, 300);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		TEST_CHECK(SCU.WriteUTF8("h\xC3\xA9llo \xE4\xB8\x96\xE7\x95\x8C \xF0\x9F\x98\x80!\n"));
+		TEST_CHECK(SCU.WriteUTF8("bad \xC0 byte\n"));
+
+		const std::wstring Line = GetLine(Console, 0);
+		const std::vector<unsigned int> Units(Line.begin(), Line.end());
+		TEST_CHECK(Units == std::vector<unsigned int>({ 'h', 0xE9, 'l', 'l', 'o', ' ', 0x4E16, 0x754C, ' ', 0xD83D, 0xDE00, '!' }));
+		TEST_CHECK(GetLine(Console, 1) == L"bad \xFFFD byte");
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// 1MB corpora in both directions at every level. Pass the corpus size in MB for a longer run.
+static void TestThroughput(SIMD_LEVEL Best, unsigned int unMegabytes) {
+	const size_t unSize = static_cast<size_t>(unMegabytes) << 20;
+	std::mt19937 Random(7);
+
+	static char const* const Words[] = { "the ", "quick ", "brown ", "fox ", "jumps ", "over ", "lazy ", "dog. ", "Error: ", "file ", "not ", "found\n" };
+	static char const* const LatinWords[] = { "Gr\xC3\xB6\xC3\x9F" "e ", "\xC3\xBC" "ber ", "caf\xC3\xA9 ", "na\xC3\xAF" "ve ", "fa\xC3\xA7" "ade ", "se\xC3\xB1" "or ", "la ", "et ", "und ", "der ", "tr\xC3\xA8s " };
+
+	std::string Corpora[4];
+	while (Corpora[0].size() < unSize) {
+		Corpora[0] += Words[Random() % 12];
+	}
+	while (Corpora[1].size() < unSize) {
+		Corpora[1] += LatinWords[Random() % 11];
+	}
+	while (Corpora[2].size() < unSize) {
+		Append(Corpora[2], 0x4E00 + Random() % 0x5000);
+		if (!(Random() % 20)) {
+			Corpora[2] += ' ';
+		}
+	}
+	while (Corpora[3].size() < unSize) {
+		Append(Corpora[3], 0x1F600 + Random() % 80);
+		if (!(Random() % 4)) {
+			Corpora[3] += ' ';
+		}
+	}
+
+	static char const* const Names[] = { "ASCII", "Latin", "CJK", "emoji" };
+
+	std::vector<wchar_t> Units(unSize + 1);
+	std::string Text(unSize * 3, '\0');
+	const unsigned int unRounds = 10;
+
+	for (unsigned int i = 0; i < 4; ++i) {
+		double fScalar = 0.0;
+		double fBest = 0.0;
+
+		for (unsigned char j = 0; j <= static_cast<unsigned char>(Best); ++j) {
+			TEST_CHECK(SetSimdLevel(static_cast<SIMD_LEVEL>(j)));
+
+			size_t unUnits = 0;
+			double fStart = GetSeconds();
+			for (unsigned int k = 0; k < unRounds; ++k) {
+				unUnits = ConvertUTF8ToUTF16(Corpora[i].data(), Corpora[i].size(), Units.data());
+			}
+			const double fDecode = Corpora[i].size() * unRounds / (GetSeconds() - fStart) / 1e9;
+
+			size_t unBytes = 0;
+			fStart = GetSeconds();
+			for (unsigned int k = 0; k < unRounds; ++k) {
+				unBytes = ConvertUTF16ToUTF8(Units.data(), unUnits, &Text[0]);
+			}
+			const double fEncode = unBytes * unRounds / (GetSeconds() - fStart) / 1e9;
+
+			TEST_CHECK(unBytes == Corpora[i].size());
+			TEST_CHECK(memcmp(Text.data(), Corpora[i].data(), unBytes) == 0);
+
+			printf("%-6s %-6s UTF-8 to UTF-16 %6.2f GB/s, UTF-16 to UTF-8 %6.2f GB/s\n", Names[i], g_szLevels[j], fDecode, fEncode);
+
+			if (!j) {
+				fScalar = fDecode;
+			}
+			fBest = fDecode;
+		}
+
+		// The ASCII fast path has to pay off.
+		if (!i && (Best != SIMD_LEVEL::SIMD_LEVEL_SCALAR)) {
+			TEST_CHECK(fBest > fScalar);
+		}
+	}
+
+	TEST_CHECK(SetSimdLevel(Best));
+}
+
+int main(int nArguments, char* pArguments[]) {
+	const SIMD_LEVEL Best = GetSimdLevel();
+	printf("best level: %s\n", g_szLevels[static_cast<unsigned char>(Best)]);
+
+	TestCases(Best);
+	TestRandom(Best);
+	TestConsole();
+	TestThroughput(Best, (nArguments > 1) ? static_cast<unsigned int>(atoi(pArguments[1])) : 1);
+
+	puts("UTF8Test passed");
+
+	return EXIT_SUCCESS;
+}
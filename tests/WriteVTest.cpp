@@ -0,0 +1,132 @@
+// Default
+#include "Test.h"
+
+// C++
+#include <string>
+
+using namespace ConsoleUtils;
+using namespace ConsoleUtilsTest;
+
+// ----------------------------------------------------------------
+// WriteV
+// ----------------------------------------------------------------
+
+static void TestJoin() {
+	EmulatedConsole Console(80, 10, 50);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+
+		// Unbuffered, the segments go out in one write. Empty ones add nothing.
+		const std::string_view Narrow[] = { "ab", "", "cd", "", "\n" };
+		Console.ResetCalls();
+		TEST_CHECK(SCU.WriteVA(Narrow, 5));
+		TEST_CHECK(Console.GetCalls(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE) == 1);
+		TEST_CHECK(GetLine(Console, 0) == L"abcd");
+
+		const std::wstring_view Wide[] = { L"", L"w\xE9", L"de", L"\n" };
+		Console.ResetCalls();
+		TEST_CHECK(SCU.WriteVW(Wide, 4));
+		TEST_CHECK(Console.GetCalls(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE) == 1);
+		TEST_CHECK(GetLine(Console, 1) == L"w\xE9" L"de");
+
+		// Nothing to write is fine, a missing array isn't.
+		Console.ResetCalls();
+		TEST_CHECK(SCU.WriteVA(nullptr, 0));
+		TEST_CHECK(SCU.WriteVW(Wide, 0));
+		TEST_CHECK(!SCU.WriteVA(nullptr, 2));
+		TEST_CHECK(!SCU.WriteVW(nullptr, 2));
+		TEST_CHECK(Console.GetCalls(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE) == 0);
+
+		COORD Cursor;
+		TEST_CHECK(Console.GetCursorPosition(&Cursor));
+		TEST_CHECK((Cursor.X == 0) && (Cursor.Y == 2));
+
+		// Size buffered with 16 characters: 15 are held, the segment reaching 16 sends everything at once.
+		TEST_CHECK(SCU.SetOutputPolicy(OUTPUT_POLICY::OUTPUT_POLICY_SIZE, 16));
+		const std::string_view Held[] = { "0123456", "", "789abcd", "e" };
+		Console.ResetCalls();
+		TEST_CHECK(SCU.WriteVA(Held, 4));
+		TEST_CHECK(Console.GetCalls(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE) == 0);
+		TEST_CHECK(GetLine(Console, 2).empty());
+
+		const std::string_view Boundary[] = { "f" };
+		TEST_CHECK(SCU.WriteVA(Boundary, 1));
+		TEST_CHECK(Console.GetCalls(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE) == 1);
+		TEST_CHECK(GetLine(Console, 2) == L"0123456789abcdef");
+
+		// A segment crossing the threshold isn't cut.
+		const std::wstring_view Crossing[] = { L"-0123456789", L"ABCDEFGHIJ", L"\n" };
+		Console.ResetCalls();
+		TEST_CHECK(SCU.WriteVW(Crossing, 3));
+		TEST_CHECK(Console.GetCalls(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE) == 1);
+		TEST_CHECK(GetLine(Console, 2) == L"0123456789abcdef-0123456789ABCDEFGHIJ");
+
+		// Narrow text still held goes out ahead of wide text.
+		const std::string_view First[] = { "narrow " };
+		const std::wstring_view Second[] = { L"wide", L"\n" };
+		TEST_CHECK(SCU.WriteVA(First, 1));
+		TEST_CHECK(GetLine(Console, 3).empty());
+		TEST_CHECK(SCU.WriteVW(Second, 2));
+		TEST_CHECK(SCU.FlushOutput());
+		TEST_CHECK(GetLine(Console, 3) == L"narrow wide");
+
+		TEST_CHECK(SCU.SetOutputPolicy(OUTPUT_POLICY::OUTPUT_POLICY_UNBUFFERED));
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+// A log line built from 16 pieces, written piece by piece and gathered, with the host charging 5us per call. Pass the line count for a longer run.
+static void TestThroughput(unsigned int unLines) {
+	EmulatedConsole Console(120, 40, 300);
+	TEST_CHECK(Console.Install());
+
+	{
+		SmartConsoleUtils SCU;
+		Console.SetCallCost(5);
+
+		static const std::wstring_view Pieces[16] = { L"2026-10-17 ", L"12:00:00.000 ", L"[", L"info", L"] ", L"worker", L"-", L"3", L": ", L"request ", L"42", L" done in ", L"17", L" ms", L" ok", L"\n" };
+
+		Console.ResetCalls();
+		double fStart = GetSeconds();
+		for (unsigned int i = 0; i < unLines; ++i) {
+			for (const std::wstring_view& Piece : Pieces) {
+				TEST_CHECK(SCU.WriteW(Piece));
+			}
+		}
+		const double fSingle = GetSeconds() - fStart;
+		const unsigned long long unSingleWrites = Console.GetCalls(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE);
+
+		Console.ResetCalls();
+		fStart = GetSeconds();
+		for (unsigned int i = 0; i < unLines; ++i) {
+			TEST_CHECK(SCU.WriteVW(Pieces, 16));
+		}
+		const double fGathered = GetSeconds() - fStart;
+		const unsigned long long unGatheredWrites = Console.GetCalls(EMULATED_CALL::EMULATED_CALL_WRITE_CONSOLE);
+
+		Console.SetCallCost(0);
+
+		printf("WriteW per piece: %.0f lines/s in %llu writes, WriteVW: %.0f lines/s in %llu writes\n", unLines / fSingle, unSingleWrites, unLines / fGathered, unGatheredWrites);
+
+		TEST_CHECK(unSingleWrites == 16ull * unLines);
+		TEST_CHECK(unGatheredWrites == unLines);
+
+		COORD Cursor;
+		TEST_CHECK(Console.GetCursorPosition(&Cursor));
+		TEST_CHECK(GetLine(Console, Cursor.Y - 1) == L"2026-10-17 12:00:00.000 [info] worker-3: request 42 done in 17 ms ok");
+	}
+
+	TEST_CHECK(Console.Uninstall());
+}
+
+int main(int nArguments, char* pArguments[]) {
+	TestJoin();
+	TestThroughput((nArguments > 1) ? static_cast<unsigned int>(atoi(pArguments[1])) : 2000);
+
+	puts("WriteVTest passed");
+
+	return EXIT_SUCCESS;
+}